@@ -20,89 +20,97 @@
  */
 
 #include <climits>
+#include <cstring>
 
 #include "elf.hxx"
 
 using namespace SoloMIPS;
 
-ELFSectionFlags operator|(ELFSectionFlags lhs, ELFSectionFlags rhs)
+ELFSectionFlags SoloMIPS::operator|(ELFSectionFlags lhs, ELFSectionFlags rhs)
 {
     return static_cast<ELFSectionFlags>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
 }
 
-ELFSectionFlags operator&(ELFSectionFlags lhs, ELFSectionFlags rhs)
+ELFSectionFlags SoloMIPS::operator&(ELFSectionFlags lhs, ELFSectionFlags rhs)
 {
     return static_cast<ELFSectionFlags>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs));
 }
 
-ELFSectionFlags operator~(ELFSectionFlags f)
+ELFSectionFlags SoloMIPS::operator~(ELFSectionFlags f)
 {
     return static_cast<ELFSectionFlags>(~static_cast<uint32_t>(f));
 }
 
+ELFSegmentFlags SoloMIPS::operator|(ELFSegmentFlags lhs, ELFSegmentFlags rhs)
+{
+    return static_cast<ELFSegmentFlags>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
+}
+
+ELFSegmentFlags SoloMIPS::operator&(ELFSegmentFlags lhs, ELFSegmentFlags rhs)
+{
+    return static_cast<ELFSegmentFlags>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs));
+}
 
-ELF32Section::ELF32Section()
-    : nameIndex(0), type(ELFSectionType::Null), flags(ELFSectionFlags::None), addr(0), offset(0), size(0), link(0), info(0), addralign(0), entsize(0) {}
 
-ELF32Section::ELF32Section(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t sectionOffset)
+ELFString::ELFString()
+    : _data(""), _size(0) {}
+
+ELFString::ELFString(const char *data, size_t size)
+    : _data(data), _size(size) {}
+
+ELFString::ELFString(const char *str)
+    : _data(str), _size(std::strlen(str)) {}
+
+ELFString::ELFString(const std::string &str)
+    : _data(str.data()), _size(str.size()) {}
+
+const char *ELFString::data() const
 {
-    this->parseHeader(obj, data, sectionOffset);
+    return this->_data;
 }
 
-void ELF32Section::parseHeader(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t sectionOffset)
+size_t ELFString::size() const
 {
-    this->nameIndex = obj->readWord(data, sectionOffset);
-    this->type = static_cast<ELFSectionType>(obj->readWord(data, sectionOffset+4));
-    this->flags = static_cast<ELFSectionFlags>(obj->readWord(data, sectionOffset+8));
-    this->addr = obj->readWord(data, sectionOffset+12);
-    this->offset = obj->readWord(data, sectionOffset+16);
-    this->size = obj->readWord(data, sectionOffset+20);
-    this->link = obj->readWord(data, sectionOffset+24);
-    this->info = obj->readWord(data, sectionOffset+28);
-    this->addralign = obj->readWord(data, sectionOffset+32);
-    this->entsize = obj->readWord(data, sectionOffset+36);
+    return this->_size;
 }
 
-void ELF32Section::readSymbolTable(const ELF32Object *obj, const std::vector<uint8_t> &data)
+bool ELFString::empty() const
 {
-    if (this->type != ELFSectionType::SymTab
-            || this->offset == 0
-            || this->entsize < 16)
-        return;
+    return this->_size == 0;
+}
 
-    this->symbolTable.clear();
-    for (size_t s = 0, entryOffset = this->offset; s < this->size; s += this->entsize, entryOffset += this->entsize) {
-        this->symbolTable.push_back(ELFSymbolTableEntry(obj, data, entryOffset, this->link));
-    }
+std::string ELFString::str() const
+{
+    return std::string(this->_data, this->_size);
 }
 
-void ELF32Section::readRelTable(const ELF32Object *obj, const std::vector<uint8_t> &data)
+bool ELFString::operator==(const ELFString &other) const
 {
-    if ((this->type != ELFSectionType::Rel && this->type != ELFSectionType::RelA)
-            || this->offset == 0
-            || this->entsize < (this->type == ELFSectionType::Rel ? 8u : 12u))
-        return;
+    return this->_size == other._size && std::memcmp(this->_data, other._data, this->_size) == 0;
+}
 
-    this->relTable.clear();
-    for (size_t s = 0, entryOffset = this->offset; s < this->size; s += this->entsize, entryOffset += this->entsize) {
-        this->relTable.push_back(ELFRelTableEntry(obj, data, entryOffset, this->type == ELFSectionType::RelA));
-    }
+bool ELFString::operator!=(const ELFString &other) const
+{
+    return !(*this == other);
 }
 
-ELFSymbolTableEntry::ELFSymbolTableEntry()
-    : value(0), size(0), info(0), other(0), shndx(0) {}
+size_t ELFString::hash() const
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < this->_size; ++i)
+        h = (h ^ static_cast<uint8_t>(this->_data[i])) * 16777619u;
+    return h;
+}
 
-ELFSymbolTableEntry::ELFSymbolTableEntry(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t entryOffset, size_t link)
+size_t ELFStringHash::operator()(const ELFString &s) const
 {
-    this->name = obj->readStringTable(data, link, obj->readWord(data, entryOffset));
-    this->value = obj->readWord(data, entryOffset+4);
-    this->size = obj->readWord(data, entryOffset+8);
-    uint16_t infoOther = obj->readHalf(data, entryOffset+12);
-    this->info = infoOther >> 8;
-    this->other = infoOther & 0xff;
-    this->shndx = obj->readHalf(data, entryOffset+14);
+    return s.hash();
 }
 
+
+ELFSymbolTableEntry::ELFSymbolTableEntry()
+    : value(0), size(0), info(0), other(0), shndx(0) {}
+
 bool ELFSymbolTableEntry::isLocal() const
 {
     return ((this->info >> 4) == 0);
@@ -132,16 +140,6 @@ ELFSymbolType ELFSymbolTableEntry::type() const
 ELFRelTableEntry::ELFRelTableEntry()
     : offset(0), info(0), addend(0) {}
 
-ELFRelTableEntry::ELFRelTableEntry(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t entryOffset, bool hasAddend)
-{
-    this->offset = obj->readWord(data, entryOffset);
-    this->info = obj->readWord(data, entryOffset+4);
-    if (hasAddend)
-        this->addend = obj->readWord(data, entryOffset+8);
-    else
-        this->addend = 0;
-}
-
 uint32_t ELFRelTableEntry::sym() const
 {
     return this->info >> 8;
@@ -149,108 +147,317 @@ uint32_t ELFRelTableEntry::sym() const
 
 ELFRelType ELFRelTableEntry::type() const
 {
-    return static_cast<ELFRelType>(this->info & 0x0f);
+    return static_cast<ELFRelType>(this->info & 0xff);
+}
+
+
+ELF32Section::ELF32Section()
+    : nameIndex(0), type(ELFSectionType::Null), flags(ELFSectionFlags::None), addr(0), offset(0), size(0), link(0), info(0), addralign(0), entsize(0) {}
+
+ELF32ProgramHeader::ELF32ProgramHeader()
+    : type(ELFSegmentType::Null), offset(0), vaddr(0), paddr(0), filesz(0), memsz(0), flags(ELFSegmentFlags::None), align(0) {}
+
+
+ELF32SymbolTable::ELF32SymbolTable(const ELF32Object *obj, size_t section)
+    : _obj(obj), _section(section), _offset(0), _entsize(0), _link(0), _size(0)
+{
+    if (section >= obj->sectionCount())
+        return;
+    size_t header = obj->sectionHeader(section);
+    if (static_cast<ELFSectionType>(obj->readWord(header+4)) != ELFSectionType::SymTab)
+        return;
+    this->_offset = obj->readWord(header+16);
+    this->_entsize = obj->readWord(header+36);
+    this->_link = obj->readWord(header+24);
+    if (this->_offset != 0 && this->_entsize >= 16)
+        this->_size = obj->readWord(header+20) / this->_entsize;
+}
+
+size_t ELF32SymbolTable::size() const
+{
+    return this->_size;
+}
+
+ELFSymbolTableEntry ELF32SymbolTable::operator[](size_t index) const
+{
+    size_t entryOffset = this->_offset + index * this->_entsize;
+    ELFSymbolTableEntry entry;
+    entry.name = this->_obj->readString(this->_link, this->_obj->readWord(entryOffset));
+    entry.value = this->_obj->readWord(entryOffset+4);
+    entry.size = this->_obj->readWord(entryOffset+8);
+    entry.info = this->_obj->_data[entryOffset+12];
+    entry.other = this->_obj->_data[entryOffset+13];
+    entry.shndx = this->_obj->readHalf(entryOffset+14);
+    return entry;
+}
+
+size_t ELF32SymbolTable::indexOf(const ELFString &name) const
+{
+    if (this->_size == 0)
+        return SIZE_MAX;
+    const ELF32Object::NameIndex &index = this->_obj->symbolIndex(this->_section);
+    auto i = index.find(name);
+    return (i == index.end()) ? SIZE_MAX : i->second;
+}
+
+
+ELF32RelTable::ELF32RelTable(const ELF32Object *obj, size_t section)
+    : _obj(obj), _offset(0), _entsize(0), _hasAddend(false), _size(0)
+{
+    if (section >= obj->sectionCount())
+        return;
+    size_t header = obj->sectionHeader(section);
+    ELFSectionType type = static_cast<ELFSectionType>(obj->readWord(header+4));
+    if (type != ELFSectionType::Rel && type != ELFSectionType::RelA)
+        return;
+    this->_hasAddend = (type == ELFSectionType::RelA);
+    this->_offset = obj->readWord(header+16);
+    this->_entsize = obj->readWord(header+36);
+    if (this->_offset != 0 && this->_entsize >= (this->_hasAddend ? 12u : 8u))
+        this->_size = obj->readWord(header+20) / this->_entsize;
+}
+
+size_t ELF32RelTable::size() const
+{
+    return this->_size;
+}
+
+ELFRelTableEntry ELF32RelTable::operator[](size_t index) const
+{
+    size_t entryOffset = this->_offset + index * this->_entsize;
+    ELFRelTableEntry entry;
+    entry.offset = this->_obj->readWord(entryOffset);
+    entry.info = this->_obj->readWord(entryOffset+4);
+    if (this->_hasAddend)
+        entry.addend = static_cast<int32_t>(this->_obj->readWord(entryOffset+8));
+    return entry;
 }
 
 
 ELF32Object::ELF32Object()
-   : type(ELFObjectType::None), machine(ELFMachineType::None), version(0), entry(0), phoff(0), shoff(0), flags(0), ehsize(0), phentsize(0),
-     phnum(0), shentsize(0), shnum(0), shstrndx(0) {} 
+   : enc(ELFDataEncoding::None), type(ELFObjectType::None), machine(ELFMachineType::None), version(0), entry(0), phoff(0), shoff(0), flags(0),
+     ehsize(0), phentsize(0), phnum(0), shentsize(0), shnum(0), shstrndx(0), _data(NULL), _size(0) {}
 
-bool ELF32Object::parse(const std::vector<uint8_t> &data)
+bool ELF32Object::parse(std::vector<uint8_t> &&data)
 {
-    if (data.size() < 52
+    this->_owned = std::move(data);
+    return this->parse(this->_owned.data(), this->_owned.size());
+}
+
+bool ELF32Object::parse(const uint8_t *data, size_t size)
+{
+    this->_data = data;
+    this->_size = size;
+    this->_sectionIndex.reset();
+    this->_symbolIndices.clear();
+    this->shnum = 0;
+    this->phnum = 0;
+
+    if (size < 52
             || data[0] != '\x7f' || data[1] != 'E' || data[2] != 'L' || data[3] != 'F' || data[4] != '\x01'
             || data[6] != '\x01' || data[7] != '\x00' || data[8] != '\x00' || data[9] != '\x00' || data[10] != '\x00' || data[11] != '\x00'
             || data[12] != '\x00' || data[13] != '\x00' || data[14] != '\x00' || data[15] != '\x00')
         return false;
 
     this->enc = static_cast<ELFDataEncoding>(data[5]);
-    this->type = static_cast<ELFObjectType>(this->readHalf(data, 16));
-    this->machine = static_cast<ELFMachineType>(this->readHalf(data, 18));
-    this->version = this->readWord(data, 20);
-    this->entry = this->readWord(data, 24);
-    this->phoff = this->readWord(data, 28);
-    this->shoff = this->readWord(data, 32);
-    this->flags = this->readWord(data, 36);
-    this->ehsize = this->readHalf(data, 40);
-    this->phentsize = this->readHalf(data, 42);
-    this->phnum = this->readHalf(data, 44);
-    this->shentsize = this->readHalf(data, 46);
-    this->shnum = this->readHalf(data, 48);
-    this->shstrndx = this->readHalf(data, 50);
+    this->type = static_cast<ELFObjectType>(this->readHalf(16));
+    this->machine = static_cast<ELFMachineType>(this->readHalf(18));
+    this->version = this->readWord(20);
+    this->entry = this->readWord(24);
+    this->phoff = this->readWord(28);
+    this->shoff = this->readWord(32);
+    this->flags = this->readWord(36);
+    this->ehsize = this->readHalf(40);
+    this->phentsize = this->readHalf(42);
+    uint16_t phnum = this->readHalf(44);
+    this->shentsize = this->readHalf(46);
+    uint16_t shnum = this->readHalf(48);
+    this->shstrndx = this->readHalf(50);
 
     if (this->version != 1 || this->ehsize != 52)
         return false;
 
+    // Likewise the contents of loaded segments
+    if (this->phoff != 0) {
+        if (this->phentsize < 32 || size < static_cast<uint64_t>(this->phoff) + phnum * this->phentsize)
+            return false;
+        for (size_t i = 0, header = this->phoff; i < phnum; ++i, header += this->phentsize) {
+            uint32_t filesz = this->readWord(header+16);
+            uint64_t end = static_cast<uint64_t>(this->readWord(header+4)) + filesz;
+            if (static_cast<ELFSegmentType>(this->readWord(header)) == ELFSegmentType::Load
+                    && (end > size || filesz > this->readWord(header+20)))
+                return false;
+        }
+        this->phnum = phnum;
+    }
+
     if (this->shoff == 0)
         return true;
 
-    size_t end = this->shoff + this->shnum * this->shentsize;
-    if (data.size() < end)
+    // Check the section table once, so access needs no checks
+    if (this->shentsize < 40 || size < static_cast<uint64_t>(this->shoff) + shnum * this->shentsize)
         return false;
-
-    for (size_t i = 0, sectionOffset = this->shoff; i < this->shnum; ++i, sectionOffset += this->shentsize) {
-        this->sections.push_back(ELF32Section(this, data, sectionOffset));
-    }
-    for (ELF32Section &section : this->sections) {
-        if (section.offset + section.size >= data.size())
+    for (size_t i = 0, header = this->shoff; i < shnum; ++i, header += this->shentsize) {
+        ELFSectionType type = static_cast<ELFSectionType>(this->readWord(header+4));
+        uint64_t end = static_cast<uint64_t>(this->readWord(header+16)) + this->readWord(header+20);
+        if (type != ELFSectionType::Null && type != ELFSectionType::NoBits && end > size)
+            return false;
+        if (type == ELFSectionType::SymTab && this->readWord(header+24) >= shnum)
             return false;
-        section.name = this->readStringTable(data, section.nameIndex);
-        if (section.type == ELFSectionType::SymTab)
-            section.readSymbolTable(this, data);
-        else if (section.type == ELFSectionType::Rel || section.type == ELFSectionType::RelA)
-            section.readRelTable(this, data);
     }
+    this->shnum = shnum;
 
     return true;
 }
 
-size_t ELF32Object::indexOfSection(const std::string &name)
+const uint8_t *ELF32Object::data() const
+{
+    return this->_data;
+}
+
+size_t ELF32Object::size() const
+{
+    return this->_size;
+}
+
+size_t ELF32Object::sectionCount() const
+{
+    return this->shnum;
+}
+
+ELF32Section ELF32Object::section(size_t index) const
 {
-    size_t i = 0;
-    for (ELF32Section &section : this->sections) {
-        if (section.name == name)
-            return i;
-        else
-            ++i;
+    ELF32Section section;
+    if (index >= this->shnum)
+        return section;
+    size_t header = this->sectionHeader(index);
+    section.nameIndex = this->readWord(header);
+    section.name = this->readString(this->shstrndx, section.nameIndex);
+    section.type = static_cast<ELFSectionType>(this->readWord(header+4));
+    section.flags = static_cast<ELFSectionFlags>(this->readWord(header+8));
+    section.addr = this->readWord(header+12);
+    section.offset = this->readWord(header+16);
+    section.size = this->readWord(header+20);
+    section.link = this->readWord(header+24);
+    section.info = this->readWord(header+28);
+    section.addralign = this->readWord(header+32);
+    section.entsize = this->readWord(header+36);
+    return section;
+}
+
+size_t ELF32Object::segmentCount() const
+{
+    return this->phnum;
+}
+
+ELF32ProgramHeader ELF32Object::segment(size_t index) const
+{
+    ELF32ProgramHeader segment;
+    if (index >= this->phnum)
+        return segment;
+    size_t header = this->phoff + index * this->phentsize;
+    segment.type = static_cast<ELFSegmentType>(this->readWord(header));
+    segment.offset = this->readWord(header+4);
+    segment.vaddr = this->readWord(header+8);
+    segment.paddr = this->readWord(header+12);
+    segment.filesz = this->readWord(header+16);
+    segment.memsz = this->readWord(header+20);
+    segment.flags = static_cast<ELFSegmentFlags>(this->readWord(header+24));
+    segment.align = this->readWord(header+28);
+    return segment;
+}
+
+ELF32SymbolTable ELF32Object::symbolTable(size_t section) const
+{
+    return ELF32SymbolTable(this, section);
+}
+
+ELF32RelTable ELF32Object::relTable(size_t section) const
+{
+    return ELF32RelTable(this, section);
+}
+
+const uint8_t *ELF32Object::sectionData(size_t index) const
+{
+    if (index >= this->shnum)
+        return NULL;
+    size_t header = this->sectionHeader(index);
+    ELFSectionType type = static_cast<ELFSectionType>(this->readWord(header+4));
+    if (type == ELFSectionType::Null || type == ELFSectionType::NoBits)
+        return NULL;
+    return this->_data + this->readWord(header+16);
+}
+
+size_t ELF32Object::indexOfSection(const ELFString &name) const
+{
+    if (!this->_sectionIndex) {
+        this->_sectionIndex.reset(new NameIndex());
+        for (size_t i = 0; i < this->shnum; ++i) {
+            ELFString sectionName = this->readString(this->shstrndx, this->readWord(this->sectionHeader(i)));
+            if (!sectionName.empty())
+                this->_sectionIndex->emplace(sectionName, i);
+        }
     }
-    return SIZE_MAX;
+    auto i = this->_sectionIndex->find(name);
+    return (i == this->_sectionIndex->end()) ? SIZE_MAX : i->second;
 }
 
-uint16_t ELF32Object::readHalf(const std::vector<uint8_t> &data, size_t offset) const
+const ELF32Object::NameIndex &ELF32Object::symbolIndex(size_t section) const
 {
+    auto i = this->_symbolIndices.find(section);
+    if (i != this->_symbolIndices.end())
+        return i->second;
+
+    NameIndex &index = this->_symbolIndices[section];
+    ELF32SymbolTable symbols(this, section);
+    index.reserve(symbols.size());
+    for (size_t s = 0; s < symbols.size(); ++s) {
+        ELFSymbolTableEntry entry = symbols[s];
+        if (entry.name.empty())
+            continue;
+        auto r = index.emplace(entry.name, s);
+        if (!r.second && !entry.isLocal() && symbols[r.first->second].isLocal())
+            r.first->second = s;
+    }
+    return index;
+}
+
+uint16_t ELF32Object::readHalf(size_t offset) const
+{
+    const uint8_t *data = this->_data;
     if (this->enc == ELFDataEncoding::MSB)
         return (data[offset] << 8) | data[offset+1];
     else
         return (data[offset+1] << 8) | data[offset];
 }
 
-uint32_t ELF32Object::readWord(const std::vector<uint8_t> &data, size_t offset) const
+uint32_t ELF32Object::readWord(size_t offset) const
 {
+    const uint8_t *data = this->_data;
     if (this->enc == ELFDataEncoding::MSB)
         return (data[offset] << 24) |(data[offset+1] << 16) | (data[offset+2] << 8) | data[offset+3];
     else
         return (data[offset+3] << 24) |(data[offset+2] << 16) | (data[offset+1] << 8) | data[offset];
 }
 
-std::string ELF32Object::readStringTable(const std::vector<uint8_t> &data, size_t index) const
+size_t ELF32Object::sectionHeader(size_t index) const
 {
-    return this->readStringTable(data, this->shstrndx, index);
+    return this->shoff + index * this->shentsize;
 }
 
-std::string ELF32Object::readStringTable(const std::vector<uint8_t> &data, size_t tableIndex, size_t index) const
+ELFString ELF32Object::readString(size_t tableIndex, size_t index) const
 {
-    if (tableIndex == 0 || this->sections.size() <= tableIndex)
+    if (tableIndex == 0 || tableIndex >= this->shnum)
         return {};
-    size_t offset = this->sections[tableIndex].offset + index;
-    const char *rawData = reinterpret_cast<const char *>(data.data());
-    size_t dataSize = data.size();
-    size_t strLen = 0;
-    for (size_t i = offset; offset < dataSize; ++i, ++strLen) {
-        if (rawData[i] == '\0')
-            return std::string(&rawData[offset], strLen);
-    }
-    return {};
+    size_t header = this->sectionHeader(tableIndex);
+    if (static_cast<ELFSectionType>(this->readWord(header+4)) != ELFSectionType::StrTab)
+        return {};
+    size_t tableSize = this->readWord(header+20);
+    if (index >= tableSize)
+        return {};
+    const char *str = reinterpret_cast<const char *>(this->_data) + this->readWord(header+16) + index;
+    const void *end = std::memchr(str, '\0', tableSize - index);
+    if (end == NULL)
+        return {};
+    return ELFString(str, static_cast<const char *>(end) - str);
 }
-
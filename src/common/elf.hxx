@@ -23,13 +23,31 @@
 #define HEADER_SOLOMIPS_ELF_HXX
 
 #include <cstdint>
-#include <vector>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ELF32 files are read through views: ELF32Object::parse only checks the file
+header and the section and program header tables and keeps a pointer to the
+data, which must stay valid as long as the object is used (unless the object
+was handed the data to own). Section headers, symbols and relocations are
+decoded from the data on access and names are slices of the string tables, so
+nothing is copied. Lookups by name go through hash indices built on first use;
+as they are filled lazily, an object must not be used from several threads at
+once before its indices have been built.
+*/
 
 namespace SoloMIPS {
 
 #define EI_NIDENT 16
 
+// Special section indices
+#define SHN_UNDEF 0x0000
+#define SHN_ABS 0xfff1
+#define SHN_COMMON 0xfff2
+
 enum class ELFDataEncoding : uint8_t
 {
     None = 0,
@@ -78,6 +96,28 @@ enum class ELFSectionType : uint32_t
     DynSym = 11
 };
 
+enum class ELFSegmentType : uint32_t
+{
+    Null = 0,
+    Load = 1,
+    Dynamic = 2,
+    Interp = 3,
+    Note = 4,
+    ShLib = 5,
+    Phdr = 6
+};
+
+enum class ELFSegmentFlags : uint32_t
+{
+    None    = 0,
+    Exec    = 1<<0,
+    Write   = 1<<1,
+    Read    = 1<<2
+};
+
+ELFSegmentFlags operator|(ELFSegmentFlags lhs, ELFSegmentFlags rhs);
+ELFSegmentFlags operator&(ELFSegmentFlags lhs, ELFSegmentFlags rhs);
+
 enum class ELFSymbolType : uint8_t
 {
     NoType = 0,
@@ -123,15 +163,45 @@ enum class ELFRelType : uint8_t
     MIPS_GOT16 = 9,
     MIPS_PC16 = 10,
     MIPS_CALL16 = 11,
-    MIPS_GPREL32 = 12
+    MIPS_GPREL32 = 12,
+    MIPS_JALR = 37
 };
 
-struct ELF32Object;
+// Read-only slice of a string table, like std::string_view
+class ELFString
+{
+public:
+    ELFString();
+    ELFString(const char *data, size_t size);
+    ELFString(const char *str);
+    ELFString(const std::string &str);
+
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+    std::string str() const;
+
+    bool operator==(const ELFString &other) const;
+    bool operator!=(const ELFString &other) const;
+
+    // FNV-1a
+    size_t hash() const;
+
+private:
+    const char *_data;
+    size_t _size;
+};
+
+struct ELFStringHash
+{
+    size_t operator()(const ELFString &s) const;
+};
+
+class ELF32Object;
 
 struct ELFSymbolTableEntry
 {
     ELFSymbolTableEntry();
-    ELFSymbolTableEntry(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t entryOffset, size_t link);
 
     bool isLocal() const;
     bool isGlobal() const;
@@ -141,7 +211,7 @@ struct ELFSymbolTableEntry
 
     ELFSymbolType type() const;
 
-    std::string name;
+    ELFString name;
 	uint32_t value;
 	uint32_t size;
 	uint8_t info;
@@ -152,7 +222,6 @@ struct ELFSymbolTableEntry
 struct ELFRelTableEntry
 {
     ELFRelTableEntry();
-    ELFRelTableEntry(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t entryOffset, bool hasAddend);
 
     uint32_t sym() const;
     ELFRelType type() const;
@@ -165,13 +234,9 @@ struct ELFRelTableEntry
 struct ELF32Section
 {
     ELF32Section();
-    ELF32Section(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t sectionOffset);
-    void parseHeader(const ELF32Object *obj, const std::vector<uint8_t> &data, size_t sectionOffset);
-    void readSymbolTable(const ELF32Object *obj, const std::vector<uint8_t> &data);
-    void readRelTable(const ELF32Object *obj, const std::vector<uint8_t> &data);
 
     uint32_t nameIndex;
-    std::string name;
+    ELFString name;
     ELFSectionType type;
     ELFSectionFlags flags;
     uint32_t addr;
@@ -181,21 +246,105 @@ struct ELF32Section
     uint32_t info;
     uint32_t addralign;
     uint32_t entsize;
+};
+
+struct ELF32ProgramHeader
+{
+    ELF32ProgramHeader();
+
+    ELFSegmentType type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    ELFSegmentFlags flags;
+    uint32_t align;
+};
+
+// View of a symbol table section; empty if the section is none
+class ELF32SymbolTable
+{
+public:
+    ELF32SymbolTable(const ELF32Object *obj, size_t section);
+
+    size_t size() const;
+    ELFSymbolTableEntry operator[](size_t index) const;
+
+    /**
+     * Return the index of the symbol with the given name, preferring global
+     * and weak symbols over local ones, or SIZE_MAX if there is none.
+     */
+    size_t indexOf(const ELFString &name) const;
+
+private:
+    const ELF32Object *_obj;
+    size_t _section;
+    uint32_t _offset;
+    uint32_t _entsize;
+    uint32_t _link;
+    size_t _size;
+};
+
+// View of a relocation section (with or without addends); empty if the
+// section is none
+class ELF32RelTable
+{
+public:
+    ELF32RelTable(const ELF32Object *obj, size_t section);
 
-    std::vector<ELFSymbolTableEntry> symbolTable;
-    std::vector<ELFRelTableEntry> relTable;
+    size_t size() const;
+    ELFRelTableEntry operator[](size_t index) const;
+
+private:
+    const ELF32Object *_obj;
+    uint32_t _offset;
+    uint32_t _entsize;
+    bool _hasAddend;
+    size_t _size;
 };
 
-struct ELF32Object
+class ELF32Object
 {
-    friend struct ELF32Section;
-    friend struct ELFSymbolTableEntry;
-    friend struct ELFRelTableEntry;
+    friend class ELF32SymbolTable;
+    friend class ELF32RelTable;
 
+public:
     ELF32Object();
-    bool parse(const std::vector<uint8_t> &data);
 
-    size_t indexOfSection(const std::string &name);
+    /**
+     * Parse the data, which must outlive the object. Returns false if it is
+     * not a valid ELF32 file.
+     */
+    bool parse(const uint8_t *data, size_t size);
+
+    /**
+     * Parse the data and keep it.
+     */
+    bool parse(std::vector<uint8_t> &&data);
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+    size_t sectionCount() const;
+    ELF32Section section(size_t index) const;
+    ELF32SymbolTable symbolTable(size_t section) const;
+    ELF32RelTable relTable(size_t section) const;
+
+    size_t segmentCount() const;
+    ELF32ProgramHeader segment(size_t index) const;
+
+    /**
+     * Return the contents of the section, or NULL for sections without any
+     * in the file.
+     */
+    const uint8_t *sectionData(size_t index) const;
+
+    /**
+     * Return the index of the first section with the given name, or SIZE_MAX
+     * if there is none.
+     */
+    size_t indexOfSection(const ELFString &name) const;
 
     ELFDataEncoding enc;
     ELFObjectType type;
@@ -212,13 +361,24 @@ struct ELF32Object
     uint16_t shnum;
     uint16_t shstrndx;
 
-    std::vector<ELF32Section> sections;
-
 private:
-    uint16_t readHalf(const std::vector<uint8_t> &data, size_t offset) const;
-    uint32_t readWord(const std::vector<uint8_t> &data, size_t offset) const;
-    std::string readStringTable(const std::vector<uint8_t> &data, size_t index) const;
-    std::string readStringTable(const std::vector<uint8_t> &data, size_t tableIndex, size_t index) const;
+    ELF32Object(const ELF32Object &other);
+    ELF32Object &operator=(const ELF32Object &other);
+
+    typedef std::unordered_map<ELFString, size_t, ELFStringHash> NameIndex;
+
+    const NameIndex &symbolIndex(size_t section) const;
+
+    uint16_t readHalf(size_t offset) const;
+    uint32_t readWord(size_t offset) const;
+    size_t sectionHeader(size_t index) const;
+    ELFString readString(size_t tableIndex, size_t index) const;
+
+    const uint8_t *_data;
+    size_t _size;
+    std::vector<uint8_t> _owned;
+    mutable std::unique_ptr<NameIndex> _sectionIndex;
+    mutable std::unordered_map<size_t, NameIndex> _symbolIndices;
 };
 
 }
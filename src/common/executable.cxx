@@ -0,0 +1,228 @@
+/*
+ *  executable.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "executable.hxx"
+#include "op.hxx"
+
+#define HEADER_SIZE 40u
+#define SEGMENT_SIZE 24u
+#define SYMBOL_SIZE 12u
+
+using namespace SoloMIPS;
+
+static uint32_t readWord(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void writeWord(uint8_t *p, uint32_t word)
+{
+    p[0] = word >> 24;
+    p[1] = (word >> 16) & 0xff;
+    p[2] = (word >> 8) & 0xff;
+    p[3] = word & 0xff;
+}
+
+static bool inBounds(uint64_t offset, uint64_t size, size_t total)
+{
+    return offset + size <= total;
+}
+
+static size_t mapSize(uint32_t fileSize)
+{
+    return (fileSize / 4 + 7) / 8;
+}
+
+SegmentFlag SoloMIPS::operator|(SegmentFlag lhs, SegmentFlag rhs)
+{
+    return static_cast<SegmentFlag>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs));
+}
+
+SegmentFlag SoloMIPS::operator&(SegmentFlag lhs, SegmentFlag rhs)
+{
+    return static_cast<SegmentFlag>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs));
+}
+
+
+ExecutableSegment::ExecutableSegment()
+    : addr(0), offset(0), fileSize(0), memSize(0), flags(SegmentFlag::None) {}
+
+
+ExecutableSymbol::ExecutableSymbol()
+    : addr(0), size(0) {}
+
+ExecutableSymbol::ExecutableSymbol(uint32_t addr, uint32_t size, const std::string &name)
+    : addr(addr), size(size), name(name) {}
+
+
+Executable::Executable()
+    : entry(0) {}
+
+bool Executable::isExecutable(const uint8_t *data, size_t size)
+{
+    return size >= HEADER_SIZE && readWord(data) == SOLOMIPS_EXECUTABLE_MAGIC;
+}
+
+bool Executable::parse(const uint8_t *data, size_t size)
+{
+    this->segments.clear();
+    this->symbols.clear();
+    if (!isExecutable(data, size) || readWord(data + 4) != SOLOMIPS_EXECUTABLE_VERSION)
+        return false;
+
+    this->entry = readWord(data + 8);
+    uint32_t segmentCount = readWord(data + 16);
+    uint32_t segmentTable = readWord(data + 20);
+    uint32_t symbolCount = readWord(data + 24);
+    uint32_t symbolTable = readWord(data + 28);
+    uint32_t stringTable = readWord(data + 32);
+    uint32_t stringSize = readWord(data + 36);
+    if (!inBounds(segmentTable, static_cast<uint64_t>(segmentCount) * SEGMENT_SIZE, size)
+            || !inBounds(symbolTable, static_cast<uint64_t>(symbolCount) * SYMBOL_SIZE, size)
+            || !inBounds(stringTable, stringSize, size))
+        return false;
+
+    const SegmentFlag allFlags = SegmentFlag::Readable | SegmentFlag::Writable | SegmentFlag::Executable;
+    this->segments.resize(segmentCount);
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        const uint8_t *p = data + segmentTable + i * SEGMENT_SIZE;
+        ExecutableSegment &segment = this->segments[i];
+        segment.addr = readWord(p);
+        segment.offset = readWord(p + 4);
+        segment.fileSize = readWord(p + 8);
+        segment.memSize = readWord(p + 12);
+        segment.flags = static_cast<SegmentFlag>(readWord(p + 16));
+        uint32_t map = readWord(p + 20);
+        if (!inBounds(segment.offset, segment.fileSize, size) || segment.fileSize > segment.memSize
+                || static_cast<uint64_t>(segment.addr) + segment.memSize > 0x100000000ull
+                || (static_cast<uint32_t>(segment.flags) & ~static_cast<uint32_t>(allFlags)) != 0)
+            return false;
+        if (map != 0) {
+            size_t n = mapSize(segment.fileSize);
+            if (!inBounds(map, n, size))
+                return false;
+            segment.instructionMap.assign(data + map, data + map + n);
+        }
+    }
+
+    // Segments must not overlap in memory
+    std::vector<const ExecutableSegment *> byAddr;
+    for (const ExecutableSegment &segment : this->segments) {
+        if (segment.memSize > 0)
+            byAddr.push_back(&segment);
+    }
+    std::sort(byAddr.begin(), byAddr.end(), [](const ExecutableSegment *a, const ExecutableSegment *b) {
+        return a->addr < b->addr;
+    });
+    for (size_t i = 1; i < byAddr.size(); ++i) {
+        if (static_cast<uint64_t>(byAddr[i-1]->addr) + byAddr[i-1]->memSize > byAddr[i]->addr)
+            return false;
+    }
+
+    const char *strings = reinterpret_cast<const char *>(data + stringTable);
+    this->symbols.resize(symbolCount);
+    for (uint32_t i = 0; i < symbolCount; ++i) {
+        const uint8_t *p = data + symbolTable + i * SYMBOL_SIZE;
+        ExecutableSymbol &symbol = this->symbols[i];
+        symbol.addr = readWord(p);
+        symbol.size = readWord(p + 4);
+        uint32_t name = readWord(p + 8);
+        if (name >= stringSize)
+            return false;
+        const void *end = std::memchr(strings + name, '\0', stringSize - name);
+        if (end == NULL)
+            return false;
+        symbol.name.assign(strings + name, static_cast<const char *>(end));
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> Executable::write(const std::vector<const uint8_t *> &contents) const
+{
+    size_t segmentTable = HEADER_SIZE;
+    size_t symbolTable = segmentTable + this->segments.size() * SEGMENT_SIZE;
+    size_t stringTable = symbolTable + this->symbols.size() * SYMBOL_SIZE;
+    std::vector<uint8_t> out(stringTable, 0);
+
+    for (size_t i = 0; i < this->symbols.size(); ++i) {
+        const ExecutableSymbol &symbol = this->symbols[i];
+        uint8_t *p = &out[symbolTable + i * SYMBOL_SIZE];
+        writeWord(p, symbol.addr);
+        writeWord(p + 4, symbol.size);
+        writeWord(p + 8, static_cast<uint32_t>(out.size() - stringTable));
+        out.insert(out.end(), symbol.name.begin(), symbol.name.end());
+        out.push_back(0);
+    }
+    size_t stringSize = out.size() - stringTable;
+    out.resize((out.size() + 3) & ~static_cast<size_t>(3), 0);
+
+    // Instruction maps of executable segments
+    std::vector<size_t> maps(this->segments.size(), 0);
+    for (size_t i = 0; i < this->segments.size(); ++i) {
+        const ExecutableSegment &segment = this->segments[i];
+        if ((segment.flags & SegmentFlag::Executable) == SegmentFlag::None || segment.fileSize < 4)
+            continue;
+        maps[i] = out.size();
+        out.resize(out.size() + mapSize(segment.fileSize), 0);
+        for (uint32_t w = 0; w < segment.fileSize / 4; ++w) {
+            try {
+                OP op(readWord(contents[i] + w * 4));
+                out[maps[i] + w / 8] |= 0x80 >> (w % 8);
+            }
+            catch (InvalidOPException &) {
+            }
+        }
+        out.resize((out.size() + 3) & ~static_cast<size_t>(3), 0);
+    }
+
+    for (size_t i = 0; i < this->segments.size(); ++i) {
+        const ExecutableSegment &segment = this->segments[i];
+        size_t offset = (out.size() + SOLOMIPS_EXECUTABLE_ALIGN - 1) / SOLOMIPS_EXECUTABLE_ALIGN * SOLOMIPS_EXECUTABLE_ALIGN;
+        if (segment.fileSize == 0)
+            offset = out.size();
+        out.resize(offset, 0);
+        out.insert(out.end(), contents[i], contents[i] + segment.fileSize);
+
+        uint8_t *p = &out[segmentTable + i * SEGMENT_SIZE];
+        writeWord(p, segment.addr);
+        writeWord(p + 4, static_cast<uint32_t>(offset));
+        writeWord(p + 8, segment.fileSize);
+        writeWord(p + 12, segment.memSize);
+        writeWord(p + 16, static_cast<uint32_t>(segment.flags));
+        writeWord(p + 20, static_cast<uint32_t>(maps[i]));
+    }
+
+    writeWord(&out[0], SOLOMIPS_EXECUTABLE_MAGIC);
+    writeWord(&out[4], SOLOMIPS_EXECUTABLE_VERSION);
+    writeWord(&out[8], this->entry);
+    writeWord(&out[12], 0);
+    writeWord(&out[16], static_cast<uint32_t>(this->segments.size()));
+    writeWord(&out[20], static_cast<uint32_t>(segmentTable));
+    writeWord(&out[24], static_cast<uint32_t>(this->symbols.size()));
+    writeWord(&out[28], static_cast<uint32_t>(symbolTable));
+    writeWord(&out[32], static_cast<uint32_t>(stringTable));
+    writeWord(&out[36], static_cast<uint32_t>(stringSize));
+    return out;
+}
@@ -0,0 +1,125 @@
+/*
+ *  executable.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_EXECUTABLE_HXX
+#define HEADER_SOLOMIPS_EXECUTABLE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+SoloMIPS executables describe where the program goes in memory, as opposed to
+the flat programs that are loaded at the entry address. All words are
+big-endian:
+
+    header      magic, version, entry, flags (0),
+                segment count, segment table offset,
+                symbol count, symbol table offset,
+                string table offset, string table size
+    segments    address, file offset, file size, memory size, flags,
+                instruction map offset (or 0)
+    symbols     address, size, name offset into the string table
+    strings     zero-terminated names
+    maps        one bit per word of the segment in the file, most significant
+                bit first, set if the word is a valid instruction
+    contents    of each segment, starting at a multiple of
+                SOLOMIPS_EXECUTABLE_ALIGN so that it can be mapped
+
+Segment flags are those of RAMMapperFlag (1 readable, 2 writable, 4
+executable); no other bits may be set. Segments must not overlap in memory,
+and memory beyond the file size of a segment is zero. The symbol
+table and the instruction maps are optional; the maps only spare the emulator
+from trying to decode data as instructions. The magic is not a valid
+instruction, so a flat program cannot be mistaken for an executable.
+*/
+
+#define SOLOMIPS_EXECUTABLE_MAGIC 0x7f534d58u // "\x7fSMX"
+#define SOLOMIPS_EXECUTABLE_VERSION 1u
+#define SOLOMIPS_EXECUTABLE_ALIGN 0x1000u
+
+namespace SoloMIPS {
+
+enum class SegmentFlag : uint32_t
+{
+    None = 0,
+    Readable = 1<<0,
+    Writable = 1<<1,
+    Executable = 1<<2
+};
+
+SegmentFlag operator|(SegmentFlag lhs, SegmentFlag rhs);
+SegmentFlag operator&(SegmentFlag lhs, SegmentFlag rhs);
+
+struct ExecutableSegment
+{
+    ExecutableSegment();
+
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t fileSize;
+    uint32_t memSize;
+    SegmentFlag flags;
+    std::vector<uint8_t> instructionMap;    // empty if there is none
+};
+
+struct ExecutableSymbol
+{
+    ExecutableSymbol();
+    ExecutableSymbol(uint32_t addr, uint32_t size, const std::string &name);
+
+    uint32_t addr;
+    uint32_t size;
+    std::string name;
+};
+
+class Executable
+{
+public:
+    Executable();
+
+    /**
+     * Return whether the data starts like an executable.
+     */
+    static bool isExecutable(const uint8_t *data, size_t size);
+
+    /**
+     * Read the tables of an executable; the contents of the segments are
+     * left in the data. Returns false if it is not a valid executable.
+     */
+    bool parse(const uint8_t *data, size_t size);
+
+    /**
+     * Write the executable with the given contents of each segment, which
+     * must be as large as its file size. Instruction maps are created for all
+     * executable segments.
+     */
+    std::vector<uint8_t> write(const std::vector<const uint8_t *> &contents) const;
+
+    uint32_t entry;
+    std::vector<ExecutableSegment> segments;
+    std::vector<ExecutableSymbol> symbols;
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_EXECUTABLE_HXX */
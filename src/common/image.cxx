@@ -0,0 +1,70 @@
+/*
+ *  image.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image.hxx"
+
+using namespace SoloMIPS;
+
+static uint32_t readWord(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void appendWord(std::vector<uint8_t> &out, uint32_t word)
+{
+    out.push_back(word >> 24);
+    out.push_back((word >> 16) & 0xff);
+    out.push_back((word >> 8) & 0xff);
+    out.push_back(word & 0xff);
+}
+
+DataImage::DataImage()
+    : offset(0), size(0), addr(0) {}
+
+bool SoloMIPS::findDataImage(const uint8_t *program, size_t size, DataImage &image)
+{
+    if (size < SOLOMIPS_DATA_IMAGE_TRAILER_SIZE)
+        return false;
+    const uint8_t *trailer = program + size - SOLOMIPS_DATA_IMAGE_TRAILER_SIZE;
+    if (readWord(trailer + 12) != SOLOMIPS_DATA_IMAGE_MAGIC)
+        return false;
+
+    DataImage found;
+    found.offset = readWord(trailer);
+    found.size = readWord(trailer + 4);
+    found.addr = readWord(trailer + 8);
+    if (found.offset % SOLOMIPS_DATA_IMAGE_ALIGN != 0
+            || static_cast<uint64_t>(found.offset) + found.size > size - SOLOMIPS_DATA_IMAGE_TRAILER_SIZE)
+        return false;
+    image = found;
+    return true;
+}
+
+void SoloMIPS::appendDataImage(std::vector<uint8_t> &program, const std::vector<uint8_t> &data, uint32_t addr)
+{
+    size_t offset = (program.size() + SOLOMIPS_DATA_IMAGE_ALIGN - 1) / SOLOMIPS_DATA_IMAGE_ALIGN * SOLOMIPS_DATA_IMAGE_ALIGN;
+    program.resize(offset, 0);
+    program.insert(program.end(), data.begin(), data.end());
+    appendWord(program, static_cast<uint32_t>(offset));
+    appendWord(program, static_cast<uint32_t>(data.size()));
+    appendWord(program, addr);
+    appendWord(program, SOLOMIPS_DATA_IMAGE_MAGIC);
+}
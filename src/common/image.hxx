@@ -0,0 +1,71 @@
+/*
+ *  image.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_IMAGE_HXX
+#define HEADER_SOLOMIPS_IMAGE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Programs written by solomips-ld are loaded as ROM at the entry address. If
+they have initialised data, the data image follows the code and is loaded at
+the start of data RAM:
+
+    [code][padding][data][trailer]
+
+The data starts at a multiple of SOLOMIPS_DATA_IMAGE_ALIGN in the file, so
+that it can be mapped straight from the file, copy-on-write. The trailer holds
+four big-endian words: the file offset of the data, its size, its address and
+SOLOMIPS_DATA_IMAGE_MAGIC. The magic is not a valid instruction, so a file
+ending in it cannot be plain code.
+*/
+
+#define SOLOMIPS_DATA_IMAGE_MAGIC 0x534d4449u // "SMDI"
+#define SOLOMIPS_DATA_IMAGE_ALIGN 0x1000u
+#define SOLOMIPS_DATA_IMAGE_TRAILER_SIZE 16u
+
+namespace SoloMIPS {
+
+struct DataImage
+{
+    DataImage();
+
+    uint32_t offset;
+    uint32_t size;
+    uint32_t addr;
+};
+
+/**
+ * Look for a data image trailer at the end of the program. Returns false if
+ * there is none, in which case all of it is code.
+ */
+bool findDataImage(const uint8_t *program, size_t size, DataImage &image);
+
+/**
+ * Append the data image and its trailer to the code.
+ */
+void appendDataImage(std::vector<uint8_t> &program, const std::vector<uint8_t> &data, uint32_t addr);
+
+}
+
+#endif /* HEADER_SOLOMIPS_IMAGE_HXX */
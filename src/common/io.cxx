@@ -19,10 +19,21 @@
  *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdint>
 #include <fstream>
 
 #include "io.hxx"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define SOLOMIPS_MAPPED_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
 using namespace SoloMIPS;
 
 IOException::IOException(const std::string &msg)
@@ -33,6 +44,15 @@ const char *IOException::what() const noexcept
     return this->_msg.data();
 }
 
+bool SoloMIPS::isTerminal(int fd)
+{
+#ifdef _WIN32
+    return _isatty(fd) != 0;
+#else
+    return isatty(fd) != 0;
+#endif
+}
+
 
 std::vector<uint8_t> SoloMIPS::loadBinaryFile(const std::string &fileName, size_t maxSize, size_t chunkSize)
 {
@@ -42,6 +62,23 @@ std::vector<uint8_t> SoloMIPS::loadBinaryFile(const std::string &fileName, size_
         throw IOException("could not open file '" + fileName + "'");
     }
     std::vector<uint8_t> data;
+    // Read files of known length in one go; pipes and the like in chunks
+    std::streamoff length = bin.seekg(0, std::ios::end).tellg();
+    if (length > 0 && bin.seekg(0, std::ios::beg)) {
+        if (static_cast<uint64_t>(length) > maxSize) {
+            bin.close();
+            throw IOException("file '" + fileName + "' too large");
+        }
+        data.resize(static_cast<size_t>(length));
+        bin.read(reinterpret_cast<char *>(data.data()), length);
+        if (bin.gcount() != length) {
+            bin.close();
+            throw IOException("could not read file '" + fileName + "'");
+        }
+        bin.close();
+        return data;
+    }
+    bin.clear();
     size_t offset = 0;
     while (!bin.eof()) {
         data.resize(offset + chunkSize);
@@ -62,3 +99,51 @@ std::vector<uint8_t> SoloMIPS::loadBinaryFile(const std::string &fileName, size_
         throw IOException("file '" + fileName + "' is empty or could not be read");
     return data;
 }
+
+
+MappedFile::MappedFile(const std::string &fileName)
+    : _mem(NULL), _size(0), _mapped(false)
+{
+#ifdef SOLOMIPS_MAPPED_FILES
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw IOException("could not open file '" + fileName + "'");
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            throw IOException("file '" + fileName + "' is empty or could not be read");
+        }
+        void *p = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            close(fd);
+            this->_mem = static_cast<const uint8_t *>(p);
+            this->_size = static_cast<size_t>(st.st_size);
+            this->_mapped = true;
+            return;
+        }
+    }
+    close(fd);
+#endif
+    this->_data = loadBinaryFile(fileName, SIZE_MAX);
+    this->_mem = this->_data.data();
+    this->_size = this->_data.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef SOLOMIPS_MAPPED_FILES
+    if (this->_mapped)
+        munmap(const_cast<uint8_t *>(this->_mem), this->_size);
+#endif
+}
+
+const uint8_t *MappedFile::data() const
+{
+    return this->_mem;
+}
+
+size_t MappedFile::size() const
+{
+    return this->_size;
+}
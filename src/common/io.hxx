@@ -39,8 +39,36 @@ private:
     std::string _msg;
 };
 
+/**
+ * Return whether the file descriptor refers to a terminal.
+ */
+bool isTerminal(int fd);
+
 std::vector<uint8_t> loadBinaryFile(const std::string &fileName, size_t maxSize = 0x1000000u, size_t chunkSize = 0x010000u);
 
+/**
+ * A file mapped read-only into memory where supported, read otherwise.
+ * Throws IOException if the file cannot be read or is empty.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &fileName);
+    ~MappedFile();
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile &other);
+    MappedFile &operator=(const MappedFile &other);
+
+    const uint8_t *_mem;
+    size_t _size;
+    bool _mapped;
+    std::vector<uint8_t> _data;
+};
+
 }
 
 #endif /* HEADER_SOLOMIPS_IO_HXX */
@@ -29,7 +29,6 @@ using namespace SoloMIPS;
 static void runDisassemble(const uint8_t *data, uint32_t size, bool hasEntry, uint32_t entry, std::ostream &out)
 {
     std::ios::fmtflags flags = out.flags();
-    out.unsetf(std::ios::binary);
     OP op;
     std::stringstream str;
     str << std::setfill('0') << std::setw(8) << std::hex;
@@ -82,63 +81,113 @@ void OP::disassemble(const uint8_t *data, uint32_t size, uint32_t entry, std::os
     runDisassemble(data, size, true, entry, out);
 }
 
-OP OP::LUI(uint8_t rt, uint16_t imm)
+static OP rType(Funct funct, uint8_t rd, uint8_t rs, uint8_t rt, uint8_t shamt = 0)
 {
     OP op;
-    op.opcode = Opcode::LUI;
+    op.opcode = Opcode::SPECIAL;
+    op.funct = funct;
+    op.rs = rs;
     op.rt = rt;
-    op.imm = imm;
+    op.rd = rd;
+    op.shamt = shamt;
     return op;
 }
 
-OP OP::ORI(uint8_t rt, uint8_t rs, uint16_t imm)
+static OP iType(Opcode opcode, uint8_t rt, uint8_t rs, uint16_t imm)
 {
     OP op;
-    op.opcode = Opcode::ORI;
+    op.opcode = opcode;
     op.rs = rs;
     op.rt = rt;
     op.imm = imm;
     return op;
 }
 
-OP OP::SW(uint8_t rt, int16_t offset, uint8_t base)
+static OP jType(Opcode opcode, uint32_t target)
 {
     OP op;
-    op.opcode = Opcode::SW;
-    op.rt = rt;
-    op.rs = base;
-    op.simm = offset;
+    op.opcode = opcode;
+    op.addr = (target >> 2) & 0x3ffffff;
     return op;
 }
 
-OP OP::OR(uint8_t rd, uint8_t rs, uint8_t rt)
-{
-    OP op;
-    op.opcode = Opcode::SPECIAL;
-    op.funct = Funct::OR;
-    op.rs = rs;
-    op.rt = rt;
-    op.rd = rd;
-    return op;
-}
+OP OP::NOP() { return OP(); }
+
+OP OP::SLL(uint8_t rd, uint8_t rt, uint8_t shamt) { return rType(Funct::SLL, rd, 0, rt, shamt); }
+OP OP::SRL(uint8_t rd, uint8_t rt, uint8_t shamt) { return rType(Funct::SRL, rd, 0, rt, shamt); }
+OP OP::SRA(uint8_t rd, uint8_t rt, uint8_t shamt) { return rType(Funct::SRA, rd, 0, rt, shamt); }
+OP OP::SLLV(uint8_t rd, uint8_t rt, uint8_t rs) { return rType(Funct::SLLV, rd, rs, rt); }
+OP OP::SRLV(uint8_t rd, uint8_t rt, uint8_t rs) { return rType(Funct::SRLV, rd, rs, rt); }
+OP OP::SRAV(uint8_t rd, uint8_t rt, uint8_t rs) { return rType(Funct::SRAV, rd, rs, rt); }
+OP OP::JR(uint8_t rs) { return rType(Funct::JR, 0, rs, 0); }
+OP OP::JALR(uint8_t rd, uint8_t rs) { return rType(Funct::JALR, rd, rs, 0); }
+OP OP::SYSCALL() { return rType(Funct::SYSCALL, 0, 0, 0); }
+OP OP::MFHI(uint8_t rd) { return rType(Funct::MFHI, rd, 0, 0); }
+OP OP::MTHI(uint8_t rs) { return rType(Funct::MTHI, 0, rs, 0); }
+OP OP::MFLO(uint8_t rd) { return rType(Funct::MFLO, rd, 0, 0); }
+OP OP::MTLO(uint8_t rs) { return rType(Funct::MTLO, 0, rs, 0); }
+OP OP::MULT(uint8_t rs, uint8_t rt) { return rType(Funct::MULT, 0, rs, rt); }
+OP OP::MULTU(uint8_t rs, uint8_t rt) { return rType(Funct::MULTU, 0, rs, rt); }
+OP OP::DIV(uint8_t rs, uint8_t rt) { return rType(Funct::DIV, 0, rs, rt); }
+OP OP::DIVU(uint8_t rs, uint8_t rt) { return rType(Funct::DIVU, 0, rs, rt); }
+OP OP::ADD(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::ADD, rd, rs, rt); }
+OP OP::ADDU(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::ADDU, rd, rs, rt); }
+OP OP::SUB(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::SUB, rd, rs, rt); }
+OP OP::SUBU(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::SUBU, rd, rs, rt); }
+OP OP::AND(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::AND, rd, rs, rt); }
+OP OP::OR(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::OR, rd, rs, rt); }
+OP OP::XOR(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::XOR, rd, rs, rt); }
+OP OP::NOR(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::NOR, rd, rs, rt); }
+OP OP::SLT(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::SLT, rd, rs, rt); }
+OP OP::SLTU(uint8_t rd, uint8_t rs, uint8_t rt) { return rType(Funct::SLTU, rd, rs, rt); }
+
+OP OP::BLTZ(uint8_t rs, int16_t simm) { return iType(Opcode::REGIMM, OP_REGIMM_BLTZ, rs, static_cast<uint16_t>(simm)); }
+OP OP::BGEZ(uint8_t rs, int16_t simm) { return iType(Opcode::REGIMM, OP_REGIMM_BGEZ, rs, static_cast<uint16_t>(simm)); }
+OP OP::BLTZAL(uint8_t rs, int16_t simm) { return iType(Opcode::REGIMM, OP_REGIMM_BLTZAL, rs, static_cast<uint16_t>(simm)); }
+OP OP::BGEZAL(uint8_t rs, int16_t simm) { return iType(Opcode::REGIMM, OP_REGIMM_BGEZAL, rs, static_cast<uint16_t>(simm)); }
+
+OP OP::J(uint32_t target) { return jType(Opcode::J, target); }
+OP OP::JAL(uint32_t target) { return jType(Opcode::JAL, target); }
+OP OP::BEQ(uint8_t rs, uint8_t rt, int16_t simm) { return iType(Opcode::BEQ, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::BNE(uint8_t rs, uint8_t rt, int16_t simm) { return iType(Opcode::BNE, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::BLEZ(uint8_t rs, int16_t simm) { return iType(Opcode::BLEZ, 0, rs, static_cast<uint16_t>(simm)); }
+OP OP::BGTZ(uint8_t rs, int16_t simm) { return iType(Opcode::BGTZ, 0, rs, static_cast<uint16_t>(simm)); }
+
+OP OP::ADDI(uint8_t rt, uint8_t rs, int16_t simm) { return iType(Opcode::ADDI, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::ADDIU(uint8_t rt, uint8_t rs, int16_t simm) { return iType(Opcode::ADDIU, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::SLTI(uint8_t rt, uint8_t rs, int16_t simm) { return iType(Opcode::SLTI, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::SLTIU(uint8_t rt, uint8_t rs, int16_t simm) { return iType(Opcode::SLTIU, rt, rs, static_cast<uint16_t>(simm)); }
+OP OP::ANDI(uint8_t rt, uint8_t rs, uint16_t imm) { return iType(Opcode::ANDI, rt, rs, imm); }
+OP OP::ORI(uint8_t rt, uint8_t rs, uint16_t imm) { return iType(Opcode::ORI, rt, rs, imm); }
+OP OP::XORI(uint8_t rt, uint8_t rs, uint16_t imm) { return iType(Opcode::XORI, rt, rs, imm); }
+OP OP::LUI(uint8_t rt, uint16_t imm) { return iType(Opcode::LUI, rt, 0, imm); }
 
-OP OP::JR(uint8_t rs)
+OP OP::LB(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::LB, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::LH(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::LH, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::LW(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::LW, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::LBU(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::LBU, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::LHU(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::LHU, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::SB(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::SB, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::SH(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::SH, rt, base, static_cast<uint16_t>(offset)); }
+OP OP::SW(uint8_t rt, int16_t offset, uint8_t base) { return iType(Opcode::SW, rt, base, static_cast<uint16_t>(offset)); }
+
+bool OP::isBranch() const
 {
-    OP op;
-    op.opcode = Opcode::SPECIAL;
-    op.funct = Funct::JR;
-    op.rs = rs;
-    return op;
+    switch (this->opcode) {
+        case Opcode::REGIMM:
+        case Opcode::BEQ:
+        case Opcode::BNE:
+        case Opcode::BLEZ:
+        case Opcode::BGTZ:
+            return true;
+        default:
+            return false;
+    }
 }
 
-OP OP::BGEZAL(uint8_t rs, int16_t simm)
+bool OP::isJump() const
 {
-    OP op;
-    op.opcode = Opcode::REGIMM;
-    op.rs = rs;
-    op.rt = OP_REGIMM_BGEZAL;
-    op.simm = simm;
-    return op;
+    return this->opcode == Opcode::J || this->opcode == Opcode::JAL;
 }
 
 void OP::decode(const uint8_t *p)
@@ -163,7 +212,6 @@ void OP::decode(uint32_t word)
         unsigned int f = word & 0x3f;
         if (f == 1 || f == 5 || f == 10 || f == 11
                 || (f >= 13 && f <= 15)
-                || f == 18
                 || (f >= 20 && f <= 23)
                 || (f >= 28 && f <= 31)
                 || f == 40 || f == 41
@@ -227,16 +275,6 @@ void OP::encode(uint8_t *p) const
 
 std::ostream &operator<<(std::ostream &out, const OP &op)
 {
-    if (out.flags() & std::ios::binary) {
-        uint32_t word = op.encode();
-        out
-            << static_cast<uint8_t>(word >> 24)
-            << static_cast<uint8_t>((word >> 16) & 0xff)
-            << static_cast<uint8_t>((word >> 8) & 0xff)
-            << static_cast<uint8_t>(word & 0xff);
-        return out;
-    }
-
     // Names
     switch (op.opcode) {
         case Opcode::ADDI:  out << "addi   "; break;
@@ -377,6 +415,7 @@ std::ostream &operator<<(std::ostream &out, const OP &op)
                 case Funct::SLL:
                     if (op.rd == 0 && op.rt == 0 && op.shamt == 0)
                         break;
+                    // fall through
                 case Funct::SLLV:
                 case Funct::SRA:
                 case Funct::SRAV:
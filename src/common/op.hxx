@@ -127,13 +127,73 @@ struct OP
     static void disassemble(const uint8_t *data, uint32_t size, std::ostream &out);
     static void disassemble(const uint8_t *data, uint32_t size, uint32_t entry, std::ostream &out);
 
-    static OP LUI(uint8_t rt, uint16_t imm);
-    static OP ORI(uint8_t rt, uint8_t rs, uint16_t imm);
-    static OP SW(uint8_t rt, int16_t offset, uint8_t base);
-    static OP OR(uint8_t rd, uint8_t rs, uint8_t rt);
+    // Encoders for every instruction, with the operands in assembler order.
+    // Branch offsets count instructions from the delay slot; jump targets
+    // are absolute addresses, of which the low 28 bits are encoded.
+    static OP NOP();
+
+    static OP SLL(uint8_t rd, uint8_t rt, uint8_t shamt);
+    static OP SRL(uint8_t rd, uint8_t rt, uint8_t shamt);
+    static OP SRA(uint8_t rd, uint8_t rt, uint8_t shamt);
+    static OP SLLV(uint8_t rd, uint8_t rt, uint8_t rs);
+    static OP SRLV(uint8_t rd, uint8_t rt, uint8_t rs);
+    static OP SRAV(uint8_t rd, uint8_t rt, uint8_t rs);
     static OP JR(uint8_t rs);
+    static OP JALR(uint8_t rd, uint8_t rs);
+    static OP SYSCALL();
+    static OP MFHI(uint8_t rd);
+    static OP MTHI(uint8_t rs);
+    static OP MFLO(uint8_t rd);
+    static OP MTLO(uint8_t rs);
+    static OP MULT(uint8_t rs, uint8_t rt);
+    static OP MULTU(uint8_t rs, uint8_t rt);
+    static OP DIV(uint8_t rs, uint8_t rt);
+    static OP DIVU(uint8_t rs, uint8_t rt);
+    static OP ADD(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP ADDU(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP SUB(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP SUBU(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP AND(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP OR(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP XOR(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP NOR(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP SLT(uint8_t rd, uint8_t rs, uint8_t rt);
+    static OP SLTU(uint8_t rd, uint8_t rs, uint8_t rt);
+
+    static OP BLTZ(uint8_t rs, int16_t simm);
+    static OP BGEZ(uint8_t rs, int16_t simm);
+    static OP BLTZAL(uint8_t rs, int16_t simm);
     static OP BGEZAL(uint8_t rs, int16_t simm);
 
+    static OP J(uint32_t target);
+    static OP JAL(uint32_t target);
+    static OP BEQ(uint8_t rs, uint8_t rt, int16_t simm);
+    static OP BNE(uint8_t rs, uint8_t rt, int16_t simm);
+    static OP BLEZ(uint8_t rs, int16_t simm);
+    static OP BGTZ(uint8_t rs, int16_t simm);
+
+    static OP ADDI(uint8_t rt, uint8_t rs, int16_t simm);
+    static OP ADDIU(uint8_t rt, uint8_t rs, int16_t simm);
+    static OP SLTI(uint8_t rt, uint8_t rs, int16_t simm);
+    static OP SLTIU(uint8_t rt, uint8_t rs, int16_t simm);
+    static OP ANDI(uint8_t rt, uint8_t rs, uint16_t imm);
+    static OP ORI(uint8_t rt, uint8_t rs, uint16_t imm);
+    static OP XORI(uint8_t rt, uint8_t rs, uint16_t imm);
+    static OP LUI(uint8_t rt, uint16_t imm);
+
+    static OP LB(uint8_t rt, int16_t offset, uint8_t base);
+    static OP LH(uint8_t rt, int16_t offset, uint8_t base);
+    static OP LW(uint8_t rt, int16_t offset, uint8_t base);
+    static OP LBU(uint8_t rt, int16_t offset, uint8_t base);
+    static OP LHU(uint8_t rt, int16_t offset, uint8_t base);
+    static OP SB(uint8_t rt, int16_t offset, uint8_t base);
+    static OP SH(uint8_t rt, int16_t offset, uint8_t base);
+    static OP SW(uint8_t rt, int16_t offset, uint8_t base);
+
+    // Whether this is a branch (conditional, relative) or a jump (J, JAL)
+    bool isBranch() const;
+    bool isJump() const;
+
     void decode(const uint8_t *p);
     void decode(uint32_t word);
     uint32_t encode() const;
@@ -158,6 +218,7 @@ struct OP
 
 }
 
+// Disassembly of the instruction; use OP::encode for its binary form
 std::ostream &operator<<(std::ostream &out, const SoloMIPS::OP &op);
 
 #endif /* HEADER_SOLOMIPS_OP_HXX */
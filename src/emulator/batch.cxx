@@ -0,0 +1,201 @@
+/*
+ *  batch.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "io.hxx"
+#include "machine.hxx"
+#include "batch.hxx"
+
+using namespace SoloMIPS;
+
+std::vector<BatchJob> SoloMIPS::loadBatchManifest(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw IOException("could not open file '" + path + "'");
+
+    std::string dir;
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos)
+        dir = path.substr(0, slash + 1);
+    auto resolve = [&dir](const std::string &p) {
+        if (p == "-")
+            return std::string();
+        if (p.empty() || p[0] == '/')
+            return p;
+        return dir + p;
+    };
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    unsigned int lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        std::istringstream fields(line);
+        std::string program, input, output, status;
+        if (!(fields >> program) || program[0] == '#')
+            continue;
+        fields >> input >> output >> status;
+
+        BatchJob job;
+        job.program = resolve(program);
+        job.input = resolve(input.empty() ? "-" : input);
+        job.expectedOutput = resolve(output.empty() ? "-" : output);
+        job.expectedStatus = -1;
+        if (!status.empty() && status != "-") {
+            char *end;
+            long l = std::strtol(status.c_str(), &end, 0);
+            if (*end != '\0' || l < 0 || l > 255)
+                throw IOException("invalid exit status in '" + path + "' line " + std::to_string(lineNo));
+            job.expectedStatus = static_cast<int>(l);
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+static BatchResult runJob(const BatchJob &job, ExecutionEngine engine, uint64_t maxInstructions)
+{
+    BatchResult result;
+    result.passed = false;
+    result.status = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        std::ifstream input;
+        if (!job.input.empty()) {
+            input.open(job.input, std::ios::in | std::ios::binary);
+            if (!input.is_open())
+                throw IOException("could not open file '" + job.input + "'");
+        }
+        std::ostringstream output;
+        std::ostringstream err;
+
+        Machine machine(job.program, &input, &output);
+        machine.cpu.engine = engine;
+        result.status = machine.run(err, maxInstructions);
+        result.message = err.str();
+        if (!result.message.empty() && result.message.back() == '\n')
+            result.message.pop_back();
+
+        // Faults and the instruction limit fail the job whatever is expected
+        result.passed = (result.status >= 0);
+        if (!result.passed && result.message.empty())
+            result.message = "error code " + std::to_string(result.status);
+        if (job.expectedStatus >= 0 && result.status != job.expectedStatus) {
+            result.passed = false;
+            if (result.message.empty())
+                result.message = "exit status " + std::to_string(result.status) + ", expected " + std::to_string(job.expectedStatus);
+        }
+        if (!job.expectedOutput.empty()) {
+            std::ifstream expected(job.expectedOutput, std::ios::in | std::ios::binary);
+            if (!expected.is_open())
+                throw IOException("could not open file '" + job.expectedOutput + "'");
+            std::ostringstream contents;
+            contents << expected.rdbuf();
+            if (contents.str() != output.str()) {
+                result.passed = false;
+                if (result.message.empty())
+                    result.message = "output differs";
+            }
+        }
+    }
+    // Jobs which cannot be loaded or checked report an error code like
+    // Machine::run, so that they never pass for a clean exit
+    catch (IOException &e) {
+        result.passed = false;
+        result.status = -21;
+        result.message = std::string("error: ") + e.what();
+    }
+    catch (std::exception &e) {
+        result.passed = false;
+        result.status = -20;
+        result.message = std::string("error: ") + e.what();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+namespace {
+
+struct WorkQueue
+{
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+}
+
+std::vector<BatchResult> SoloMIPS::runBatch(const std::vector<BatchJob> &jobs, unsigned int threads, ExecutionEngine engine, uint64_t maxInstructions)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads > jobs.size())
+        threads = std::max<unsigned int>(1u, static_cast<unsigned int>(jobs.size()));
+
+    std::vector<BatchResult> results(jobs.size());
+    std::vector<WorkQueue> queues(threads);
+    for (size_t i = 0; i < jobs.size(); ++i)
+        queues[i % threads].jobs.push_back(i);
+
+    auto worker = [&](unsigned int self) {
+        for (;/*_*/;) {
+            // Take from the front of the own queue, else steal from the back
+            // of another one
+            size_t job = jobs.size();
+            for (unsigned int k = 0; k < threads && job == jobs.size(); ++k) {
+                WorkQueue &q = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (q.jobs.empty())
+                    continue;
+                if (k == 0) {
+                    job = q.jobs.front();
+                    q.jobs.pop_front();
+                }
+                else {
+                    job = q.jobs.back();
+                    q.jobs.pop_back();
+                }
+            }
+            if (job == jobs.size())
+                return;
+            results[job] = runJob(jobs[job], engine, maxInstructions);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.push_back(std::thread(worker, t));
+    worker(0);
+    for (std::thread &t : pool)
+        t.join();
+
+    return results;
+}
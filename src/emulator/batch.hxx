@@ -0,0 +1,76 @@
+/*
+ *  batch.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_BATCH_HXX
+#define HEADER_SOLOMIPS_BATCH_HXX
+
+#include <string>
+#include <vector>
+
+#include "cpu.hxx"
+
+/*
+Batch mode: runs many guest programs on a pool of worker threads, each job on
+its own Machine. Jobs are dealt out round-robin to per-worker queues; a worker
+that runs out of jobs steals from the back of the other queues.
+
+The manifest lists one job per line, as whitespace separated fields:
+
+    <program> [<stdin file> [<expected stdout file> [<expected exit status>]]]
+
+A field of "-" stands for no input or no expectation; relative paths are taken
+relative to the manifest. Empty lines and lines starting with '#' are ignored.
+*/
+
+namespace SoloMIPS {
+
+struct BatchJob
+{
+    std::string program;
+    std::string input;              // empty for no input
+    std::string expectedOutput;     // empty to not check the output
+    int expectedStatus;             // -1 to not check the exit status
+};
+
+struct BatchResult
+{
+    bool passed;
+    int status;                     // exit status (0-255) or negative error code (see Machine::run)
+    std::string message;            // fault or reason of failure
+    double seconds;
+};
+
+/**
+ * Parse the given manifest file; throws an IOException on failure.
+ */
+std::vector<BatchJob> loadBatchManifest(const std::string &path);
+
+/**
+ * Run all jobs using the given number of threads (0 for one per core) and
+ * return their results in order. Jobs which fault or exceed maxInstructions
+ * fail, whatever exit status they are expected to have; so do jobs whose
+ * files cannot be read, with error code -21.
+ */
+std::vector<BatchResult> runBatch(const std::vector<BatchJob> &jobs, unsigned int threads, ExecutionEngine engine, uint64_t maxInstructions = UINT64_MAX);
+
+}
+
+#endif /* HEADER_SOLOMIPS_BATCH_HXX */
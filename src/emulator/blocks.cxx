@@ -0,0 +1,546 @@
+/*
+ *  blocks.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.hxx"
+#include "blocks.hxx"
+#include "handlers.hxx"
+
+using namespace SoloMIPS;
+
+TranslatedBlock::TranslatedBlock()
+    : start(0), end(0), branch(false), mapper(NULL), generation(0), pageGeneration(0), next(NULL), taken(NULL), takenAddr(0), hits(0), native(NULL) {}
+
+
+BlockCache::BlockCache() : ramGeneration(0) {}
+
+BlockCache::BlockCache(const BlockCache &other) : ramGeneration(other.ramGeneration) {}
+
+BlockCache &BlockCache::operator=(const BlockCache &other)
+{
+    this->ramGeneration = other.ramGeneration;
+    this->_blocks.clear();
+    return *this;
+}
+
+TranslatedBlock *BlockCache::find(uint32_t addr) const
+{
+    auto i = this->_blocks.find(addr);
+    if (i == this->_blocks.end())
+        return NULL;
+    return i->second.get();
+}
+
+TranslatedBlock *BlockCache::insert(std::unique_ptr<TranslatedBlock> &&block)
+{
+    TranslatedBlock *b = block.get();
+    this->_blocks[b->start] = std::move(block);
+    return b;
+}
+
+void BlockCache::clear()
+{
+    this->_blocks.clear();
+}
+
+void BlockCache::removePage(uint32_t addr)
+{
+    // Unlink first, while the blocks linked to still exist
+    uint32_t page = addr & ~SOLOMIPS_RAM_PAGE_MASK;
+    for (auto &i : this->_blocks) {
+        TranslatedBlock *b = i.second.get();
+        if (b->next != NULL && (b->next->start & ~SOLOMIPS_RAM_PAGE_MASK) == page)
+            b->next = NULL;
+        if (b->taken != NULL && (b->taken->start & ~SOLOMIPS_RAM_PAGE_MASK) == page)
+            b->taken = NULL;
+    }
+    for (auto i = this->_blocks.begin(); i != this->_blocks.end(); ) {
+        if ((i->first & ~SOLOMIPS_RAM_PAGE_MASK) == page)
+            i = this->_blocks.erase(i);
+        else
+            ++i;
+    }
+}
+
+// Blocks may start and end in different decoded pages of an unaligned mapper;
+// the sum of both generations changes whenever either does
+static uint32_t blockPageGeneration(const TranslatedBlock *block)
+{
+    uint32_t generation = block->mapper->pageGeneration(block->start);
+    if (((block->start - block->mapper->offset()) ^ (block->end - 4 - block->mapper->offset())) & ~SOLOMIPS_RAM_PAGE_MASK)
+        generation += block->mapper->pageGeneration(block->end - 4);
+    return generation;
+}
+
+
+static MicroOP translateOP(const OP &op, uint32_t addr)
+{
+    MicroOP u;
+    u.handler = resolveHandler(op);
+    u.rd = op.rd;
+    u.rs = op.rs;
+    u.rt = op.rt;
+    u.shamt = op.shamt;
+    u.addr = addr;
+
+    switch (u.handler) {
+        case H_ANDI:
+        case H_ORI:
+        case H_XORI:
+            u.imm = op.imm;
+            break;
+        case H_LUI:
+            u.imm = static_cast<uint32_t>(op.imm) << 16;
+            break;
+        case H_BEQ:
+        case H_BNE:
+        case H_BLEZ:
+        case H_BGTZ:
+        case H_BLTZ:
+        case H_BGEZ:
+        case H_BLTZAL:
+        case H_BGEZAL:
+            u.imm = addr + 4 + (static_cast<int32_t>(op.simm) << 2);
+            break;
+        case H_J:
+        case H_JAL:
+            u.imm = ((addr + 8) & 0xf0000000) | (op.addr << 2);
+            break;
+        default:
+            u.imm = static_cast<uint32_t>(static_cast<int32_t>(op.simm));
+            break;
+    }
+
+    return u;
+}
+
+TranslatedBlock *R3000::translateBlock(uint32_t addr)
+{
+    if ((addr & 0x03) || addr == 0)
+        return NULL;
+
+    // Only code served by a pre-decoding mapper can be translated
+    try {
+        if (this->fetch(addr) == NULL)
+            return NULL;
+    }
+    catch (std::exception &) {
+        return NULL;
+    }
+    if (this->_fetchMapper == NULL || addr < this->_fetchFirst || addr > this->_fetchLast)
+        return NULL;
+
+    std::unique_ptr<TranslatedBlock> block(new TranslatedBlock());
+    block->start = addr;
+    block->mapper = this->_fetchMapper;
+    block->generation = this->_fetchMapper->codeGeneration();
+
+    uint32_t last = this->_fetchLast;
+    // End the block before an invalid or inaccessible instruction; the
+    // window is served by the mapper alone, so nothing is thrown
+    for (uint32_t a = addr; a <= last; a += 4) {
+        const OP *o = this->fetch(a);
+        if (o == NULL)
+            break;
+        if (isControlTransfer(*o)) {
+            // The delay slot must be part of the block and not branch itself
+            if (a + 4 > last)
+                break;
+            OP b = *o;
+            const OP *d = this->fetch(a + 4);
+            if (d == NULL || isControlTransfer(*d))
+                break;
+            block->ops.push_back(b);
+            block->uops.push_back(translateOP(b, a));
+            block->ops.push_back(*d);
+            block->uops.push_back(translateOP(*d, a + 4));
+            block->branch = true;
+            break;
+        }
+        block->ops.push_back(*o);
+        block->uops.push_back(translateOP(*o, a));
+    }
+
+    if (block->uops.empty())
+        return NULL;
+    block->end = addr + static_cast<uint32_t>(block->uops.size() << 2);
+    block->pageGeneration = blockPageGeneration(block.get());
+    return this->_blocks.insert(std::move(block));
+}
+
+// Step through the interpreter until the next instruction to be executed
+// (at pc - 4) is not in a delay slot; return false if execution has to stop
+// before that.
+bool R3000::interpretToBoundary(uint64_t limit)
+{
+    do {
+        if (this->instructions >= limit || !this->cycle<false>())
+            return false;
+    } while (this->dex != DelayedException::None || isControlTransfer(this->op));
+    return true;
+}
+
+bool R3000::interpretFrom(uint32_t addr, uint64_t limit)
+{
+    this->pc = addr;
+    this->fetchNext();
+    return this->interpretToBoundary(limit);
+}
+
+// Restore the pipeline as `step()` would have left it after the given micro-op
+// faulted. Only delayed loads can fault after a jump or branch, in which case
+// `pc` already points to the target. The recorded fault takes precedence over
+// one of the fetch.
+void R3000::restoreBlockState(const TranslatedBlock *block, size_t i, uint32_t next, bool taken)
+{
+    DelayedException dex = this->dex;
+    const char *dexWhat = this->dexWhat;
+    std::exception_ptr dexException = this->dexException;
+
+    size_t n = block->uops.size();
+    this->op = block->ops[i];
+    this->pc = (block->branch && i + 1 == n) ? next : block->uops[i].addr + 4;
+    this->fetchNext();
+    if (block->branch && i + 2 == n && taken)
+        this->pc = next;
+    this->instructions += i + 1;
+
+    this->dex = dex;
+    this->dexWhat = dexWhat;
+    this->dexException = dexException;
+}
+
+// See the note on `R3000::cycle()` regarding "this->".
+void R3000::runBlocks(bool jit, uint64_t limit)
+{
+    // Get to a state where the next instruction may start a block
+    if (!interpretToBoundary(limit))
+        return;
+    uint32_t addr = pc - 4;
+
+    TranslatedBlock *block = NULL;
+    for (;/*_*/;) {
+        if (_blocks.ramGeneration != ram.generation()) {
+            _blocks.clear();
+            _jit.reset();
+            _blocks.ramGeneration = ram.generation();
+            block = NULL;
+        }
+        if (block == NULL)
+            block = _blocks.find(addr);
+        if (block != NULL && block->mapper->codeGeneration() != block->generation) {
+            _blocks.clear();
+            _jit.reset();
+            block = NULL;
+        }
+        else if (block != NULL && blockPageGeneration(block) != block->pageGeneration) {
+            _blocks.removePage(block->start);
+            block = NULL;
+        }
+        if (block == NULL)
+            block = translateBlock(addr);
+        if (block == NULL || instructions + block->uops.size() > limit) {
+            // Blocks run to completion, so the last few are interpreted
+            if (!interpretFrom(addr, limit))
+                return;
+            addr = pc - 4;
+            block = NULL;
+            continue;
+        }
+
+        uint32_t next;
+        bool taken;
+        if (block->native != NULL) {
+            // Run native code
+            uint64_t res = block->native(this);
+            next = static_cast<uint32_t>(res);
+            taken = (res >> 32) & 1;
+            if (res >> 33) {
+                restoreBlockState(block, (res >> 33) - 1, next, taken);
+                return;
+            }
+        }
+        else {
+            if (jit && ++block->hits == SOLOMIPS_JIT_THRESHOLD)
+                block->native = _jit.compile(*block, this);
+
+            // Run translated block
+            const MicroOP *u = block->uops.data();
+            const MicroOP *end = u + block->uops.size();
+            next = block->end;
+            taken = false;
+            bool pending = (dlOpcode != Opcode::SPECIAL);
+            for (; u != end; ++u) {
+                switch (u->handler) {
+                    case H_SLL:
+                        r[u->rd] = r[u->rt] << u->shamt;
+                        break;
+                    case H_SRL:
+                        r[u->rd] = r[u->rt] >> u->shamt;
+                        break;
+                    case H_SRA:
+                        sr[u->rd] = sr[u->rt] >> u->shamt;
+                        break;
+                    case H_SLLV:
+                        r[u->rd] = r[u->rt] << (r[u->rs] & 0x1f);
+                        break;
+                    case H_SRLV:
+                        r[u->rd] = r[u->rt] >> (r[u->rs] & 0x1f);
+                        break;
+                    case H_SRAV:
+                        sr[u->rd] = sr[u->rt] >> (r[u->rs] & 0x1f);
+                        break;
+                    case H_JALR:
+                        r[u->rd] = u->addr + 8;
+                        // fall through
+                    case H_JR:
+                        next = r[u->rs];
+                        taken = true;
+                        break;
+                    case H_MFHI:
+                        r[u->rd] = hi;
+                        break;
+                    case H_MTHI:
+                        hi = r[u->rs];
+                        break;
+                    case H_MFLO:
+                        r[u->rd] = lo;
+                        break;
+                    case H_MTLO:
+                        lo = r[u->rs];
+                        break;
+                    case H_MULT: {
+                        int64_t prod = static_cast<int64_t>(sr[u->rs]) * sr[u->rt];
+                        hi = static_cast<uint64_t>(prod) >> 32;
+                        lo = static_cast<uint64_t>(prod) & 0xffffffff;
+                        break;
+                    }
+                    case H_MULTU: {
+                        uint64_t prod = static_cast<uint64_t>(r[u->rs]) * r[u->rt];
+                        hi = prod >> 32;
+                        lo = prod & 0xffffffff;
+                        break;
+                    }
+                    case H_DIV:
+                        if (sr[u->rt] == 0) {
+                            fault(DelayedException::ArithmeticException, "Divided by zero");
+                            goto faulted;
+                        }
+                        divSigned(sr[u->rs], sr[u->rt], lo, hi);
+                        break;
+                    case H_DIVU:
+                        if (sr[u->rt] == 0) {
+                            fault(DelayedException::ArithmeticException, "Divided by zero");
+                            goto faulted;
+                        }
+                        hi = r[u->rs] % r[u->rt];
+                        lo = r[u->rs] / r[u->rt];
+                        break;
+                    case H_ADD: {
+                        uint32_t sum;
+                        if (!addSigned(r[u->rs], r[u->rt], sum)) {
+                            fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+                            goto faulted;
+                        }
+                        r[u->rd] = sum;
+                        break;
+                    }
+                    case H_ADDU:
+                        r[u->rd] = r[u->rs] + r[u->rt];
+                        break;
+                    case H_SUB: {
+                        uint32_t diff;
+                        if (!subSigned(r[u->rs], r[u->rt], diff)) {
+                            fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+                            goto faulted;
+                        }
+                        r[u->rd] = diff;
+                        break;
+                    }
+                    case H_SUBU:
+                        r[u->rd] = r[u->rs] - r[u->rt];
+                        break;
+                    case H_AND:
+                        r[u->rd] = r[u->rs] & r[u->rt];
+                        break;
+                    case H_OR:
+                        r[u->rd] = r[u->rs] | r[u->rt];
+                        break;
+                    case H_XOR:
+                        r[u->rd] = r[u->rs] ^ r[u->rt];
+                        break;
+                    case H_NOR:
+                        r[u->rd] = ~(r[u->rs] | r[u->rt]);
+                        break;
+                    case H_SLT:
+                        r[u->rd] = sr[u->rs] < sr[u->rt];
+                        break;
+                    case H_SLTU:
+                        r[u->rd] = r[u->rs] < r[u->rt];
+                        break;
+                    case H_BLTZAL:
+                        r[31] = u->addr + 8;
+                        // fall through
+                    case H_BLTZ:
+                        if (sr[u->rs] < 0) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_BGEZAL:
+                        r[31] = u->addr + 8;
+                        // fall through
+                    case H_BGEZ:
+                        if (sr[u->rs] >= 0) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_JAL:
+                        r[31] = u->addr + 8;
+                        // fall through
+                    case H_J:
+                        next = u->imm;
+                        taken = true;
+                        break;
+                    case H_BEQ:
+                        if (r[u->rs] == r[u->rt]) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_BNE:
+                        if (r[u->rs] != r[u->rt]) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_BLEZ:
+                        if (sr[u->rs] <= 0) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_BGTZ:
+                        if (sr[u->rs] > 0) {
+                            next = u->imm;
+                            taken = true;
+                        }
+                        break;
+                    case H_ADDI: {
+                        uint32_t sum;
+                        if (!addSigned(r[u->rs], u->imm, sum)) {
+                            fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+                            goto faulted;
+                        }
+                        r[u->rt] = sum;
+                        break;
+                    }
+                    case H_ADDIU:
+                        r[u->rt] = r[u->rs] + u->imm;
+                        break;
+                    case H_SLTI:
+                        r[u->rt] = (sr[u->rs] < static_cast<int32_t>(u->imm));
+                        break;
+                    case H_SLTIU:
+                        r[u->rt] = (r[u->rs] < u->imm);
+                        break;
+                    case H_ANDI:
+                        r[u->rt] = r[u->rs] & u->imm;
+                        break;
+                    case H_ORI:
+                        r[u->rt] = r[u->rs] | u->imm;
+                        break;
+                    case H_XORI:
+                        r[u->rt] = r[u->rs] ^ u->imm;
+                        break;
+                    case H_LUI:
+                        r[u->rt] = u->imm;
+                        break;
+                    case H_LB:
+                    case H_LH:
+                    case H_LW:
+                    case H_LBU:
+                    case H_LHU:
+                        // Perform pending delay load, then schedule this one
+                        if (pending && !performDelayedLoad())
+                            goto faulted;
+                        r[0] = 0;
+                        dlOpcode = block->ops[u - block->uops.data()].opcode;
+                        dlTarget = u->rt;
+                        dlAddr = u->imm+r[u->rs];
+                        pending = true;
+                        continue;
+                    case H_SB:
+                        if (!storeByte(u->imm+r[u->rs], static_cast<uint8_t>(r[u->rt])))
+                            goto faulted;
+                        break;
+                    case H_SH:
+                        if (!storeHalfWord(u->imm+r[u->rs], static_cast<uint16_t>(r[u->rt])))
+                            goto faulted;
+                        break;
+                    case H_SW:
+                        if (!storeWord(u->imm+r[u->rs], r[u->rt]))
+                            goto faulted;
+                        break;
+                    default:
+                        fault(DelayedException::InvalidOPException, NULL);
+                        goto faulted;
+                }
+
+                // Perform delay load
+                if (pending) {
+                    if (!performDelayedLoad())
+                        goto faulted;
+                    pending = false;
+                }
+
+                // Always clear zero register
+                r[0] = 0;
+            }
+faulted:
+            if (u != end) {
+                restoreBlockState(block, u - block->uops.data(), next, taken);
+                return;
+            }
+        }
+        instructions += block->uops.size();
+
+        // Follow or establish the chain to the next block
+        addr = next;
+        TranslatedBlock *successor;
+        if (taken) {
+            successor = (block->takenAddr == next) ? block->taken : NULL;
+            if (successor == NULL) {
+                successor = _blocks.find(next);
+                block->taken = successor;
+                block->takenAddr = next;
+            }
+        }
+        else {
+            successor = block->next;
+            if (successor == NULL) {
+                successor = _blocks.find(next);
+                block->next = successor;
+            }
+        }
+        block = successor;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ *  blocks.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_BLOCKS_HXX
+#define HEADER_SOLOMIPS_BLOCKS_HXX
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "op.hxx"
+
+/*
+Translation cache for the block engine. Guest code is split into basic blocks
+that end after a jump or branch and its delay slot (or at the end of a page).
+Each block is stored as a sequence of micro-ops with pre-resolved handlers and
+operands, keyed by the guest address of its first instruction, and remembers
+its successors so that hot loops go from block to block without a lookup.
+
+Blocks never span more than one page of a single ArrayRAMMapper. A store into
+the decoded instructions of a page only drops the blocks of that page, and
+the links of other blocks to them; the whole cache is dropped whenever the
+mapper's code generation or the RAM generation changes. Native code of
+dropped blocks is only reclaimed along with the whole cache. Copying a cache
+yields an empty one.
+*/
+
+namespace SoloMIPS {
+
+class ArrayRAMMapper;
+
+// Native code generated for a block (see jit.hxx)
+typedef uint64_t (*NativeCode)(void *cpu);
+
+struct MicroOP
+{
+    uint8_t handler;
+    uint8_t rd;
+    uint8_t rs;
+    uint8_t rt;
+    uint8_t shamt;
+    bool commit;        // perform the pending delayed load afterwards
+    uint32_t imm;       // extended immediate or branch target
+    uint32_t addr;      // guest address of the instruction
+};
+
+struct TranslatedBlock
+{
+    TranslatedBlock();
+
+    uint32_t start;
+    uint32_t end;       // address following the last instruction
+    bool branch;        // last two micro-ops are a jump/branch and its delay slot
+
+    const ArrayRAMMapper *mapper;
+    uint32_t generation;
+    uint32_t pageGeneration;    // see `blockPageGeneration()`
+
+    std::vector<MicroOP> uops;
+    std::vector<OP> ops;
+
+    // Chained successors; `taken` is keyed by its address for register jumps
+    TranslatedBlock *next;
+    TranslatedBlock *taken;
+    uint32_t takenAddr;
+
+    // Number of executions, used to find blocks worth compiling
+    uint32_t hits;
+    NativeCode native;
+};
+
+class BlockCache
+{
+public:
+    BlockCache();
+    BlockCache(const BlockCache &other);
+    BlockCache &operator=(const BlockCache &other);
+
+    TranslatedBlock *find(uint32_t addr) const;
+    TranslatedBlock *insert(std::unique_ptr<TranslatedBlock> &&block);
+    void clear();
+
+    /**
+     * Drop the blocks starting in the page of the given address and unlink
+     * the others from them.
+     */
+    void removePage(uint32_t addr);
+
+    uint32_t ramGeneration;
+
+private:
+    std::unordered_map<uint32_t, std::unique_ptr<TranslatedBlock>> _blocks;
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_BLOCKS_HXX */
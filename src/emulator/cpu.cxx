@@ -19,11 +19,16 @@
  *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <ios>
+
 #include "cpu.hxx"
+#include "handlers.hxx"
 
 using namespace SoloMIPS;
 
-R3000::R3000(uint32_t _entrypoint) : entrypoint(_entrypoint)
+R3000::R3000(uint32_t _entrypoint) : engine(ExecutionEngine::Switch), entrypoint(_entrypoint), statistics(NULL), profiler(NULL), tracer(NULL), _trackWrites(false)
 {
     this->reset();
 }
@@ -39,50 +44,203 @@ void R3000::reset()
     this->nextOp.decode(0x00000000u);
     // Set program counter
     this->pc = entrypoint;
-    // Clear delayed exception
+    // Clear delayed load and exception
+    this->dlOpcode = Opcode::SPECIAL;
     this->dex = DelayedException::None;
     this->dexWhat = NULL;
+    this->dexException = NULL;
+    this->instructions = 0;
+    this->_nextOpAddr = this->pc - 4;
+    this->dropCaches();
 }
 
-// Author's note: Although I prefer to use "this->" everywhere I can, for this
-// function I will not use it in order to improve readability.
-void R3000::step()
+void R3000::dropCaches()
 {
-    // Raise delayed exceptions
-    switch (dex) {
-        case DelayedException::None:
-            break;
-        case DelayedException::MisalignedPCException:
-            throw MisalignedPCException();
-        case DelayedException::HaltException:
-            throw HaltException();
-        case DelayedException::InvalidOPException:
-            throw InvalidOPException();
-        case DelayedException::MemoryException:
-            throw MemoryException(dexWhat);
+    // Drop fetch window
+    this->_fetchMapper = NULL;
+    this->_fetchFirst = 1;
+    this->_fetchLast = 0;
+    // Drop cached pages
+    this->flushTLB();
+    // Drop translated blocks
+    this->_blocks.clear();
+    this->_jit.reset();
+}
+
+void R3000::flushTLB()
+{
+    for (TLBEntry &e : this->_tlb) {
+        e.page = ~0u;
+        e.mapper = NULL;
+        e.host = NULL;
     }
+    this->_tlbGeneration = this->ram.generation();
+}
 
-    // Fetch next instruction
-    op = nextOp;
-    if (pc & 0x03) {
-        dex = DelayedException::MisalignedPCException;
+uint8_t *R3000::translateSlow(uint32_t addr, uint32_t size, bool write)
+{
+    if (this->_tlbGeneration != this->ram.generation())
+        this->flushTLB();
+
+    // Only pages served entirely by an array mapper are cached
+    const RAMPage *page = this->ram.pageAt(addr);
+    if (page == NULL || page->array == NULL)
+        return NULL;
+    TLBEntry &e = this->_tlb[(addr >> SOLOMIPS_RAM_PAGE_BITS) & (SOLOMIPS_TLB_SIZE - 1)];
+    e.page = addr >> SOLOMIPS_RAM_PAGE_BITS;
+    e.mapper = page->array;
+    e.host = page->host;
+    if (this->_trackWrites && e.mapper->isWriteable())
+        this->_writtenPages.insert(addr & ~SOLOMIPS_RAM_PAGE_MASK);
+
+    if ((addr & SOLOMIPS_RAM_PAGE_MASK) > SOLOMIPS_RAM_PAGE_MASK + 1 - size)
+        return NULL;
+    if (write ? (!e.mapper->isWriteable() || e.mapper->hasDecodedInstructions()) : !e.mapper->isReadable())
+        return NULL;
+    return e.host + (addr & SOLOMIPS_RAM_PAGE_MASK);
+}
+
+const OP *R3000::fetchSlow(uint32_t addr)
+{
+    this->_fetchMapper = NULL;
+    this->_fetchFirst = 1;
+    this->_fetchLast = 0;
+
+    // Open a new window if the address is served by a pre-decoding mapper
+    ArrayRAMMapper *mapper = dynamic_cast<ArrayRAMMapper *>(this->ram.findMapper(addr));
+    if (mapper != NULL && mapper->isExecutable() && ((addr - mapper->offset()) & 0x03) == 0
+            && mapper->highestAddress() - mapper->lowestAddress() >= 3) {
+        uint32_t first = std::max(addr & ~0xfffu, mapper->lowestAddress());
+        uint32_t last = std::min((addr | 0xfffu) - 3, mapper->highestAddress() - 3);
+        if (addr <= last && this->ram.isExclusive(mapper, first, last + 3)) {
+            this->_fetchMapper = mapper;
+            this->_fetchFirst = first;
+            this->_fetchLast = last;
+            this->_fetchGeneration = this->ram.generation();
+            return mapper->findInstruction(addr);
+        }
     }
-    else if (pc == 0) {
-        dex = DelayedException::HaltException;
+
+    try {
+        this->_fetchOp.decode(this->ram[addr].instr());
+    }
+    catch (InvalidOPException &) {
+        return NULL;
+    }
+    return &this->_fetchOp;
+}
+
+void R3000::fetchNextSlow()
+{
+    if (this->pc & 0x03) {
+        this->dex = DelayedException::MisalignedPCException;
+        return;
+    }
+    if (this->pc == 0) {
+        this->dex = DelayedException::HaltException;
+        return;
+    }
+
+    const char *what = this->ram.checkAccess(this->pc, 4, RAMMapperFlag::Executable);
+    if (what != NULL) {
+        this->fault(DelayedException::MemoryException, what);
     }
     else {
         try {
-            nextOp.decode(ram[pc].instr());
-        }
-        catch (InvalidOPException &) {
-            dex = DelayedException::InvalidOPException;
+            const OP *op = this->fetchSlow(this->pc);
+            if (op != NULL)
+                this->nextOp = *op;
+            else
+                this->dex = DelayedException::InvalidOPException;
         }
         catch (MemoryException &e) {
-            dex = DelayedException::MemoryException;
-            dexWhat = e.what();
+            this->fault(DelayedException::MemoryException, e.what());
+        }
+        catch (...) {
+            this->dexException = std::current_exception();
+            this->dex = DelayedException::ForeignException;
         }
-        pc += 4;
     }
+    this->pc += 4;
+}
+
+bool R3000::loadSlow(uint32_t addr, uint32_t size, uint32_t &value)
+{
+    const char *what = this->ram.checkAccess(addr, size, RAMMapperFlag::Readable);
+    if (what != NULL)
+        return this->fault(DelayedException::MemoryException, what);
+    try {
+        RAMPointer p = this->ram[addr];
+        if (size == 1)
+            value = static_cast<uint8_t>(p);
+        else if (size == 2)
+            value = static_cast<uint16_t>(p);
+        else
+            value = static_cast<uint32_t>(p);
+    }
+    catch (MemoryException &e) {
+        return this->fault(DelayedException::MemoryException, e.what());
+    }
+    catch (...) {
+        this->dexException = std::current_exception();
+        return this->fault(DelayedException::ForeignException, NULL);
+    }
+    return true;
+}
+
+bool R3000::storeSlow(uint32_t addr, uint32_t size, uint32_t value)
+{
+    const char *what = this->ram.checkAccess(addr, size, RAMMapperFlag::Writable);
+    if (what != NULL)
+        return this->fault(DelayedException::MemoryException, what);
+    if (this->_trackWrites) {
+        this->_writtenPages.insert(addr & ~SOLOMIPS_RAM_PAGE_MASK);
+        this->_writtenPages.insert((addr + size - 1) & ~SOLOMIPS_RAM_PAGE_MASK);
+    }
+    try {
+        RAMPointer p = this->ram[addr];
+        if (size == 1)
+            p = static_cast<uint8_t>(value);
+        else if (size == 2)
+            p = static_cast<uint16_t>(value);
+        else
+            p = value;
+    }
+    catch (MemoryException &e) {
+        return this->fault(DelayedException::MemoryException, e.what());
+    }
+    catch (...) {
+        this->dexException = std::current_exception();
+        return this->fault(DelayedException::ForeignException, NULL);
+    }
+    return true;
+}
+
+void R3000::step()
+{
+    if (!this->cycle())
+        this->raiseDelayedException();
+}
+
+bool R3000::cycle()
+{
+    return this->instrumented() ? this->cycle<true>() : this->cycle<false>();
+}
+
+// Author's note: Although I prefer to use "this->" everywhere I can, for this
+// function I will not use it in order to improve readability.
+template <bool Instrumented>
+bool R3000::cycle()
+{
+    // Stop at delayed exceptions
+    if (dex != DelayedException::None)
+        return false;
+    ++instructions;
+
+    // Fetch next instruction
+    op = nextOp;
+    fetchNext();
+    uint32_t fallthrough = pc;
 
     // Run instruction
     switch (op.opcode) {
@@ -98,22 +256,22 @@ void R3000::step()
                     sr[op.rd] = sr[op.rt] >> op.shamt;
                     break;
                 case Funct::SLLV:
-                    r[op.rd] = r[op.rt] << r[op.rs];
+                    r[op.rd] = r[op.rt] << (r[op.rs] & 0x1f);
                     break;
                 case Funct::SRLV:
-                    r[op.rd] = r[op.rt] >> r[op.rs];
+                    r[op.rd] = r[op.rt] >> (r[op.rs] & 0x1f);
                     break;
                 case Funct::SRAV:
-                    sr[op.rd] = sr[op.rt] >> r[op.rs];
+                    sr[op.rd] = sr[op.rt] >> (r[op.rs] & 0x1f);
                     break;
                 case Funct::JALR:
-                    r[op.rd] = pc+4;
+                    r[op.rd] = pc;
+                    // fall through
                 case Funct::JR:
                     pc = r[op.rs];
                     break;
                 case Funct::SYSCALL:
-                    throw InvalidOPException();
-                    break;
+                    return fault(DelayedException::InvalidOPException, NULL);
                 case Funct::MFHI:
                     r[op.rd] = hi;
                     break;
@@ -127,40 +285,47 @@ void R3000::step()
                     lo = r[op.rs];
                     break;
                 case Funct::MULT: {
-                    int64_t prod = sr[op.rs] * sr[op.rt];
+                    int64_t prod = static_cast<int64_t>(sr[op.rs]) * sr[op.rt];
                     hi = static_cast<uint64_t>(prod) >> 32;
                     lo = static_cast<uint64_t>(prod) & 0xffffffff;
                     break;
                 }
                 case Funct::MULTU: {
-                    uint64_t prod = r[op.rs] * r[op.rt];
+                    uint64_t prod = static_cast<uint64_t>(r[op.rs]) * r[op.rt];
                     hi = prod >> 32;
                     lo = prod & 0xffffffff;
                     break;
                 }
                 case Funct::DIV: {
                     if (sr[op.rt] == 0)
-                        throw ArithmeticException("Divided by zero");
-                    hi = static_cast<uint32_t>(sr[op.rs] % sr[op.rt]);
-                    lo = static_cast<uint32_t>(sr[op.rs] / sr[op.rt]);
+                        return fault(DelayedException::ArithmeticException, "Divided by zero");
+                    divSigned(sr[op.rs], sr[op.rt], lo, hi);
                     break;
                 }
                 case Funct::DIVU: {
                     if (sr[op.rt] == 0)
-                        throw ArithmeticException("Divided by zero");
+                        return fault(DelayedException::ArithmeticException, "Divided by zero");
                     hi = r[op.rs] % r[op.rt];
                     lo = r[op.rs] / r[op.rt];
                     break;
                 }
-                case Funct::ADD:
-                    sr[op.rd] = sr[op.rs] + sr[op.rt];
+                case Funct::ADD: {
+                    uint32_t sum;
+                    if (!addSigned(r[op.rs], r[op.rt], sum))
+                        return fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+                    r[op.rd] = sum;
                     break;
+                }
                 case Funct::ADDU:
                     r[op.rd] = r[op.rs] + r[op.rt];
                     break;
-                case Funct::SUB:
-                    sr[op.rd] = sr[op.rs] - sr[op.rt];
+                case Funct::SUB: {
+                    uint32_t diff;
+                    if (!subSigned(r[op.rs], r[op.rt], diff))
+                        return fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+                    r[op.rd] = diff;
                     break;
+                }
                 case Funct::SUBU:
                     r[op.rd] = r[op.rs] - r[op.rt];
                     break;
@@ -188,22 +353,25 @@ void R3000::step()
             switch (op.rt) {
                 case OP_REGIMM_BLTZAL:
                     r[31] = pc;
+                    // fall through
                 case OP_REGIMM_BLTZ:
-                    if (r[op.rs] < 0)
+                    if (sr[op.rs] < 0)
                         pc += (static_cast<int32_t>(op.simm) << 2) - 4;
                     break;
                 case OP_REGIMM_BGEZAL:
                     r[31] = pc;
+                    // fall through
                 case OP_REGIMM_BGEZ:
-                    if (r[op.rs] >= 0)
+                    if (sr[op.rs] >= 0)
                         pc += (static_cast<int32_t>(op.simm) << 2) - 4;
                     break;
                 default:
-                    throw InvalidOPException();
+                    return fault(DelayedException::InvalidOPException, NULL);
             }
             break;
         case Opcode::JAL:
             r[31] = pc;
+            // fall through
         case Opcode::J:
             pc = (pc & 0xf0000000) | (op.addr << 2);
             break;
@@ -216,16 +384,20 @@ void R3000::step()
                 pc += (static_cast<int32_t>(op.simm) << 2) - 4;
             break;
         case Opcode::BLEZ:
-            if (r[op.rs] <= 0)
+            if (sr[op.rs] <= 0)
                 pc += (static_cast<int32_t>(op.simm) << 2) - 4;
             break;
         case Opcode::BGTZ:
-            if (r[op.rs] > 0)
+            if (sr[op.rs] > 0)
                 pc += (static_cast<int32_t>(op.simm) << 2) - 4;
             break;
-        case Opcode::ADDI:
-            sr[op.rt] = sr[op.rs] + op.simm;
+        case Opcode::ADDI: {
+            uint32_t sum;
+            if (!addSigned(r[op.rs], static_cast<int32_t>(op.simm), sum))
+                return fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+            r[op.rt] = sum;
             break;
+        }
         case Opcode::ADDIU:
             r[op.rt] = r[op.rs] + op.simm;
             break;
@@ -233,7 +405,7 @@ void R3000::step()
             r[op.rt] = (sr[op.rs] < op.simm);
             break;
         case Opcode::SLTIU:
-            r[op.rt] = (r[op.rs] < op.imm);
+            r[op.rt] = (r[op.rs] < static_cast<uint32_t>(static_cast<int32_t>(op.simm)));
             break;
         case Opcode::ANDI:
             r[op.rt] = r[op.rs] & op.imm;
@@ -255,41 +427,22 @@ void R3000::step()
             // Delayed
             break;
         case Opcode::SB:
-            ram[op.simm+r[op.rs]] = static_cast<uint8_t>(r[op.rt]);
+            if (!storeByte(op.simm+r[op.rs], static_cast<uint8_t>(r[op.rt])))
+                return false;
             break;
         case Opcode::SH:
-            ram[op.simm+r[op.rs]] = static_cast<uint16_t>(r[op.rt]);
+            if (!storeHalfWord(op.simm+r[op.rs], static_cast<uint16_t>(r[op.rt])))
+                return false;
             break;
         case Opcode::SW:
-            ram[op.simm+r[op.rs]] = r[op.rt];
+            if (!storeWord(op.simm+r[op.rs], r[op.rt]))
+                return false;
             break;
     }
 
     // Perform delay load
-    switch (dlOpcode) {
-        case Opcode::LB:
-            sr[dlTarget] = static_cast<int8_t>(ram[dlAddr]);
-            dlOpcode = Opcode::SPECIAL;
-            break;
-        case Opcode::LH:
-            sr[dlTarget] = static_cast<int16_t>(ram[dlAddr]);
-            dlOpcode = Opcode::SPECIAL;
-            break;
-        case Opcode::LW:
-            r[dlTarget] = ram[dlAddr];
-            dlOpcode = Opcode::SPECIAL;
-            break;
-        case Opcode::LBU:
-            r[dlTarget] = static_cast<uint8_t>(ram[dlAddr]);
-            dlOpcode = Opcode::SPECIAL;
-            break;
-        case Opcode::LHU:
-            r[dlTarget] = static_cast<uint16_t>(ram[dlAddr]);
-            dlOpcode = Opcode::SPECIAL;
-            break;
-        default:
-            break;
-    }
+    if (dlOpcode != Opcode::SPECIAL && !performDelayedLoad())
+        return false;
 
     // Always clear zero register
     r[0] = 0;
@@ -308,15 +461,217 @@ void R3000::step()
         default:
             break;
     }
+
+    if (Instrumented)
+        instrument(fallthrough);
+    return true;
+}
+
+template bool R3000::cycle<false>();
+template bool R3000::cycle<true>();
+
+void R3000::runEngine(uint64_t limit)
+{
+    if (this->instrumented()) {
+        if (this->engine == ExecutionEngine::Switch) {
+            while (this->instructions < limit && this->cycle<true>())
+                ;
+        }
+        else {
+            this->runThreaded<true>(limit);
+        }
+        return;
+    }
+
+    switch (this->engine) {
+        case ExecutionEngine::Threaded:
+            this->runThreaded<false>(limit);
+            break;
+        case ExecutionEngine::Blocks:
+            this->runBlocks(false, limit);
+            break;
+        case ExecutionEngine::JIT:
+            this->runBlocks(JITCompiler::isSupported(), limit);
+            break;
+        default:
+            while (this->instructions < limit && this->cycle<false>())
+                ;
+    }
 }
 
 void R3000::run()
 {
-    try {
-        for (;/*_*/;)
-            this->step();
+    this->runEngine(UINT64_MAX);
+    if (this->dex != DelayedException::HaltException)
+        this->raiseDelayedException();
+}
+
+RunResult R3000::runFor(uint64_t maxInstructions)
+{
+    uint64_t limit = this->limitAfter(maxInstructions);
+    while (this->dex == DelayedException::None && this->instructions < limit) {
+        if (this->_interrupt.take())
+            return this->stopResult(StopReason::Interrupted);
+        this->runEngine(std::min(limit, this->instructions + SOLOMIPS_RUN_SLICE));
+    }
+    return this->stopResult(StopReason::InstructionLimit);
+}
+
+RunResult R3000::runUntil(const std::function<bool(const R3000 &)> &predicate, uint64_t maxInstructions)
+{
+    uint64_t limit = this->limitAfter(maxInstructions);
+    uint64_t check = this->instructions;
+    while (this->dex == DelayedException::None && this->instructions < limit) {
+        if (this->instructions >= check) {
+            if (this->_interrupt.take())
+                return this->stopResult(StopReason::Interrupted);
+            check = this->instructions + SOLOMIPS_RUN_SLICE;
+        }
+        if (predicate(*this))
+            return this->stopResult(StopReason::Condition);
+        this->cycle();
+    }
+    return this->stopResult(StopReason::InstructionLimit);
+}
+
+void R3000::interrupt()
+{
+    this->_interrupt.set();
+}
+
+void R3000::trackWrites(bool enable)
+{
+    this->_trackWrites = enable;
+    this->_writtenPages.clear();
+    // Cached pages must be seen again
+    this->flushTLB();
+}
+
+std::set<uint32_t> R3000::takeWrittenPages()
+{
+    std::set<uint32_t> pages;
+    pages.swap(this->_writtenPages);
+    this->flushTLB();
+    return pages;
+}
+
+uint64_t R3000::limitAfter(uint64_t maxInstructions) const
+{
+    uint64_t limit = this->instructions + maxInstructions;
+    return (limit < this->instructions) ? UINT64_MAX : limit;
+}
+
+// Describe why execution stopped; reason is used if there is no fault
+RunResult R3000::stopResult(StopReason reason)
+{
+    RunResult result;
+    result.address = this->pc - 8;
+    switch (this->dex) {
+        case DelayedException::None:
+            result.reason = reason;
+            result.address = this->pc - 4;
+            break;
+        case DelayedException::HaltException:
+            result.reason = StopReason::Halted;
+            result.address = this->pc;
+            break;
+        case DelayedException::MisalignedPCException:
+            result.reason = StopReason::MisalignedPC;
+            result.message = MisalignedPCException().what();
+            break;
+        case DelayedException::InvalidOPException:
+            result.reason = StopReason::InvalidInstruction;
+            break;
+        case DelayedException::MemoryException:
+            result.reason = StopReason::MemoryFault;
+            result.message = this->dexWhat;
+            break;
+        case DelayedException::ArithmeticException:
+            result.reason = StopReason::ArithmeticFault;
+            result.message = this->dexWhat;
+            break;
+        case DelayedException::ForeignException:
+            // Only mapper exceptions ever have to be thrown again
+            try {
+                std::rethrow_exception(this->dexException);
+            }
+            catch (std::ios_base::failure &e) {
+                result.reason = StopReason::IOError;
+                result.message = e.what();
+            }
+            catch (std::exception &e) {
+                result.reason = StopReason::Error;
+                result.message = e.what();
+            }
+            catch (...) {
+                result.reason = StopReason::Error;
+            }
+            break;
+    }
+    return result;
+}
+
+void R3000::raiseDelayedException() const
+{
+    switch (this->dex) {
+        case DelayedException::None:
+            break;
+        case DelayedException::MisalignedPCException:
+            throw MisalignedPCException();
+        case DelayedException::HaltException:
+            throw HaltException();
+        case DelayedException::InvalidOPException:
+            throw InvalidOPException();
+        case DelayedException::MemoryException:
+            throw MemoryException(this->dexWhat);
+        case DelayedException::ArithmeticException:
+            throw ArithmeticException(this->dexWhat);
+        case DelayedException::ForeignException:
+            std::rethrow_exception(this->dexException);
     }
-    catch (HaltException &) {
-        // pass
+}
+
+bool R3000::performDelayedLoad()
+{
+    switch (this->dlOpcode) {
+        case Opcode::LB: {
+            uint8_t v;
+            if (!this->loadByte(this->dlAddr, v))
+                return false;
+            this->sr[this->dlTarget] = static_cast<int8_t>(v);
+            break;
+        }
+        case Opcode::LH: {
+            uint16_t v;
+            if (!this->loadHalfWord(this->dlAddr, v))
+                return false;
+            this->sr[this->dlTarget] = static_cast<int16_t>(v);
+            break;
+        }
+        case Opcode::LW: {
+            uint32_t v;
+            if (!this->loadWord(this->dlAddr, v))
+                return false;
+            this->r[this->dlTarget] = v;
+            break;
+        }
+        case Opcode::LBU: {
+            uint8_t v;
+            if (!this->loadByte(this->dlAddr, v))
+                return false;
+            this->r[this->dlTarget] = v;
+            break;
+        }
+        case Opcode::LHU: {
+            uint16_t v;
+            if (!this->loadHalfWord(this->dlAddr, v))
+                return false;
+            this->r[this->dlTarget] = v;
+            break;
+        }
+        default:
+            break;
     }
+    this->dlOpcode = Opcode::SPECIAL;
+    return true;
 }
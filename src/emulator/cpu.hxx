@@ -24,9 +24,18 @@
 
 #include "op.hxx"
 #include "ram.hxx"
+#include "blocks.hxx"
+#include "jit.hxx"
+#include "stats.hxx"
+#include "profiler.hxx"
+#include "trace.hxx"
 
+#include <atomic>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <set>
+#include <string>
 
 /*
 This emulates a R2000 processor on a high level. It is partially optimized for
@@ -36,12 +45,42 @@ The internal state is publicly exposed and can be manipulated (with obvious
 consequences).
 
 Attempting to execute address 0 will halt the processor (throw a HaltException).
+
+Internally, no exceptions are thrown while executing: faults are recorded in
+`dex` just like the delayed exceptions of the fetch stage, the cycle is
+abandoned at that point, and the engines stop before starting the next one.
+`step()` and `run()` turn them into exceptions afterwards, whereas
+`runFor()` and `runUntil()` report them as a RunResult. Memory faults are detected
+up front through `RAM::checkAccess()`; only exceptions thrown by other mappers
+(e.g. I/O errors) are caught, on the slow path, and kept for later.
+
+The bounded entry points count executed instructions and stop exactly at the
+given budget, so that many guests can take turns on one thread; as the state
+is always consistent between instructions, stopping and resuming (even with
+another engine) does not change the outcome. `interrupt()` may be called from
+any thread to stop them early; it is only checked every SOLOMIPS_RUN_SLICE
+instructions so that the engines need not check for it.
+
+Loads and stores go through a small direct-mapped TLB which caches the host
+memory of recently accessed pages served by an ArrayRAMMapper. It is flushed
+whenever the set of RAM mappers changes; the mapper flags are checked on every
+access. Everything else (I/O, faults, accesses crossing a page) takes the slow
+path through RAM.
 */
 
+// Instructions run between two checks for an interrupt request
+#define SOLOMIPS_RUN_SLICE 0x10000u
+
+#define SOLOMIPS_TLB_BITS 6
+#define SOLOMIPS_TLB_SIZE (1u << SOLOMIPS_TLB_BITS)
+
 namespace SoloMIPS {
 
 struct HaltException : public std::exception {};
-struct MisalignedPCException : public std::exception {};
+struct MisalignedPCException : public std::exception
+{
+    const char *what() const noexcept { return "misaligned program counter"; }
+};
 
 struct ArithmeticException : public std::exception
 {
@@ -50,13 +89,63 @@ struct ArithmeticException : public std::exception
     const char *_msg;
 };
 
+enum class ExecutionEngine : unsigned int
+{
+    Switch = 0,
+    Threaded,
+    Blocks,
+    JIT
+};
+
 enum class DelayedException : unsigned int
 {
     None = 0,
     MisalignedPCException,
     HaltException,
     InvalidOPException,
-    MemoryException
+    MemoryException,
+    ArithmeticException,
+    ForeignException        // thrown by a mapper, see `R3000::dexException`
+};
+
+enum class StopReason : unsigned int
+{
+    Halted = 0,
+    InstructionLimit,
+    Interrupted,
+    Condition,
+    MisalignedPC,
+    InvalidInstruction,
+    MemoryFault,
+    ArithmeticFault,
+    IOError,
+    Error
+};
+
+// Request flag which may be set from any thread; copies start out cleared
+class InterruptFlag
+{
+public:
+    InterruptFlag() : _flag(false) {}
+    InterruptFlag(const InterruptFlag &) : _flag(false) {}
+    InterruptFlag &operator=(const InterruptFlag &) { return *this; }
+
+    void set() { this->_flag.store(true, std::memory_order_relaxed); }
+    bool isSet() const { return this->_flag.load(std::memory_order_relaxed); }
+    // Return whether the flag was set and clear it
+    bool take() { return this->isSet() && this->_flag.exchange(false, std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> _flag;
+};
+
+struct RunResult
+{
+    StopReason reason;
+    // For faults, the address reported by solomips-emu (pc - 8); otherwise
+    // the address of the next instruction
+    uint32_t address;
+    std::string message;
 };
 
 class R3000
@@ -74,15 +163,62 @@ public:
      * Perform one CPU cycle.
      * 
      * Throw delayed exceptions, perform delayed loading, copy nextOp to op,
-     * load next instruction from pc, increment pc, execute op.
+     * load next instruction from pc, increment pc, execute op. Faults of the
+     * cycle are thrown as well and stay pending.
      */
     void step();
 
     /**
-     * Repeatedly calls `step()` until a HaltException is thrown.
+     * Run until the processor halts, using the selected engine; faults are
+     * thrown as exceptions.
+     *
+     * The switch engine repeats the cycle of `step()`; the threaded engine
+     * dispatches through a table of handlers instead (see threaded.cxx) and
+     * the block engine runs translated basic blocks (see blocks.cxx) and the
+     * JIT engine additionally compiles hot blocks to native code (see jit.cxx,
+     * falls back to the block engine on unsupported hosts). All
+     * have the same architectural semantics, except that stores into the
+     * running block only take effect with the next block in the latter.
      */
     void run();
 
+    /**
+     * Run until the processor halts or faults, maxInstructions have been
+     * executed or an interrupt is requested, using the selected engine.
+     * Never throws; a pending fault is reported again by every further call.
+     * Execution can be resumed after InstructionLimit and Interrupted, with
+     * any engine, as if it had never stopped.
+     */
+    RunResult runFor(uint64_t maxInstructions);
+
+    /**
+     * Like `runFor()`, but also stop with Condition as soon as the predicate
+     * holds before an instruction. Since the predicate is evaluated for every
+     * instruction, this always runs the switch engine.
+     */
+    RunResult runUntil(const std::function<bool(const R3000 &)> &predicate, uint64_t maxInstructions = UINT64_MAX);
+
+    /**
+     * Ask a running (or the next) `runFor()` or `runUntil()` to return
+     * Interrupted. Safe to call from any thread.
+     */
+    void interrupt();
+
+    /**
+     * Start or stop keeping track of the pages stores may have hit; see
+     * `takeWrittenPages()`.
+     */
+    void trackWrites(bool enable);
+
+    /**
+     * Return the addresses of the pages written to since tracking started or
+     * the last call. Pages cached for fast stores count as written as soon
+     * as they are cached, so some may not actually have been.
+     */
+    std::set<uint32_t> takeWrittenPages();
+
+    ExecutionEngine engine;
+
     union {
         uint32_t r[32];
         int32_t sr[32];
@@ -104,8 +240,234 @@ public:
 
     DelayedException dex;
     const char *dexWhat;
+    std::exception_ptr dexException;
+
+    // Executed instructions since reset, including one that faulted
+    uint64_t instructions;
+
+    // Counters to update, or NULL; only the switch and threaded engines
+    // count, so the others fall back to the latter while this is set
+    Statistics *statistics;
+    // Profiler to sample into, or NULL; like statistics
+    Profiler *profiler;
+    // Tracer to record every completed instruction with, or NULL; like
+    // statistics
+    Tracer *tracer;
+
+private:
+    friend class JITCompiler;
+    friend class Snapshot;
+
+    // Forget everything cached about the RAM and the code within
+    void dropCaches();
+
+    // Run the selected engine until dex is set or the instruction counter
+    // reaches limit
+    void runEngine(uint64_t limit);
+    uint64_t limitAfter(uint64_t maxInstructions) const;
+    RunResult stopResult(StopReason reason);
+    // Perform one cycle of `step()`; return false without throwing if a
+    // delayed exception is pending or the cycle faulted
+    template <bool Instrumented> bool cycle();
+    bool cycle();
+    bool instrumented() const;
+    // Account the completed instruction with statistics, profiler and tracer
+    void instrument(uint32_t fallthrough);
+    template <bool Instrumented> void runThreaded(uint64_t limit);
+    void runBlocks(bool jit, uint64_t limit);
+    TranslatedBlock *translateBlock(uint32_t addr);
+    bool interpretFrom(uint32_t addr, uint64_t limit);
+    bool interpretToBoundary(uint64_t limit);
+    void restoreBlockState(const TranslatedBlock *block, size_t i, uint32_t next, bool taken);
+    void raiseDelayedException() const;
+    bool performDelayedLoad();
+
+    // Record a fault of the current cycle; always returns false
+    bool fault(DelayedException dex, const char *what);
+
+    // All of these return false after recording a fault
+    bool loadByte(uint32_t addr, uint8_t &value);
+    bool loadHalfWord(uint32_t addr, uint16_t &value);
+    bool loadWord(uint32_t addr, uint32_t &value);
+    bool storeByte(uint32_t addr, uint8_t value);
+    bool storeHalfWord(uint32_t addr, uint16_t value);
+    bool storeWord(uint32_t addr, uint32_t value);
+    bool loadSlow(uint32_t addr, uint32_t size, uint32_t &value);
+    bool storeSlow(uint32_t addr, uint32_t size, uint32_t value);
+
+    // Return host memory for `size` bytes at addr, or NULL to take the slow path
+    uint8_t *translate(uint32_t addr, uint32_t size, bool write);
+    uint8_t *translateSlow(uint32_t addr, uint32_t size, bool write);
+    void flushTLB();
+
+    // Return the decoded instruction at addr, or NULL if it is invalid or
+    // cannot be fetched from a pre-decoding mapper; others may throw
+    const OP *fetch(uint32_t addr);
+    const OP *fetchSlow(uint32_t addr);
+    void fetchNext();
+    void fetchNextSlow();
+
+    // Window of addresses served by a pre-decoding mapper
+    ArrayRAMMapper *_fetchMapper;
+    uint32_t _fetchFirst;
+    uint32_t _fetchLast;
+    uint32_t _fetchGeneration;
+    OP _fetchOp;
+
+    // Address nextOp was fetched from; pc does not tell it for delay slots,
+    // so it is only kept track of by instrumented runs
+    uint32_t _nextOpAddr;
+
+    struct TLBEntry
+    {
+        uint32_t page;          // guest page number, or ~0 if unused
+        ArrayRAMMapper *mapper;
+        uint8_t *host;          // backing memory of the page
+    };
+    TLBEntry _tlb[SOLOMIPS_TLB_SIZE];
+    uint32_t _tlbGeneration;
+
+    bool _trackWrites;
+    std::set<uint32_t> _writtenPages;
+
+    BlockCache _blocks;
+
+    // Helpers called from generated code; they return 1 on fault
+    static uint32_t jitLoad(R3000 *cpu, const MicroOP *u);
+    static uint32_t jitExecute(R3000 *cpu, const MicroOP *u);
+    static uint32_t jitCommit(R3000 *cpu, const MicroOP *u);
+
+    JITCompiler _jit;
+
+    InterruptFlag _interrupt;
 };
 
+inline uint8_t *R3000::translate(uint32_t addr, uint32_t size, bool write)
+{
+    const TLBEntry &e = this->_tlb[(addr >> SOLOMIPS_RAM_PAGE_BITS) & (SOLOMIPS_TLB_SIZE - 1)];
+    if (e.page == (addr >> SOLOMIPS_RAM_PAGE_BITS) && this->_tlbGeneration == this->ram.generation()
+            && (addr & SOLOMIPS_RAM_PAGE_MASK) <= SOLOMIPS_RAM_PAGE_MASK + 1 - size
+            && (write ? (e.mapper->isWriteable() && !e.mapper->hasDecodedInstructions()) : e.mapper->isReadable()))
+        return e.host + (addr & SOLOMIPS_RAM_PAGE_MASK);
+    return this->translateSlow(addr, size, write);
+}
+
+inline bool R3000::loadByte(uint32_t addr, uint8_t &value)
+{
+    const uint8_t *h = this->translate(addr, 1, false);
+    if (h == NULL) {
+        uint32_t v;
+        if (!this->loadSlow(addr, 1, v))
+            return false;
+        value = static_cast<uint8_t>(v);
+        return true;
+    }
+    value = h[0];
+    return true;
+}
+
+inline bool R3000::loadHalfWord(uint32_t addr, uint16_t &value)
+{
+    const uint8_t *h = this->translate(addr, 2, false);
+    if (h == NULL) {
+        uint32_t v;
+        if (!this->loadSlow(addr, 2, v))
+            return false;
+        value = static_cast<uint16_t>(v);
+        return true;
+    }
+    value = static_cast<uint16_t>((h[0] << 8) | h[1]);
+    return true;
+}
+
+inline bool R3000::loadWord(uint32_t addr, uint32_t &value)
+{
+    const uint8_t *h = this->translate(addr, 4, false);
+    if (h == NULL)
+        return this->loadSlow(addr, 4, value);
+    value = (static_cast<uint32_t>(h[0]) << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+    return true;
+}
+
+inline bool R3000::storeByte(uint32_t addr, uint8_t value)
+{
+    uint8_t *h = this->translate(addr, 1, true);
+    if (h == NULL)
+        return this->storeSlow(addr, 1, value);
+    h[0] = value;
+    return true;
+}
+
+inline bool R3000::storeHalfWord(uint32_t addr, uint16_t value)
+{
+    uint8_t *h = this->translate(addr, 2, true);
+    if (h == NULL)
+        return this->storeSlow(addr, 2, value);
+    h[0] = value >> 8;
+    h[1] = value & 0xff;
+    return true;
+}
+
+inline bool R3000::storeWord(uint32_t addr, uint32_t value)
+{
+    uint8_t *h = this->translate(addr, 4, true);
+    if (h == NULL)
+        return this->storeSlow(addr, 4, value);
+    h[0] = value >> 24;
+    h[1] = (value >> 16) & 0xff;
+    h[2] = (value >> 8) & 0xff;
+    h[3] = value & 0xff;
+    return true;
+}
+
+inline bool R3000::fault(DelayedException dex, const char *what)
+{
+    this->dex = dex;
+    this->dexWhat = what;
+    return false;
+}
+
+inline const OP *R3000::fetch(uint32_t addr)
+{
+    if (addr >= this->_fetchFirst && addr <= this->_fetchLast && this->_fetchGeneration == this->ram.generation())
+        return this->_fetchMapper->findInstruction(addr);
+    return this->fetchSlow(addr);
+}
+
+inline void R3000::fetchNext()
+{
+    // Anything unusual, including faults, is left to the slow path
+    uint32_t pc = this->pc;
+    if ((pc & 0x03) == 0 && pc != 0 && pc >= this->_fetchFirst && pc <= this->_fetchLast
+            && this->_fetchGeneration == this->ram.generation()) {
+        const OP *op = this->_fetchMapper->findInstruction(pc);
+        if (op != NULL) {
+            this->nextOp = *op;
+            this->pc = pc + 4;
+            return;
+        }
+    }
+    this->fetchNextSlow();
+}
+
+inline bool R3000::instrumented() const
+{
+    return this->statistics != NULL || this->profiler != NULL || this->tracer != NULL;
+}
+
+inline void R3000::instrument(uint32_t fallthrough)
+{
+    uint32_t addr = this->_nextOpAddr;
+    this->_nextOpAddr = fallthrough - 4;
+    bool taken = (this->pc != fallthrough);
+    if (this->statistics != NULL)
+        this->statistics->count(this->op, taken);
+    if (this->profiler != NULL)
+        this->profiler->count(this->op, addr, this->pc, taken, this->r);
+    if (this->tracer != NULL)
+        this->tracer->record(*this, addr);
+}
+
 }
 
 #endif /* HEADER_SOLOMIPS_CPU_HXX */
@@ -0,0 +1,95 @@
+/*
+ *  handlers.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "handlers.hxx"
+
+using namespace SoloMIPS;
+
+const HandlerTable SoloMIPS::handlerTable;
+
+HandlerTable::HandlerTable()
+{
+    for (uint8_t &h : this->handlers)
+        h = H_INVALID;
+
+#define F(name) this->handlers[64 + static_cast<unsigned int>(Funct::name)] = H_##name;
+#define O(name) this->handlers[static_cast<unsigned int>(Opcode::name)] = H_##name;
+    F(SLL) F(SRL) F(SRA) F(SLLV) F(SRLV) F(SRAV) F(JR) F(JALR) F(SYSCALL)
+    F(MFHI) F(MTHI) F(MFLO) F(MTLO) F(MULT) F(MULTU) F(DIV) F(DIVU)
+    F(ADD) F(ADDU) F(SUB) F(SUBU) F(AND) F(OR) F(XOR) F(NOR) F(SLT) F(SLTU)
+    O(REGIMM) O(J) O(JAL) O(BEQ) O(BNE) O(BLEZ) O(BGTZ)
+    O(ADDI) O(ADDIU) O(SLTI) O(SLTIU) O(ANDI) O(ORI) O(XORI) O(LUI)
+    O(LB) O(LH) O(LW) O(LBU) O(LHU) O(SB) O(SH) O(SW)
+#undef O
+#undef F
+}
+
+Handler SoloMIPS::resolveHandler(const OP &op)
+{
+    Handler h = static_cast<Handler>(handlerTable.handlers[handlerIndex(op)]);
+    if (h != H_REGIMM)
+        return h;
+
+    switch (op.rt) {
+        case OP_REGIMM_BLTZ:
+            return H_BLTZ;
+        case OP_REGIMM_BGEZ:
+            return H_BGEZ;
+        case OP_REGIMM_BLTZAL:
+            return H_BLTZAL;
+        case OP_REGIMM_BGEZAL:
+            return H_BGEZAL;
+        default:
+            return H_INVALID;
+    }
+}
+
+bool SoloMIPS::isControlTransfer(const OP &op)
+{
+    switch (op.opcode) {
+        case Opcode::SPECIAL:
+            return (op.funct == Funct::JR || op.funct == Funct::JALR);
+        case Opcode::REGIMM:
+        case Opcode::J:
+        case Opcode::JAL:
+        case Opcode::BEQ:
+        case Opcode::BNE:
+        case Opcode::BLEZ:
+        case Opcode::BGTZ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool SoloMIPS::isLoad(const OP &op)
+{
+    switch (op.opcode) {
+        case Opcode::LB:
+        case Opcode::LH:
+        case Opcode::LW:
+        case Opcode::LBU:
+        case Opcode::LHU:
+            return true;
+        default:
+            return false;
+    }
+}
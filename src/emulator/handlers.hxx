@@ -0,0 +1,106 @@
+/*
+ *  handlers.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_HANDLERS_HXX
+#define HEADER_SOLOMIPS_HANDLERS_HXX
+
+#include <cstdint>
+
+#include "op.hxx"
+
+/*
+Flat numbering of instruction handlers shared by the execution engines. The
+threaded engine dispatches through `handlerTable` (REGIMM is a single handler
+there), while translated blocks resolve REGIMM branches up front through
+`resolveHandler()`.
+*/
+
+#define SOLOMIPS_HANDLERS(X) \
+    X(INVALID) \
+    X(SLL) X(SRL) X(SRA) X(SLLV) X(SRLV) X(SRAV) X(JR) X(JALR) X(SYSCALL) \
+    X(MFHI) X(MTHI) X(MFLO) X(MTLO) X(MULT) X(MULTU) X(DIV) X(DIVU) \
+    X(ADD) X(ADDU) X(SUB) X(SUBU) X(AND) X(OR) X(XOR) X(NOR) X(SLT) X(SLTU) \
+    X(REGIMM) X(J) X(JAL) X(BEQ) X(BNE) X(BLEZ) X(BGTZ) \
+    X(ADDI) X(ADDIU) X(SLTI) X(SLTIU) X(ANDI) X(ORI) X(XORI) X(LUI) \
+    X(LB) X(LH) X(LW) X(LBU) X(LHU) X(SB) X(SH) X(SW) \
+    X(BLTZ) X(BGEZ) X(BLTZAL) X(BGEZAL)
+
+namespace SoloMIPS {
+
+enum Handler : uint8_t
+{
+#define SOLOMIPS_HANDLER_ENUM(name) H_##name,
+    SOLOMIPS_HANDLERS(SOLOMIPS_HANDLER_ENUM)
+#undef SOLOMIPS_HANDLER_ENUM
+};
+
+struct HandlerTable
+{
+    HandlerTable();
+
+    // Indexed by opcode, or 64 + funct for SPECIAL
+    uint8_t handlers[128];
+};
+
+extern const HandlerTable handlerTable;
+
+inline unsigned int handlerIndex(const OP &op)
+{
+    unsigned int opcode = static_cast<unsigned int>(op.opcode);
+    return (opcode == 0) ? 64 + static_cast<unsigned int>(op.funct) : opcode;
+}
+
+Handler resolveHandler(const OP &op);
+
+bool isControlTransfer(const OP &op);
+
+bool isLoad(const OP &op);
+
+// Signed addition and subtraction of add, addi and sub; false on overflow,
+// which traps without writing the result
+inline bool addSigned(uint32_t a, uint32_t b, uint32_t &result)
+{
+    result = a + b;
+    return !(~(a ^ b) & (a ^ result) & 0x80000000u);
+}
+
+inline bool subSigned(uint32_t a, uint32_t b, uint32_t &result)
+{
+    result = a - b;
+    return !((a ^ b) & (a ^ result) & 0x80000000u);
+}
+
+// Signed division of div for a non-zero divisor; the quotient of INT32_MIN and
+// -1 wraps around instead of trapping on the host
+inline void divSigned(int32_t a, int32_t b, uint32_t &quotient, uint32_t &remainder)
+{
+    if (b == -1) {
+        quotient = 0u - static_cast<uint32_t>(a);
+        remainder = 0;
+        return;
+    }
+    quotient = static_cast<uint32_t>(a / b);
+    remainder = static_cast<uint32_t>(a % b);
+}
+
+}
+
+#endif /* HEADER_SOLOMIPS_HANDLERS_HXX */
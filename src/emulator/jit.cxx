@@ -0,0 +1,491 @@
+/*
+ *  jit.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "cpu.hxx"
+#include "jit.hxx"
+#include "handlers.hxx"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define SOLOMIPS_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+using namespace SoloMIPS;
+
+// Helpers called from generated code; faults are recorded like in
+// `R3000::cycle()` and reported by returning 1.
+
+uint32_t R3000::jitLoad(R3000 *cpu, const MicroOP *u)
+{
+    if (cpu->dlOpcode != Opcode::SPECIAL && !cpu->performDelayedLoad())
+        return 1;
+    cpu->r[0] = 0;
+    switch (u->handler) {
+        case H_LB:  cpu->dlOpcode = Opcode::LB; break;
+        case H_LH:  cpu->dlOpcode = Opcode::LH; break;
+        case H_LW:  cpu->dlOpcode = Opcode::LW; break;
+        case H_LBU: cpu->dlOpcode = Opcode::LBU; break;
+        case H_LHU: cpu->dlOpcode = Opcode::LHU; break;
+    }
+    cpu->dlTarget = u->rt;
+    cpu->dlAddr = u->imm+cpu->r[u->rs];
+    return 0;
+}
+
+uint32_t R3000::jitExecute(R3000 *cpu, const MicroOP *u)
+{
+    uint32_t *r = cpu->r;
+    int32_t *sr = cpu->sr;
+    uint32_t result;
+    switch (u->handler) {
+        case H_ADD:
+            if (!addSigned(r[u->rs], r[u->rt], result))
+                return !cpu->fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+            r[u->rd] = result;
+            return 0;
+        case H_SUB:
+            if (!subSigned(r[u->rs], r[u->rt], result))
+                return !cpu->fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+            r[u->rd] = result;
+            return 0;
+        case H_ADDI:
+            if (!addSigned(r[u->rs], u->imm, result))
+                return !cpu->fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+            r[u->rt] = result;
+            return 0;
+        case H_DIV:
+            if (sr[u->rt] == 0)
+                return !cpu->fault(DelayedException::ArithmeticException, "Divided by zero");
+            divSigned(sr[u->rs], sr[u->rt], cpu->lo, cpu->hi);
+            return 0;
+        case H_DIVU:
+            if (sr[u->rt] == 0)
+                return !cpu->fault(DelayedException::ArithmeticException, "Divided by zero");
+            cpu->hi = r[u->rs] % r[u->rt];
+            cpu->lo = r[u->rs] / r[u->rt];
+            return 0;
+        case H_SB:
+            return !cpu->storeByte(u->imm+r[u->rs], static_cast<uint8_t>(r[u->rt]));
+        case H_SH:
+            return !cpu->storeHalfWord(u->imm+r[u->rs], static_cast<uint16_t>(r[u->rt]));
+        case H_SW:
+            return !cpu->storeWord(u->imm+r[u->rs], r[u->rt]);
+        default:
+            return !cpu->fault(DelayedException::InvalidOPException, NULL);
+    }
+}
+
+uint32_t R3000::jitCommit(R3000 *cpu, const MicroOP *u)
+{
+    (void)u;
+    return !cpu->performDelayedLoad();
+}
+
+
+#ifdef SOLOMIPS_JIT_X86_64
+
+namespace {
+
+// Minimal x86-64 emitter; rbx holds the R3000 pointer, r12d the next guest
+// address and r13 the "taken" bit (1 << 32).
+class Emitter
+{
+public:
+    void b(uint8_t v) { this->code.push_back(v); }
+    void d(uint32_t v) { for (int i = 0; i < 4; ++i) this->b((v >> (i*8)) & 0xff); }
+    void q(uint64_t v) { for (int i = 0; i < 8; ++i) this->b((v >> (i*8)) & 0xff); }
+
+    void patch(size_t at, uint32_t v) { for (int i = 0; i < 4; ++i) this->code[at+i] = (v >> (i*8)) & 0xff; }
+
+    // mov reg32, [rbx+disp32] (eax = 0, ecx = 1, edx = 2)
+    void load(uint8_t reg, uint32_t disp) { this->b(0x8b); this->b(0x83 | (reg << 3)); this->d(disp); }
+    // mov [rbx+disp32], reg32
+    void store(uint32_t disp, uint8_t reg) { this->b(0x89); this->b(0x83 | (reg << 3)); this->d(disp); }
+    // mov dword [rbx+disp32], imm32
+    void storeImm(uint32_t disp, uint32_t imm) { this->b(0xc7); this->b(0x83); this->d(disp); this->d(imm); }
+    // op eax, ecx
+    void aluReg(uint8_t opcode) { this->b(opcode); this->b(0xc8); }
+    // op eax, imm32
+    void aluImm(uint8_t opcode, uint32_t imm) { this->b(opcode); this->d(imm); }
+    // shl/shr/sar eax, imm8 (ext = 4, 5, 7)
+    void shiftImm(uint8_t ext, uint8_t imm) { this->b(0xc1); this->b(0xc0 | (ext << 3)); this->b(imm); }
+    // shl/shr/sar eax, cl
+    void shiftCl(uint8_t ext) { this->b(0xd3); this->b(0xc0 | (ext << 3)); }
+    // setcc al; movzx eax, al
+    void setcc(uint8_t cc) { this->b(0x0f); this->b(0x90 | cc); this->b(0xc0); this->b(0x0f); this->b(0xb6); this->b(0xc0); }
+    // jcc rel32; returns the position to patch
+    size_t jcc(uint8_t cc) { this->b(0x0f); this->b(0x80 | cc); this->d(0); return this->code.size() - 4; }
+    void bind(size_t at) { this->patch(at, static_cast<uint32_t>(this->code.size() - (at + 4))); }
+
+    void setNext(uint32_t addr)
+    {
+        this->b(0x41); this->b(0xbc); this->d(addr);            // mov r12d, imm32
+        this->b(0x49); this->b(0xbd); this->q(1ull << 32);      // mov r13, 1 << 32
+    }
+
+    void setNextFrom(uint32_t disp)
+    {
+        this->b(0x44); this->b(0x8b); this->b(0xa3); this->d(disp);   // mov r12d, [rbx+disp32]
+        this->b(0x49); this->b(0xbd); this->q(1ull << 32);            // mov r13, 1 << 32
+    }
+
+    // Call helper(cpu, u); returns the position of the jump to patch on fault
+    size_t call(const void *helper, const MicroOP *u)
+    {
+        this->b(0x48); this->b(0x89); this->b(0xdf);                                  // mov rdi, rbx
+        this->b(0x48); this->b(0xbe); this->q(reinterpret_cast<uint64_t>(u));        // mov rsi, imm64
+        this->b(0x48); this->b(0xb8); this->q(reinterpret_cast<uint64_t>(helper));   // mov rax, imm64
+        this->b(0xff); this->b(0xd0);                                                 // call rax
+        this->b(0x85); this->b(0xc0);                                                 // test eax, eax
+        return this->jcc(0x5);                                                        // jnz
+    }
+
+    void result()
+    {
+        this->b(0x44); this->b(0x89); this->b(0xe0);    // mov eax, r12d
+        this->b(0x4c); this->b(0x09); this->b(0xe8);    // or rax, r13
+    }
+
+    std::vector<uint8_t> code;
+};
+
+enum : uint8_t
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+
+    ADD = 0x01,
+    OR = 0x09,
+    AND = 0x21,
+    SUB = 0x29,
+    XOR = 0x31,
+    CMP = 0x39,
+
+    ADD_IMM = 0x05,
+    OR_IMM = 0x0d,
+    AND_IMM = 0x25,
+    XOR_IMM = 0x35,
+    CMP_IMM = 0x3d,
+
+    SHL = 4,
+    SHR = 5,
+    SAR = 7,
+
+    CC_NO = 0x1,
+    CC_B = 0x2,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_S = 0x8,
+    CC_NS = 0x9,
+    CC_L = 0xc,
+    CC_LE = 0xe,
+    CC_G = 0xf
+};
+
+}
+
+#endif
+
+JITCompiler::JITCompiler() : _buffer(NULL), _used(0) {}
+
+JITCompiler::JITCompiler(const JITCompiler &other) : _buffer(NULL), _used(0)
+{
+    (void)other;
+}
+
+JITCompiler &JITCompiler::operator=(const JITCompiler &other)
+{
+    (void)other;
+    this->reset();
+    return *this;
+}
+
+JITCompiler::~JITCompiler()
+{
+#ifdef SOLOMIPS_JIT_X86_64
+    if (this->_buffer != NULL)
+        munmap(this->_buffer, SOLOMIPS_JIT_BUFFER_SIZE);
+#endif
+}
+
+bool JITCompiler::isSupported()
+{
+#ifdef SOLOMIPS_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JITCompiler::reset()
+{
+    this->_used = 0;
+}
+
+NativeCode JITCompiler::compile(const TranslatedBlock &block, R3000 *cpu)
+{
+#ifdef SOLOMIPS_JIT_X86_64
+    if (this->_buffer == NULL) {
+        void *p = mmap(NULL, SOLOMIPS_JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        this->_buffer = static_cast<uint8_t *>(p);
+        this->_used = 0;
+    }
+
+    // Displacements relative to the pinned R3000 object
+    const char *base = reinterpret_cast<const char *>(cpu);
+    uint32_t R[32];
+    for (int i = 0; i < 32; ++i)
+        R[i] = static_cast<uint32_t>(reinterpret_cast<const char *>(&cpu->r[i]) - base);
+    uint32_t HI = static_cast<uint32_t>(reinterpret_cast<const char *>(&cpu->hi) - base);
+    uint32_t LO = static_cast<uint32_t>(reinterpret_cast<const char *>(&cpu->lo) - base);
+    uint32_t DL = static_cast<uint32_t>(reinterpret_cast<const char *>(&cpu->dlOpcode) - base);
+
+    Emitter e;
+    std::vector<std::pair<size_t, size_t>> faults;
+
+    // Prologue: push rbx; push r12; push r13; mov rbx, rdi; mov r12d, end; xor r13d, r13d
+    e.b(0x53); e.b(0x41); e.b(0x54); e.b(0x41); e.b(0x55);
+    e.b(0x48); e.b(0x89); e.b(0xfb);
+    e.b(0x41); e.b(0xbc); e.d(block.end);
+    e.b(0x45); e.b(0x31); e.b(0xed);
+
+    bool mayPend = true;
+    for (size_t i = 0; i < block.uops.size(); ++i) {
+        const MicroOP *u = &block.uops[i];
+        uint8_t dest = 32;
+        switch (u->handler) {
+            case H_SLL:
+            case H_SRL:
+            case H_SRA:
+                e.load(EAX, R[u->rt]);
+                e.shiftImm(u->handler == H_SLL ? SHL : (u->handler == H_SRL ? SHR : SAR), u->shamt);
+                e.store(R[u->rd], EAX);
+                dest = u->rd;
+                break;
+            case H_SLLV:
+            case H_SRLV:
+            case H_SRAV:
+                e.load(EAX, R[u->rt]);
+                e.load(ECX, R[u->rs]);
+                e.shiftCl(u->handler == H_SLLV ? SHL : (u->handler == H_SRLV ? SHR : SAR));
+                e.store(R[u->rd], EAX);
+                dest = u->rd;
+                break;
+            case H_JALR:
+                e.storeImm(R[u->rd], u->addr + 8);
+                e.setNextFrom(R[u->rs]);
+                dest = u->rd;
+                break;
+            case H_JR:
+                e.setNextFrom(R[u->rs]);
+                break;
+            case H_MFHI:
+            case H_MFLO:
+                e.load(EAX, u->handler == H_MFHI ? HI : LO);
+                e.store(R[u->rd], EAX);
+                dest = u->rd;
+                break;
+            case H_MTHI:
+            case H_MTLO:
+                e.load(EAX, R[u->rs]);
+                e.store(u->handler == H_MTHI ? HI : LO, EAX);
+                break;
+            case H_MULT:
+            case H_MULTU:
+                e.load(EAX, R[u->rs]);
+                e.load(ECX, R[u->rt]);
+                e.b(0xf7); e.b(u->handler == H_MULT ? 0xe9 : 0xe1);    // imul/mul ecx
+                e.store(LO, EAX);
+                e.store(HI, EDX);
+                break;
+            case H_ADD:
+            case H_ADDU:
+            case H_SUB:
+            case H_SUBU:
+            case H_AND:
+            case H_OR:
+            case H_XOR:
+            case H_NOR:
+                e.load(EAX, R[u->rs]);
+                e.load(ECX, R[u->rt]);
+                switch (u->handler) {
+                    case H_ADD:
+                    case H_ADDU: e.aluReg(ADD); break;
+                    case H_SUB:
+                    case H_SUBU: e.aluReg(SUB); break;
+                    case H_AND: e.aluReg(AND); break;
+                    case H_OR: e.aluReg(OR); break;
+                    case H_XOR: e.aluReg(XOR); break;
+                    default: e.aluReg(OR); e.b(0xf7); e.b(0xd0); break;    // not eax
+                }
+                if (u->handler == H_ADD || u->handler == H_SUB) {
+                    // The helper raises the overflow trap
+                    size_t ok = e.jcc(CC_NO);
+                    faults.push_back(std::make_pair(e.call(reinterpret_cast<const void *>(&R3000::jitExecute), u), i));
+                    e.bind(ok);
+                }
+                e.store(R[u->rd], EAX);
+                dest = u->rd;
+                break;
+            case H_SLT:
+            case H_SLTU:
+                e.load(EAX, R[u->rs]);
+                e.load(ECX, R[u->rt]);
+                e.aluReg(CMP);
+                e.setcc(u->handler == H_SLT ? CC_L : CC_B);
+                e.store(R[u->rd], EAX);
+                dest = u->rd;
+                break;
+            case H_ADDI:
+            case H_ADDIU:
+            case H_ANDI:
+            case H_ORI:
+            case H_XORI:
+                e.load(EAX, R[u->rs]);
+                switch (u->handler) {
+                    case H_ANDI: e.aluImm(AND_IMM, u->imm); break;
+                    case H_ORI: e.aluImm(OR_IMM, u->imm); break;
+                    case H_XORI: e.aluImm(XOR_IMM, u->imm); break;
+                    default: e.aluImm(ADD_IMM, u->imm); break;
+                }
+                if (u->handler == H_ADDI) {
+                    size_t ok = e.jcc(CC_NO);
+                    faults.push_back(std::make_pair(e.call(reinterpret_cast<const void *>(&R3000::jitExecute), u), i));
+                    e.bind(ok);
+                }
+                e.store(R[u->rt], EAX);
+                dest = u->rt;
+                break;
+            case H_SLTI:
+            case H_SLTIU:
+                e.load(EAX, R[u->rs]);
+                e.aluImm(CMP_IMM, u->imm);
+                e.setcc(u->handler == H_SLTI ? CC_L : CC_B);
+                e.store(R[u->rt], EAX);
+                dest = u->rt;
+                break;
+            case H_LUI:
+                e.storeImm(R[u->rt], u->imm);
+                dest = u->rt;
+                break;
+            case H_JAL:
+                e.storeImm(R[31], u->addr + 8);
+                e.setNext(u->imm);
+                break;
+            case H_J:
+                e.setNext(u->imm);
+                break;
+            case H_BEQ:
+            case H_BNE: {
+                e.load(EAX, R[u->rs]);
+                e.load(ECX, R[u->rt]);
+                e.aluReg(CMP);
+                size_t skip = e.jcc(u->handler == H_BEQ ? CC_NE : CC_E);
+                e.setNext(u->imm);
+                e.bind(skip);
+                break;
+            }
+            case H_BLEZ:
+            case H_BGTZ:
+            case H_BLTZAL:
+            case H_BLTZ:
+            case H_BGEZAL:
+            case H_BGEZ: {
+                // Signed comparisons against zero; the link is written first,
+                // as in the interpreter
+                uint8_t skipIf;
+                switch (u->handler) {
+                    case H_BLEZ: skipIf = CC_G; break;
+                    case H_BGTZ: skipIf = CC_LE; break;
+                    case H_BLTZAL:
+                    case H_BLTZ: skipIf = CC_NS; break;
+                    default: skipIf = CC_S; break;
+                }
+                if (u->handler == H_BLTZAL || u->handler == H_BGEZAL)
+                    e.storeImm(R[31], u->addr + 8);
+                e.load(EAX, R[u->rs]);
+                e.b(0x85); e.b(0xc0);    // test eax, eax
+                size_t skip = e.jcc(skipIf);
+                e.setNext(u->imm);
+                e.bind(skip);
+                break;
+            }
+            case H_LB:
+            case H_LH:
+            case H_LW:
+            case H_LBU:
+            case H_LHU:
+                faults.push_back(std::make_pair(e.call(reinterpret_cast<const void *>(&R3000::jitLoad), u), i));
+                mayPend = true;
+                continue;
+            default:
+                faults.push_back(std::make_pair(e.call(reinterpret_cast<const void *>(&R3000::jitExecute), u), i));
+                dest = 0;
+                break;
+        }
+
+        // Perform delay load
+        if (mayPend) {
+            e.b(0x83); e.b(0xbb); e.d(DL); e.b(0x00);     // cmp dword [rbx+DL], 0
+            size_t skip = e.jcc(CC_E);
+            faults.push_back(std::make_pair(e.call(reinterpret_cast<const void *>(&R3000::jitCommit), u), i));
+            e.bind(skip);
+            mayPend = false;
+            dest = 0;
+        }
+
+        // Always clear zero register
+        if (dest == 0)
+            e.storeImm(R[0], 0);
+    }
+
+    // Epilogue
+    e.result();
+    size_t epilogue = e.code.size();
+    e.b(0x41); e.b(0x5d); e.b(0x41); e.b(0x5c); e.b(0x5b); e.b(0xc3);
+
+    // Fault exits
+    for (auto &f : faults) {
+        e.bind(f.first);
+        e.result();
+        e.b(0x48); e.b(0xb9); e.q(static_cast<uint64_t>(f.second + 1) << 33);   // mov rcx, imm64
+        e.b(0x48); e.b(0x09); e.b(0xc8);                                         // or rax, rcx
+        e.b(0xe9); e.d(static_cast<uint32_t>(epilogue - (e.code.size() + 4)));  // jmp epilogue
+    }
+
+    if (this->_used + e.code.size() > SOLOMIPS_JIT_BUFFER_SIZE)
+        return NULL;
+    uint8_t *p = this->_buffer + this->_used;
+    std::memcpy(p, e.code.data(), e.code.size());
+    this->_used += (e.code.size() + 15) & ~static_cast<size_t>(15);
+    return reinterpret_cast<NativeCode>(p);
+#else
+    (void)block;
+    (void)cpu;
+    return NULL;
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ *  jit.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_JIT_HXX
+#define HEADER_SOLOMIPS_JIT_HXX
+
+#include <cstdint>
+#include <cstddef>
+
+#include "blocks.hxx"
+
+/*
+Dynamic recompiler for hot translated blocks (x86-64 only). The generated code
+works directly on the R3000 object, which is pinned in a host register, and
+calls back into C++ helpers for loads, stores and anything else that may
+fault. Helpers never throw; a fault is recorded in the CPU like everywhere else
+and reported through the return value, so that the block engine can restore
+the pipeline and stop.
+
+The native function returns the next guest address in the low 32 bits, bit 32
+is set if the terminating branch was taken, and the bits above hold the index
+of the faulting micro-op plus one (zero if the block completed).
+
+On other hosts, or if no executable memory can be allocated, `compile()`
+always returns NULL and all blocks stay interpreted.
+*/
+
+#define SOLOMIPS_JIT_BUFFER_SIZE 0x400000u
+#define SOLOMIPS_JIT_THRESHOLD 64u
+
+namespace SoloMIPS {
+
+class R3000;
+
+class JITCompiler
+{
+public:
+    JITCompiler();
+    JITCompiler(const JITCompiler &other);
+    JITCompiler &operator=(const JITCompiler &other);
+    ~JITCompiler();
+
+    /**
+     * Return whether native code can be generated on this host.
+     */
+    static bool isSupported();
+
+    /**
+     * Generate native code for the given block of the given CPU. Returns NULL
+     * if the buffer is full or the host is not supported.
+     */
+    NativeCode compile(const TranslatedBlock &block, R3000 *cpu);
+
+    /**
+     * Drop all generated code.
+     */
+    void reset();
+
+private:
+    uint8_t *_buffer;
+    size_t _used;
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_JIT_HXX */
@@ -0,0 +1,438 @@
+/*
+ *  lockstep.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#include "defaults.hxx"
+#include "machine.hxx"
+#include "lockstep.hxx"
+
+using namespace SoloMIPS;
+
+namespace {
+
+// One of the two machines compared
+struct Side
+{
+    Side(const std::vector<uint8_t> &program, const std::string &input, ExecutionEngine engine)
+        : input(input), machine(std::vector<uint8_t>(program), &this->input, &this->output)
+    {
+        this->machine.cpu.engine = engine;
+        this->machine.cpu.trackWrites(true);
+        this->result.reason = StopReason::InstructionLimit;
+        this->result.address = 0;
+    }
+
+    RunResult runFor(uint64_t maxInstructions)
+    {
+        this->result = this->machine.cpu.runFor(maxInstructions);
+        try {
+            this->machine.oram.flush();
+        }
+        catch (std::exception &) {
+            // Cannot fail on a string stream
+        }
+        return this->result;
+    }
+
+    std::istringstream input;
+    std::ostringstream output;
+    Machine machine;
+    RunResult result;
+};
+
+}
+
+static std::string hex(uint32_t value)
+{
+    std::ostringstream out;
+    out << "0x" << std::setfill('0') << std::setw(8) << std::hex << value;
+    return out.str();
+}
+
+static bool readByte(R3000 &cpu, uint32_t addr, uint8_t &value)
+{
+    if (cpu.ram.checkAccess(addr, 1, RAMMapperFlag::Readable) != NULL)
+        return false;
+    try {
+        value = static_cast<uint8_t>(cpu.ram[addr]);
+    }
+    catch (std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+// Compare a page both may have written; array pages are compared in place
+static bool comparePage(R3000 &a, R3000 &b, uint32_t page, std::string &what)
+{
+    const RAMPage *pa = a.ram.pageAt(page);
+    const RAMPage *pb = b.ram.pageAt(page);
+    if (pa != NULL && pb != NULL && pa->host != NULL && pb->host != NULL
+            && std::memcmp(pa->host, pb->host, SOLOMIPS_RAM_PAGE_MASK + 1) == 0)
+        return true;
+
+    for (uint32_t addr = page; addr <= (page | SOLOMIPS_RAM_PAGE_MASK); ++addr) {
+        uint8_t va = 0, vb = 0;
+        bool ra = readByte(a, addr, va);
+        bool rb = readByte(b, addr, vb);
+        if (ra != rb || va != vb) {
+            std::ostringstream out;
+            out << "memory at " << hex(addr) << ": " << hex(va) << " vs " << hex(vb);
+            what = out.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compareRegister(const char *name, uint32_t a, uint32_t b, std::string &what)
+{
+    if (a == b)
+        return true;
+    what = std::string(name) + ": " + hex(a) + " vs " + hex(b);
+    return false;
+}
+
+// Describe the first difference between the two sides in what
+static bool compareSides(Side &a, Side &b, std::string &what)
+{
+    R3000 &ca = a.machine.cpu;
+    R3000 &cb = b.machine.cpu;
+
+    if (ca.instructions != cb.instructions) {
+        what = "instruction counter: " + std::to_string(ca.instructions) + " vs " + std::to_string(cb.instructions);
+        return false;
+    }
+    if (a.result.reason != b.result.reason || a.result.address != b.result.address || a.result.message != b.result.message) {
+        what = "run result: " + std::to_string(static_cast<unsigned int>(a.result.reason)) + " at " + hex(a.result.address) + " (" + a.result.message + ") vs "
+            + std::to_string(static_cast<unsigned int>(b.result.reason)) + " at " + hex(b.result.address) + " (" + b.result.message + ")";
+        return false;
+    }
+    // The next instruction is moot once the run has stopped at a fault
+    if (!compareRegister("pc", ca.pc, cb.pc, what))
+        return false;
+    if (ca.dex == DelayedException::None && !compareRegister("next instruction", ca.nextOp.encode(), cb.nextOp.encode(), what))
+        return false;
+    for (unsigned int i = 0; i < 32; ++i) {
+        if (!compareRegister(("r" + std::to_string(i)).c_str(), ca.r[i], cb.r[i], what))
+            return false;
+    }
+    if (!compareRegister("hi", ca.hi, cb.hi, what) || !compareRegister("lo", ca.lo, cb.lo, what))
+        return false;
+
+    // Delayed loads only matter while pending
+    bool pa = (ca.dlOpcode != Opcode::SPECIAL);
+    bool pb = (cb.dlOpcode != Opcode::SPECIAL);
+    if (pa != pb || (pa && (ca.dlOpcode != cb.dlOpcode || ca.dlTarget != cb.dlTarget || ca.dlAddr != cb.dlAddr))) {
+        what = "delayed load: " + std::string(pa ? "r" + std::to_string(ca.dlTarget) + " from " + hex(ca.dlAddr) : "none") + " vs "
+            + std::string(pb ? "r" + std::to_string(cb.dlTarget) + " from " + hex(cb.dlAddr) : "none");
+        return false;
+    }
+    if (ca.dex != cb.dex) {
+        what = "pending fault: " + std::to_string(static_cast<unsigned int>(ca.dex)) + " vs " + std::to_string(static_cast<unsigned int>(cb.dex));
+        return false;
+    }
+
+    std::string oa = a.output.str();
+    std::string ob = b.output.str();
+    if (oa != ob) {
+        size_t i = 0;
+        while (i < oa.size() && i < ob.size() && oa[i] == ob[i])
+            ++i;
+        what = "output differs from byte " + std::to_string(i);
+        return false;
+    }
+
+    std::set<uint32_t> pages = ca.takeWrittenPages();
+    std::set<uint32_t> pagesB = cb.takeWrittenPages();
+    pages.insert(pagesB.begin(), pagesB.end());
+    for (uint32_t page : pages) {
+        if (!comparePage(ca, cb, page, what))
+            return false;
+    }
+    return true;
+}
+
+static void disassembleAround(R3000 &cpu, uint32_t addr, std::ostream &out)
+{
+    for (uint32_t a = addr - 16; a != addr + 20; a += 4) {
+        out << ((a == addr) ? "  => " : "     ") << hex(a) << "  ";
+        uint8_t bytes[4];
+        bool readable = true;
+        for (uint32_t i = 0; i < 4 && readable; ++i)
+            readable = readByte(cpu, a + i, bytes[i]);
+        if (!readable) {
+            out << "??" << std::endl;
+            continue;
+        }
+        uint32_t word = (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+        try {
+            out << OP(word) << std::endl;
+        }
+        catch (InvalidOPException &) {
+            out << ".word  " << hex(word) << std::endl;
+        }
+    }
+}
+
+static void printState(const char *engine, R3000 &cpu, std::ostream &out)
+{
+    out << "  " << engine << ": pc=" << hex(cpu.pc) << " hi=" << hex(cpu.hi) << " lo=" << hex(cpu.lo) << std::endl;
+    for (unsigned int i = 0; i < 32; ++i) {
+        out << ((i % 8 == 0) ? "    " : " ") << "r" << std::setfill('0') << std::setw(2) << std::dec << i << "=" << hex(cpu.r[i]);
+        if (i % 8 == 7)
+            out << std::endl;
+    }
+}
+
+
+const char *SoloMIPS::engineName(ExecutionEngine engine)
+{
+    switch (engine) {
+        case ExecutionEngine::Switch:
+            return "switch";
+        case ExecutionEngine::Threaded:
+            return "threaded";
+        case ExecutionEngine::Blocks:
+            return "blocks";
+        case ExecutionEngine::JIT:
+            return "jit";
+    }
+    return "unknown";
+}
+
+
+Lockstep::Lockstep(ExecutionEngine first, ExecutionEngine second, uint64_t interval)
+    : _engines{first, second}, _interval(std::max<uint64_t>(1, interval)), _instructions(0) {}
+
+bool Lockstep::run(const std::vector<uint8_t> &program, const std::string &input, uint64_t maxInstructions, std::ostream &report)
+{
+    this->_instructions = 0;
+    std::unique_ptr<Side> a(new Side(program, input, this->_engines[0]));
+    std::unique_ptr<Side> b(new Side(program, input, this->_engines[1]));
+
+    // Run in checkpoints while the engines agree
+    std::string what;
+    uint64_t good = 0;
+    for (;/*_*/;) {
+        uint64_t chunk = std::min(this->_interval, maxInstructions - good);
+        a->runFor(chunk);
+        b->runFor(chunk);
+        if (!compareSides(*a, *b, what))
+            break;
+        good = a->machine.cpu.instructions;
+        this->_instructions = good;
+        if (a->result.reason != StopReason::InstructionLimit || good >= maxInstructions)
+            return true;
+    }
+
+    // Find the first divergent instruction by stepping from the last good
+    // checkpoint; single steps are already checkpoints
+    if (this->_interval > 1) {
+        std::string checkpointWhat = what;
+        a.reset(new Side(program, input, this->_engines[0]));
+        b.reset(new Side(program, input, this->_engines[1]));
+        a->runFor(good);
+        b->runFor(good);
+        a->machine.cpu.takeWrittenPages();
+        b->machine.cpu.takeWrittenPages();
+        for (;/*_*/;) {
+            a->runFor(1);
+            b->runFor(1);
+            if (!compareSides(*a, *b, what))
+                break;
+            if (a->result.reason != StopReason::InstructionLimit) {
+                what = checkpointWhat + ", but not when single stepping";
+                break;
+            }
+        }
+    }
+
+    R3000 &ca = a->machine.cpu;
+    R3000 &cb = b->machine.cpu;
+    this->_instructions = ca.instructions;
+    report << "divergence after instruction " << std::dec << ca.instructions << ": " << what << std::endl;
+    printState(engineName(this->_engines[0]), ca, report);
+    printState(engineName(this->_engines[1]), cb, report);
+    report << "  last instruction (" << engineName(this->_engines[0]) << "):" << std::endl;
+    disassembleAround(ca, ca.pc - 8, report);
+    return false;
+}
+
+uint64_t Lockstep::instructions() const
+{
+    return this->_instructions;
+}
+
+
+// Registers the random programs compute with; r28 holds the data pointer, r26
+// and r27 non-zero divisors
+static uint8_t randomRegister(std::mt19937 &random)
+{
+    static const uint8_t regs[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 31};
+    return regs[random() % sizeof(regs)];
+}
+
+static uint32_t randomWord(std::mt19937 &random, uint32_t index, uint32_t length)
+{
+    // Only the non-trapping forms of addition and subtraction, so that runs
+    // are not cut short by overflows of random operands
+    static const Funct functs[] = {
+        Funct::SLL, Funct::SRL, Funct::SRA, Funct::SLLV, Funct::SRLV, Funct::SRAV, Funct::MFHI, Funct::MTHI, Funct::MFLO,
+        Funct::MTLO, Funct::MULT, Funct::MULTU, Funct::DIV, Funct::DIVU, Funct::ADDU, Funct::SUBU,
+        Funct::AND, Funct::OR, Funct::XOR, Funct::NOR, Funct::SLT, Funct::SLTU
+    };
+    static const Opcode immediates[] = {
+        Opcode::ADDIU, Opcode::SLTI, Opcode::SLTIU, Opcode::ANDI, Opcode::ORI, Opcode::XORI, Opcode::LUI
+    };
+    static const Opcode memory[] = {
+        Opcode::LB, Opcode::LH, Opcode::LW, Opcode::LBU, Opcode::LHU, Opcode::SB, Opcode::SH, Opcode::SW
+    };
+    static const Opcode branches[] = {
+        Opcode::BEQ, Opcode::BNE, Opcode::BLEZ, Opcode::BGTZ, Opcode::REGIMM
+    };
+    static const uint8_t regimm[] = {OP_REGIMM_BLTZ, OP_REGIMM_BGEZ, OP_REGIMM_BLTZAL, OP_REGIMM_BGEZAL};
+
+    // Divisions by any register, accesses anywhere, backward branches and
+    // returns may fault or loop and thus cut short or stretch a run, so only
+    // about one in four programs gets one of them
+    static const unsigned int riskyKinds[] = {0, 65, 85, 98};
+    bool risky = (random() % (4 * length) == 0);
+
+    OP op;
+    unsigned int kind = risky ? riskyKinds[random() % 4] : random() % 100;
+    if (kind < 40) {
+        op.opcode = Opcode::SPECIAL;
+        op.funct = risky ? Funct::DIV : functs[random() % (sizeof(functs) / sizeof(functs[0]))];
+        op.rs = randomRegister(random);
+        op.rt = randomRegister(random);
+        op.rd = randomRegister(random);
+        op.shamt = random() % 32;
+        if ((op.funct == Funct::DIV || op.funct == Funct::DIVU) && !risky)
+            op.rt = 26 + random() % 2;
+    }
+    else if (kind < 65) {
+        op.opcode = immediates[random() % (sizeof(immediates) / sizeof(immediates[0]))];
+        op.rs = randomRegister(random);
+        op.rt = randomRegister(random);
+        op.imm = static_cast<uint16_t>(random());
+    }
+    else if (kind < 85) {
+        // Aligned accesses around the data pointer, unless risky
+        op.opcode = memory[random() % (sizeof(memory) / sizeof(memory[0]))];
+        op.rs = risky ? randomRegister(random) : 28;
+        op.rt = randomRegister(random);
+        op.simm = static_cast<int16_t>((random() % 0x400) - 0x200);
+        if (!risky)
+            op.simm &= ~3;
+    }
+    else if (kind < 95) {
+        // Short branches, backward only if risky
+        op.opcode = branches[random() % (sizeof(branches) / sizeof(branches[0]))];
+        op.rs = randomRegister(random);
+        op.rt = (op.opcode == Opcode::REGIMM) ? regimm[random() % sizeof(regimm)] : randomRegister(random);
+        op.simm = static_cast<int16_t>(risky ? -1 - static_cast<int>(random() % 6) : static_cast<int>(random() % 4));
+    }
+    else if (!risky) {
+        // Jumps stay short, as skipped code does not run
+        op.opcode = (random() % 2) ? Opcode::J : Opcode::JAL;
+        op.addr = ((SOLOMIPS_DEFAULT_ENTRY >> 2) + std::min(length - 1, index + 2 + static_cast<uint32_t>(random() % 4))) & 0x3ffffff;
+    }
+    else {
+        // Returns to wherever r31 points, which may well fault
+        op.opcode = Opcode::SPECIAL;
+        op.funct = (random() % 2) ? Funct::JR : Funct::JALR;
+        op.rs = 31;
+        op.rt = 0;
+        op.rd = (op.funct == Funct::JALR) ? randomRegister(random) : 0;
+        op.shamt = 0;
+    }
+    return op.encode();
+}
+
+static bool isControlTransferWord(uint32_t word)
+{
+    Opcode opcode = static_cast<Opcode>(word >> 26);
+    if (opcode == Opcode::SPECIAL) {
+        Funct funct = static_cast<Funct>(word & 0x3f);
+        return funct == Funct::JR || funct == Funct::JALR;
+    }
+    return opcode == Opcode::REGIMM || opcode == Opcode::J || opcode == Opcode::JAL
+        || opcode == Opcode::BEQ || opcode == Opcode::BNE || opcode == Opcode::BLEZ || opcode == Opcode::BGTZ;
+}
+
+std::vector<uint8_t> SoloMIPS::randomProgram(std::mt19937 &random, size_t length)
+{
+    std::vector<uint32_t> words;
+
+    // Point r28 into work RAM, r31 somewhere into the program, set the
+    // divisors (-1 for the overflowing quotient) and seed the other registers
+    size_t prologue = 1 + 2 + 3 + 2 * 25;
+    uint32_t ret = SOLOMIPS_DEFAULT_ENTRY + static_cast<uint32_t>((prologue + random() % (length + 1)) * 4);
+    words.push_back(OP::LUI(28, static_cast<uint16_t>((SOLOMIPS_DEFAULT_DATA_ADDR >> 16) + 1)).encode());
+    words.push_back(OP::LUI(26, static_cast<uint16_t>(random())).encode());
+    words.push_back(OP::ORI(26, 26, static_cast<uint16_t>(random() | 1)).encode());
+    words.push_back(OP::ADDIU(27, 0, -1).encode());
+    words.push_back(OP::LUI(31, static_cast<uint16_t>(ret >> 16)).encode());
+    words.push_back(OP::ORI(31, 31, static_cast<uint16_t>(ret)).encode());
+    for (uint8_t r = 1; r < 26; ++r) {
+        words.push_back(OP::LUI(r, static_cast<uint16_t>(random())).encode());
+        words.push_back(OP::ORI(r, r, static_cast<uint16_t>(random())).encode());
+    }
+
+    // Instructions the decoder rejects are left out, and nothing that
+    // transfers control is placed in a delay slot
+    uint32_t total = static_cast<uint32_t>(words.size() + length + 2);
+    while (words.size() < total - 2) {
+        uint32_t word = randomWord(random, static_cast<uint32_t>(words.size()), total);
+        try {
+            OP op(word);
+        }
+        catch (InvalidOPException &) {
+            continue;
+        }
+        if (isControlTransferWord(word) && isControlTransferWord(words.back()))
+            continue;
+        words.push_back(word);
+    }
+    if (isControlTransferWord(words.back()))
+        words.back() = 0;
+
+    // Halt
+    words.push_back(OP::JR(0).encode());
+    words.push_back(0);
+
+    std::vector<uint8_t> program;
+    program.reserve(words.size() * 4);
+    for (uint32_t word : words) {
+        program.push_back(word >> 24);
+        program.push_back((word >> 16) & 0xff);
+        program.push_back((word >> 8) & 0xff);
+        program.push_back(word & 0xff);
+    }
+    return program;
+}
@@ -0,0 +1,87 @@
+/*
+ *  lockstep.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEADER_SOLOMIPS_LOCKSTEP_HXX
+#define HEADER_SOLOMIPS_LOCKSTEP_HXX
+
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpu.hxx"
+
+/*
+Differential execution of two engines. The program runs on two machines with
+the same input, one per engine, which are stopped every `interval`
+instructions and compared: instruction counter, pc, the next instruction,
+registers, hi/lo, the pending delayed load and fault, the run result, the
+output so far and every page either of them may have written to since the
+last checkpoint (see `R3000::takeWrittenPages()`).
+
+On a mismatch, both machines are run again up to the last checkpoint that
+matched and then compared after every instruction, which finds the first
+divergent instruction without paying for single-stepping the whole run. It
+is reported with both states and a disassembly around it.
+*/
+
+#define SOLOMIPS_LOCKSTEP_INTERVAL 0x10000u
+
+namespace SoloMIPS {
+
+const char *engineName(ExecutionEngine engine);
+
+class Lockstep
+{
+public:
+    Lockstep(ExecutionEngine first, ExecutionEngine second, uint64_t interval = SOLOMIPS_LOCKSTEP_INTERVAL);
+
+    /**
+     * Run the program with the given input on both engines until it stops
+     * or maxInstructions have been run. Returns true if the engines agree;
+     * otherwise the first divergence is printed to report.
+     */
+    bool run(const std::vector<uint8_t> &program, const std::string &input, uint64_t maxInstructions, std::ostream &report);
+
+    /**
+     * Instructions run by the last `run()` until it stopped or diverged.
+     */
+    uint64_t instructions() const;
+
+private:
+    ExecutionEngine _engines[2];
+    uint64_t _interval;
+    uint64_t _instructions;
+};
+
+/**
+ * Generate a random program of about length instructions that exercises
+ * every kind of instruction, including loads and stores to work RAM, jumps
+ * and faults. Most programs run about length instructions; about one in four
+ * faults or loops, so run them with an instruction limit.
+ */
+std::vector<uint8_t> randomProgram(std::mt19937 &random, size_t length);
+
+}
+
+#endif /* HEADER_SOLOMIPS_LOCKSTEP_HXX */
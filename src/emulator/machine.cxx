@@ -0,0 +1,298 @@
+/*
+ *  machine.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+#include "defaults.hxx"
+#include "elf.hxx"
+#include "io.hxx"
+#include "machine.hxx"
+
+using namespace SoloMIPS;
+
+Machine::Machine(std::vector<uint8_t> &&program, std::istream *input, std::ostream *output)
+    : rom(SOLOMIPS_DEFAULT_ENTRY, std::move(program), RAMMapperFlag::Readable | RAMMapperFlag::Executable),
+      wram(SOLOMIPS_DEFAULT_DATA_ADDR, SOLOMIPS_DEFAULT_DATA_SIZE),
+      iram(SOLOMIPS_DEFAULT_I_ADDR, input),
+      oram(SOLOMIPS_DEFAULT_O_ADDR, output),
+      cpu(SOLOMIPS_DEFAULT_ENTRY), codeAddr(SOLOMIPS_DEFAULT_ENTRY), codeSize(rom.size())
+{
+    if (this->loadSegmented(NULL)) {
+        this->attach();
+        return;
+    }
+    DataImage image;
+    if (this->findDataImage(image)) {
+        std::copy(this->rom.data() + image.offset, this->rom.data() + image.offset + image.size,
+                  this->wram.data() + (image.addr - SOLOMIPS_DEFAULT_DATA_ADDR));
+    }
+    this->attach();
+}
+
+Machine::Machine(const std::string &fileName, std::istream *input, std::ostream *output)
+    : rom(SOLOMIPS_DEFAULT_ENTRY, RAMMapperFlag::Readable | RAMMapperFlag::Executable),
+      wram(SOLOMIPS_DEFAULT_DATA_ADDR, SOLOMIPS_DEFAULT_DATA_SIZE),
+      iram(SOLOMIPS_DEFAULT_I_ADDR, input),
+      oram(SOLOMIPS_DEFAULT_O_ADDR, output),
+      cpu(SOLOMIPS_DEFAULT_ENTRY), codeAddr(SOLOMIPS_DEFAULT_ENTRY), codeSize(0)
+{
+    this->rom.mapFile(fileName);
+    this->codeSize = this->rom.size();
+    if (this->loadSegmented(&fileName)) {
+        this->attach();
+        return;
+    }
+    // The data is mapped again, as work RAM must be writable
+    DataImage image;
+    if (this->findDataImage(image))
+        this->wram.mapFileAt(image.addr, fileName, image.offset, image.size);
+    this->attach();
+}
+
+bool Machine::findDataImage(DataImage &image)
+{
+    if (!SoloMIPS::findDataImage(this->rom.data(), this->rom.size(), image))
+        return false;
+    if (image.addr < SOLOMIPS_DEFAULT_DATA_ADDR || static_cast<uint64_t>(image.addr - SOLOMIPS_DEFAULT_DATA_ADDR) + image.size > this->wram.size())
+        throw IOException("data image of the program does not fit work RAM");
+    this->codeSize = image.offset;
+    return true;
+}
+
+bool Machine::loadSegmented(const std::string *fileName)
+{
+    const uint8_t *data = this->rom.data();
+    size_t size = this->rom.size();
+    bool executable = Executable::isExecutable(data, size);
+    bool elf = size >= 4 && std::memcmp(data, "\x7f" "ELF", 4) == 0;
+    if (!executable && !elf)
+        return false;
+
+    // The ROM is replaced by the first segment, so keep the program unless
+    // the segments can be mapped from the file
+    std::vector<uint8_t> program;
+    if (fileName == NULL) {
+        program.assign(data, data + size);
+        data = program.data();
+    }
+    if (executable)
+        this->loadExecutable(data, size, fileName);
+    else
+        this->loadELF(data, size, fileName);
+    return true;
+}
+
+void Machine::loadExecutable(const uint8_t *data, size_t size, const std::string *fileName)
+{
+    Executable exe;
+    if (!exe.parse(data, size))
+        throw IOException("program is not a valid SoloMIPS executable");
+    this->loadSegments(exe, data, fileName, true);
+}
+
+void Machine::loadELF(const uint8_t *data, size_t size, const std::string *fileName)
+{
+    ELF32Object obj;
+    if (!obj.parse(data, size) || obj.type != ELFObjectType::Exec || obj.machine != ELFMachineType::MIPS
+            || obj.enc != ELFDataEncoding::MSB)
+        throw IOException("program is not a big-endian MIPS ELF32 executable");
+
+    Executable exe;
+    exe.entry = obj.entry;
+    uint32_t end = 0;
+    for (size_t i = 0; i < obj.segmentCount(); ++i) {
+        ELF32ProgramHeader ph = obj.segment(i);
+        if (ph.type != ELFSegmentType::Load || ph.memsz == 0)
+            continue;
+        ExecutableSegment segment;
+        segment.addr = ph.vaddr;
+        segment.offset = ph.offset;
+        segment.fileSize = ph.filesz;
+        segment.memSize = ph.memsz;
+        if ((ph.flags & ELFSegmentFlags::Read) == ELFSegmentFlags::Read)
+            segment.flags = segment.flags | SegmentFlag::Readable;
+        if ((ph.flags & ELFSegmentFlags::Write) == ELFSegmentFlags::Write)
+            segment.flags = segment.flags | SegmentFlag::Writable;
+        if ((ph.flags & ELFSegmentFlags::Exec) == ELFSegmentFlags::Exec)
+            segment.flags = segment.flags | SegmentFlag::Executable;
+
+        // Linkers keep addresses and offsets congruent modulo the page size,
+        // so segments can start on a page boundary and be mapped, unless
+        // that would overlap the one before
+        uint32_t slack = ph.vaddr & (SOLOMIPS_EXECUTABLE_ALIGN - 1);
+        if ((ph.offset & (SOLOMIPS_EXECUTABLE_ALIGN - 1)) == slack && ph.vaddr - slack >= end
+                && static_cast<uint64_t>(ph.memsz) + slack <= UINT32_MAX) {
+            segment.addr -= slack;
+            segment.offset -= slack;
+            segment.fileSize += slack;
+            segment.memSize += slack;
+        }
+        end = ph.vaddr + ph.memsz;
+        exe.segments.push_back(std::move(segment));
+    }
+
+    // Code and data symbols for diagnostics, and the global pointer of the
+    // MIPS ABI
+    uint32_t gp = 0;
+    for (size_t i = 0; i < obj.sectionCount(); ++i) {
+        ELF32SymbolTable symtab = obj.symbolTable(i);
+        for (size_t j = 0; j < symtab.size(); ++j) {
+            ELFSymbolTableEntry sym = symtab[j];
+            if (sym.name == ELFString("_gp"))
+                gp = sym.value;
+            if (sym.shndx == SHN_UNDEF || sym.name.empty()
+                    || (sym.type() != ELFSymbolType::Func && sym.type() != ELFSymbolType::Object))
+                continue;
+            exe.symbols.push_back(ExecutableSymbol(sym.value, sym.size, sym.name.str()));
+        }
+    }
+
+    // The code segment usually starts with the file headers; the code is
+    // what the executable sections span
+    uint32_t first = UINT32_MAX, last = 0;
+    for (size_t i = 0; i < obj.sectionCount(); ++i) {
+        ELF32Section section = obj.section(i);
+        if ((section.flags & ELFSectionFlags::ExecInstr) == ELFSectionFlags::None || section.size == 0)
+            continue;
+        first = std::min(first, section.addr);
+        last = std::max(last, static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(section.addr) + section.size - 1, UINT32_MAX)));
+    }
+
+    // The file may not be mapped any longer once the segments are
+    this->loadSegments(exe, data, fileName, false);
+
+    if (first <= last && first >= this->rom.offset() && last - this->rom.offset() < this->rom.size()) {
+        this->codeAddr = first;
+        this->codeSize = last - first + 1;
+    }
+
+    // There is no startup code to set up the stack, so it goes at the top of
+    // work RAM, leaving room for the arguments main may spill
+    this->cpu.r[28] = gp;
+    this->cpu.r[29] = this->wram.offset() + this->wram.size() - 16;
+}
+
+void Machine::loadSegments(Executable &exe, const uint8_t *data, const std::string *fileName, bool dataRAM)
+{
+    // The first code segment replaces the ROM and, if it is the data RAM of
+    // the program, the first other writable one work RAM; any others get
+    // mappers of their own
+    bool hasCode = false, hasData = !dataRAM;
+    for (ExecutableSegment &segment : exe.segments) {
+        if (segment.memSize == 0)
+            continue;
+        ArrayRAMMapper *mapper;
+        bool executable = (segment.flags & SegmentFlag::Executable) == SegmentFlag::Executable;
+        bool writable = (segment.flags & SegmentFlag::Writable) == SegmentFlag::Writable;
+        if (executable && !hasCode) {
+            mapper = &this->rom;
+            hasCode = true;
+        } else if (writable && !executable && !hasData) {
+            mapper = &this->wram;
+            hasData = true;
+        } else {
+            this->segments.emplace_back(new ArrayRAMMapper(segment.addr));
+            mapper = this->segments.back().get();
+        }
+
+        mapper->setOffset(segment.addr);
+        mapper->setFlags(static_cast<RAMMapperFlag>(static_cast<uint32_t>(segment.flags)));
+        mapper->zeroFill(segment.memSize);
+        if (fileName)
+            mapper->mapFileAt(segment.addr, *fileName, segment.offset, segment.fileSize);
+        else
+            std::copy(data + segment.offset, data + segment.offset + segment.fileSize, mapper->data());
+        mapper->setInstructionMap(std::move(segment.instructionMap));
+    }
+    if (!hasCode)
+        throw IOException("executable has no code segment");
+
+    this->codeAddr = this->rom.offset();
+    this->codeSize = this->rom.size();
+    this->symbols = std::move(exe.symbols);
+    this->cpu.entrypoint = exe.entry;
+    this->cpu.reset();
+}
+
+void Machine::attach()
+{
+    this->iram.setTie(&this->oram);
+    this->cpu.ram.addMapper(&this->rom);
+    this->cpu.ram.addMapper(&this->iram);
+    this->cpu.ram.addMapper(&this->oram);
+    this->cpu.ram.addMapper(&this->wram);
+    for (std::unique_ptr<ArrayRAMMapper> &segment : this->segments)
+        this->cpu.ram.addMapper(segment.get());
+}
+
+int Machine::run(std::ostream &err, uint64_t maxInstructions)
+{
+    // Output goes out before any error message, as it would unbuffered
+    RunResult result = this->cpu.runFor(maxInstructions);
+    try {
+        this->oram.flush();
+    }
+    catch (std::ios_base::failure &e) {
+        if (result.reason == StopReason::Halted) {
+            result.reason = StopReason::IOError;
+            result.address = this->cpu.pc - 8;
+            result.message = e.what();
+        }
+    }
+
+    const char *what;
+    int status;
+    switch (result.reason) {
+        case StopReason::Halted:
+            return (this->cpu.r[2] & 0xff);
+        case StopReason::InstructionLimit:
+        case StopReason::Interrupted:
+            err << "error: " << (result.reason == StopReason::Interrupted ? "interrupted" : "instruction limit reached")
+                << " at 0x" << std::setfill('0') << std::setw(8) << std::hex << result.address << std::endl;
+            return -13;
+        case StopReason::ArithmeticFault:
+            what = "arithmetic exception";
+            status = -10;
+            break;
+        case StopReason::MemoryFault:
+            what = "memory exception";
+            status = -11;
+            break;
+        case StopReason::InvalidInstruction:
+            err << "error: invalid instruction at 0x" << std::setfill('0') << std::setw(8) << std::hex << result.address << std::endl;
+            return -12;
+        case StopReason::MisalignedPC:
+            err << "error: misaligned program counter at 0x" << std::setfill('0') << std::setw(8) << std::hex << result.address << std::endl;
+            return -20;
+        case StopReason::IOError:
+            what = "i/o exception";
+            status = -21;
+            break;
+        default:
+            what = "unknown exception";
+            status = -20;
+            break;
+    }
+    err << "error: " << what << " at 0x" << std::setfill('0') << std::setw(8) << std::hex << result.address << ": " << result.message << std::endl;
+    return status;
+}
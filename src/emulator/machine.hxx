@@ -0,0 +1,102 @@
+/*
+ *  machine.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_MACHINE_HXX
+#define HEADER_SOLOMIPS_MACHINE_HXX
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "executable.hxx"
+#include "image.hxx"
+#include "ram.hxx"
+#include "cpu.hxx"
+
+/*
+The standard machine run by solomips-emu: the program as ROM at the default
+entry point, work RAM and the console ports at their default addresses. A data
+image of the program (see image.hxx) is loaded into work RAM. A SoloMIPS
+executable (see executable.hxx) instead puts its first code segment in the ROM,
+its first data segment in work RAM and any others in mappers of their own,
+with the flags and at the addresses of the segments. So do the PT_LOAD
+segments of a big-endian MIPS ELF32 executable, except that work RAM is kept
+for the stack, which starts at its top; the symbols of both are kept for
+diagnostics. Every machine is self-contained, so any number of them can run
+in parallel.
+*/
+
+namespace SoloMIPS {
+
+class Machine
+{
+public:
+    Machine(std::vector<uint8_t> &&program, std::istream *input = &std::cin, std::ostream *output = &std::cout);
+
+    /**
+     * Map the program file as ROM instead of reading it (see
+     * ArrayRAMMapper::mapFile), and its data image into work RAM. Throws
+     * IOException if it cannot be loaded.
+     */
+    Machine(const std::string &fileName, std::istream *input = &std::cin, std::ostream *output = &std::cout);
+
+    /**
+     * Run the program until it halts and flush its output. Faults are
+     * reported to err; returns the low byte of v0 or a negative error code
+     * (-10 arithmetic, -11 memory, -12 invalid instruction, -13 instruction
+     * limit reached or interrupted, -21 i/o, -20 other).
+     */
+    int run(std::ostream &err, uint64_t maxInstructions = UINT64_MAX);
+
+    ArrayRAMMapper rom;
+    ArrayRAMMapper wram;
+    InputRAMMapper iram;
+    OutputRAMMapper oram;
+    R3000 cpu;
+
+    // Segments of an executable beyond the ROM and work RAM
+    std::vector<std::unique_ptr<ArrayRAMMapper>> segments;
+
+    // Address and size of the code in the ROM, without the data image or
+    // file headers
+    uint32_t codeAddr;
+    uint32_t codeSize;
+
+    // Symbols of an executable or ELF file, for diagnostics
+    std::vector<ExecutableSymbol> symbols;
+
+private:
+    void attach();
+    bool loadSegmented(const std::string *fileName);
+    void loadExecutable(const uint8_t *data, size_t size, const std::string *fileName);
+    void loadELF(const uint8_t *data, size_t size, const std::string *fileName);
+    void loadSegments(Executable &exe, const uint8_t *data, const std::string *fileName, bool dataRAM);
+    bool findDataImage(DataImage &image);
+
+    Machine(const Machine &other);
+    Machine &operator=(const Machine &other);
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_MACHINE_HXX */
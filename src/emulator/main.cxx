@@ -21,54 +21,269 @@
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
 
 #include "defaults.hxx"
 #include "io.hxx"
 #include "ram.hxx"
 #include "cpu.hxx"
 #include "elf.hxx"
+#include "machine.hxx"
+#include "batch.hxx"
+#include "profiler.hxx"
+#include "trace.hxx"
+#include "lockstep.hxx"
 
 using namespace SoloMIPS;
 
 static void printVersion(const char *argv0)
 {
-    std::cerr << "usage: " << argv0 << "[-d] <path>" << std::endl;
+    std::cerr << "usage: " << argv0 << " [-d] [--engine switch|threaded|blocks|jit] [--max-instructions <n>] [--raw-io] [--stats]" << std::endl;
+    std::cerr << "       " << std::string(std::strlen(argv0), ' ') << " [--profile <interval> [--symbols <object>] [--folded <path>]]" << std::endl;
+    std::cerr << "       " << std::string(std::strlen(argv0), ' ') << " [--trace <path> | --replay <path>] <path>" << std::endl;
+    std::cerr << "       " << argv0 << " --lockstep <engine>,<engine> [--checkpoint <n>] [--max-instructions <n>] [--random <n> [--seed <n>]] [<path>...]" << std::endl;
+    std::cerr << "       " << argv0 << " [--engine switch|threaded|blocks|jit] [--max-instructions <n>] [-j <threads>] --batch <manifest>" << std::endl;
 }
 
-int main(int argc, char **argv)
+static bool parseEngine(const char *name, ExecutionEngine &engine)
 {
-    if (argc < 2) {
-        printVersion(argv[0]);
-        return -20;
+    if (std::strcmp(name, "switch") == 0)
+        engine = ExecutionEngine::Switch;
+    else if (std::strcmp(name, "threaded") == 0)
+        engine = ExecutionEngine::Threaded;
+    else if (std::strcmp(name, "blocks") == 0)
+        engine = ExecutionEngine::Blocks;
+    else if (std::strcmp(name, "jit") == 0)
+        engine = ExecutionEngine::JIT;
+    else
+        return false;
+    return true;
+}
+
+static int runLockstep(Lockstep &lockstep, const std::vector<const char *> &paths, unsigned int randomPrograms, uint32_t seed, uint64_t maxInstructions)
+{
+    size_t passed = 0;
+    size_t total = paths.size() + randomPrograms;
+    for (const char *path : paths) {
+        std::vector<uint8_t> program;
+        try {
+            program = loadBinaryFile(path);
+        }
+        catch (IOException &e) {
+            std::cerr << "error: " << e.what() << std::endl;
+            return -21;
+        }
+        std::ostringstream report;
+        bool equal = lockstep.run(program, std::string(), maxInstructions, report);
+        std::cout << (equal ? "PASS " : "FAIL ") << path << " (" << std::dec << lockstep.instructions() << " instructions)" << std::endl << report.str();
+        if (equal)
+            ++passed;
+    }
+
+    // Random programs may loop, so they are always limited
+    std::mt19937 random(seed);
+    uint64_t randomLimit = std::min<uint64_t>(maxInstructions, 1000000);
+    for (unsigned int i = 0; i < randomPrograms; ++i) {
+        std::vector<uint8_t> program = randomProgram(random, 1000);
+        std::ostringstream report;
+        bool equal = lockstep.run(program, std::string(), randomLimit, report);
+        std::cout << (equal ? "PASS " : "FAIL ") << "random #" << std::dec << i << " (seed " << seed << ", " << lockstep.instructions()
+                  << " instructions)" << std::endl << report.str();
+        if (equal)
+            ++passed;
     }
 
+    std::cout << total << " programs, " << passed << " passed, " << (total - passed) << " failed" << std::endl;
+    return (passed == total) ? 0 : 1;
+}
+
+static int runBatchManifest(const char *path, unsigned int threads, ExecutionEngine engine, uint64_t maxInstructions)
+{
+    std::vector<BatchJob> jobs;
+    try {
+        jobs = loadBatchManifest(path);
+    }
+    catch (IOException &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return -21;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = runBatch(jobs, threads, engine, maxInstructions);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t passed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const BatchResult &r = results[i];
+        if (r.passed)
+            ++passed;
+        std::cout << (r.passed ? "PASS " : "FAIL ") << jobs[i].program << " status=" << std::dec << r.status
+                  << " time=" << std::fixed << std::setprecision(3) << (r.seconds * 1000.0) << "ms";
+        if (!r.message.empty())
+            std::cout << " (" << r.message << ")";
+        std::cout << std::endl;
+    }
+    std::cout << jobs.size() << " jobs, " << passed << " passed, " << (jobs.size() - passed) << " failed in "
+              << std::setprecision(3) << seconds << "s (" << std::setprecision(1) << (seconds > 0 ? jobs.size() / seconds : 0.0)
+              << " jobs/s)" << std::endl;
+
+    return (passed == jobs.size()) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
     bool disassemble = false;
-    const char *path = argv[1];
-    if (std::strcmp(path, "-d") == 0) {
-        disassemble = true;
-        if (argc < 3) {
+    bool rawIO = false;
+    bool stats = false;
+    uint32_t profileInterval = 0;
+    const char *symbolsPath = NULL;
+    const char *foldedPath = NULL;
+    const char *tracePath = NULL;
+    const char *replayPath = NULL;
+    ExecutionEngine engine = ExecutionEngine::Switch;
+    const char *path = NULL;
+    std::vector<const char *> paths;
+    const char *manifest = NULL;
+    bool lockstep = false;
+    ExecutionEngine lockstepEngines[2];
+    uint64_t checkpoint = SOLOMIPS_LOCKSTEP_INTERVAL;
+    unsigned int randomPrograms = 0;
+    uint32_t seed = 1;
+    unsigned int threads = 0;
+    uint64_t maxInstructions = UINT64_MAX;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-d") == 0) {
+            disassemble = true;
+        }
+        else if (std::strcmp(argv[i], "--raw-io") == 0) {
+            rawIO = true;
+        }
+        else if (std::strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0 && i+1 < argc) {
+            profileInterval = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 0));
+            if (profileInterval == 0) {
+                std::cerr << "error: invalid profile interval" << std::endl;
+                return -20;
+            }
+        }
+        else if (std::strcmp(argv[i], "--symbols") == 0 && i+1 < argc) {
+            symbolsPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--folded") == 0 && i+1 < argc) {
+            foldedPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i+1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--replay") == 0 && i+1 < argc) {
+            replayPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 && i+1 < argc) {
+            manifest = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--max-instructions") == 0 && i+1 < argc) {
+            maxInstructions = std::strtoull(argv[++i], NULL, 0);
+        }
+        else if (std::strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            threads = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 0));
+        }
+        else if (std::strcmp(argv[i], "--engine") == 0 && i+1 < argc) {
+            ++i;
+            if (!parseEngine(argv[i], engine)) {
+                std::cerr << "error: unknown engine '" << argv[i] << "'" << std::endl;
+                return -20;
+            }
+        }
+        else if (std::strcmp(argv[i], "--lockstep") == 0 && i+1 < argc) {
+            std::string pair = argv[++i];
+            size_t comma = pair.find(',');
+            if (comma == std::string::npos || !parseEngine(pair.substr(0, comma).c_str(), lockstepEngines[0])
+                    || !parseEngine(pair.substr(comma + 1).c_str(), lockstepEngines[1])) {
+                std::cerr << "error: invalid engines '" << pair << "'" << std::endl;
+                return -20;
+            }
+            lockstep = true;
+        }
+        else if (std::strcmp(argv[i], "--checkpoint") == 0 && i+1 < argc) {
+            checkpoint = std::strtoull(argv[++i], NULL, 0);
+        }
+        else if (std::strcmp(argv[i], "--random") == 0 && i+1 < argc) {
+            randomPrograms = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 0));
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 0));
+        }
+        else if (argv[i][0] == '-') {
             printVersion(argv[0]);
             return -20;
         }
-        path = argv[2];
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    // Reject options which would otherwise be ignored: batch and lockstep
+    // runs are neither instrumented nor attached to the console, and only
+    // the switch and threaded engines can be instrumented (see
+    // R3000::statistics)
+    const char *instrument = stats ? "--stats" : (profileInterval != 0) ? "--profile"
+                           : (tracePath != NULL) ? "--trace" : (replayPath != NULL) ? "--replay" : NULL;
+    const char *mode = lockstep ? "--lockstep" : (manifest != NULL) ? "--batch" : NULL;
+    std::string conflict;
+    if (lockstep && manifest != NULL)
+        conflict = "--lockstep cannot be combined with --batch";
+    else if (mode != NULL && (instrument != NULL || rawIO))
+        conflict = std::string(instrument != NULL ? instrument : "--raw-io") + " cannot be combined with " + mode;
+    else if (instrument != NULL && (engine == ExecutionEngine::Blocks || engine == ExecutionEngine::JIT))
+        conflict = std::string(instrument) + " cannot be combined with --engine " + (engine == ExecutionEngine::JIT ? "jit" : "blocks");
+    if (!conflict.empty()) {
+        std::cerr << "error: " << conflict << std::endl;
+        printVersion(argv[0]);
+        return -20;
     }
 
-    // Prepare ROM
-    ArrayRAMMapper rom(SOLOMIPS_DEFAULT_ENTRY, RAMMapperFlag::Readable | RAMMapperFlag::Executable);
+    if (lockstep && !disassemble) {
+        Lockstep harness(lockstepEngines[0], lockstepEngines[1], checkpoint);
+        return runLockstep(harness, paths, randomPrograms, seed, maxInstructions);
+    }
+    if (paths.size() > 1) {
+        printVersion(argv[0]);
+        return -20;
+    }
+    if (!paths.empty())
+        path = paths.front();
+    if (manifest != NULL && path == NULL && !disassemble)
+        return runBatchManifest(manifest, threads, engine, maxInstructions);
+    if (path == NULL || manifest != NULL || (tracePath != NULL && replayPath != NULL)) {
+        printVersion(argv[0]);
+        return -20;
+    }
 
-    // Load program
+    // Load program; the file is mapped, so only the pages used are read
+    std::unique_ptr<Machine> loaded;
     try {
-        rom.setData(loadBinaryFile(path));
+        loaded.reset(new Machine(path));
     }
     catch (IOException &e) {
         std::cerr << "error: " << e.what() << std::endl;
         return -21;
     }
 
+    Machine &machine = *loaded;
+    const uint8_t *program = machine.rom.data() + (machine.codeAddr - machine.rom.offset());
+    uint32_t programSize = machine.codeSize;
+
     // Disassemble
     if (disassemble) {
         try {
-            OP::disassemble(rom.data(), rom.size(), SOLOMIPS_DEFAULT_ENTRY, std::cout);
+            OP::disassemble(program, programSize, machine.codeAddr, std::cout);
         }
         catch (InvalidOPException &e) {
             std::cerr << e.what();
@@ -77,45 +292,107 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    // Allocate work RAM
-    ArrayRAMMapper wram(SOLOMIPS_DEFAULT_DATA_ADDR, SOLOMIPS_DEFAULT_DATA_SIZE);
+    // Symbolise with the object the program was linked from; the linker
+    // places its .text at the end of the program. Executables carry their
+    // own symbols
+    SymbolTable symbols;
+    for (const ExecutableSymbol &symbol : machine.symbols)
+        symbols.add(symbol.addr, symbol.name);
+    if (symbolsPath != NULL) {
+        std::unique_ptr<MappedFile> file;
+        ELF32Object obj;
+        try {
+            file.reset(new MappedFile(symbolsPath));
+            if (!obj.parse(file->data(), file->size())) {
+                std::cerr << "error: " << symbolsPath << " is not an ELF object" << std::endl;
+                return -21;
+            }
+        }
+        catch (IOException &e) {
+            std::cerr << "error: " << e.what() << std::endl;
+            return -21;
+        }
+        size_t ti = obj.indexOfSection(".text");
+        uint32_t textSize = (ti == SIZE_MAX) ? 0 : obj.section(ti).size;
+        if (textSize > programSize) {
+            std::cerr << "error: " << symbolsPath << " does not match the program" << std::endl;
+            return -21;
+        }
+        symbols.addObject(obj, machine.codeAddr + programSize - textSize);
+    }
 
-    // Setup i/o RAM
-    InputRAMMapper iram(SOLOMIPS_DEFAULT_I_ADDR);
-    OutputRAMMapper oram(SOLOMIPS_DEFAULT_O_ADDR);
+    // Setup machine; either bypass iostreams or let them buffer
+    machine.cpu.engine = engine;
+    if (rawIO) {
+        machine.iram.setFd(0);
+        machine.oram.setFd(1);
+    }
+    else {
+        std::ios::sync_with_stdio(false);
+        machine.oram.setLineBuffered(isTerminal(1));
+    }
 
-    // Setup CPU
-    R3000 cpu(SOLOMIPS_DEFAULT_ENTRY);
-    cpu.ram.addMapper(&rom);
-    cpu.ram.addMapper(&iram);
-    cpu.ram.addMapper(&oram);
-    cpu.ram.addMapper(&wram);
+    Statistics statistics;
+    if (stats)
+        machine.cpu.statistics = &statistics;
+    Profiler profiler(profileInterval, machine.cpu.entrypoint);
+    if (profileInterval != 0)
+        machine.cpu.profiler = &profiler;
 
-    // Run
+    // Record or check a trace of the run
+    std::unique_ptr<TraceWriter> traceWriter;
+    std::unique_ptr<TraceReader> traceReader;
+    std::unique_ptr<TraceVerifier> traceVerifier;
     try {
-        cpu.run();
-    }
-    catch (ArithmeticException &e) {
-        std::cerr << "error: arithmetic exception at 0x" << std::setfill('0') << std::setw(8) << std::hex << (cpu.pc - 8) << ": " << e.what() << std::endl;
-        return -10;
+        if (tracePath != NULL) {
+            traceWriter.reset(new TraceWriter(tracePath, machine.cpu.entrypoint));
+            machine.cpu.tracer = traceWriter.get();
+        }
+        if (replayPath != NULL) {
+            traceReader.reset(new TraceReader(replayPath));
+            if (traceReader->entry() != machine.cpu.entrypoint) {
+                std::cerr << "error: trace '" << replayPath << "' is not of this program" << std::endl;
+                return -21;
+            }
+            traceVerifier.reset(new TraceVerifier(*traceReader, machine.cpu));
+            machine.cpu.tracer = traceVerifier.get();
+        }
     }
-    catch (MemoryException &e) {
-        std::cerr << "error: memory exception at 0x" << std::setfill('0') << std::setw(8) << std::hex << (cpu.pc - 8) << ": " << e.what() << std::endl;
-        return -11;
+    catch (IOException &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return -21;
     }
-    catch (InvalidOPException &) {
-        std::cerr << "error: invalid instruction at 0x" << std::setfill('0') << std::setw(8) << std::hex << (cpu.pc - 8) << std::endl;
-        return -12;
+
+    // Run and exit; a divergence from the trace interrupts the run, which is
+    // reported instead
+    std::ostringstream runErrors;
+    int status = machine.run(traceVerifier ? runErrors : std::cerr, maxInstructions);
+    if (traceVerifier) {
+        if (!traceVerifier->finish(std::cerr))
+            return -14;
+        std::cerr << runErrors.str();
     }
-    catch (std::ios_base::failure &e) {
-        std::cerr << "error: i/o exception at 0x" << std::setfill('0') << std::setw(8) << std::hex << (cpu.pc - 8) << ": " << e.what() << std::endl;
-        return -21;
+    if (traceWriter) {
+        try {
+            traceWriter->close();
+        }
+        catch (IOException &e) {
+            std::cerr << "error: " << e.what() << std::endl;
+            return -21;
+        }
     }
-    catch (std::exception &e) {
-        std::cerr << "error: unknown exception at 0x" << std::setfill('0') << std::setw(8) << std::hex << (cpu.pc - 8) << ": " << e.what() << std::endl;
-        return -20;
+    if (stats)
+        statistics.print(std::cerr);
+    if (profileInterval != 0) {
+        profiler.printFlat(std::cerr, symbols);
+        if (foldedPath != NULL) {
+            std::ofstream folded(foldedPath);
+            profiler.printFolded(folded, symbols);
+            if (!folded) {
+                std::cerr << "error: could not write " << foldedPath << std::endl;
+                return -21;
+            }
+        }
     }
-
-    // Exit
-    return (cpu.r[2] & 0xff);
+    return status;
 }
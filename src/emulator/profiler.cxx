@@ -0,0 +1,205 @@
+/*
+ *  profiler.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#include "profiler.hxx"
+
+using namespace SoloMIPS;
+
+void SymbolTable::addObject(const ELF32Object &obj, uint32_t base)
+{
+    size_t ti = obj.indexOfSection(".text");
+    if (ti == SIZE_MAX)
+        return;
+    for (size_t si = 0; si < obj.sectionCount(); ++si) {
+        ELF32SymbolTable symbolTable = obj.symbolTable(si);
+        for (size_t s = 0; s < symbolTable.size(); ++s) {
+            ELFSymbolTableEntry entry = symbolTable[s];
+            ELFSymbolType type = entry.type();
+            if (entry.shndx != ti || entry.name.empty() || (type != ELFSymbolType::Func && type != ELFSymbolType::NoType))
+                continue;
+            // Prefer global names for aliases
+            uint32_t addr = base + entry.value;
+            if (this->_symbols.count(addr) == 0 || entry.isGlobal())
+                this->_symbols[addr] = entry.name.str();
+        }
+    }
+}
+
+void SymbolTable::add(uint32_t addr, const std::string &name)
+{
+    this->_symbols[addr] = name;
+}
+
+std::string SymbolTable::lookup(uint32_t addr) const
+{
+    auto i = this->_symbols.upper_bound(addr);
+    if (i == this->_symbols.begin())
+        return std::string();
+    return (--i)->second;
+}
+
+bool SymbolTable::empty() const
+{
+    return this->_symbols.empty();
+}
+
+
+Profiler::Profiler(uint32_t interval, uint32_t entry)
+    : _interval(std::max(1u, interval)), _entry(entry), _countdown(std::max(1u, interval)), _samples(0), _pending(Transfer::None) {}
+
+void Profiler::sample(uint32_t addr)
+{
+    std::vector<uint32_t> stack;
+    stack.reserve(this->_frames.size() + 2);
+    stack.push_back(this->_entry);
+    for (const Frame &f : this->_frames)
+        stack.push_back(f.callee);
+    stack.push_back(addr);
+    ++this->_stacks[stack];
+    ++this->_samples;
+}
+
+void Profiler::transfer(const OP &op, uint32_t next, const uint32_t *r)
+{
+    uint32_t link;
+    switch (op.opcode) {
+        case Opcode::JAL:
+            link = r[31];
+            break;
+        case Opcode::REGIMM:
+            if (op.rt != OP_REGIMM_BLTZAL && op.rt != OP_REGIMM_BGEZAL)
+                return;
+            link = r[31];
+            break;
+        default:
+            if (op.funct == Funct::JALR) {
+                link = r[op.rd];
+                break;
+            }
+            if (op.funct == Funct::JR) {
+                this->_pending = Transfer::Return;
+                this->_pendingFrame = Frame{0, next};
+            }
+            return;
+    }
+
+    this->_pending = Transfer::Call;
+    this->_pendingFrame = Frame{next, link};
+}
+
+void Profiler::completeTransfer()
+{
+    if (this->_pending == Transfer::Call) {
+        if (this->_frames.size() < SOLOMIPS_PROFILER_MAX_DEPTH)
+            this->_frames.push_back(this->_pendingFrame);
+    }
+    else {
+        // Unwind to the frame returned from, if any
+        for (size_t i = this->_frames.size(); i-- > 0;) {
+            if (this->_frames[i].ret == this->_pendingFrame.ret) {
+                this->_frames.resize(i);
+                break;
+            }
+        }
+    }
+    this->_pending = Transfer::None;
+}
+
+// Name the frames and the function of the sampled address, unless that is the
+// innermost frame anyway
+std::vector<std::string> Profiler::symbolise(const std::vector<uint32_t> &stack, const SymbolTable &symbols) const
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < stack.size(); ++i) {
+        std::string name = symbols.lookup(stack[i]);
+        bool leaf = (i + 1 == stack.size());
+        if (name.empty()) {
+            if (leaf)
+                break;
+            std::ostringstream hex;
+            hex << "0x" << std::setfill('0') << std::setw(8) << std::hex << stack[i];
+            name = hex.str();
+        }
+        if (leaf && !names.empty() && names.back() == name)
+            continue;
+        names.push_back(name);
+    }
+    return names;
+}
+
+void Profiler::printFlat(std::ostream &out, const SymbolTable &symbols) const
+{
+    std::map<std::string, std::pair<uint64_t, uint64_t>> functions;
+    for (const auto &s : this->_stacks) {
+        std::vector<std::string> names = this->symbolise(s.first, symbols);
+        functions[names.back()].first += s.second;
+        // Count recursive functions only once per sample
+        std::set<std::string> seen(names.begin(), names.end());
+        for (const std::string &name : seen)
+            functions[name].second += s.second;
+    }
+
+    std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> sorted(functions.begin(), functions.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, std::pair<uint64_t, uint64_t>> &a, const std::pair<std::string, std::pair<uint64_t, uint64_t>> &b) {
+            return a.second.first > b.second.first || (a.second.first == b.second.first && a.second.second > b.second.second);
+        });
+
+    out << std::dec << this->_samples << " samples" << std::endl;
+    out << "      self    self%   total%  function" << std::endl;
+    for (const auto &f : sorted) {
+        out << std::setw(10) << f.second.first << std::fixed << std::setprecision(2)
+            << std::setw(8) << (100.0 * f.second.first / this->_samples) << "%"
+            << std::setw(8) << (100.0 * f.second.second / this->_samples) << "%"
+            << "  " << f.first << std::endl;
+    }
+}
+
+void Profiler::printFolded(std::ostream &out, const SymbolTable &symbols) const
+{
+    // Stacks may symbolise to the same names
+    std::map<std::string, uint64_t> folded;
+    for (const auto &s : this->_stacks) {
+        std::vector<std::string> names = this->symbolise(s.first, symbols);
+        std::string line;
+        for (const std::string &name : names) {
+            if (!line.empty())
+                line += ';';
+            line += name;
+        }
+        folded[line] += s.second;
+    }
+    for (const auto &f : folded)
+        out << f.first << " " << std::dec << f.second << std::endl;
+}
+
+uint64_t Profiler::samples() const
+{
+    return this->_samples;
+}
@@ -0,0 +1,145 @@
+/*
+ *  profiler.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEADER_SOLOMIPS_PROFILER_HXX
+#define HEADER_SOLOMIPS_PROFILER_HXX
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "op.hxx"
+#include "elf.hxx"
+
+/*
+Sampling profiler for guest code. Every `interval` completed instructions, the
+address of the instruction and the current call stack are recorded. The call
+stack is a shadow stack maintained from the linking jumps and branches (jal,
+jalr, bltzal, bgezal) and jumps back to one of the return addresses on it
+(usually `jr $ra`), so it needs no cooperation from the guest.
+
+Samples are kept per distinct stack and symbolised only when printing, either
+as a flat profile or as folded stacks ("main;foo;bar 42") for flame graph
+tools. Addresses without a symbol are attributed to the function of the
+innermost frame, which is named by its address then.
+*/
+
+#define SOLOMIPS_PROFILER_MAX_DEPTH 256u
+
+namespace SoloMIPS {
+
+// Function symbols by address, for symbolising guest addresses
+class SymbolTable
+{
+public:
+    /**
+     * Add the function symbols of the .text section of the given relocatable
+     * object, which has been placed at base.
+     */
+    void addObject(const ELF32Object &obj, uint32_t base);
+
+    void add(uint32_t addr, const std::string &name);
+
+    /**
+     * Return the name of the symbol at or before addr, or an empty string if
+     * there is none.
+     */
+    std::string lookup(uint32_t addr) const;
+
+    bool empty() const;
+
+private:
+    std::map<uint32_t, std::string> _symbols;
+};
+
+class Profiler
+{
+public:
+    // Sample every interval instructions of the program started at entry
+    Profiler(uint32_t interval, uint32_t entry);
+
+    // Account a completed instruction at addr; next is the pc afterwards,
+    // taken whether it changed the control flow and r the registers
+    void count(const OP &op, uint32_t addr, uint32_t next, bool taken, const uint32_t *r);
+
+    /**
+     * Print samples per function (self and including callees), most
+     * frequent first.
+     */
+    void printFlat(std::ostream &out, const SymbolTable &symbols) const;
+
+    /**
+     * Print one line per distinct stack in the folded format.
+     */
+    void printFolded(std::ostream &out, const SymbolTable &symbols) const;
+
+    uint64_t samples() const;
+
+private:
+    struct Frame
+    {
+        uint32_t callee;
+        uint32_t ret;
+    };
+
+    enum class Transfer : uint8_t
+    {
+        None,
+        Call,
+        Return
+    };
+
+    void sample(uint32_t addr);
+    // Note a call or return by a jump or taken branch; it takes effect after
+    // the delay slot
+    void transfer(const OP &op, uint32_t next, const uint32_t *r);
+    void completeTransfer();
+    std::vector<std::string> symbolise(const std::vector<uint32_t> &stack, const SymbolTable &symbols) const;
+
+    uint32_t _interval;
+    uint32_t _entry;
+    uint32_t _countdown;
+    uint64_t _samples;
+    std::vector<Frame> _frames;
+    Transfer _pending;
+    Frame _pendingFrame;
+    // Entry and callees of the frames followed by the sampled address
+    std::map<std::vector<uint32_t>, uint64_t> _stacks;
+};
+
+inline void Profiler::count(const OP &op, uint32_t addr, uint32_t next, bool taken, const uint32_t *r)
+{
+    if (--this->_countdown == 0) {
+        this->_countdown = this->_interval;
+        this->sample(addr);
+    }
+    if (this->_pending != Transfer::None)
+        this->completeTransfer();
+    if (op.opcode == Opcode::JAL || (taken && (op.opcode == Opcode::SPECIAL || op.opcode == Opcode::REGIMM)))
+        this->transfer(op, next, r);
+}
+
+}
+
+#endif /* HEADER_SOLOMIPS_PROFILER_HXX */
@@ -19,8 +19,29 @@
  *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "io.hxx"
 #include "ram.hxx"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define SOLOMIPS_LAZY_RAM
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+#define DECODED_PAGE_BITS 12
+#define DECODED_PAGE_OPS (1u << (DECODED_PAGE_BITS - 2))
+
 using namespace SoloMIPS;
 
 RAMMapper::RAMMapper() {}
@@ -78,6 +99,24 @@ uint32_t RAMMapper::loadInstructionWord(uint32_t addr) const
     throw MemoryException("Memory not accessible for executing");
 }
 
+const char *RAMMapper::checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const
+{
+    (void)addr;
+    (void)size;
+    (void)access;
+    return NULL;
+}
+
+uint32_t RAMMapper::lowestAddress() const
+{
+    return 0x00000000u;
+}
+
+uint32_t RAMMapper::highestAddress() const
+{
+    return 0xffffffffu;
+}
+
 
 RAMMapperFlag SoloMIPS::operator|(RAMMapperFlag lhs, RAMMapperFlag rhs)
 {
@@ -95,27 +134,274 @@ RAMMapperFlag SoloMIPS::operator~(RAMMapperFlag f)
 }
 
 
+static const uint8_t zeroPage[1u << DECODED_PAGE_BITS] = {};
+
+// Call visit(offset, length) for every page-sized chunk of the memory which
+// is not all zero. If the memory is a purely anonymous mapping, on Linux the
+// page map tells which host pages were ever populated; the others still read
+// as zero and are skipped without a scan, so a mostly untouched lazy mapping
+// costs only a few page map reads. Untouched pages of a file mapping hold
+// file data, so anything else is scanned in full.
+template <typename Visit>
+static void forEachNonZeroPage(const uint8_t *mem, size_t size, bool anonymous, Visit visit)
+{
+    size_t i = 0;
+#if defined(SOLOMIPS_LAZY_RAM) && defined(__linux__)
+    int fd = anonymous ? open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC) : -1;
+    long hostPage = sysconf(_SC_PAGESIZE);
+    if (fd >= 0 && hostPage >= static_cast<long>(sizeof(zeroPage))) {
+        uintptr_t pageMask = static_cast<uintptr_t>(hostPage) - 1;
+        uintptr_t first = reinterpret_cast<uintptr_t>(mem) & ~pageMask;
+        uintptr_t end = reinterpret_cast<uintptr_t>(mem) + size;
+        uint64_t entries[512];
+        for (uintptr_t page = first; page < end; ) {
+            size_t count = std::min<uintptr_t>(512, (end - page + pageMask) / hostPage);
+            off_t at = static_cast<off_t>(page / hostPage * sizeof(uint64_t));
+            ssize_t n = pread(fd, entries, count * sizeof(uint64_t), at);
+            if (n != static_cast<ssize_t>(count * sizeof(uint64_t)))
+                break;
+            for (size_t e = 0; e < count; ++e, page += hostPage) {
+                // Bit 63: present in RAM, bit 62: swapped out
+                if ((entries[e] >> 62) == 0)
+                    continue;
+                size_t from = page > reinterpret_cast<uintptr_t>(mem) ? page - reinterpret_cast<uintptr_t>(mem) : 0;
+                size_t to = std::min<size_t>(size, page + hostPage - reinterpret_cast<uintptr_t>(mem));
+                for (size_t j = from; j < to; j += sizeof(zeroPage)) {
+                    size_t len = std::min(sizeof(zeroPage), to - j);
+                    if (std::memcmp(mem + j, zeroPage, len) != 0)
+                        visit(j, len);
+                }
+            }
+            i = std::min<size_t>(size, page - reinterpret_cast<uintptr_t>(mem));
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    if (i >= size)
+        return;
+#else
+    (void)anonymous;
+#endif
+    // Fall back to scanning whatever is left
+    for (; i < size; i += sizeof(zeroPage)) {
+        size_t n = std::min(sizeof(zeroPage), size - i);
+        if (std::memcmp(mem + i, zeroPage, n) != 0)
+            visit(i, n);
+    }
+}
+
+RAMImage::RAMImage(const uint8_t *data, size_t size) : _fd(-1), _size(size)
+{
+    this->init(data, size, false);
+}
+
+RAMImage::RAMImage(const ArrayRAMMapper &mapper) : _fd(-1), _size(mapper._size)
+{
+    this->init(mapper._mem, mapper._size, mapper._anonymous);
+}
+
+void RAMImage::init(const uint8_t *data, size_t size, bool anonymous)
+{
+#ifdef SOLOMIPS_LAZY_RAM
+    // Write everything but zero pages to an unlinked file, leaving holes
+#ifdef __linux__
+    this->_fd = memfd_create("solomips-ram", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/solomips-ram-XXXXXX";
+    this->_fd = mkstemp(path);
+    if (this->_fd >= 0)
+        unlink(path);
+#endif
+    if (this->_fd >= 0 && ftruncate(this->_fd, static_cast<off_t>(size)) == 0) {
+        bool ok = true;
+        int fd = this->_fd;
+        forEachNonZeroPage(data, size, anonymous, [&](size_t i, size_t n) {
+            if (ok)
+                ok = (pwrite(fd, data + i, n, static_cast<off_t>(i)) == static_cast<ssize_t>(n));
+        });
+        if (ok)
+            return;
+    }
+    if (this->_fd >= 0) {
+        close(this->_fd);
+        this->_fd = -1;
+    }
+#else
+    (void)anonymous;
+#endif
+    this->_data.assign(data, data + size);
+}
+
+RAMImage::~RAMImage()
+{
+#ifdef SOLOMIPS_LAZY_RAM
+    if (this->_fd >= 0)
+        close(this->_fd);
+#endif
+}
+
+size_t RAMImage::size() const
+{
+    return this->_size;
+}
+
+
+ArrayRAMMapper::DecodedPage::DecodedPage() : generation(0) {}
+
 ArrayRAMMapper::ArrayRAMMapper(uint32_t offset, RAMMapperFlag flags)
-    : _offset(offset), _flags(flags) {}
+    : _offset(offset), _mem(NULL), _size(0), _mapped(false), _anonymous(false), _readOnly(false), _flags(flags), _codeGeneration(0) {}
 
 ArrayRAMMapper::ArrayRAMMapper(uint32_t offset, const std::vector<uint8_t> &data, RAMMapperFlag flags)
-    : _offset(offset), _data(data), _flags(flags) {}
+    : _offset(offset), _data(data), _mem(this->_data.data()), _size(this->_data.size()), _mapped(false), _anonymous(false), _readOnly(false), _flags(flags), _codeGeneration(0) {}
 
 ArrayRAMMapper::ArrayRAMMapper(uint32_t offset, std::vector<uint8_t> &&data, RAMMapperFlag flags)
-    : _offset(offset), _data(std::move(data)), _flags(flags) {}
+    : _offset(offset), _data(std::move(data)), _mem(this->_data.data()), _size(this->_data.size()), _mapped(false), _anonymous(false), _readOnly(false), _flags(flags), _codeGeneration(0) {}
 
 ArrayRAMMapper::ArrayRAMMapper(uint32_t offset, uint32_t length, RAMMapperFlag flags)
-    : _offset(offset), _data(length, 0), _flags(flags) {}
+    : _offset(offset), _mem(NULL), _size(0), _mapped(false), _anonymous(false), _readOnly(false), _flags(flags), _codeGeneration(0)
+{
+    this->allocate(length);
+}
+
+ArrayRAMMapper::ArrayRAMMapper(uint32_t offset, const RAMImage &image, RAMMapperFlag flags)
+    : _offset(offset), _mem(NULL), _size(0), _mapped(false), _anonymous(false), _readOnly(false), _flags(flags), _codeGeneration(0)
+{
+    this->map(image);
+}
+
+ArrayRAMMapper::ArrayRAMMapper(const ArrayRAMMapper &other)
+    : RAMMapper(), _offset(other._offset), _mem(NULL), _size(0), _mapped(false), _anonymous(false), _readOnly(false), _flags(other._flags), _codeGeneration(0)
+{
+    this->copyFrom(other);
+}
+
+ArrayRAMMapper &ArrayRAMMapper::operator=(const ArrayRAMMapper &other)
+{
+    if (this != &other) {
+        this->_offset = other._offset;
+        this->_flags = other._flags;
+        this->copyFrom(other);
+        this->_decoded.clear();
+        this->_instructionMap.clear();
+        ++this->_codeGeneration;
+    }
+    return *this;
+}
+
+ArrayRAMMapper::~ArrayRAMMapper()
+{
+    this->release();
+}
+
+void ArrayRAMMapper::allocate(size_t length)
+{
+    this->release();
+#ifdef SOLOMIPS_LAZY_RAM
+    // Anonymous mappings are zero-filled on demand by the kernel
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    if (length > 0) {
+        void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p != MAP_FAILED) {
+            this->_mem = static_cast<uint8_t *>(p);
+            this->_size = length;
+            this->_mapped = true;
+            this->_anonymous = true;
+            return;
+        }
+    }
+#endif
+    this->_data.assign(length, 0);
+    this->_mem = this->_data.data();
+    this->_size = length;
+}
+
+void ArrayRAMMapper::map(const RAMImage &image)
+{
+    this->release();
+#ifdef SOLOMIPS_LAZY_RAM
+    if (image._fd >= 0 && image._size > 0) {
+        void *p = mmap(NULL, image._size, PROT_READ | PROT_WRITE, MAP_PRIVATE, image._fd, 0);
+        if (p != MAP_FAILED) {
+            this->_mem = static_cast<uint8_t *>(p);
+            this->_size = image._size;
+            this->_mapped = true;
+            return;
+        }
+    }
+    if (image._fd >= 0) {
+        // Read back the file, page by page
+        this->allocate(image._size);
+        for (size_t i = 0; i < image._size; ) {
+            ssize_t n = pread(image._fd, this->_mem + i, std::min(sizeof(zeroPage), image._size - i), static_cast<off_t>(i));
+            if (n <= 0)
+                throw MemoryException("Failed to read RAM image");
+            i += static_cast<size_t>(n);
+        }
+        return;
+    }
+#endif
+    this->allocate(image._size);
+    if (image._size > 0)
+        std::memcpy(this->_mem, image._data.data(), image._size);
+}
+
+void ArrayRAMMapper::release()
+{
+#ifdef SOLOMIPS_LAZY_RAM
+    if (this->_mapped)
+        munmap(this->_mem, this->_size);
+#endif
+    this->_data.clear();
+    this->_data.shrink_to_fit();
+    this->_mem = NULL;
+    this->_size = 0;
+    this->_mapped = false;
+    this->_anonymous = false;
+    this->_readOnly = false;
+}
+
+void ArrayRAMMapper::updateProtection()
+{
+#ifdef SOLOMIPS_LAZY_RAM
+    if (this->_readOnly && this->isWriteable()) {
+        if (mprotect(this->_mem, this->_size, PROT_READ | PROT_WRITE) != 0)
+            throw MemoryException("Failed to make RAM writable");
+        this->_readOnly = false;
+    }
+#endif
+}
+
+void ArrayRAMMapper::copyFrom(const ArrayRAMMapper &other)
+{
+    if (!other._mapped) {
+        std::vector<uint8_t> data(other._mem, other._mem + other._size);
+        this->release();
+        this->_data = std::move(data);
+        this->_mem = this->_data.data();
+        this->_size = this->_data.size();
+        return;
+    }
+
+    // Only copy pages which are not all zero, so that the copy stays sparse
+    this->allocate(other._size);
+    uint8_t *mem = this->_mem;
+    forEachNonZeroPage(other._mem, other._size, other._anonymous, [&](size_t i, size_t n) {
+        std::memcpy(mem + i, other._mem + i, n);
+    });
+}
 
 bool ArrayRAMMapper::respondsTo(uint32_t addr) const
 {
-    return (addr >= this->_offset && addr < this->_offset + this->_data.size());
+    return (addr >= this->_offset && addr - this->_offset < this->_size);
 }
 
 uint8_t ArrayRAMMapper::loadByte(uint32_t addr) const
 {
     if (this->isReadable())
-        return this->_data[addr - this->_offset];
+        return this->_mem[addr - this->_offset];
     return RAMMapper::loadByte(addr);
 }
 
@@ -125,7 +411,7 @@ uint16_t ArrayRAMMapper::loadHalfWord(uint32_t addr) const
         throw MemoryException("Segmentation fault");
     if (this->isReadable()) {
         size_t i = addr - this->_offset;
-        return (this->_data[i] << 8) | this->_data[i+1];
+        return (this->_mem[i] << 8) | this->_mem[i+1];
     }
     return RAMMapper::loadHalfWord(addr);
 }
@@ -136,17 +422,21 @@ uint32_t ArrayRAMMapper::loadWord(uint32_t addr) const
         throw MemoryException("Segmentation fault");
     if (this->isReadable()) {
         size_t i = addr - this->_offset;
-        return (this->_data[i] << 24) | (this->_data[i+1] << 16) | (this->_data[i+2] << 8) | this->_data[i+3];
+        return (this->_mem[i] << 24) | (this->_mem[i+1] << 16) | (this->_mem[i+2] << 8) | this->_mem[i+3];
     }
     return RAMMapper::loadWord(addr);
 }
 
 void ArrayRAMMapper::storeByte(uint32_t addr, uint8_t value)
 {
-    if (this->isWriteable())
-        this->_data[addr - this->_offset] = value;
-    else
+    if (this->isWriteable()) {
+        this->_mem[addr - this->_offset] = value;
+        if (!this->_decoded.empty())
+            this->invalidateInstructions(addr);
+    }
+    else {
         RAMMapper::storeByte(addr, value);
+    }
 }
 
 void ArrayRAMMapper::storeHalfWord(uint32_t addr, uint16_t value)
@@ -155,8 +445,12 @@ void ArrayRAMMapper::storeHalfWord(uint32_t addr, uint16_t value)
         throw MemoryException("Segmentation fault");
     if (this->isWriteable()) {
         size_t i = addr - this->_offset;
-        this->_data[i] = value >> 8;
-        this->_data[i+1] = value & 0xff;
+        this->_mem[i] = value >> 8;
+        this->_mem[i+1] = value & 0xff;
+        if (!this->_decoded.empty()) {
+            this->invalidateInstructions(addr);
+            this->invalidateInstructions(addr + 1);
+        }
     }
     else {
         RAMMapper::storeHalfWord(addr, value);
@@ -169,10 +463,14 @@ void ArrayRAMMapper::storeWord(uint32_t addr, uint32_t value)
         throw MemoryException("Segmentation fault");
     if (this->isWriteable()) {
         size_t i = addr - this->_offset;
-        this->_data[i] = value >> 24;
-        this->_data[i+1] = (value >> 16) & 0xff;
-        this->_data[i+2] = (value >> 8) & 0xff;
-        this->_data[i+3] = value & 0xff;
+        this->_mem[i] = value >> 24;
+        this->_mem[i+1] = (value >> 16) & 0xff;
+        this->_mem[i+2] = (value >> 8) & 0xff;
+        this->_mem[i+3] = value & 0xff;
+        if (!this->_decoded.empty()) {
+            this->invalidateInstructions(addr);
+            this->invalidateInstructions(addr + 3);
+        }
     }
     else {
         RAMMapper::storeWord(addr, value);
@@ -186,6 +484,122 @@ uint32_t ArrayRAMMapper::loadInstructionWord(uint32_t addr) const
     return RAMMapper::loadInstructionWord(addr);
 }
 
+const char *ArrayRAMMapper::checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const
+{
+    // Same order of checks as the load, store and fetch methods
+    bool range = this->respondsTo(addr) && this->respondsTo(addr + size - 1);
+    if (access == RAMMapperFlag::Executable) {
+        if (!this->isExecutable())
+            return "Memory not accessible for executing";
+        return range ? NULL : "Segmentation fault";
+    }
+    if (!range)
+        return "Segmentation fault";
+    if (access == RAMMapperFlag::Writable)
+        return this->isWriteable() ? NULL : "Memory not accessible for writing";
+    return this->isReadable() ? NULL : "Memory not accessible for reading";
+}
+
+uint32_t ArrayRAMMapper::lowestAddress() const
+{
+    return this->_offset;
+}
+
+uint32_t ArrayRAMMapper::highestAddress() const
+{
+    if (this->_size == 0)
+        return this->_offset;
+    return this->_offset + static_cast<uint32_t>(this->_size - 1);
+}
+
+const OP &ArrayRAMMapper::loadInstruction(uint32_t addr)
+{
+    const OP *op = this->findInstruction(addr);
+    if (op != NULL)
+        return *op;
+    if (!this->isExecutable())
+        throw MemoryException("Memory not accessible for executing");
+    if (!this->respondsTo(addr) || !this->respondsTo(addr + 3))
+        throw MemoryException("Segmentation fault");
+    throw InvalidOPException();
+}
+
+const OP *ArrayRAMMapper::findInstruction(uint32_t addr)
+{
+    if (!this->isExecutable() || !this->respondsTo(addr) || !this->respondsTo(addr + 3))
+        return NULL;
+
+    size_t i = addr - this->_offset;
+    if (i & 0x03) {
+        // Pages are aligned to the mapper offset; decode on the fly
+        try {
+            this->_unalignedOp.decode(&this->_mem[i]);
+        }
+        catch (InvalidOPException &) {
+            return NULL;
+        }
+        return &this->_unalignedOp;
+    }
+
+    size_t page = i >> DECODED_PAGE_BITS;
+    if (this->_decoded.empty())
+        this->_decoded.resize((this->_size >> DECODED_PAGE_BITS) + 1);
+    if (this->_decoded[page].ops.empty())
+        this->decodePage(page);
+
+    DecodedPage &dp = this->_decoded[page];
+    size_t j = (i >> 2) & (DECODED_PAGE_OPS - 1);
+    if (dp.invalid[j])
+        return NULL;
+    return &dp.ops[j];
+}
+
+void ArrayRAMMapper::decodePage(size_t page)
+{
+    DecodedPage &dp = this->_decoded[page];
+    size_t start = page << DECODED_PAGE_BITS;
+    size_t end = std::min(start + (DECODED_PAGE_OPS << 2), this->_size);
+    size_t count = (end - start) >> 2;
+
+    dp.ops.resize(count);
+    dp.invalid.assign(count, 0);
+    const std::vector<uint8_t> &map = this->_instructionMap;
+    for (size_t j = 0; j < count; ++j) {
+        size_t w = (start >> 2) + j;
+        if ((w >> 3) < map.size() && !(map[w >> 3] & (0x80 >> (w & 7)))) {
+            dp.invalid[j] = 1;
+            continue;
+        }
+        try {
+            dp.ops[j].decode(&this->_mem[start + (j << 2)]);
+        }
+        catch (InvalidOPException &) {
+            dp.invalid[j] = 1;
+        }
+    }
+}
+
+void ArrayRAMMapper::invalidateInstructions(uint32_t addr)
+{
+    DecodedPage &dp = this->_decoded[(addr - this->_offset) >> DECODED_PAGE_BITS];
+    if (!dp.ops.empty()) {
+        dp.ops.clear();
+        ++dp.generation;
+    }
+    this->_instructionMap.clear();
+}
+
+uint32_t ArrayRAMMapper::codeGeneration() const
+{
+    return this->_codeGeneration;
+}
+
+uint32_t ArrayRAMMapper::pageGeneration(uint32_t addr) const
+{
+    size_t page = (addr - this->_offset) >> DECODED_PAGE_BITS;
+    return (page < this->_decoded.size()) ? this->_decoded[page].generation : 0;
+}
+
 RAMMapperFlag ArrayRAMMapper::flags() const
 {
     return this->_flags;
@@ -194,11 +608,7 @@ RAMMapperFlag ArrayRAMMapper::flags() const
 void ArrayRAMMapper::setFlags(RAMMapperFlag flags)
 {
     this->_flags = flags;
-}
-
-bool ArrayRAMMapper::isReadable() const
-{
-    return (this->_flags & RAMMapperFlag::Readable) == RAMMapperFlag::Readable;
+    this->updateProtection();
 }
 
 void ArrayRAMMapper::setReadable(bool readable)
@@ -209,22 +619,13 @@ void ArrayRAMMapper::setReadable(bool readable)
         this->_flags = this->_flags & ~RAMMapperFlag::Readable;
 }
 
-bool ArrayRAMMapper::isWriteable() const
-{
-    return (this->_flags & RAMMapperFlag::Writable) == RAMMapperFlag::Writable;
-}
-
 void ArrayRAMMapper::setWriteable(bool readable)
 {
     if (readable)
         this->_flags = this->_flags | RAMMapperFlag::Writable;
     else
         this->_flags = this->_flags & ~RAMMapperFlag::Writable;
-}
-
-bool ArrayRAMMapper::isExecutable() const
-{
-    return (this->_flags & RAMMapperFlag::Executable) == RAMMapperFlag::Executable;
+    this->updateProtection();
 }
 
 void ArrayRAMMapper::setExecutable(bool readable)
@@ -243,31 +644,196 @@ uint32_t ArrayRAMMapper::offset() const
 void ArrayRAMMapper::setOffset(uint32_t offset)
 {
     this->_offset = offset;
+    this->_decoded.clear();
+    ++this->_codeGeneration;
 }
 
 uint8_t *ArrayRAMMapper::data()
 {
-    return this->_data.data();
+    return this->_mem;
+}
+
+const uint8_t *ArrayRAMMapper::data() const
+{
+    return this->_mem;
 }
 
 void ArrayRAMMapper::setData(const std::vector<uint8_t> &data)
 {
+    this->release();
     this->_data = data;
+    this->_mem = this->_data.data();
+    this->_size = this->_data.size();
+    this->_decoded.clear();
+    this->_instructionMap.clear();
+    ++this->_codeGeneration;
 }
 
 void ArrayRAMMapper::setData(std::vector<uint8_t> &&data)
 {
+    this->release();
     this->_data = std::move(data);
+    this->_mem = this->_data.data();
+    this->_size = this->_data.size();
+    this->_decoded.clear();
+    this->_instructionMap.clear();
+    ++this->_codeGeneration;
 }
 
 uint32_t ArrayRAMMapper::size() const
 {
-    return static_cast<uint32_t>(this->_data.size());
+    return static_cast<uint32_t>(this->_size);
 }
 
+void ArrayRAMMapper::mapFile(const std::string &fileName)
+{
+    // The mapper must end within the address space
+    uint64_t maxSize = 0x100000000ull - this->_offset;
+#ifdef SOLOMIPS_LAZY_RAM
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw IOException("could not open file '" + fileName + "'");
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            throw IOException("file '" + fileName + "' is empty or could not be read");
+        }
+        if (static_cast<uint64_t>(st.st_size) > maxSize) {
+            close(fd);
+            throw IOException("file '" + fileName + "' too large");
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        int prot = this->isWriteable() ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void *p = mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p != MAP_FAILED) {
+            this->release();
+            this->_mem = static_cast<uint8_t *>(p);
+            this->_size = size;
+            this->_mapped = true;
+            this->_readOnly = !this->isWriteable();
+            this->_decoded.clear();
+            this->_instructionMap.clear();
+            ++this->_codeGeneration;
+            return;
+        }
+    }
+    else {
+        close(fd);
+    }
+#endif
+    // Not a regular file or no mmap(); read it
+    this->setData(loadBinaryFile(fileName, static_cast<size_t>(std::min<uint64_t>(maxSize, SIZE_MAX))));
+}
+
+void ArrayRAMMapper::mapFileAt(uint32_t addr, const std::string &fileName, uint32_t fileOffset, uint32_t size)
+{
+    if (addr < this->_offset || static_cast<uint64_t>(addr - this->_offset) + size > this->_size)
+        throw IOException("contents of file '" + fileName + "' do not fit the memory");
+    if (size == 0)
+        return;
+    this->updateProtection();
+    this->_decoded.clear();
+    this->_instructionMap.clear();
+    ++this->_codeGeneration;
+
+    uint8_t *dst = this->_mem + (addr - this->_offset);
+    size_t done = 0;
+#ifdef SOLOMIPS_LAZY_RAM
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw IOException("could not open file '" + fileName + "'");
+    // Mapped pages past the end of the file would fault on access
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < static_cast<uint64_t>(fileOffset) + size) {
+        close(fd);
+        throw IOException("file '" + fileName + "' could not be read");
+    }
+    // Whole pages of a mapping can be replaced by the file
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    if (this->_mapped && (dst - this->_mem) % pageSize == 0 && fileOffset % pageSize == 0) {
+        // Like the rest of the memory, the pages stay host-writable, which
+        // only ever copies them
+        size_t pages = size / pageSize * pageSize;
+        if (pages > 0 && mmap(dst, pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, static_cast<off_t>(fileOffset)) != MAP_FAILED) {
+            // Untouched pages now hold file data instead of zeros
+            this->_anonymous = false;
+            done = pages;
+        }
+    }
+    while (done < size) {
+        ssize_t n = pread(fd, dst + done, size - done, static_cast<off_t>(fileOffset + done));
+        if (n <= 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+#else
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+    if (file.seekg(fileOffset))
+        done = static_cast<size_t>(file.read(reinterpret_cast<char *>(dst), size).gcount());
+#endif
+    if (done < size)
+        throw IOException("file '" + fileName + "' could not be read");
+}
+
+void ArrayRAMMapper::zeroFill(uint32_t length)
+{
+    this->allocate(length);
+    this->_decoded.clear();
+    this->_instructionMap.clear();
+    ++this->_codeGeneration;
+}
+
+void ArrayRAMMapper::setInstructionMap(std::vector<uint8_t> &&map)
+{
+    this->_instructionMap = std::move(map);
+    this->_decoded.clear();
+    ++this->_codeGeneration;
+}
+
+
+static size_t fdRead(int fd, char *buffer, size_t size)
+{
+    for (;/*_*/;) {
+#ifdef _WIN32
+        int n = _read(fd, buffer, static_cast<unsigned int>(size));
+#else
+        ssize_t n = read(fd, buffer, size);
+#endif
+        if (n >= 0)
+            return static_cast<size_t>(n);
+        if (errno != EINTR)
+            throw std::ios_base::failure("Failed to read input");
+    }
+}
+
+static void fdWrite(int fd, const char *buffer, size_t size)
+{
+    while (size > 0) {
+#ifdef _WIN32
+        int n = _write(fd, buffer, static_cast<unsigned int>(size));
+#else
+        ssize_t n = write(fd, buffer, size);
+#endif
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::ios_base::failure("Failed to write output");
+        }
+        buffer += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+
 
 InputRAMMapper::InputRAMMapper(uint32_t offset, std::istream *input)
-    : _offset(offset), _input(input) {}
+    : _offset(offset), _input(input), _fd(-1), _tie(NULL), _buffer(SOLOMIPS_IO_BUFFER_SIZE), _pos(0), _end(0) {}
+
+InputRAMMapper::InputRAMMapper(uint32_t offset, int fd)
+    : _offset(offset), _input(NULL), _fd(fd), _tie(NULL), _buffer(SOLOMIPS_IO_BUFFER_SIZE), _pos(0), _end(0) {}
 
 bool InputRAMMapper::respondsTo(uint32_t addr) const
 {
@@ -277,7 +843,39 @@ bool InputRAMMapper::respondsTo(uint32_t addr) const
 uint8_t InputRAMMapper::loadByte(uint32_t addr) const
 {
     (void)addr;
-    return static_cast<uint8_t>(this->_input->get());
+    if (this->_pos == this->_end && !this->fill())
+        return 0xff;
+    return static_cast<uint8_t>(this->_buffer[this->_pos++]);
+}
+
+bool InputRAMMapper::fill() const
+{
+    if (this->_tie != NULL)
+        this->_tie->flush();
+
+    this->_pos = 0;
+    this->_end = 0;
+    if (this->_fd >= 0) {
+        // Returns whatever is available, i.e. a line on terminals
+        this->_end = fdRead(this->_fd, this->_buffer.data(), this->_buffer.size());
+    }
+    else if (this->_input != NULL) {
+        // Take what the stream has buffered, or block for a single character
+        std::streambuf *sb = this->_input->rdbuf();
+        std::streamsize n = sb->in_avail();
+        if (n > 0) {
+            n = sb->sgetn(this->_buffer.data(), std::min(n, static_cast<std::streamsize>(this->_buffer.size())));
+            this->_end = static_cast<size_t>(n);
+        }
+        else {
+            int c = sb->sbumpc();
+            if (c != std::char_traits<char>::eof()) {
+                this->_buffer[0] = static_cast<char>(c);
+                this->_end = 1;
+            }
+        }
+    }
+    return this->_end > 0;
 }
 
 uint16_t InputRAMMapper::loadHalfWord(uint32_t addr) const
@@ -290,6 +888,27 @@ uint32_t InputRAMMapper::loadWord(uint32_t addr) const
     return static_cast<uint32_t>(this->loadByte(addr));
 }
 
+const char *InputRAMMapper::checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const
+{
+    (void)addr;
+    (void)size;
+    if (access == RAMMapperFlag::Writable)
+        return "Memory not accessible for writing";
+    if (access == RAMMapperFlag::Executable)
+        return "Memory not accessible for executing";
+    return NULL;
+}
+
+uint32_t InputRAMMapper::lowestAddress() const
+{
+    return this->_offset;
+}
+
+uint32_t InputRAMMapper::highestAddress() const
+{
+    return this->_offset;
+}
+
 uint32_t InputRAMMapper::offset() const
 {
     return this->_offset;
@@ -308,11 +927,56 @@ std::istream *InputRAMMapper::input() const
 void InputRAMMapper::setInput(std::istream *input)
 {
     this->_input = input;
+    this->_fd = -1;
+    this->_pos = 0;
+    this->_end = 0;
+}
+
+int InputRAMMapper::fd() const
+{
+    return this->_fd;
+}
+
+void InputRAMMapper::setFd(int fd)
+{
+    this->_input = NULL;
+    this->_fd = fd;
+    this->_pos = 0;
+    this->_end = 0;
+}
+
+OutputRAMMapper *InputRAMMapper::tie() const
+{
+    return this->_tie;
+}
+
+void InputRAMMapper::setTie(OutputRAMMapper *tie)
+{
+    this->_tie = tie;
 }
 
 
 OutputRAMMapper::OutputRAMMapper(uint32_t offset, std::ostream *output)
-    : _offset(offset), _output(output) {}
+    : _offset(offset), _output(output), _fd(-1), _lineBuffered(false)
+{
+    this->_buffer.reserve(SOLOMIPS_IO_BUFFER_SIZE);
+}
+
+OutputRAMMapper::OutputRAMMapper(uint32_t offset, int fd)
+    : _offset(offset), _output(NULL), _fd(fd), _lineBuffered(isTerminal(fd))
+{
+    this->_buffer.reserve(SOLOMIPS_IO_BUFFER_SIZE);
+}
+
+OutputRAMMapper::~OutputRAMMapper()
+{
+    try {
+        this->flush();
+    }
+    catch (std::exception &) {
+        // Nowhere to report this
+    }
+}
 
 bool OutputRAMMapper::respondsTo(uint32_t addr) const
 {
@@ -322,7 +986,9 @@ bool OutputRAMMapper::respondsTo(uint32_t addr) const
 void OutputRAMMapper::storeByte(uint32_t addr, uint8_t value)
 {
     (void)addr;
-    this->_output->put(static_cast<char>(value));
+    this->_buffer.push_back(static_cast<char>(value));
+    if (this->_buffer.size() >= SOLOMIPS_IO_BUFFER_SIZE || (this->_lineBuffered && value == '\n'))
+        this->flush();
 }
 
 void OutputRAMMapper::storeHalfWord(uint32_t addr, uint16_t value)
@@ -335,6 +1001,41 @@ void OutputRAMMapper::storeWord(uint32_t addr, uint32_t value)
     this->storeByte(addr, static_cast<uint8_t>(value));
 }
 
+void OutputRAMMapper::flush()
+{
+    if (this->_buffer.empty())
+        return;
+    if (this->_fd >= 0) {
+        fdWrite(this->_fd, this->_buffer.data(), this->_buffer.size());
+    }
+    else if (this->_output != NULL) {
+        this->_output->write(this->_buffer.data(), static_cast<std::streamsize>(this->_buffer.size()));
+        this->_output->flush();
+    }
+    this->_buffer.clear();
+}
+
+const char *OutputRAMMapper::checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const
+{
+    (void)addr;
+    (void)size;
+    if (access == RAMMapperFlag::Readable)
+        return "Memory not accessible for reading";
+    if (access == RAMMapperFlag::Executable)
+        return "Memory not accessible for executing";
+    return NULL;
+}
+
+uint32_t OutputRAMMapper::lowestAddress() const
+{
+    return this->_offset;
+}
+
+uint32_t OutputRAMMapper::highestAddress() const
+{
+    return this->_offset;
+}
+
 uint32_t OutputRAMMapper::offset() const
 {
     return this->_offset;
@@ -352,77 +1053,69 @@ std::ostream *OutputRAMMapper::output() const
 
 void OutputRAMMapper::setOutput(std::ostream *output)
 {
+    this->flush();
     this->_output = output;
+    this->_fd = -1;
 }
 
-
-RAMPointer::RAMPointer(RAMMapper *mapper, uint32_t addr)
-    : _mapper(mapper), _addr(addr) {}
-
-RAMPointer::operator uint8_t() const
+int OutputRAMMapper::fd() const
 {
-    return this->_mapper->loadByte(this->_addr);
+    return this->_fd;
 }
 
-RAMPointer::operator uint16_t() const
+void OutputRAMMapper::setFd(int fd)
 {
-    return this->_mapper->loadHalfWord(this->_addr);
+    this->flush();
+    this->_output = NULL;
+    this->_fd = fd;
+    this->_lineBuffered = isTerminal(fd);
 }
 
-RAMPointer::operator uint32_t() const
+bool OutputRAMMapper::isLineBuffered() const
 {
-    return this->_mapper->loadWord(this->_addr);
+    return this->_lineBuffered;
 }
 
-RAMPointer::operator int8_t() const
+void OutputRAMMapper::setLineBuffered(bool lineBuffered)
 {
-    return static_cast<int8_t>(this->_mapper->loadByte(this->_addr));
+    this->_lineBuffered = lineBuffered;
 }
 
-RAMPointer::operator int16_t() const
-{
-    return static_cast<int16_t>(this->_mapper->loadHalfWord(this->_addr));
-}
 
-RAMPointer::operator int32_t() const
-{
-    return static_cast<int8_t>(this->_mapper->loadWord(this->_addr));
-}
+RAMPointer::RAMPointer(RAMMapper *mapper, uint32_t addr)
+    : _mapper(mapper), _addr(addr), _host(NULL) {}
+
+RAMPointer::RAMPointer(ArrayRAMMapper *mapper, uint32_t addr, uint8_t *host)
+    : _mapper(mapper), _addr(addr), _host(host) {}
 
-RAMPointer &RAMPointer::operator=(uint8_t value)
+RAMPointer::operator int8_t() const
 {
-    this->_mapper->storeByte(this->_addr, value);
-    return *this;
+    return static_cast<int8_t>(static_cast<uint8_t>(*this));
 }
 
-RAMPointer &RAMPointer::operator=(uint16_t value)
+RAMPointer::operator int16_t() const
 {
-    this->_mapper->storeHalfWord(this->_addr, value);
-    return *this;
+    return static_cast<int16_t>(static_cast<uint16_t>(*this));
 }
 
-RAMPointer &RAMPointer::operator=(uint32_t value)
+RAMPointer::operator int32_t() const
 {
-    this->_mapper->storeWord(this->_addr, value);
-    return *this;
+    return static_cast<int32_t>(static_cast<uint32_t>(*this));
 }
 
 RAMPointer &RAMPointer::operator=(int8_t value)
 {
-    this->_mapper->storeByte(this->_addr, static_cast<uint8_t>(value));
-    return *this;
+    return *this = static_cast<uint8_t>(value);
 }
 
 RAMPointer &RAMPointer::operator=(int16_t value)
 {
-    this->_mapper->storeHalfWord(this->_addr, static_cast<uint16_t>(value));
-    return *this;
+    return *this = static_cast<uint16_t>(value);
 }
 
 RAMPointer &RAMPointer::operator=(int32_t value)
 {
-    this->_mapper->storeWord(this->_addr, static_cast<uint32_t>(value));
-    return *this;
+    return *this = static_cast<uint32_t>(value);
 }
 
 uint32_t RAMPointer::instr() const
@@ -436,11 +1129,22 @@ RAMPointer::operator OP() const
 }
 
 
-RAM::RAM() {}
+RAMPage::RAMPage() : mapper(NULL), array(NULL), host(NULL), shared(false) {}
+
+
+RAM::RAM() : _generation(0), _paged(false) {}
 
 void RAM::addMapper(RAMMapper *mapper)
 {
     this->_mappers.push_back(mapper);
+    ++this->_generation;
+    this->rebuildPages();
+}
+
+void RAM::addMapper(const std::shared_ptr<RAMMapper> &mapper)
+{
+    this->_owned.push_back(mapper);
+    this->addMapper(mapper.get());
 }
 
 void RAM::removeMapper(RAMMapper *mapper)
@@ -451,19 +1155,126 @@ void RAM::removeMapper(RAMMapper *mapper)
             break;
         }
     }
+    ++this->_generation;
+    this->rebuildPages();
+
+    for (auto i = this->_owned.begin(); i != this->_owned.end(); ++i) {
+        if (i->get() == mapper) {
+            this->_owned.erase(i);
+            break;
+        }
+    }
 }
 
 void RAM::removeAllMappers()
 {
     this->_mappers.clear();
+    ++this->_generation;
+    this->rebuildPages();
+    this->_owned.clear();
+}
+
+const std::vector<RAMMapper *> &RAM::mappers() const
+{
+    return this->_mappers;
 }
 
-RAMPointer RAM::operator[](uint32_t addr)
+RAMMapper *RAM::mapperAt(uint32_t addr)
 {
+    RAMMapper *mapper = this->findMapper(addr);
+    if (mapper == NULL)
+        throw MemoryException("Segmentation fault");
+    return mapper;
+}
+
+RAMMapper *RAM::findMapper(uint32_t addr)
+{
+    if (this->_paged) {
+        const RAMPage *page = this->pageAt(addr);
+        if (page == NULL)
+            return NULL;
+        if (page->array != NULL)
+            return page->array;
+        if (page->mapper != NULL)
+            return page->mapper->respondsTo(addr) ? page->mapper : NULL;
+        if (!page->shared)
+            return NULL;
+    }
+
     for (auto i = this->_mappers.rbegin(); i != this->_mappers.rend(); ++i) {
         if ((*i)->respondsTo(addr))
-            return RAMPointer(*i, addr);
+            return *i;
+    }
+
+    return NULL;
+}
+
+const char *RAM::checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access)
+{
+    RAMMapper *mapper = this->findMapper(addr);
+    if (mapper == NULL)
+        return "Segmentation fault";
+    return mapper->checkAccess(addr, size, access);
+}
+
+void RAM::rebuildPages()
+{
+    this->_pages.assign(1u << SOLOMIPS_RAM_TABLE_BITS, std::vector<RAMPage>());
+    this->_paged = true;
+
+    // Oldest mapper first, so that later ones take precedence
+    for (RAMMapper *mapper : this->_mappers) {
+        uint32_t lowest = mapper->lowestAddress();
+        uint32_t highest = mapper->highestAddress();
+        if (lowest == 0x00000000u && highest == 0xffffffffu) {
+            this->_pages.clear();
+            this->_paged = false;
+            return;
+        }
+        ArrayRAMMapper *array = dynamic_cast<ArrayRAMMapper *>(mapper);
+
+        for (uint32_t n = lowest >> SOLOMIPS_RAM_PAGE_BITS; ; ++n) {
+            std::vector<RAMPage> &table = this->_pages[n >> SOLOMIPS_RAM_TABLE_BITS];
+            if (table.empty())
+                table.resize(1u << SOLOMIPS_RAM_TABLE_BITS);
+            RAMPage &page = table[n & ((1u << SOLOMIPS_RAM_TABLE_BITS) - 1)];
+
+            uint32_t first = n << SOLOMIPS_RAM_PAGE_BITS;
+            uint32_t last = first | SOLOMIPS_RAM_PAGE_MASK;
+            if (array != NULL && array->size() > 0 && lowest <= first && highest >= last) {
+                page.mapper = array;
+                page.array = array;
+                page.host = array->data() + (first - lowest);
+                page.shared = false;
+            }
+            else if (page.mapper == NULL && !page.shared) {
+                page.mapper = mapper;
+            }
+            else {
+                page.mapper = NULL;
+                page.array = NULL;
+                page.host = NULL;
+                page.shared = true;
+            }
+
+            if (n == highest >> SOLOMIPS_RAM_PAGE_BITS)
+                break;
+        }
     }
+}
+
+bool RAM::isExclusive(const RAMMapper *mapper, uint32_t first, uint32_t last) const
+{
+    for (auto i = this->_mappers.rbegin(); i != this->_mappers.rend(); ++i) {
+        if (*i == mapper)
+            return true;
+        if ((*i)->lowestAddress() <= last && (*i)->highestAddress() >= first)
+            return false;
+    }
+    return false;
+}
 
-    throw MemoryException("Segmentation fault");
+uint32_t RAM::generation() const
+{
+    return this->_generation;
 }
@@ -25,6 +25,8 @@
 #include <cstdint>
 #include <iostream>
 #include <exception>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "op.hxx"
@@ -38,8 +40,21 @@ ability to decode appropriatly.
 
 RAM mappers can be added and removed at runtime. The most recently added mapper
 will be asked first; if no mapper responds, an exception is thrown.
+
+To avoid asking every mapper on each access, RAM keeps a two-level table of
+4 KiB pages which is rebuilt whenever the set of mappers changes. Pages served
+entirely by an ArrayRAMMapper point straight at its backing memory; all other
+pages remember the only mapper which might respond, or fall back to asking all
+mappers if there are several. Mappers which do not report their bounds (see
+`RAMMapper::lowestAddress()`) disable the table altogether.
 */
 
+#define SOLOMIPS_RAM_PAGE_BITS 12
+#define SOLOMIPS_RAM_PAGE_MASK ((1u << SOLOMIPS_RAM_PAGE_BITS) - 1)
+#define SOLOMIPS_RAM_TABLE_BITS 10
+
+#define SOLOMIPS_IO_BUFFER_SIZE 0x10000u
+
 struct MemoryException : public std::exception
 {
     explicit MemoryException(const char *msg) : _msg(msg) {}
@@ -47,6 +62,19 @@ struct MemoryException : public std::exception
     const char *_msg;
 };
 
+enum class RAMMapperFlag : unsigned int
+{
+    Intangible = 0,
+    Readable = 1<<0,
+    Writable = 1<<1,
+    Executable = 1<<2
+};
+
+RAMMapperFlag operator|(RAMMapperFlag lhs, RAMMapperFlag rhs);
+RAMMapperFlag operator&(RAMMapperFlag lhs, RAMMapperFlag rhs);
+RAMMapperFlag operator~(RAMMapperFlag f);
+
+
 // Base implementation; generates exceptions on everything
 class RAMMapper
 {
@@ -65,22 +93,49 @@ public:
 
     virtual uint32_t loadInstructionWord(uint32_t addr) const;
 
+    // Return the message of the MemoryException the given access of size
+    // bytes would throw, or NULL if it is expected to succeed; `access` is
+    // exactly one flag. The default cannot tell and always returns NULL.
+    virtual const char *checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const;
+
+    // Bounds (inclusive) of the addresses this mapper might respond to; used
+    // by fast paths to find out which mapper exclusively serves a range
+    virtual uint32_t lowestAddress() const;
+    virtual uint32_t highestAddress() const;
+
 protected:
     RAMMapper();
 };
 
 
-enum class RAMMapperFlag : unsigned int
+// Read-only copy of the memory of an array mapper, from which any number of
+// mappers can be created that share its pages copy-on-write. Where supported,
+// the image lives in an anonymous shared memory file that is mapped privately;
+// otherwise it is kept in memory and copied.
+class ArrayRAMMapper;
+
+class RAMImage
 {
-    Intangible = 0,
-    Readable = 1<<0,
-    Writable = 1<<1,
-    Executable = 1<<2
-};
+public:
+    RAMImage(const uint8_t *data, size_t size);
+    // Cheaper than copying the data when the mapper's memory is sparse
+    explicit RAMImage(const ArrayRAMMapper &mapper);
+    ~RAMImage();
 
-RAMMapperFlag operator|(RAMMapperFlag lhs, RAMMapperFlag rhs);
-RAMMapperFlag operator&(RAMMapperFlag lhs, RAMMapperFlag rhs);
-RAMMapperFlag operator~(RAMMapperFlag f);
+    size_t size() const;
+
+private:
+    RAMImage(const RAMImage &other);
+    RAMImage &operator=(const RAMImage &other);
+
+    void init(const uint8_t *data, size_t size, bool anonymous);
+
+    int _fd;
+    size_t _size;
+    std::vector<uint8_t> _data;
+
+    friend class ArrayRAMMapper;
+};
 
 
 // Array-backed RAM Mapper; general purpose
@@ -90,7 +145,13 @@ public:
     ArrayRAMMapper(uint32_t offset, RAMMapperFlag flags = RAMMapperFlag::Readable);
     ArrayRAMMapper(uint32_t offset, const std::vector<uint8_t> &data, RAMMapperFlag flags = RAMMapperFlag::Readable);
     ArrayRAMMapper(uint32_t offset, std::vector<uint8_t> &&data, RAMMapperFlag flags = RAMMapperFlag::Readable);
+    // Zero-filled; memory is only committed when first written to, if possible
     ArrayRAMMapper(uint32_t offset, uint32_t length, RAMMapperFlag flags = RAMMapperFlag::Readable | RAMMapperFlag::Writable);
+    // Initialized from the image; pages are only copied when written to
+    ArrayRAMMapper(uint32_t offset, const RAMImage &image, RAMMapperFlag flags = RAMMapperFlag::Readable | RAMMapperFlag::Writable);
+    ArrayRAMMapper(const ArrayRAMMapper &other);
+    ArrayRAMMapper &operator=(const ArrayRAMMapper &other);
+    ~ArrayRAMMapper();
 
     bool respondsTo(uint32_t addr) const;
 
@@ -104,6 +165,45 @@ public:
 
     uint32_t loadInstructionWord(uint32_t addr) const;
 
+    const char *checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const;
+
+    uint32_t lowestAddress() const;
+    uint32_t highestAddress() const;
+
+    /**
+     * Return the decoded instruction at the given address.
+     *
+     * Instructions are decoded lazily, one page at a time, and kept until a
+     * store hits the page or the data is replaced. Throws InvalidOPException
+     * if the word is not a valid instruction.
+     */
+    const OP &loadInstruction(uint32_t addr);
+
+    /**
+     * Like `loadInstruction()`, but return NULL instead of throwing if the
+     * instruction cannot be fetched or is invalid.
+     */
+    const OP *findInstruction(uint32_t addr);
+
+    /**
+     * Incremented whenever all decoded instructions are dropped, as when the
+     * data is replaced.
+     */
+    uint32_t codeGeneration() const;
+
+    /**
+     * Incremented whenever a store hits the decoded instructions of the page
+     * holding the address; only meaningful while `codeGeneration()` stays
+     * the same.
+     */
+    uint32_t pageGeneration(uint32_t addr) const;
+
+    /**
+     * Return whether any instructions have been decoded; stores must then go
+     * through the store methods so that they can be invalidated.
+     */
+    bool hasDecodedInstructions() const;
+
     RAMMapperFlag flags() const;
     void setFlags(RAMMapperFlag flags);
     bool isReadable() const;
@@ -117,22 +217,88 @@ public:
     void setOffset(uint32_t offset);
 
     uint8_t *data();
+    const uint8_t *data() const;
     void setData(const std::vector<uint8_t> &data);
     void setData(std::vector<uint8_t> &&data);
     uint32_t size() const;
 
+    /**
+     * Replace the data with the contents of the file. Where supported, the
+     * file is mapped instead of read, so nothing is copied up front: pages are
+     * read in on first access and copied only when written to; while the
+     * mapper is not writable, the mapping is read-only. Throws IOException if
+     * the file cannot be read, is empty or does not fit the address space.
+     */
+    void mapFile(const std::string &fileName);
+
+    /**
+     * Replace size bytes from the given address on with the contents of the
+     * file at the given offset. Where supported, whole pages are mapped from
+     * the file copy-on-write, so they are only read when accessed and only
+     * copied when written to; the rest is read. Throws IOException if the
+     * file cannot be read or the range does not fit the mapper.
+     */
+    void mapFileAt(uint32_t addr, const std::string &fileName, uint32_t fileOffset, uint32_t size);
+
+    /**
+     * Replace the data with length zero bytes; memory is only committed when
+     * first written to, if possible.
+     */
+    void zeroFill(uint32_t length);
+
+    /**
+     * Tell which words hold valid instructions, one bit per word from the
+     * start, most significant bit first. Decoding then skips the other words
+     * instead of trying them. The map is dropped when the data changes.
+     */
+    void setInstructionMap(std::vector<uint8_t> &&map);
+
 private:
+    struct DecodedPage
+    {
+        DecodedPage();
+
+        std::vector<OP> ops;
+        std::vector<uint8_t> invalid;
+        uint32_t generation;
+    };
+
+    void decodePage(size_t page);
+    void invalidateInstructions(uint32_t addr);
+
+    void allocate(size_t length);
+    void map(const RAMImage &image);
+    void release();
+    void updateProtection();
+    void copyFrom(const ArrayRAMMapper &other);
+
     uint32_t _offset;
     std::vector<uint8_t> _data;
+    uint8_t *_mem;          // either _data or a mapping
+    size_t _size;
+    bool _mapped;
+    bool _anonymous;        // mapped, and pages never touched are all zero
+    bool _readOnly;         // mapped without write access
     RAMMapperFlag _flags;
+
+    std::vector<DecodedPage> _decoded;
+    std::vector<uint8_t> _instructionMap;
+    uint32_t _codeGeneration;
+    OP _unalignedOp;
+
+    friend class RAMImage;
 };
 
 
-// Mapper for stream reading
+// Buffered mapper for stream reading; reads from either an istream or a file
+// descriptor. Reading past the end of the input yields 0xff.
+class OutputRAMMapper;
+
 class InputRAMMapper : public RAMMapper
 {
 public:
     explicit InputRAMMapper(uint32_t offset, std::istream *input = &std::cin);
+    InputRAMMapper(uint32_t offset, int fd);
 
     bool respondsTo(uint32_t addr) const;
 
@@ -140,23 +306,53 @@ public:
     uint16_t loadHalfWord(uint32_t addr) const;
     uint32_t loadWord(uint32_t addr) const;
 
+    const char *checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const;
+
+    uint32_t lowestAddress() const;
+    uint32_t highestAddress() const;
+
     uint32_t offset() const;
     void setOffset(uint32_t offset);
 
     std::istream *input() const;
     void setInput(std::istream *input);
+    int fd() const;
+    void setFd(int fd);
+
+    /**
+     * Output to flush whenever more input has to be read, so that prompts are
+     * visible before the guest waits for input.
+     */
+    OutputRAMMapper *tie() const;
+    void setTie(OutputRAMMapper *tie);
 
 private:
+    InputRAMMapper(const InputRAMMapper &other);
+    InputRAMMapper &operator=(const InputRAMMapper &other);
+
+    bool fill() const;
+
     uint32_t _offset;
     std::istream *_input;
+    int _fd;
+    OutputRAMMapper *_tie;
+
+    mutable std::vector<char> _buffer;
+    mutable size_t _pos;
+    mutable size_t _end;
 };
 
 
-// Mapper for stream writing
+// Buffered mapper for stream writing; writes to either an ostream or a file
+// descriptor. Output is written when the buffer is full, on `flush()` and on
+// destruction; if line buffered (the default for terminals), also after every
+// newline.
 class OutputRAMMapper : public RAMMapper
 {
 public:
     explicit OutputRAMMapper(uint32_t offset, std::ostream *output = &std::cout);
+    OutputRAMMapper(uint32_t offset, int fd);
+    ~OutputRAMMapper();
 
     bool respondsTo(uint32_t addr) const;
 
@@ -164,15 +360,39 @@ public:
     void storeHalfWord(uint32_t addr, uint16_t value);
     void storeWord(uint32_t addr, uint32_t value);
 
+    const char *checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access) const;
+
+    uint32_t lowestAddress() const;
+    uint32_t highestAddress() const;
+
     uint32_t offset() const;
     void setOffset(uint32_t offset);
 
     std::ostream *output() const;
     void setOutput(std::ostream *output);
+    int fd() const;
+    // Also enables line buffering if fd refers to a terminal
+    void setFd(int fd);
+
+    bool isLineBuffered() const;
+    void setLineBuffered(bool lineBuffered);
+
+    /**
+     * Write out all buffered output. Throws std::ios_base::failure if writing
+     * to the file descriptor fails.
+     */
+    void flush();
 
 private:
+    OutputRAMMapper(const OutputRAMMapper &other);
+    OutputRAMMapper &operator=(const OutputRAMMapper &other);
+
     uint32_t _offset;
     std::ostream *_output;
+    int _fd;
+    bool _lineBuffered;
+
+    std::vector<char> _buffer;
 };
 
 
@@ -180,6 +400,8 @@ struct RAMPointer
 {
 public:
     RAMPointer(RAMMapper *mapper, uint32_t addr);
+    // Accesses within the page go straight to host memory
+    RAMPointer(ArrayRAMMapper *mapper, uint32_t addr, uint8_t *host);
 
     operator uint8_t() const;
     operator uint16_t() const;
@@ -201,6 +423,19 @@ public:
 private:
     RAMMapper *_mapper;
     uint32_t _addr;
+    uint8_t *_host;
+};
+
+
+// Entry of the page table kept by RAM
+struct RAMPage
+{
+    RAMPage();
+
+    RAMMapper *mapper;          // only mapper which might respond within the page
+    ArrayRAMMapper *array;      // set if an array mapper serves the whole page
+    uint8_t *host;              // backing memory of the page if array is set
+    bool shared;                // several mappers might respond within the page
 };
 
 
@@ -210,15 +445,176 @@ public:
     RAM();
 
     void addMapper(RAMMapper *mapper);
+    // Install a mapper which is kept alive until it is removed again
+    void addMapper(const std::shared_ptr<RAMMapper> &mapper);
     void removeMapper(RAMMapper *mapper);
     void removeAllMappers();
 
+    /**
+     * Return the installed mappers, least recently added first.
+     */
+    const std::vector<RAMMapper *> &mappers() const;
+
     RAMPointer operator[](uint32_t addr);
 
+    /**
+     * Return the mapper responding to the given address; throws a
+     * MemoryException if there is none.
+     */
+    RAMMapper *mapperAt(uint32_t addr);
+
+    /**
+     * Like `mapperAt()`, but return NULL if there is none.
+     */
+    RAMMapper *findMapper(uint32_t addr);
+
+    /**
+     * Return the message of the MemoryException the given access would
+     * throw, or NULL if it is expected to succeed (see
+     * `RAMMapper::checkAccess()`). Never throws.
+     */
+    const char *checkAccess(uint32_t addr, uint32_t size, RAMMapperFlag access);
+
+    /**
+     * Check that no mapper added after the given one could respond to an
+     * address within first and last (inclusive).
+     */
+    bool isExclusive(const RAMMapper *mapper, uint32_t first, uint32_t last) const;
+
+    /**
+     * Return the page table entry for the given address, or NULL if no mapper
+     * might respond to it or the table is disabled.
+     */
+    const RAMPage *pageAt(uint32_t addr) const;
+
+    /**
+     * Incremented whenever the set of mappers changes. Mappers must not be
+     * moved or resized while installed.
+     */
+    uint32_t generation() const;
+
 private:
+    void rebuildPages();
+
     std::vector<RAMMapper *> _mappers;
+    std::vector<std::shared_ptr<RAMMapper>> _owned;
+    uint32_t _generation;
+
+    std::vector<std::vector<RAMPage>> _pages;
+    bool _paged;
 };
 
+
+inline bool ArrayRAMMapper::isReadable() const
+{
+    return (this->_flags & RAMMapperFlag::Readable) == RAMMapperFlag::Readable;
+}
+
+inline bool ArrayRAMMapper::isWriteable() const
+{
+    return (this->_flags & RAMMapperFlag::Writable) == RAMMapperFlag::Writable;
+}
+
+inline bool ArrayRAMMapper::isExecutable() const
+{
+    return (this->_flags & RAMMapperFlag::Executable) == RAMMapperFlag::Executable;
+}
+
+inline bool ArrayRAMMapper::hasDecodedInstructions() const
+{
+    return !this->_decoded.empty();
+}
+
+inline RAMPointer::operator uint8_t() const
+{
+    if (this->_host != NULL && static_cast<ArrayRAMMapper *>(this->_mapper)->isReadable())
+        return this->_host[0];
+    return this->_mapper->loadByte(this->_addr);
+}
+
+inline RAMPointer::operator uint16_t() const
+{
+    if (this->_host != NULL && (this->_addr & SOLOMIPS_RAM_PAGE_MASK) < SOLOMIPS_RAM_PAGE_MASK
+            && static_cast<ArrayRAMMapper *>(this->_mapper)->isReadable())
+        return (this->_host[0] << 8) | this->_host[1];
+    return this->_mapper->loadHalfWord(this->_addr);
+}
+
+inline RAMPointer::operator uint32_t() const
+{
+    if (this->_host != NULL && (this->_addr & SOLOMIPS_RAM_PAGE_MASK) < SOLOMIPS_RAM_PAGE_MASK - 2
+            && static_cast<ArrayRAMMapper *>(this->_mapper)->isReadable()) {
+        const uint8_t *h = this->_host;
+        return (static_cast<uint32_t>(h[0]) << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+    }
+    return this->_mapper->loadWord(this->_addr);
+}
+
+// Stores to pages of a mapper holding decoded instructions take the slow path,
+// which invalidates them.
+
+inline RAMPointer &RAMPointer::operator=(uint8_t value)
+{
+    if (this->_host != NULL) {
+        // Only array mappers hand out host pointers
+        ArrayRAMMapper *array = static_cast<ArrayRAMMapper *>(this->_mapper);
+        if (array->isWriteable() && !array->hasDecodedInstructions()) {
+            this->_host[0] = value;
+            return *this;
+        }
+    }
+    this->_mapper->storeByte(this->_addr, value);
+    return *this;
+}
+
+inline RAMPointer &RAMPointer::operator=(uint16_t value)
+{
+    if (this->_host != NULL && (this->_addr & SOLOMIPS_RAM_PAGE_MASK) < SOLOMIPS_RAM_PAGE_MASK) {
+        ArrayRAMMapper *array = static_cast<ArrayRAMMapper *>(this->_mapper);
+        if (array->isWriteable() && !array->hasDecodedInstructions()) {
+            this->_host[0] = value >> 8;
+            this->_host[1] = value & 0xff;
+            return *this;
+        }
+    }
+    this->_mapper->storeHalfWord(this->_addr, value);
+    return *this;
+}
+
+inline RAMPointer &RAMPointer::operator=(uint32_t value)
+{
+    if (this->_host != NULL && (this->_addr & SOLOMIPS_RAM_PAGE_MASK) < SOLOMIPS_RAM_PAGE_MASK - 2) {
+        ArrayRAMMapper *array = static_cast<ArrayRAMMapper *>(this->_mapper);
+        if (array->isWriteable() && !array->hasDecodedInstructions()) {
+            this->_host[0] = value >> 24;
+            this->_host[1] = (value >> 16) & 0xff;
+            this->_host[2] = (value >> 8) & 0xff;
+            this->_host[3] = value & 0xff;
+            return *this;
+        }
+    }
+    this->_mapper->storeWord(this->_addr, value);
+    return *this;
+}
+
+inline const RAMPage *RAM::pageAt(uint32_t addr) const
+{
+    if (!this->_paged)
+        return NULL;
+    const std::vector<RAMPage> &table = this->_pages[addr >> (32 - SOLOMIPS_RAM_TABLE_BITS)];
+    if (table.empty())
+        return NULL;
+    return &table[(addr >> SOLOMIPS_RAM_PAGE_BITS) & ((1u << SOLOMIPS_RAM_TABLE_BITS) - 1)];
+}
+
+inline RAMPointer RAM::operator[](uint32_t addr)
+{
+    const RAMPage *page = this->pageAt(addr);
+    if (page != NULL && page->array != NULL)
+        return RAMPointer(page->array, addr, page->host + (addr & SOLOMIPS_RAM_PAGE_MASK));
+    return RAMPointer(this->mapperAt(addr), addr);
+}
+
 }
 
 #endif /* HEADER_SOLOMIPS_CPU_HXX */
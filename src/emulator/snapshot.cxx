@@ -0,0 +1,79 @@
+/*
+ *  snapshot.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.hxx"
+
+using namespace SoloMIPS;
+
+Snapshot::Snapshot(const R3000 &cpu) : _state(cpu)
+{
+    for (RAMMapper *mapper : cpu.ram.mappers()) {
+        Mapper m;
+        if (ArrayRAMMapper *array = dynamic_cast<ArrayRAMMapper *>(mapper)) {
+            m.kind = MapperKind::Array;
+            m.offset = array->offset();
+            m.flags = array->flags();
+            m.image = std::make_shared<const RAMImage>(*array);
+        }
+        else if (InputRAMMapper *input = dynamic_cast<InputRAMMapper *>(mapper)) {
+            m.kind = MapperKind::Input;
+            m.offset = input->offset();
+            m.flags = RAMMapperFlag::Readable;
+        }
+        else if (OutputRAMMapper *output = dynamic_cast<OutputRAMMapper *>(mapper)) {
+            m.kind = MapperKind::Output;
+            m.offset = output->offset();
+            m.flags = RAMMapperFlag::Writable;
+        }
+        else {
+            throw SnapshotException("RAM mapper cannot be captured");
+        }
+        this->_mappers.push_back(m);
+    }
+
+    // The state must not keep the original mappers alive, nor share counters
+    this->_state.ram.removeAllMappers();
+    this->_state.statistics = NULL;
+    this->_state.profiler = NULL;
+    this->_state.tracer = NULL;
+}
+
+std::unique_ptr<R3000> Snapshot::fork(std::istream *input, std::ostream *output) const
+{
+    std::unique_ptr<R3000> cpu(new R3000(this->_state));
+
+    for (const Mapper &m : this->_mappers) {
+        switch (m.kind) {
+            case MapperKind::Array:
+                cpu->ram.addMapper(std::shared_ptr<RAMMapper>(new ArrayRAMMapper(m.offset, *m.image, m.flags)));
+                break;
+            case MapperKind::Input:
+                cpu->ram.addMapper(std::shared_ptr<RAMMapper>(new InputRAMMapper(m.offset, input)));
+                break;
+            case MapperKind::Output:
+                cpu->ram.addMapper(std::shared_ptr<RAMMapper>(new OutputRAMMapper(m.offset, output)));
+                break;
+        }
+    }
+
+    cpu->dropCaches();
+    return cpu;
+}
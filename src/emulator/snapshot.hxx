@@ -0,0 +1,86 @@
+/*
+ *  snapshot.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_SNAPSHOT_HXX
+#define HEADER_SOLOMIPS_SNAPSHOT_HXX
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "cpu.hxx"
+
+/*
+Snapshot of a whole machine: registers, pipeline, delayed load and exception,
+and the contents of all RAM mappers. Any number of CPUs can be forked from a
+snapshot; their array mappers share all pages with the snapshot until written
+to (see RAMImage), so forking is cheap regardless of the amount of RAM.
+
+Input and output mappers are recreated at the same addresses with the streams
+given to `fork()`. Other kinds of mappers cannot be captured.
+*/
+
+namespace SoloMIPS {
+
+struct SnapshotException : public std::exception
+{
+    explicit SnapshotException(const char *msg) : _msg(msg) {}
+    const char *what() const noexcept { return this->_msg; }
+    const char *_msg;
+};
+
+class Snapshot
+{
+public:
+    /**
+     * Capture the current state of the given CPU. Throws a SnapshotException
+     * if one of its mappers cannot be captured.
+     */
+    explicit Snapshot(const R3000 &cpu);
+
+    /**
+     * Create a new CPU in the captured state which owns its mappers.
+     */
+    std::unique_ptr<R3000> fork(std::istream *input = &std::cin, std::ostream *output = &std::cout) const;
+
+private:
+    enum class MapperKind : unsigned int
+    {
+        Array = 0,
+        Input,
+        Output
+    };
+
+    struct Mapper
+    {
+        MapperKind kind;
+        uint32_t offset;
+        RAMMapperFlag flags;
+        std::shared_ptr<const RAMImage> image;
+    };
+
+    R3000 _state;
+    std::vector<Mapper> _mappers;
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_SNAPSHOT_HXX */
@@ -0,0 +1,193 @@
+/*
+ *  stats.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <utility>
+#include <vector>
+
+#include "stats.hxx"
+
+using namespace SoloMIPS;
+
+static const char *opcodeName(unsigned int opcode)
+{
+    switch (static_cast<Opcode>(opcode)) {
+        case Opcode::J:     return "j";
+        case Opcode::JAL:   return "jal";
+        case Opcode::BEQ:   return "beq";
+        case Opcode::BNE:   return "bne";
+        case Opcode::BLEZ:  return "blez";
+        case Opcode::BGTZ:  return "bgtz";
+        case Opcode::ADDI:  return "addi";
+        case Opcode::ADDIU: return "addiu";
+        case Opcode::SLTI:  return "slti";
+        case Opcode::SLTIU: return "sltiu";
+        case Opcode::ANDI:  return "andi";
+        case Opcode::ORI:   return "ori";
+        case Opcode::XORI:  return "xori";
+        case Opcode::LUI:   return "lui";
+        case Opcode::LB:    return "lb";
+        case Opcode::LH:    return "lh";
+        case Opcode::LW:    return "lw";
+        case Opcode::LBU:   return "lbu";
+        case Opcode::LHU:   return "lhu";
+        case Opcode::SB:    return "sb";
+        case Opcode::SH:    return "sh";
+        case Opcode::SW:    return "sw";
+        default:            return "?";
+    }
+}
+
+static const char *functName(unsigned int funct)
+{
+    switch (static_cast<Funct>(funct)) {
+        case Funct::SLL:     return "sll";
+        case Funct::SRL:     return "srl";
+        case Funct::SRA:     return "sra";
+        case Funct::SLLV:    return "sllv";
+        case Funct::SRLV:    return "srlv";
+        case Funct::SRAV:    return "srav";
+        case Funct::JR:      return "jr";
+        case Funct::JALR:    return "jalr";
+        case Funct::SYSCALL: return "syscall";
+        case Funct::MFHI:    return "mfhi";
+        case Funct::MTHI:    return "mthi";
+        case Funct::MFLO:    return "mflo";
+        case Funct::MTLO:    return "mtlo";
+        case Funct::MULT:    return "mult";
+        case Funct::MULTU:   return "multu";
+        case Funct::DIV:     return "div";
+        case Funct::DIVU:    return "divu";
+        case Funct::ADD:     return "add";
+        case Funct::ADDU:    return "addu";
+        case Funct::SUB:     return "sub";
+        case Funct::SUBU:    return "subu";
+        case Funct::AND:     return "and";
+        case Funct::OR:      return "or";
+        case Funct::XOR:     return "xor";
+        case Funct::NOR:     return "nor";
+        case Funct::SLT:     return "slt";
+        case Funct::SLTU:    return "sltu";
+        default:             return "?";
+    }
+}
+
+static const char *regimmName(unsigned int rt)
+{
+    switch (rt) {
+        case OP_REGIMM_BLTZ:   return "bltz";
+        case OP_REGIMM_BGEZ:   return "bgez";
+        case OP_REGIMM_BLTZAL: return "bltzal";
+        case OP_REGIMM_BGEZAL: return "bgezal";
+        default:               return "?";
+    }
+}
+
+Statistics::Statistics()
+{
+    std::memset(this->opcodes, 0, sizeof(this->opcodes));
+    std::memset(this->functs, 0, sizeof(this->functs));
+    std::memset(this->regimm, 0, sizeof(this->regimm));
+    this->branchesTaken = 0;
+}
+
+uint64_t Statistics::instructions() const
+{
+    uint64_t n = 0;
+    for (uint64_t c : this->opcodes)
+        n += c;
+    return n;
+}
+
+uint64_t Statistics::branches() const
+{
+    return this->opcodes[static_cast<unsigned int>(Opcode::BEQ)] + this->opcodes[static_cast<unsigned int>(Opcode::BNE)]
+        + this->opcodes[static_cast<unsigned int>(Opcode::BLEZ)] + this->opcodes[static_cast<unsigned int>(Opcode::BGTZ)]
+        + this->opcodes[static_cast<unsigned int>(Opcode::REGIMM)];
+}
+
+uint64_t Statistics::loads(unsigned int width) const
+{
+    switch (width) {
+        case 1:
+            return this->opcodes[static_cast<unsigned int>(Opcode::LB)] + this->opcodes[static_cast<unsigned int>(Opcode::LBU)];
+        case 2:
+            return this->opcodes[static_cast<unsigned int>(Opcode::LH)] + this->opcodes[static_cast<unsigned int>(Opcode::LHU)];
+        case 4:
+            return this->opcodes[static_cast<unsigned int>(Opcode::LW)];
+        default:
+            return 0;
+    }
+}
+
+uint64_t Statistics::stores(unsigned int width) const
+{
+    switch (width) {
+        case 1:
+            return this->opcodes[static_cast<unsigned int>(Opcode::SB)];
+        case 2:
+            return this->opcodes[static_cast<unsigned int>(Opcode::SH)];
+        case 4:
+            return this->opcodes[static_cast<unsigned int>(Opcode::SW)];
+        default:
+            return 0;
+    }
+}
+
+void Statistics::print(std::ostream &out) const
+{
+    uint64_t total = this->instructions();
+    uint64_t branches = this->branches();
+    uint64_t jumps = this->opcodes[static_cast<unsigned int>(Opcode::J)] + this->opcodes[static_cast<unsigned int>(Opcode::JAL)]
+        + this->functs[static_cast<unsigned int>(Funct::JR)] + this->functs[static_cast<unsigned int>(Funct::JALR)];
+
+    out << std::dec;
+    out << "instructions: " << total << " (= cycles)" << std::endl;
+    out << "branches:     " << branches << " (" << this->branchesTaken << " taken, "
+        << (branches - this->branchesTaken) << " not taken)" << std::endl;
+    out << "jumps:        " << jumps << std::endl;
+    out << "loads:        " << (this->loads(1) + this->loads(2) + this->loads(4)) << " (" << this->loads(1) << " byte, "
+        << this->loads(2) << " halfword, " << this->loads(4) << " word)" << std::endl;
+    out << "stores:       " << (this->stores(1) + this->stores(2) + this->stores(4)) << " (" << this->stores(1) << " byte, "
+        << this->stores(2) << " halfword, " << this->stores(4) << " word)" << std::endl;
+
+    std::vector<std::pair<uint64_t, const char *>> histogram;
+    for (unsigned int i = 0; i < 64; ++i) {
+        if (this->functs[i] != 0)
+            histogram.push_back(std::make_pair(this->functs[i], functName(i)));
+        if (this->opcodes[i] != 0 && i != static_cast<unsigned int>(Opcode::SPECIAL) && i != static_cast<unsigned int>(Opcode::REGIMM))
+            histogram.push_back(std::make_pair(this->opcodes[i], opcodeName(i)));
+    }
+    for (unsigned int i = 0; i < 32; ++i) {
+        if (this->regimm[i] != 0)
+            histogram.push_back(std::make_pair(this->regimm[i], regimmName(i)));
+    }
+    std::stable_sort(histogram.begin(), histogram.end(),
+        [](const std::pair<uint64_t, const char *> &a, const std::pair<uint64_t, const char *> &b) { return a.first > b.first; });
+
+    for (const auto &h : histogram) {
+        out << "  " << std::left << std::setw(8) << h.second << std::right << std::setw(14) << h.first << "  "
+            << std::fixed << std::setprecision(2) << std::setw(6) << (100.0 * h.first / total) << "%" << std::endl;
+    }
+}
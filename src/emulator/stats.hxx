@@ -0,0 +1,90 @@
+/*
+ *  stats.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEADER_SOLOMIPS_STATS_HXX
+#define HEADER_SOLOMIPS_STATS_HXX
+
+#include <cstdint>
+#include <ostream>
+
+#include "op.hxx"
+
+/*
+Execution statistics of a CPU: a histogram of completed instructions by opcode
+(and by function for SPECIAL and by rt for REGIMM) and the outcome of
+conditional branches. Loads and stores per width follow from the histogram.
+
+Counting is only done while `R3000::statistics` is set; the engines are
+instantiated with and without it, so the latter does not pay for it at all.
+The R3000 executes one instruction per cycle in this model, so the cycle count
+equals the number of instructions.
+*/
+
+namespace SoloMIPS {
+
+struct Statistics
+{
+    Statistics();
+
+    // Count a completed instruction; taken is only looked at for branches
+    void count(const OP &op, bool taken);
+
+    /**
+     * Print a summary and the histogram, most frequent first.
+     */
+    void print(std::ostream &out) const;
+
+    uint64_t instructions() const;
+    uint64_t branches() const;
+    uint64_t loads(unsigned int width) const;
+    uint64_t stores(unsigned int width) const;
+
+    uint64_t opcodes[64];
+    uint64_t functs[64];
+    uint64_t regimm[32];
+    uint64_t branchesTaken;
+};
+
+inline void Statistics::count(const OP &op, bool taken)
+{
+    ++this->opcodes[static_cast<unsigned int>(op.opcode)];
+    switch (op.opcode) {
+        case Opcode::SPECIAL:
+            ++this->functs[static_cast<unsigned int>(op.funct)];
+            break;
+        case Opcode::REGIMM:
+            ++this->regimm[op.rt & 0x1f];
+            // fall through
+        case Opcode::BEQ:
+        case Opcode::BNE:
+        case Opcode::BLEZ:
+        case Opcode::BGTZ:
+            this->branchesTaken += taken;
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+#endif /* HEADER_SOLOMIPS_STATS_HXX */
@@ -0,0 +1,312 @@
+/*
+ *  threaded.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.hxx"
+#include "handlers.hxx"
+
+/*
+Threaded execution engine. Every instruction is mapped to a handler through a
+flat table indexed by opcode (or 64 + funct for SPECIAL), so dispatch costs a
+single indirect jump instead of the nested switches of `R3000::step()`. With
+GCC and Clang the handlers are labels reached by computed goto; other compilers
+fall back to a switch over the handler index, which still compiles to a single
+jump table.
+
+The cycle is the same as in `step()`: stop at a delayed exception, fetch,
+execute, perform the delayed load, clear r0, prepare the next delayed load.
+Delayed exceptions and loads are only checked for, not dispatched on. Faults
+are recorded like in `R3000::cycle()` and end the run. The instrumented
+instantiation accounts every completed instruction with `R3000::statistics`
+and `R3000::profiler`.
+*/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SOLOMIPS_COMPUTED_GOTO
+#endif
+
+using namespace SoloMIPS;
+
+#ifdef SOLOMIPS_COMPUTED_GOTO
+#define DISPATCH() goto *labels[handlerTable.handlers[handlerIndex(op)]]
+#else
+#define DISPATCH_CASE(name) case H_##name: goto L_##name;
+#define DISPATCH() switch (handlerTable.handlers[handlerIndex(op)]) { SOLOMIPS_HANDLERS(DISPATCH_CASE) }
+#endif
+
+// See the note on `R3000::cycle()` regarding "this->".
+template <bool Instrumented>
+void R3000::runThreaded(uint64_t limit)
+{
+#ifdef SOLOMIPS_COMPUTED_GOTO
+    static const void *const labels[] = {
+#define L(name) &&L_##name,
+        SOLOMIPS_HANDLERS(L)
+#undef L
+    };
+#endif
+
+cycle:
+    // Stop at delayed exceptions and at the limit
+    if (dex != DelayedException::None || instructions >= limit)
+        return;
+    ++instructions;
+
+    // Fetch next instruction
+    op = nextOp;
+    fetchNext();
+    uint32_t fallthrough = pc;
+
+    // Run instruction
+    DISPATCH();
+
+L_BLTZ:
+L_BGEZ:
+L_BLTZAL:
+L_BGEZAL:
+    // Resolved REGIMM handlers are only used by translated blocks
+L_INVALID:
+    fault(DelayedException::InvalidOPException, NULL);
+    return;
+L_SLL:
+    r[op.rd] = r[op.rt] << op.shamt;
+    goto retire;
+L_SRL:
+    r[op.rd] = r[op.rt] >> op.shamt;
+    goto retire;
+L_SRA:
+    sr[op.rd] = sr[op.rt] >> op.shamt;
+    goto retire;
+L_SLLV:
+    r[op.rd] = r[op.rt] << (r[op.rs] & 0x1f);
+    goto retire;
+L_SRLV:
+    r[op.rd] = r[op.rt] >> (r[op.rs] & 0x1f);
+    goto retire;
+L_SRAV:
+    sr[op.rd] = sr[op.rt] >> (r[op.rs] & 0x1f);
+    goto retire;
+L_JALR:
+    r[op.rd] = pc;
+    pc = r[op.rs];
+    goto retire;
+L_JR:
+    pc = r[op.rs];
+    goto retire;
+L_SYSCALL:
+    fault(DelayedException::InvalidOPException, NULL);
+    return;
+L_MFHI:
+    r[op.rd] = hi;
+    goto retire;
+L_MTHI:
+    hi = r[op.rs];
+    goto retire;
+L_MFLO:
+    r[op.rd] = lo;
+    goto retire;
+L_MTLO:
+    lo = r[op.rs];
+    goto retire;
+L_MULT: {
+    int64_t prod = static_cast<int64_t>(sr[op.rs]) * sr[op.rt];
+    hi = static_cast<uint64_t>(prod) >> 32;
+    lo = static_cast<uint64_t>(prod) & 0xffffffff;
+    goto retire;
+}
+L_MULTU: {
+    uint64_t prod = static_cast<uint64_t>(r[op.rs]) * r[op.rt];
+    hi = prod >> 32;
+    lo = prod & 0xffffffff;
+    goto retire;
+}
+L_DIV:
+    if (sr[op.rt] == 0) {
+        fault(DelayedException::ArithmeticException, "Divided by zero");
+        return;
+    }
+    divSigned(sr[op.rs], sr[op.rt], lo, hi);
+    goto retire;
+L_DIVU:
+    if (sr[op.rt] == 0) {
+        fault(DelayedException::ArithmeticException, "Divided by zero");
+        return;
+    }
+    hi = r[op.rs] % r[op.rt];
+    lo = r[op.rs] / r[op.rt];
+    goto retire;
+L_ADD: {
+    uint32_t sum;
+    if (!addSigned(r[op.rs], r[op.rt], sum)) {
+        fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+        return;
+    }
+    r[op.rd] = sum;
+    goto retire;
+}
+L_ADDU:
+    r[op.rd] = r[op.rs] + r[op.rt];
+    goto retire;
+L_SUB: {
+    uint32_t diff;
+    if (!subSigned(r[op.rs], r[op.rt], diff)) {
+        fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+        return;
+    }
+    r[op.rd] = diff;
+    goto retire;
+}
+L_SUBU:
+    r[op.rd] = r[op.rs] - r[op.rt];
+    goto retire;
+L_AND:
+    r[op.rd] = r[op.rs] & r[op.rt];
+    goto retire;
+L_OR:
+    r[op.rd] = r[op.rs] | r[op.rt];
+    goto retire;
+L_XOR:
+    r[op.rd] = r[op.rs] ^ r[op.rt];
+    goto retire;
+L_NOR:
+    r[op.rd] = ~(r[op.rs] | r[op.rt]);
+    goto retire;
+L_SLT:
+    r[op.rd] = sr[op.rs] < sr[op.rt];
+    goto retire;
+L_SLTU:
+    r[op.rd] = r[op.rs] < r[op.rt];
+    goto retire;
+L_REGIMM:
+    switch (op.rt) {
+        case OP_REGIMM_BLTZAL:
+            r[31] = pc;
+            // fall through
+        case OP_REGIMM_BLTZ:
+            if (sr[op.rs] < 0)
+                pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+            break;
+        case OP_REGIMM_BGEZAL:
+            r[31] = pc;
+            // fall through
+        case OP_REGIMM_BGEZ:
+            if (sr[op.rs] >= 0)
+                pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+            break;
+        default:
+            fault(DelayedException::InvalidOPException, NULL);
+            return;
+    }
+    goto retire;
+L_JAL:
+    r[31] = pc;
+    pc = (pc & 0xf0000000) | (op.addr << 2);
+    goto retire;
+L_J:
+    pc = (pc & 0xf0000000) | (op.addr << 2);
+    goto retire;
+L_BEQ:
+    if (r[op.rs] == r[op.rt])
+        pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+    goto retire;
+L_BNE:
+    if (r[op.rs] != r[op.rt])
+        pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+    goto retire;
+L_BLEZ:
+    if (sr[op.rs] <= 0)
+        pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+    goto retire;
+L_BGTZ:
+    if (sr[op.rs] > 0)
+        pc += (static_cast<int32_t>(op.simm) << 2) - 4;
+    goto retire;
+L_ADDI: {
+    uint32_t sum;
+    if (!addSigned(r[op.rs], static_cast<int32_t>(op.simm), sum)) {
+        fault(DelayedException::ArithmeticException, "Arithmetic overflow");
+        return;
+    }
+    r[op.rt] = sum;
+    goto retire;
+}
+L_ADDIU:
+    r[op.rt] = r[op.rs] + op.simm;
+    goto retire;
+L_SLTI:
+    r[op.rt] = (sr[op.rs] < op.simm);
+    goto retire;
+L_SLTIU:
+    r[op.rt] = (r[op.rs] < static_cast<uint32_t>(static_cast<int32_t>(op.simm)));
+    goto retire;
+L_ANDI:
+    r[op.rt] = r[op.rs] & op.imm;
+    goto retire;
+L_ORI:
+    r[op.rt] = r[op.rs] | op.imm;
+    goto retire;
+L_XORI:
+    r[op.rt] = r[op.rs] ^ op.imm;
+    goto retire;
+L_LUI:
+    r[op.rt] = op.imm << 16;
+    goto retire;
+L_LB:
+L_LH:
+L_LW:
+L_LBU:
+L_LHU:
+    // Perform pending delay load, then schedule this one
+    if (dlOpcode != Opcode::SPECIAL && !performDelayedLoad())
+        return;
+    r[0] = 0;
+    dlOpcode = op.opcode;
+    dlTarget = op.rt;
+    dlAddr = op.simm+r[op.rs];
+    if (Instrumented)
+        instrument(fallthrough);
+    goto cycle;
+L_SB:
+    if (!storeByte(op.simm+r[op.rs], static_cast<uint8_t>(r[op.rt])))
+        return;
+    goto retire;
+L_SH:
+    if (!storeHalfWord(op.simm+r[op.rs], static_cast<uint16_t>(r[op.rt])))
+        return;
+    goto retire;
+L_SW:
+    if (!storeWord(op.simm+r[op.rs], r[op.rt]))
+        return;
+    goto retire;
+
+retire:
+    // Perform delay load
+    if (dlOpcode != Opcode::SPECIAL && !performDelayedLoad())
+        return;
+
+    // Always clear zero register
+    r[0] = 0;
+    if (Instrumented)
+        instrument(fallthrough);
+    goto cycle;
+}
+
+template void R3000::runThreaded<false>(uint64_t limit);
+template void R3000::runThreaded<true>(uint64_t limit);
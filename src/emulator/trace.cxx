@@ -0,0 +1,492 @@
+/*
+ *  trace.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <iomanip>
+
+#include "io.hxx"
+#include "cpu.hxx"
+#include "trace.hxx"
+
+using namespace SoloMIPS;
+
+static const char traceMagic[4] = {'S', 'M', 'T', 'R'};
+static const uint8_t traceVersion = 1;
+static const uint8_t traceEnd = 0x80;
+
+// Largest encoded record: flags, pc, word, four register writes, access
+static const size_t traceMaxRecord = 1 + 5 + 4 + 4 * (1 + 5) + 5 + 5;
+
+static inline uint32_t zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80) {
+        *p++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(value);
+    return p;
+}
+
+static inline uint8_t *putWord(uint8_t *p, uint32_t value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+
+TraceRecord::TraceRecord()
+    : pc(0), word(0), writes(0), reg(), value(), access(TraceAccess::None), memAddr(0), memValue(0) {}
+
+bool TraceRecord::operator==(const TraceRecord &other) const
+{
+    if (this->pc != other.pc || this->word != other.word || this->writes != other.writes || this->access != other.access)
+        return false;
+    for (uint8_t i = 0; i < this->writes; ++i) {
+        if (this->reg[i] != other.reg[i] || this->value[i] != other.value[i])
+            return false;
+    }
+    if (this->access != TraceAccess::None && this->memAddr != other.memAddr)
+        return false;
+    return this->access != TraceAccess::Store || this->memValue == other.memValue;
+}
+
+bool TraceRecord::operator!=(const TraceRecord &other) const
+{
+    return !(*this == other);
+}
+
+
+TraceContext::TraceContext()
+    : pc(0), memAddr(0)
+{
+    std::memset(this->regs, 0, sizeof(this->regs));
+    // No instruction is fetched from the top of the address space
+    std::memset(this->cacheAddr, 0xff, sizeof(this->cacheAddr));
+    std::memset(this->cacheWord, 0, sizeof(this->cacheWord));
+}
+
+
+Tracer::Tracer()
+{
+    std::memset(this->_regs, 0, sizeof(this->_regs));
+}
+
+Tracer::~Tracer() {}
+
+void Tracer::record(const R3000 &cpu, uint32_t addr)
+{
+    const OP &op = cpu.op;
+    TraceRecord record;
+    record.pc = addr;
+    record.word = op.encode();
+
+    // Stores read their operands before a delayed load completes, so they
+    // are taken from the previous register file
+    switch (op.opcode) {
+        case Opcode::LB:
+        case Opcode::LH:
+        case Opcode::LW:
+        case Opcode::LBU:
+        case Opcode::LHU:
+            record.access = TraceAccess::Load;
+            record.memAddr = cpu.dlAddr;
+            break;
+        case Opcode::SB:
+            record.access = TraceAccess::Store;
+            record.memAddr = op.simm + this->_regs[op.rs];
+            record.memValue = this->_regs[op.rt] & 0xff;
+            break;
+        case Opcode::SH:
+            record.access = TraceAccess::Store;
+            record.memAddr = op.simm + this->_regs[op.rs];
+            record.memValue = this->_regs[op.rt] & 0xffff;
+            break;
+        case Opcode::SW:
+            record.access = TraceAccess::Store;
+            record.memAddr = op.simm + this->_regs[op.rs];
+            record.memValue = this->_regs[op.rt];
+            break;
+        default:
+            break;
+    }
+
+    // At most the result, hi and lo and a delayed load change; r0 never does
+    for (uint8_t i = 1; i < 34 && record.writes < 4; ++i) {
+        uint32_t value = (i < 32) ? cpu.r[i] : ((i == 32) ? cpu.hi : cpu.lo);
+        if (value != this->_regs[i]) {
+            record.reg[record.writes] = i;
+            record.value[record.writes] = value;
+            ++record.writes;
+            this->_regs[i] = value;
+        }
+    }
+
+    this->retired(record);
+}
+
+
+TraceWriter::TraceWriter(const std::string &path, uint32_t entry)
+    : _path(path), _records(0), _buffer(SOLOMIPS_TRACE_BUFFER_SIZE), _pending(SOLOMIPS_TRACE_BUFFER_SIZE),
+      _used(0), _pendingUsed(0), _hasPending(false), _closing(false), _failed(false)
+{
+    this->_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!this->_file.is_open())
+        throw IOException("could not create file '" + path + "'");
+
+    uint8_t *p = this->_buffer.data();
+    std::memcpy(p, traceMagic, sizeof(traceMagic));
+    p[4] = traceVersion;
+    putWord(p + 5, entry);
+    this->_used = 9;
+    this->_context.pc = entry - 8;
+
+    this->_thread = std::thread(&TraceWriter::writeLoop, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    try {
+        this->close();
+    }
+    catch (std::exception &) {
+        // Nowhere to report this
+    }
+}
+
+void TraceWriter::close()
+{
+    if (!this->_thread.joinable())
+        return;
+    this->_buffer[this->_used++] = traceEnd;
+    this->submit();
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_closing = true;
+    }
+    this->_cond.notify_all();
+    this->_thread.join();
+
+    this->_file.close();
+    if (this->_failed || this->_file.fail())
+        throw IOException("could not write file '" + this->_path + "'");
+}
+
+uint64_t TraceWriter::records() const
+{
+    return this->_records;
+}
+
+void TraceWriter::retired(const TraceRecord &record)
+{
+    if (SOLOMIPS_TRACE_BUFFER_SIZE - this->_used < traceMaxRecord)
+        this->submit();
+
+    TraceContext &c = this->_context;
+    uint8_t *start = this->_buffer.data() + this->_used;
+    uint8_t *p = start + 1;
+    uint8_t flags = record.writes | (static_cast<uint8_t>(record.access) << 5);
+
+    if (record.pc != c.pc + 4) {
+        flags |= 0x08;
+        p = putVarint(p, zigzag(record.pc - (c.pc + 4)));
+    }
+    c.pc = record.pc;
+
+    uint32_t slot = (record.pc >> 2) & (SOLOMIPS_TRACE_WORD_CACHE - 1);
+    if (c.cacheAddr[slot] != record.pc || c.cacheWord[slot] != record.word) {
+        flags |= 0x10;
+        p = putWord(p, record.word);
+        c.cacheAddr[slot] = record.pc;
+        c.cacheWord[slot] = record.word;
+    }
+
+    for (uint8_t i = 0; i < record.writes; ++i) {
+        uint8_t reg = record.reg[i];
+        *p++ = reg;
+        p = putVarint(p, zigzag(record.value[i] - c.regs[reg]));
+        c.regs[reg] = record.value[i];
+    }
+
+    if (record.access != TraceAccess::None) {
+        p = putVarint(p, zigzag(record.memAddr - c.memAddr));
+        c.memAddr = record.memAddr;
+        if (record.access == TraceAccess::Store)
+            p = putVarint(p, record.memValue);
+    }
+
+    *start = flags;
+    this->_used += p - start;
+    ++this->_records;
+}
+
+void TraceWriter::submit()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    this->_cond.wait(lock, [this]{ return !this->_hasPending; });
+    std::swap(this->_buffer, this->_pending);
+    this->_pendingUsed = this->_used;
+    this->_used = 0;
+    this->_hasPending = true;
+    lock.unlock();
+    this->_cond.notify_all();
+}
+
+void TraceWriter::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    for (;/*_*/;) {
+        this->_cond.wait(lock, [this]{ return this->_hasPending || this->_closing; });
+        if (!this->_hasPending)
+            break;
+
+        // The buffer is not touched by the run until it is handed back
+        lock.unlock();
+        if (!this->_failed) {
+            this->_file.write(reinterpret_cast<const char *>(this->_pending.data()), static_cast<std::streamsize>(this->_pendingUsed));
+            if (this->_file.fail())
+                this->_failed = true;
+        }
+        lock.lock();
+        this->_hasPending = false;
+        this->_cond.notify_all();
+    }
+}
+
+
+TraceReader::TraceReader(const std::string &path)
+    : _path(path), _entry(0), _ended(false), _buffer(SOLOMIPS_TRACE_BUFFER_SIZE), _pos(0), _size(0)
+{
+    this->_file.open(path, std::ios::in | std::ios::binary);
+    if (!this->_file.is_open())
+        throw IOException("could not open file '" + path + "'");
+
+    uint8_t header[9];
+    for (size_t i = 0; i < sizeof(header); ++i)
+        header[i] = this->byte();
+    if (std::memcmp(header, traceMagic, sizeof(traceMagic)) != 0 || header[4] != traceVersion)
+        throw IOException("file '" + path + "' is not a trace");
+    this->_entry = header[5] | (header[6] << 8) | (header[7] << 16) | (static_cast<uint32_t>(header[8]) << 24);
+    this->_context.pc = this->_entry - 8;
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    if (this->_ended)
+        return false;
+
+    TraceContext &c = this->_context;
+    uint8_t flags = this->byte();
+    if (flags == traceEnd) {
+        this->_ended = true;
+        return false;
+    }
+    if ((flags & 0x87) > 4 || (flags & 0x60) == 0x60)
+        throw IOException("trace '" + this->_path + "' is corrupt");
+
+    record = TraceRecord();
+    record.writes = flags & 0x07;
+    record.access = static_cast<TraceAccess>((flags >> 5) & 0x03);
+
+    record.pc = c.pc + 4;
+    if (flags & 0x08)
+        record.pc += unzigzag(this->varint());
+    c.pc = record.pc;
+
+    uint32_t slot = (record.pc >> 2) & (SOLOMIPS_TRACE_WORD_CACHE - 1);
+    if (flags & 0x10) {
+        record.word = this->byte();
+        record.word |= this->byte() << 8;
+        record.word |= this->byte() << 16;
+        record.word |= static_cast<uint32_t>(this->byte()) << 24;
+        c.cacheAddr[slot] = record.pc;
+        c.cacheWord[slot] = record.word;
+    }
+    else if (c.cacheAddr[slot] == record.pc) {
+        record.word = c.cacheWord[slot];
+    }
+    else {
+        throw IOException("trace '" + this->_path + "' is corrupt");
+    }
+
+    for (uint8_t i = 0; i < record.writes; ++i) {
+        uint8_t reg = this->byte();
+        if (reg >= 34)
+            throw IOException("trace '" + this->_path + "' is corrupt");
+        record.reg[i] = reg;
+        record.value[i] = c.regs[reg] + unzigzag(this->varint());
+        c.regs[reg] = record.value[i];
+    }
+
+    if (record.access != TraceAccess::None) {
+        record.memAddr = c.memAddr + unzigzag(this->varint());
+        c.memAddr = record.memAddr;
+        if (record.access == TraceAccess::Store)
+            record.memValue = this->varint();
+    }
+    return true;
+}
+
+uint32_t TraceReader::entry() const
+{
+    return this->_entry;
+}
+
+uint8_t TraceReader::byte()
+{
+    if (this->_pos == this->_size) {
+        this->fill();
+        if (this->_size == 0)
+            throw IOException("trace '" + this->_path + "' is truncated");
+    }
+    return this->_buffer[this->_pos++];
+}
+
+uint32_t TraceReader::varint()
+{
+    uint32_t value = 0;
+    for (unsigned int shift = 0; shift < 35; shift += 7) {
+        uint8_t b = this->byte();
+        value |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return value;
+    }
+    throw IOException("trace '" + this->_path + "' is corrupt");
+}
+
+void TraceReader::fill()
+{
+    this->_pos = 0;
+    this->_size = 0;
+    if (this->_file.eof())
+        return;
+    this->_file.read(reinterpret_cast<char *>(this->_buffer.data()), static_cast<std::streamsize>(this->_buffer.size()));
+    if (this->_file.fail() && !this->_file.eof())
+        throw IOException("could not read file '" + this->_path + "'");
+    this->_size = static_cast<size_t>(this->_file.gcount());
+}
+
+
+TraceVerifier::TraceVerifier(TraceReader &reader, R3000 &cpu)
+    : _reader(reader), _cpu(cpu), _records(0), _diverged(false), _traceEnded(false) {}
+
+bool TraceVerifier::finish(std::ostream &out)
+{
+    if (!this->_diverged && this->_error.empty()) {
+        try {
+            if (!this->_reader.next(this->_expected))
+                return true;
+        }
+        catch (IOException &e) {
+            this->_error = e.what();
+        }
+    }
+
+    out << "error: ";
+    if (!this->_error.empty()) {
+        out << this->_error << " at instruction " << std::dec << this->_records << std::endl;
+    }
+    else if (this->_traceEnded) {
+        out << "run continues after the trace ends at instruction " << std::dec << this->_records << std::endl;
+        out << "  actual:   " << this->_actual << std::endl;
+    }
+    else if (!this->_diverged) {
+        out << "trace continues after the run ends at instruction " << std::dec << this->_records << std::endl;
+        out << "  expected: " << this->_expected << std::endl;
+    }
+    else {
+        out << "run diverges from the trace at instruction " << std::dec << this->_records << std::endl;
+        out << "  expected: " << this->_expected << std::endl;
+        out << "  actual:   " << this->_actual << std::endl;
+    }
+    return false;
+}
+
+void TraceVerifier::retired(const TraceRecord &record)
+{
+    if (this->_diverged)
+        return;
+
+    // Exceptions must not leave the engines
+    try {
+        if (!this->_reader.next(this->_expected)) {
+            this->_traceEnded = true;
+            this->_diverged = true;
+        }
+        else if (this->_expected != record) {
+            this->_diverged = true;
+        }
+    }
+    catch (IOException &e) {
+        this->_error = e.what();
+        this->_diverged = true;
+    }
+
+    if (this->_diverged) {
+        this->_actual = record;
+        this->_cpu.interrupt();
+    }
+    else {
+        ++this->_records;
+    }
+}
+
+
+std::ostream &operator<<(std::ostream &out, const TraceRecord &record)
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::hex << std::setfill('0') << "0x" << std::setw(8) << record.pc << "  ";
+    try {
+        out << std::dec << OP(record.word) << std::hex;
+    }
+    catch (InvalidOPException &) {
+        out << ".word  0x" << std::setw(8) << record.word;
+    }
+    for (uint8_t i = 0; i < record.writes; ++i) {
+        out << "  ";
+        if (record.reg[i] == 32)
+            out << "hi";
+        else if (record.reg[i] == 33)
+            out << "lo";
+        else
+            out << "r" << std::dec << static_cast<unsigned int>(record.reg[i]) << std::hex;
+        out << "=0x" << std::setw(8) << record.value[i];
+    }
+    if (record.access == TraceAccess::Load)
+        out << "  load 0x" << std::setw(8) << record.memAddr;
+    else if (record.access == TraceAccess::Store)
+        out << "  store 0x" << std::setw(8) << record.memAddr << " = 0x" << std::setw(8) << record.memValue;
+    out.flags(flags);
+    return out;
+}
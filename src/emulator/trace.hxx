@@ -0,0 +1,239 @@
+/*
+ *  trace.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEADER_SOLOMIPS_TRACE_HXX
+#define HEADER_SOLOMIPS_TRACE_HXX
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "op.hxx"
+
+/*
+Execution traces. A trace holds one record per completed instruction: its
+address and instruction word, the registers it changed (including hi and lo)
+and the address of the memory it accessed, plus the value for stores. Loaded
+values show up as the register write of the following instruction, where the
+delayed load completes; I/O is not read twice for the trace.
+
+The file format is compact rather than simple, so that a trace of a billion
+instructions stays in the order of a few GiB:
+
+    header:  "SMTR" version(1) entry(4, little endian)
+    record:  flags(1) [pc delta] [word(4)] {register(1) value delta}* [access]
+    end:     0x80
+
+Flags hold the number of register writes (bits 0-2), whether pc is not the
+previous pc + 4 (bit 3), whether the word differs from the one last seen at
+this address (bit 4; a small direct mapped cache is kept by both sides) and
+the kind of memory access (bits 5-6). Deltas are zigzag varints against the
+previous pc, the previous value of the register and the previous memory
+address; stored values are plain varints.
+
+The writer encodes into a large buffer that a background thread writes out,
+so the run only stalls if the disk cannot keep up. The reader streams the
+file back in chunks.
+*/
+
+#define SOLOMIPS_TRACE_BUFFER_SIZE 0x400000u
+#define SOLOMIPS_TRACE_WORD_CACHE 1024u
+
+namespace SoloMIPS {
+
+class R3000;
+
+enum class TraceAccess : uint8_t
+{
+    None = 0,
+    Load = 1,
+    Store = 2
+};
+
+struct TraceRecord
+{
+    TraceRecord();
+
+    bool operator==(const TraceRecord &other) const;
+    bool operator!=(const TraceRecord &other) const;
+
+    uint32_t pc;
+    uint32_t word;
+    // Register numbers are 0-31, 32 for hi and 33 for lo
+    uint8_t writes;
+    uint8_t reg[4];
+    uint32_t value[4];
+    TraceAccess access;
+    uint32_t memAddr;
+    uint32_t memValue;
+};
+
+// Encoding state shared by writer and reader
+struct TraceContext
+{
+    TraceContext();
+
+    uint32_t pc;
+    uint32_t memAddr;
+    uint32_t regs[34];
+    uint32_t cacheAddr[SOLOMIPS_TRACE_WORD_CACHE];
+    uint32_t cacheWord[SOLOMIPS_TRACE_WORD_CACHE];
+};
+
+// Attached to `R3000::tracer`; turns completed instructions into records
+class Tracer
+{
+public:
+    Tracer();
+    virtual ~Tracer();
+
+    // Record the instruction completed by cpu at addr
+    void record(const R3000 &cpu, uint32_t addr);
+
+protected:
+    virtual void retired(const TraceRecord &record) = 0;
+
+private:
+    // Register file after the previous instruction
+    uint32_t _regs[34];
+};
+
+class TraceWriter : public Tracer
+{
+public:
+    /**
+     * Create the trace file at path for a program starting at entry; throws
+     * IOException if it cannot be created.
+     */
+    TraceWriter(const std::string &path, uint32_t entry);
+    ~TraceWriter();
+
+    /**
+     * Write the end of the trace and wait for all of it to be written;
+     * throws IOException if writing failed at any point.
+     */
+    void close();
+
+    uint64_t records() const;
+
+protected:
+    void retired(const TraceRecord &record);
+
+private:
+    TraceWriter(const TraceWriter &other);
+    TraceWriter &operator=(const TraceWriter &other);
+
+    // Hand the current buffer to the writer thread
+    void submit();
+    void writeLoop();
+
+    std::ofstream _file;
+    std::string _path;
+    TraceContext _context;
+    uint64_t _records;
+
+    // The run encodes into _buffer while the thread writes _pending
+    std::vector<uint8_t> _buffer;
+    std::vector<uint8_t> _pending;
+    size_t _used;
+    size_t _pendingUsed;
+    bool _hasPending;
+    bool _closing;
+    bool _failed;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::thread _thread;
+};
+
+class TraceReader
+{
+public:
+    /**
+     * Open the trace file at path; throws IOException if it cannot be read
+     * or is not a trace.
+     */
+    explicit TraceReader(const std::string &path);
+
+    /**
+     * Read the next record; returns false at the end of the trace. Throws
+     * IOException if the trace is truncated or corrupt.
+     */
+    bool next(TraceRecord &record);
+
+    uint32_t entry() const;
+
+private:
+    uint8_t byte();
+    uint32_t varint();
+    void fill();
+
+    std::ifstream _file;
+    std::string _path;
+    TraceContext _context;
+    uint32_t _entry;
+    bool _ended;
+
+    std::vector<uint8_t> _buffer;
+    size_t _pos;
+    size_t _size;
+};
+
+// Checks a run against a recorded trace
+class TraceVerifier : public Tracer
+{
+public:
+    /**
+     * Verify cpu against the trace read by reader; cpu is interrupted at the
+     * first divergence.
+     */
+    TraceVerifier(TraceReader &reader, R3000 &cpu);
+
+    /**
+     * Finish verification after the run; returns false and prints the
+     * divergence to out if the run and trace differ.
+     */
+    bool finish(std::ostream &out);
+
+protected:
+    void retired(const TraceRecord &record);
+
+private:
+    TraceReader &_reader;
+    R3000 &_cpu;
+    uint64_t _records;
+    bool _diverged;
+    bool _traceEnded;
+    std::string _error;
+    TraceRecord _expected;
+    TraceRecord _actual;
+};
+
+}
+
+std::ostream &operator<<(std::ostream &out, const SoloMIPS::TraceRecord &record);
+
+#endif /* HEADER_SOLOMIPS_TRACE_HXX */
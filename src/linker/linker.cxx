@@ -19,203 +19,851 @@
  *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <climits>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #include "linker.hxx"
 #include "elf.hxx"
+#include "executable.hxx"
+#include "image.hxx"
 #include "io.hxx"
 #include "op.hxx"
 
 using namespace SoloMIPS;
 
-static void parseCheckObjectData(const std::string &input, const std::vector<uint8_t> &data, ELF32Object &obj)
+namespace {
+
+enum class SectionClass : uint8_t
+{
+    None,
+    Text,
+    Data,
+    ROData,
+    BSS
+};
+
+enum class SymbolState : uint8_t
+{
+    Undefined,
+    Weak,
+    Common,
+    Defined
+};
+
+struct GlobalSymbol
+{
+    GlobalSymbol()
+        : state(SymbolState::Undefined), strongRef(false), func(false), object(SIZE_MAX), shndx(SHN_UNDEF),
+          value(0), size(0), align(1), got(SIZE_MAX) {}
+
+    SymbolState state;
+    bool strongRef;
+    bool func;
+    size_t object; // Defining object, or first referencing one while undefined; SIZE_MAX for the linker
+    uint16_t shndx;
+    uint32_t value; // Section offset until laid out, then the address
+    uint32_t size;
+    uint32_t align;
+    size_t got;
+};
+
+struct InputObject
 {
-    if (!obj.parse(data))
+    explicit InputObject(const std::string &name) : name(name), file(name), symtab(SIZE_MAX) {}
+
+    std::string name;
+    MappedFile file;
+    ELF32Object obj;
+    size_t symtab;
+    std::vector<SectionClass> classes;
+    std::vector<uint32_t> addr;
+    std::vector<size_t> rel; // Relocation table of each section, or SIZE_MAX
+};
+
+// A placed section: object and section index
+typedef std::pair<size_t, size_t> SectionRef;
+
+// Local GOT entry: object, section index and 64 KiB window
+typedef std::tuple<size_t, uint16_t, int32_t> LocalGOTKey;
+
+struct GOTEntry
+{
+    GOTEntry(const GlobalSymbol *global, size_t object, uint16_t shndx, int32_t window)
+        : global(global), object(object), shndx(shndx), window(window) {}
+
+    const GlobalSymbol *global;
+    size_t object;
+    uint16_t shndx;
+    int32_t window;
+};
+
+// What a relocation refers to
+struct Target
+{
+    Target() : global(NULL), shndx(SHN_UNDEF), value(0) {}
+
+    GlobalSymbol *global; // NULL for local symbols
+    uint16_t shndx;
+    uint32_t value; // Section offset of a local symbol
+};
+
+uint32_t readWord(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void writeWord(uint8_t *p, uint32_t word)
+{
+    p[0] = word >> 24;
+    p[1] = (word >> 16) & 0xff;
+    p[2] = (word >> 8) & 0xff;
+    p[3] = word & 0xff;
+}
+
+uint32_t alignTo(uint32_t value, uint32_t align)
+{
+    if (align <= 1)
+        return value;
+    return (value + align - 1) / align * align;
+}
+
+/*
+Calls f(0) to f(count-1) on up to the given number of threads (0 for one per
+core), handing out indices one at a time. If any calls throw, the exception of
+the lowest index is rethrown, so errors are the same as in a serial run.
+*/
+template<typename F>
+void parallelFor(size_t count, unsigned int threads, F f)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads > count)
+        threads = std::max<unsigned int>(1u, static_cast<unsigned int>(count));
+
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(count);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                f(i);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (std::thread &t : pool)
+        t.join();
+
+    for (const std::exception_ptr &e : errors) {
+        if (e)
+            std::rethrow_exception(e);
+    }
+}
+
+SectionClass classifySection(const ELF32Section &section)
+{
+    if ((section.flags & ELFSectionFlags::Alloc) == ELFSectionFlags::None)
+        return SectionClass::None;
+    // Unwind tables are of no use to the emulator
+    if (section.name == ".eh_frame")
+        return SectionClass::None;
+    if (section.type == ELFSectionType::NoBits)
+        return SectionClass::BSS;
+    if (section.type != ELFSectionType::ProgBits)
+        return SectionClass::None;
+    if ((section.flags & ELFSectionFlags::ExecInstr) != ELFSectionFlags::None)
+        return SectionClass::Text;
+    if ((section.flags & ELFSectionFlags::Write) != ELFSectionFlags::None)
+        return SectionClass::Data;
+    return SectionClass::ROData;
+}
+
+void parseCheckObjectData(InputObject &in)
+{
+    const std::string &input = in.name;
+    ELF32Object &obj = in.obj;
+
+    if (!obj.parse(in.file.data(), in.file.size()))
         throw LinkerError("'" + input + "' is not a valid ELF32 object file");
 
     if (obj.machine != ELFMachineType::MIPS)
         throw LinkerError("unsupported machine type in ELF object file '" + input + "'");
     if (obj.type != ELFObjectType::Rel)
         throw LinkerError("unsupported ELF object type in file '" + input + "'");
+    if (obj.enc != ELFDataEncoding::MSB)
+        throw LinkerError("ELF object file '" + input + "' is not big-endian");
 
-    if (obj.indexOfSection(".text") == SIZE_MAX)
-        throw LinkerError("object file '" + input + "' does not contain any code");
-    if (obj.indexOfSection(".symtab") == SIZE_MAX)
+    in.symtab = obj.indexOfSection(".symtab");
+    if (in.symtab == SIZE_MAX)
         throw LinkerError("object file '" + input + "' does not contain a symbol table");
-}
 
-static size_t findRelocationTable(size_t textSectionIndex, const ELF32Object &obj)
-{
-    for (size_t tir = 0; tir < obj.sections.size(); ++tir) {
-        if (obj.sections[tir].type == ELFSectionType::Rel && obj.sections[tir].info == textSectionIndex) {
-            return tir;
+    size_t count = obj.sectionCount();
+    in.classes.assign(count, SectionClass::None);
+    in.addr.assign(count, 0);
+    in.rel.assign(count, SIZE_MAX);
+    for (size_t i = 0; i < count; ++i)
+        in.classes[i] = classifySection(obj.section(i));
+
+    for (size_t i = 0; i < count; ++i) {
+        ELF32Section section = obj.section(i);
+        if (section.type != ELFSectionType::Rel && section.type != ELFSectionType::RelA)
+            continue;
+        if (section.info >= count || in.classes[section.info] == SectionClass::None)
+            continue;
+        if (section.link != in.symtab)
+            throw LinkerError("relocation table '" + section.name.str() + "' of object file '" + input + "' does not point to the correct symbol table");
+        if (section.type == ELFSectionType::RelA)
+            throw LinkerError("object file '" + input + "' contains relocations with addends (this is not supported)");
+        if (in.classes[section.info] == SectionClass::BSS) {
+            if (obj.relTable(i).size() != 0)
+                throw LinkerError("object file '" + input + "' contains relocations in a section without data");
+            continue;
         }
+        in.rel[section.info] = i;
     }
+}
 
-    return SIZE_MAX;
+/*
+Collects the objects, resolves their symbols and relocates their code. All
+state lives here so that Linker::run can stay const.
+*/
+class LinkJob
+{
+public:
+    LinkJob(uint32_t entry, uint32_t tdata, uint32_t sdata, unsigned int threads);
+
+    void load(const std::vector<std::string> &input);
+    void collectSymbols();
+    void layoutData();
+    void scanRelocations();
+    void layoutText();
+    void relocate();
+    void relocateSection(const SectionRef &ref, uint8_t *out, uint32_t outAddr);
+    void write(std::ostream &out, LinkerFormat format);
+
+private:
+    GlobalSymbol &defineLinkerSymbol(const char *name);
+    std::string objectName(size_t object) const;
+
+    Target target(size_t object, uint32_t rsym);
+    uint32_t address(size_t object, const Target &t) const;
+    size_t findLO16(const ELF32RelTable &relTable, size_t i, size_t ti, size_t object, uint32_t size) const;
+    int32_t pairAddend(const uint8_t *text, uint32_t hi, uint32_t lo) const;
+    size_t allocLocalGOT(size_t object, uint16_t shndx, int32_t window);
+    uint32_t prologueSize() const;
+    void emit(OP op);
+    void collectExecutableSymbols(Executable &exe) const;
+
+    uint32_t _entry;
+    uint32_t _tdata;
+    uint32_t _sdata;
+    uint32_t _gp;
+    unsigned int _threads;
+
+    std::vector<std::unique_ptr<InputObject>> _objects;
+    std::unordered_map<ELFString, GlobalSymbol, ELFStringHash> _symbols;
+    std::vector<ELFString> _symbolOrder;
+    GlobalSymbol *_main;
+    const GlobalSymbol *_gpDisp;
+
+    std::vector<SectionRef> _text;
+    std::vector<SectionRef> _data; // Sections with contents in the data image
+    uint32_t _dataSize;
+    std::vector<GOTEntry> _got;
+    std::map<LocalGOTKey, size_t> _localGOT;
+
+    std::vector<uint8_t> _image;
+    std::vector<uint8_t> _dataImage;
+};
+
+LinkJob::LinkJob(uint32_t entry, uint32_t tdata, uint32_t sdata, unsigned int threads)
+    : _entry(entry), _tdata(tdata), _sdata(sdata), _gp(tdata + sdata - 4), _threads(threads), _main(NULL), _gpDisp(NULL), _dataSize(0) {}
+
+void LinkJob::load(const std::vector<std::string> &input)
+{
+    // Objects are independent of each other until their symbols are collected
+    this->_objects.resize(input.size());
+    parallelFor(input.size(), this->_threads, [&](size_t i) {
+        this->_objects[i].reset(new InputObject(input[i]));
+        parseCheckObjectData(*this->_objects[i]);
+    });
 }
 
-Linker::Linker(const std::vector<std::string> &input, uint32_t entry, uint32_t tdata, uint32_t sdata)
-    : _input(input), _entry(entry), _tdata(tdata), _sdata(sdata) {}
+GlobalSymbol &LinkJob::defineLinkerSymbol(const char *name)
+{
+    GlobalSymbol &sym = this->_symbols[ELFString(name)];
+    sym.state = SymbolState::Defined;
+    sym.shndx = SHN_ABS;
+    return sym;
+}
 
-void Linker::run(std::ostream &out) const
+std::string LinkJob::objectName(size_t object) const
 {
-    out.setf(std::ios::binary);
+    if (object == SIZE_MAX)
+        return "the linker";
+    return "'" + this->_objects[object]->name + "'";
+}
 
-    if (this->_input.size() == 0u)
-        throw LinkerError("no input files");
-    if (this->_input.size() > 1u)
-        throw LinkerError("currently only a single input file is supported");
-
-    for (std::string input : this->_input) {
-        std::vector<uint8_t> data = loadBinaryFile(input);
-
-        // Parse and do all sorts of checks
-        ELF32Object obj;
-        parseCheckObjectData(input, data, obj);
-
-        size_t di = obj.indexOfSection(".data");
-        if (di != SIZE_MAX) {
-            uint32_t dataSize = obj.sections[di].size;
-            if (dataSize > this->_sdata - 4)
-                throw LinkerError("data section of '" + input + "' is too large");
-
-            if (dataSize > 0) {
-                for (uint8_t *p = data.data() + obj.sections[di].offset, *e = p + dataSize; p != e; ++p) {
-                    if (*p != 0)
-                        throw LinkerError("data section of '" + input + "' is not empty (this is not supported yet)");
-                }
+void LinkJob::collectSymbols()
+{
+    defineLinkerSymbol("_gp").value = this->_gp;
+    defineLinkerSymbol("__gnu_local_gp").value = this->_gp;
+    this->_gpDisp = &defineLinkerSymbol("_gp_disp");
+    defineLinkerSymbol("_end");
+
+    for (size_t o = 0; o < this->_objects.size(); ++o) {
+        const InputObject &in = *this->_objects[o];
+        ELF32SymbolTable symbolTable = in.obj.symbolTable(in.symtab);
+        for (size_t s = 1; s < symbolTable.size(); ++s) {
+            ELFSymbolTableEntry entry = symbolTable[s];
+            if (entry.isLocal() || entry.name.empty())
+                continue;
+            if (!entry.isGlobal() && !entry.isWeak())
+                throw LinkerError("symbol '" + entry.name.str() + "' in object file '" + in.name + "' has an unsupported binding");
+
+            auto r = this->_symbols.emplace(entry.name, GlobalSymbol());
+            GlobalSymbol &sym = r.first->second;
+            if (r.second)
+                this->_symbolOrder.push_back(entry.name);
+
+            if (entry.shndx == SHN_UNDEF) {
+                if (sym.state == SymbolState::Undefined && sym.object == SIZE_MAX)
+                    sym.object = o;
+                if (!entry.isWeak())
+                    sym.strongRef = true;
+                continue;
+            }
 
-                // Emit code to setup the Global Offset Table and prepare $gp
-                uint32_t gp = this->_tdata + this->_sdata - 4;
-                out << OP::LUI(28, gp >> 16);
-                if (gp & 0xffff)
-                    out << OP::ORI(28, 28, gp & 0xffff);
-
-                out << OP::LUI(1, this->_tdata >> 16);
-                if (this->_tdata & 0xffff)
-                    out << OP::ORI(1, 1, this->_tdata & 0xffff);
-                out << OP::SW(1, 0, 28)
-                    << OP::OR(1, 0, 0);
+            if (entry.shndx == SHN_COMMON) {
+                if (sym.state == SymbolState::Defined)
+                    continue;
+                if (sym.state != SymbolState::Common) {
+                    sym.state = SymbolState::Common;
+                    sym.object = o;
+                    sym.size = 0;
+                    sym.align = 1;
+                }
+                if (entry.size > sym.size)
+                    sym.size = entry.size;
+                // The value of a common symbol is its alignment
+                if (entry.value > sym.align)
+                    sym.align = entry.value;
+                continue;
             }
+
+            if (entry.shndx != SHN_ABS && (entry.shndx >= in.classes.size() || in.classes[entry.shndx] == SectionClass::None))
+                throw LinkerError("symbol '" + entry.name.str() + "' in object file '" + in.name + "' is defined in an unsupported section");
+
+            SymbolState state = entry.isWeak() ? SymbolState::Weak : SymbolState::Defined;
+            if (state == SymbolState::Defined && sym.state == SymbolState::Defined)
+                throw LinkerError("multiple definition of '" + entry.name.str() + "' in object file '" + in.name + "' (first defined by " + this->objectName(sym.object) + ")");
+            if (state < sym.state || (state == SymbolState::Weak && sym.state == SymbolState::Weak))
+                continue;
+
+            sym.state = state;
+            sym.object = o;
+            sym.shndx = entry.shndx;
+            sym.value = entry.value;
+            sym.size = entry.size;
+            sym.func = (entry.type() == ELFSymbolType::Func);
         }
+    }
 
-        bool foundMain = false;
-        size_t si = obj.indexOfSection(".symtab");
-        std::vector<ELFSymbolTableEntry> &symbolTable = obj.sections[si].symbolTable;
-        for (ELFSymbolTableEntry &entry : symbolTable) {
-            if (entry.name == "main") {
-                ELFSymbolType est = entry.type();
-                if (entry.value != 0 && est != ELFSymbolType::Func)
-                    throw LinkerError("\"main\" symbol in object file '" + input + "', if not a function, must point to the first instruction");
-
-                size_t ti = entry.shndx;
-                ELF32Section &textSection = obj.sections[ti];
-                if (textSection.type != ELFSectionType::ProgBits)
-                    throw LinkerError("\"main\" symbol in object file '" + input + "' does not point to a text section");
-
-                size_t tir = findRelocationTable(ti, obj);
-                if (tir != SIZE_MAX) {
-                    if (obj.sections[tir].link != si)
-                        throw LinkerError("code relocation table of object file '" + input + "' does not point to the correct symbol table");
-                }
+    for (const ELFString &name : this->_symbolOrder) {
+        const GlobalSymbol &sym = this->_symbols[name];
+        if (sym.state == SymbolState::Undefined && sym.strongRef)
+            throw LinkerError("undefined reference to '" + name.str() + "' in object file " + this->objectName(sym.object));
+    }
+
+    auto mi = this->_symbols.find(ELFString("main"));
+    if (mi == this->_symbols.end() || mi->second.state == SymbolState::Undefined)
+        throw LinkerError("no object file defines a \"main\" symbol");
+    GlobalSymbol &main = mi->second;
+    if (main.object == SIZE_MAX || main.state == SymbolState::Common || main.shndx == SHN_ABS
+            || this->_objects[main.object]->classes[main.shndx] != SectionClass::Text)
+        throw LinkerError("\"main\" symbol in object file " + this->objectName(main.object) + " does not point to a text section");
+    if (main.value != 0 && !main.func)
+        throw LinkerError("\"main\" symbol in object file " + this->objectName(main.object) + ", if not a function, must point to the first instruction");
+    this->_main = &main;
+}
 
-                if (est == ELFSymbolType::Func) {
-                    // Setup stack
-                    uint32_t sp = this->_tdata + this->_sdata - 8;
-                    out << OP::LUI(29, sp >> 16);
-                    if (sp & 0xffff)
-                        out << OP::ORI(29, 29, sp & 0xffff);
-                    // Emit call and exit code
-                    out << OP::BGEZAL(0, 3)
-                        << OP()
-                        << OP::JR(0)
-                        << OP();
+void LinkJob::layoutData()
+{
+    uint32_t addr = this->_tdata;
+    const SectionClass order[] = {SectionClass::Data, SectionClass::ROData, SectionClass::BSS};
+    for (SectionClass cls : order) {
+        for (const std::unique_ptr<InputObject> &in : this->_objects) {
+            for (size_t i = 0; i < in->classes.size(); ++i) {
+                if (in->classes[i] != cls)
+                    continue;
+                ELF32Section section = in->obj.section(i);
+                addr = alignTo(addr, section.addralign);
+                in->addr[i] = addr;
+                addr += section.size;
+                if (addr < in->addr[i])
+                    throw LinkerError("data sections are too large");
+                if (cls != SectionClass::BSS) {
+                    this->_data.push_back(SectionRef(&in - this->_objects.data(), i));
+                    this->_dataSize = addr - this->_tdata;
                 }
+            }
+        }
+    }
 
-                uint8_t *text = data.data() + textSection.offset;
-                // Do relocations
-                if (tir != SIZE_MAX) {
-                    std::vector<ELFRelTableEntry> &relTable = obj.sections[tir].relTable;
-                    for (size_t i = 0; i < relTable.size(); ++i) {
-                        ELFRelTableEntry &rentry = relTable[i];
-                        if (rentry.offset+4 > textSection.size)
-                            throw LinkerError("code relocation table of object file '" + input + "' contains an out-of-bounds offset");
-                        uint32_t rsym = rentry.sym();
-                        if (rsym >= symbolTable.size())
-                            throw LinkerError("code relocation table of object file '" + input + "' contains an out-of-bounds relocation target");
-                        ELFSymbolTableEntry &targetSym = symbolTable[rsym];
-                        if (targetSym.type() != ELFSymbolType::Section)
-                            throw LinkerError("code relocation table of object file '" + input + "' contains an unsupported relocation target type");
-                        if (targetSym.shndx != di)
-                            throw LinkerError("code relocation table of object file '" + input + "' contains an unsupported relocation target");
-
-                        switch (rentry.type()) {
-                            case ELFRelType::MIPS_GOT16: {
-                                // Requires the next rel entry to be a LO16 with same symbol
-                                if (i+1 == relTable.size() || relTable[i+1].type() != ELFRelType::MIPS_LO16 || relTable[i+1].sym() != rsym)
-                                    throw LinkerError("code relocation table of object file '" + input + "' is invalid (GOT16 not followed by valid LO16)");
-                                if (relTable[i+1].offset+4 > textSection.size)
-                                    throw LinkerError("code relocation table of object file '" + input + "' contains an out-of-bounds offset");
-
-                                // Force to zero
-                                text[rentry.offset + 2] = 0;
-                                text[rentry.offset + 3] = 0;
-                                // Leave GP offset alone
-                                ++i;
-                                break;
-                            }
+    for (const ELFString &name : this->_symbolOrder) {
+        GlobalSymbol &sym = this->_symbols[name];
+        if (sym.state != SymbolState::Common)
+            continue;
+        addr = alignTo(addr, sym.align);
+        sym.value = addr;
+        addr += sym.size;
+        if (addr < sym.value)
+            throw LinkerError("data sections are too large");
+    }
+
+    this->_symbols[ELFString("_end")].value = addr;
+    // The GOT size is not known yet, this is checked again in layoutText
+    if (addr - this->_tdata > this->_sdata - 4)
+        throw LinkerError("data sections are too large");
+}
+
+Target LinkJob::target(size_t object, uint32_t rsym)
+{
+    const InputObject &in = *this->_objects[object];
+    ELF32SymbolTable symbolTable = in.obj.symbolTable(in.symtab);
+    if (rsym >= symbolTable.size())
+        throw LinkerError("relocation table of object file '" + in.name + "' contains an out-of-bounds relocation target");
+    ELFSymbolTableEntry entry = symbolTable[rsym];
+
+    Target t;
+    if (!entry.isLocal()) {
+        t.global = &this->_symbols.find(entry.name)->second;
+        return t;
+    }
+    if (entry.shndx != SHN_ABS && entry.shndx != SHN_UNDEF
+            && (entry.shndx >= in.classes.size() || in.classes[entry.shndx] == SectionClass::None))
+        throw LinkerError("relocation table of object file '" + in.name + "' refers to an unsupported section");
+    t.shndx = entry.shndx;
+    t.value = entry.value;
+    return t;
+}
+
+uint32_t LinkJob::address(size_t object, const Target &t) const
+{
+    if (t.global != NULL)
+        return t.global->value;
+    if (t.shndx == SHN_ABS || t.shndx == SHN_UNDEF)
+        return t.value;
+    return this->_objects[object]->addr[t.shndx] + t.value;
+}
+
+size_t LinkJob::findLO16(const ELF32RelTable &relTable, size_t i, size_t ti, size_t object, uint32_t size) const
+{
+    uint32_t rsym = relTable[i].sym();
+    for (size_t j = i + 1; j < relTable.size(); ++j) {
+        ELFRelTableEntry lo = relTable[j];
+        if (lo.type() == ELFRelType::MIPS_LO16 && lo.sym() == rsym) {
+            if (lo.offset + 4 > size)
+                break;
+            return j;
+        }
+    }
+    throw LinkerError("code relocation table of section '" + this->_objects[object]->obj.section(ti).name.str() + "' of object file '"
+                      + this->_objects[object]->name + "' is invalid (HI16 or GOT16 not followed by valid LO16)");
+}
+
+int32_t LinkJob::pairAddend(const uint8_t *text, uint32_t hi, uint32_t lo) const
+{
+    return static_cast<int32_t>((readWord(text + hi) & 0xffff) << 16) + static_cast<int16_t>(readWord(text + lo) & 0xffff);
+}
+
+size_t LinkJob::allocLocalGOT(size_t object, uint16_t shndx, int32_t window)
+{
+    auto r = this->_localGOT.emplace(LocalGOTKey(object, shndx, window), this->_got.size());
+    if (r.second)
+        this->_got.emplace_back(static_cast<const GlobalSymbol *>(NULL), object, shndx, window);
+    return r.first->second;
+}
 
-                            default:
-                                throw LinkerError("code relocation table of object file '" + input + "' contains an unsupported relocation type");
+void LinkJob::scanRelocations()
+{
+    for (size_t o = 0; o < this->_objects.size(); ++o) {
+        const InputObject &in = *this->_objects[o];
+        for (size_t ti = 0; ti < in.rel.size(); ++ti) {
+            if (in.rel[ti] == SIZE_MAX)
+                continue;
+            uint32_t size = in.obj.section(ti).size;
+            const uint8_t *text = in.obj.sectionData(ti);
+            ELF32RelTable relTable = in.obj.relTable(in.rel[ti]);
+            for (size_t i = 0; i < relTable.size(); ++i) {
+                ELFRelTableEntry rentry = relTable[i];
+                if (rentry.offset + 4 > size || rentry.offset + 4 < rentry.offset)
+                    throw LinkerError("relocation table of object file '" + in.name + "' contains an out-of-bounds offset");
+                Target t = this->target(o, rentry.sym());
+                // Data only holds addresses
+                if (in.classes[ti] != SectionClass::Text && rentry.type() != ELFRelType::MIPS_32 && rentry.type() != ELFRelType::MIPS_NONE)
+                    throw LinkerError("data relocation table of object file '" + in.name + "' contains an unsupported relocation type");
+
+                switch (rentry.type()) {
+                    case ELFRelType::MIPS_NONE:
+                    case ELFRelType::MIPS_JALR:
+                    case ELFRelType::MIPS_32:
+                    case ELFRelType::MIPS_26:
+                    case ELFRelType::MIPS_LO16:
+                        break;
+
+                    case ELFRelType::MIPS_HI16:
+                        this->findLO16(relTable, i, ti, o, size);
+                        break;
+
+                    case ELFRelType::MIPS_GOT16:
+                    case ELFRelType::MIPS_CALL16: {
+                        if (t.global == this->_gpDisp)
+                            throw LinkerError("object file '" + in.name + "' loads _gp_disp from the GOT");
+                        if (t.global != NULL) {
+                            if (t.global->got == SIZE_MAX) {
+                                t.global->got = this->_got.size();
+                                this->_got.emplace_back(t.global, SIZE_MAX, SHN_UNDEF, 0);
+                            }
+                            break;
                         }
+                        if (rentry.type() == ELFRelType::MIPS_CALL16)
+                            throw LinkerError("object file '" + in.name + "' contains a CALL16 relocation against a local symbol");
+                        size_t j = this->findLO16(relTable, i, ti, o, size);
+                        int32_t offset = static_cast<int32_t>(t.value) + this->pairAddend(text, rentry.offset, relTable[j].offset);
+                        this->allocLocalGOT(o, t.shndx, (offset + 0x8000) >> 16);
+                        break;
                     }
+
+                    default:
+                        throw LinkerError("code relocation table of object file '" + in.name + "' contains an unsupported relocation type");
                 }
+            }
+        }
+    }
+
+    if (this->_got.size() > 0x2000u)
+        throw LinkerError("global offset table is too large");
+}
+
+uint32_t LinkJob::prologueSize() const
+{
+    uint32_t count = (this->_gp & 0xffff) ? 2 : 1;
+    if (!this->_got.empty())
+        count += 3 * this->_got.size() + 1;
+    if (this->_main->func) {
+        uint32_t sp = this->_gp - 4 * this->_got.size();
+        count += ((sp & 0xffff) ? 2 : 1) + 6;
+    }
+    return count * 4;
+}
+
+void LinkJob::layoutText()
+{
+    uint32_t gotBottom = this->_gp - 4 * (this->_got.size() > 0 ? this->_got.size() - 1 : 0);
+    if (this->_symbols[ELFString("_end")].value > gotBottom)
+        throw LinkerError("data sections are too large");
+
+    // A "main" that is not a function is entered by falling through
+    SectionRef mainSection(this->_main->object, this->_main->shndx);
+    if (!this->_main->func)
+        this->_text.push_back(mainSection);
+    for (size_t o = 0; o < this->_objects.size(); ++o) {
+        const InputObject &in = *this->_objects[o];
+        for (size_t i = 0; i < in.classes.size(); ++i) {
+            if (in.classes[i] == SectionClass::Text && (this->_main->func || SectionRef(o, i) != mainSection))
+                this->_text.push_back(SectionRef(o, i));
+        }
+    }
+
+    uint32_t addr = this->_entry + this->prologueSize();
+    for (const SectionRef &ref : this->_text) {
+        InputObject &in = *this->_objects[ref.first];
+        ELF32Section section = in.obj.section(ref.second);
+        // A fall-through "main" must directly follow the prologue
+        if (this->_main->func || &ref != &this->_text.front())
+            addr = alignTo(addr, section.addralign);
+        in.addr[ref.second] = addr;
+        addr += section.size;
+        if (addr < in.addr[ref.second])
+            throw LinkerError("text sections are too large");
+    }
+
+    for (const ELFString &name : this->_symbolOrder) {
+        GlobalSymbol &sym = this->_symbols[name];
+        if (sym.state == SymbolState::Weak || sym.state == SymbolState::Defined) {
+            if (sym.object != SIZE_MAX && sym.shndx != SHN_ABS)
+                sym.value += this->_objects[sym.object]->addr[sym.shndx];
+        }
+        else if (sym.state == SymbolState::Undefined)
+            sym.value = 0;
+    }
+}
+
+void LinkJob::emit(OP op)
+{
+    size_t at = this->_image.size();
+    this->_image.resize(at + 4);
+    op.encode(&this->_image[at]);
+}
+
+void LinkJob::relocate()
+{
+    // Emit code to set up $gp and fill the Global Offset Table
+    this->emit(OP::LUI(28, this->_gp >> 16));
+    if (this->_gp & 0xffff)
+        this->emit(OP::ORI(28, 28, this->_gp & 0xffff));
+    for (size_t k = 0; k < this->_got.size(); ++k) {
+        const GOTEntry &e = this->_got[k];
+        uint32_t value;
+        if (e.global != NULL)
+            value = e.global->value;
+        else {
+            Target t;
+            t.shndx = e.shndx;
+            value = this->address(e.object, t) + (static_cast<uint32_t>(e.window) << 16);
+        }
+        this->emit(OP::LUI(1, value >> 16));
+        this->emit(OP::ORI(1, 1, value & 0xffff));
+        this->emit(OP::SW(1, -4 * static_cast<int32_t>(k), 28));
+    }
+    if (!this->_got.empty())
+        this->emit(OP::OR(1, 0, 0));
+
+    if (this->_main->func) {
+        // Setup stack below the table, then call main through $t9 and halt
+        uint32_t sp = this->_gp - 4 * this->_got.size();
+        this->emit(OP::LUI(29, sp >> 16));
+        if (sp & 0xffff)
+            this->emit(OP::ORI(29, 29, sp & 0xffff));
+        this->emit(OP::LUI(25, this->_main->value >> 16));
+        this->emit(OP::ORI(25, 25, this->_main->value & 0xffff));
+        this->emit(OP::JALR(31, 25));
+        this->emit(OP());
+        this->emit(OP::JR(0));
+        this->emit(OP());
+    }
+
+    // Copy all code first, so that the sections can be relocated in place
+    // independently of each other
+    for (const SectionRef &ref : this->_text) {
+        const InputObject &in = *this->_objects[ref.first];
+        // Padding is NOPs
+        this->_image.resize(in.addr[ref.second] - this->_entry, 0);
+        const uint8_t *textData = in.obj.sectionData(ref.second);
+        this->_image.insert(this->_image.end(), textData, textData + in.obj.section(ref.second).size);
+    }
+
+    this->_dataImage.assign(this->_dataSize, 0);
+    for (const SectionRef &ref : this->_data) {
+        const InputObject &in = *this->_objects[ref.first];
+        const uint8_t *data = in.obj.sectionData(ref.second);
+        std::copy(data, data + in.obj.section(ref.second).size, this->_dataImage.begin() + (in.addr[ref.second] - this->_tdata));
+    }
+
+    size_t textCount = this->_text.size();
+    parallelFor(textCount + this->_data.size(), this->_threads, [this, textCount](size_t n) {
+        if (n < textCount)
+            this->relocateSection(this->_text[n], this->_image.data(), this->_entry);
+        else
+            this->relocateSection(this->_data[n - textCount], this->_dataImage.data(), this->_tdata);
+    });
+}
 
-                out.write(reinterpret_cast<char *>(data.data()) + textSection.offset, textSection.size);
-                foundMain = true;
+// The section has been copied to the output, which starts at outAddr
+void LinkJob::relocateSection(const SectionRef &ref, uint8_t *out, uint32_t outAddr)
+{
+    const InputObject &in = *this->_objects[ref.first];
+    size_t ri = in.rel[ref.second];
+    if (ri == SIZE_MAX)
+        return;
+
+    ELF32Section section = in.obj.section(ref.second);
+    uint32_t base = in.addr[ref.second];
+    const uint8_t *textData = in.obj.sectionData(ref.second);
+    uint8_t *text = out + (base - outAddr);
+    ELF32RelTable relTable = in.obj.relTable(ri);
+    // LO16 relocations that belong to a local GOT16 keep their offset
+    std::vector<bool> keep(relTable.size(), false);
+    for (size_t i = 0; i < relTable.size(); ++i) {
+        if (keep[i])
+            continue;
+        ELFRelTableEntry rentry = relTable[i];
+        Target t = this->target(ref.first, rentry.sym());
+        uint8_t *p = text + rentry.offset;
+        uint32_t pc = base + rentry.offset;
+        // Addends are read from the object, as LO16s may be shared
+        uint32_t word = readWord(textData + rentry.offset);
+        uint32_t s = this->address(ref.first, t);
+
+        switch (rentry.type()) {
+            case ELFRelType::MIPS_32:
+                writeWord(p, word + s);
+                break;
+
+            case ELFRelType::MIPS_26: {
+                uint32_t a = (word & 0x3ffffff) << 2;
+                uint32_t dest;
+                if (t.global == NULL)
+                    dest = a + s;
+                else
+                    dest = static_cast<uint32_t>(static_cast<int32_t>(a << 4) >> 4) + s;
+                if ((dest & 0xf0000000) != ((pc + 4) & 0xf0000000))
+                    throw LinkerError("jump target in object file '" + in.name + "' is out of range");
+                writeWord(p, (word & 0xfc000000) | ((dest >> 2) & 0x3ffffff));
+                break;
+            }
+
+            case ELFRelType::MIPS_HI16: {
+                size_t j = this->findLO16(relTable, i, ref.second, ref.first, section.size);
+                int32_t ahl = this->pairAddend(textData, rentry.offset, relTable[j].offset);
+                if (t.global == this->_gpDisp)
+                    s = this->_gp - pc;
+                uint32_t value = static_cast<uint32_t>(ahl) + s;
+                writeWord(p, (word & 0xffff0000) | (((value + 0x8000) >> 16) & 0xffff));
+                break;
+            }
+
+            case ELFRelType::MIPS_LO16: {
+                if (t.global == this->_gpDisp)
+                    s = this->_gp - pc + 4;
+                uint32_t value = static_cast<uint32_t>(static_cast<int16_t>(word & 0xffff)) + s;
+                writeWord(p, (word & 0xffff0000) | (value & 0xffff));
+                break;
+            }
+
+            case ELFRelType::MIPS_GOT16:
+            case ELFRelType::MIPS_CALL16: {
+                size_t k;
+                if (t.global != NULL)
+                    k = t.global->got;
+                else {
+                    size_t j = this->findLO16(relTable, i, ref.second, ref.first, section.size);
+                    int32_t offset = static_cast<int32_t>(t.value) + this->pairAddend(textData, rentry.offset, relTable[j].offset);
+                    int32_t window = (offset + 0x8000) >> 16;
+                    k = this->_localGOT.find(LocalGOTKey(ref.first, t.shndx, window))->second;
+                    uint8_t *lo = text + relTable[j].offset;
+                    writeWord(lo, (readWord(lo) & 0xffff0000) | (static_cast<uint32_t>(offset) & 0xffff));
+                    keep[j] = true;
+                }
+                writeWord(p, (word & 0xffff0000) | (static_cast<uint32_t>(-4 * static_cast<int32_t>(k)) & 0xffff));
                 break;
             }
+
+            default:
+                break;
+        }
+    }
+}
+
+void LinkJob::collectExecutableSymbols(Executable &exe) const
+{
+    for (const ELFString &name : this->_symbolOrder) {
+        const GlobalSymbol &sym = this->_symbols.find(name)->second;
+        if (sym.state != SymbolState::Undefined && sym.object != SIZE_MAX)
+            exe.symbols.push_back(ExecutableSymbol(sym.value, sym.size, name.str()));
+    }
+
+    // Local functions, so that the profiler can tell them apart
+    for (const SectionRef &ref : this->_text) {
+        const InputObject &in = *this->_objects[ref.first];
+        ELF32SymbolTable symbolTable = in.obj.symbolTable(in.symtab);
+        for (size_t s = 1; s < symbolTable.size(); ++s) {
+            ELFSymbolTableEntry entry = symbolTable[s];
+            if (entry.isLocal() && entry.shndx == ref.second && entry.type() == ELFSymbolType::Func && !entry.name.empty())
+                exe.symbols.push_back(ExecutableSymbol(in.addr[ref.second] + entry.value, entry.size, entry.name.str()));
         }
+    }
+
+    std::stable_sort(exe.symbols.begin(), exe.symbols.end(), [](const ExecutableSymbol &a, const ExecutableSymbol &b) {
+        return a.addr < b.addr;
+    });
+}
 
-        if (!foundMain)
-            throw LinkerError("object file '" + input + "' does not contain a \"main\" symbol");
+void LinkJob::write(std::ostream &out, LinkerFormat format)
+{
+    // Data that is all zero need not be loaded
+    bool hasData = std::any_of(this->_dataImage.begin(), this->_dataImage.end(), [](uint8_t b) { return b != 0; });
+
+    if (format == LinkerFormat::Executable) {
+        Executable exe;
+        exe.entry = this->_entry;
+        exe.segments.resize(2);
+        ExecutableSegment &code = exe.segments[0];
+        code.addr = this->_entry;
+        code.fileSize = code.memSize = static_cast<uint32_t>(this->_image.size());
+        code.flags = SegmentFlag::Readable | SegmentFlag::Executable;
+        // The data segment spans all of data RAM, including stack and GOT
+        ExecutableSegment &data = exe.segments[1];
+        data.addr = this->_tdata;
+        data.fileSize = hasData ? static_cast<uint32_t>(this->_dataImage.size()) : 0;
+        data.memSize = this->_sdata;
+        data.flags = SegmentFlag::Readable | SegmentFlag::Writable;
+        this->collectExecutableSymbols(exe);
+
+        std::vector<const uint8_t *> contents;
+        contents.push_back(this->_image.data());
+        contents.push_back(this->_dataImage.data());
+        std::vector<uint8_t> file = exe.write(contents);
+        out.write(reinterpret_cast<const char *>(file.data()), file.size());
+        return;
     }
+
+    if (hasData)
+        appendDataImage(this->_image, this->_dataImage, this->_tdata);
+    out.write(reinterpret_cast<const char *>(this->_image.data()), this->_image.size());
+}
+
+}
+
+Linker::Linker(const std::vector<std::string> &input, uint32_t entry, uint32_t tdata, uint32_t sdata, unsigned int threads, LinkerFormat format)
+    : _input(input), _entry(entry), _tdata(tdata), _sdata(sdata), _threads(threads), _format(format) {}
+
+void Linker::run(std::ostream &out) const
+{
+    if (this->_input.size() == 0u)
+        throw LinkerError("no input files");
+
+    LinkJob job(this->_entry, this->_tdata, this->_sdata, this->_threads);
+    job.load(this->_input);
+    job.collectSymbols();
+    job.layoutData();
+    job.scanRelocations();
+    job.layoutText();
+    job.relocate();
+    job.write(out, this->_format);
 }
 
 void Linker::disassemble(std::ostream &out) const
 {
     if (this->_input.size() == 0u)
         throw LinkerError("no input files");
-    if (this->_input.size() > 1u)
-        throw LinkerError("currently only a single input file is supported");
-
-    for (std::string input : this->_input) {
-        std::vector<uint8_t> data = loadBinaryFile(input);
-
-        ELF32Object obj;
-        parseCheckObjectData(input, data, obj);
-
-        bool foundMain = false;
-        size_t si = obj.indexOfSection(".symtab");
-        std::vector<ELFSymbolTableEntry> &symbolTable = obj.sections[si].symbolTable;
-        for (ELFSymbolTableEntry &entry : symbolTable) {
-            if (entry.name == "main") {
-                size_t ti = entry.shndx;
-                ELF32Section &textSection = obj.sections[ti];
-                if (textSection.type != ELFSectionType::ProgBits)
-                    throw LinkerError("\"main\" symbol in object file '" + input + "' does not point to a text section");
-
-                const uint8_t *text = data.data() + textSection.offset;
-                out << input << ":" << std::endl;
-                OP::disassemble(text, textSection.size, out);
-                out << std::endl;
-                foundMain = true;
-            }
-        }
 
-        if (!foundMain)
-            throw LinkerError("object file '" + input + "' does not contain a \"main\" symbol");
+    for (const std::string &input : this->_input) {
+        InputObject in(input);
+        parseCheckObjectData(in);
+
+        for (size_t i = 0; i < in.classes.size(); ++i) {
+            if (in.classes[i] != SectionClass::Text)
+                continue;
+            ELF32Section section = in.obj.section(i);
+            out << input << "(" << section.name.str() << "):" << std::endl;
+            OP::disassemble(in.obj.sectionData(i), section.size, out);
+            out << std::endl;
+        }
     }
 }
@@ -28,6 +28,45 @@
 #include <exception>
 #include <ostream>
 
+/*
+The linker combines any number of relocatable MIPS ELF32 objects into a flat
+program image to be loaded at the entry address:
+
+    [prologue][.text of all objects][data image (see image.hxx)]
+
+Alternatively, the same code and data are written as a SoloMIPS executable
+(see executable.hxx) with a code segment, a data segment spanning all of data
+RAM and the symbols of the program.
+
+The .text sections are concatenated in input order. If "main" is not a
+function, it must be at the start of its section, and that section goes first,
+so that execution falls through into it. The .data, .rodata and .bss sections
+and common symbols are laid out in that order from the start of data RAM
+(-Tdata). The contents of .data and .rodata become the data image, which is
+left out if it is all zero.
+
+Global symbols are collected from all objects in a hash table. A strong
+definition overrides weak and common ones, and common symbols are merged to
+the largest size. Every undefined symbol must be defined by some object,
+unless all references to it are weak, in which case it is 0. The linker also
+defines _gp and __gnu_local_gp (the value of $gp), _gp_disp (for the $gp
+setup of PIC functions) and _end (the end of the data sections).
+
+Supported relocations are R_MIPS_32, R_MIPS_26, R_MIPS_HI16/R_MIPS_LO16,
+R_MIPS_GOT16 and R_MIPS_CALL16 (R_MIPS_JALR hints are ignored) in code, and
+R_MIPS_32 in data. The global offset table lives at the top of data RAM: $gp
+points at its first entry and further entries follow downwards. A global
+symbol gets one entry. A local R_MIPS_GOT16/R_MIPS_LO16 pair gets one entry
+per section and 64 KiB window, holding the address of the window, and the
+R_MIPS_LO16 keeps the offset into it. The prologue fills the table, then calls
+"main" through $t9 with $sp below the table if "main" is a function, and halts
+when it returns.
+
+Objects are loaded and parsed, and sections relocated, on a pool of
+threads. Everything in between runs in input order, so the output does not
+depend on the number of threads.
+*/
+
 namespace SoloMIPS {
 
 class LinkerError : public std::exception
@@ -41,10 +80,21 @@ private:
 };
 
 
+enum class LinkerFormat
+{
+    Flat,
+    Executable
+};
+
 class Linker
 {
 public:
-    Linker(const std::vector<std::string> &input, uint32_t entry, uint32_t tdata, uint32_t sdata);
+    /**
+     * Link the given objects using up to the given number of threads (0 for
+     * one per core).
+     */
+    Linker(const std::vector<std::string> &input, uint32_t entry, uint32_t tdata, uint32_t sdata, unsigned int threads = 0,
+           LinkerFormat format = LinkerFormat::Flat);
 
     void run(std::ostream &out) const;
     void disassemble(std::ostream &out) const;
@@ -59,6 +109,8 @@ private:
     uint32_t _entry;
     uint32_t _tdata;
     uint32_t _sdata;
+    unsigned int _threads;
+    LinkerFormat _format;
 };
 
 }
@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <climits>
 
 #include "defaults.hxx"
 #include "linker.hxx"
@@ -36,6 +37,8 @@ static void showUsage(const char *argv0)
     std::cerr << "  -e ADDRESS, --entry ADDRESS Set start address (default: 0x10000000)" << std::endl;
     std::cerr << "  -Tdata ADDRESS              Set address of .data section (default: 0x20000000)" << std::endl;
     std::cerr << "  -Sdata SIZE                 Set size of .data section (default: 0x4000000)" << std::endl;
+    std::cerr << "  -f FORMAT, --format FORMAT  Set output format: flat or smx (default: flat)" << std::endl;
+    std::cerr << "  -j N, --jobs N              Use N threads (default: one per core)" << std::endl;
     std::cerr << "  -d, --disassemble           Print a disassembly of all input files (ignores -o)" << std::endl;
     std::cerr << "  -h, --help                  Print option help" << std::endl;
     std::cerr << "  -v, --version               Print version information" << std::endl;
@@ -77,6 +80,8 @@ int main(int argc, char **argv)
     uint32_t entry = SOLOMIPS_DEFAULT_ENTRY;
     uint32_t tdata = SOLOMIPS_DEFAULT_DATA_ADDR;
     uint32_t sdata = SOLOMIPS_DEFAULT_DATA_SIZE;
+    uint32_t threads = 0;
+    LinkerFormat format = LinkerFormat::Flat;
     std::vector<std::string> input;
 
     for (int i = 1; i < argc; ++i) {
@@ -109,6 +114,24 @@ int main(int argc, char **argv)
             }
             ++i;
         }
+        else if (args[i] == "-f" || args[i] == "--format") {
+            if (!checkArg(args, i, argc))
+                return 2;
+            if (args[i+1] == "flat")
+                format = LinkerFormat::Flat;
+            else if (args[i+1] == "smx")
+                format = LinkerFormat::Executable;
+            else {
+                std::cerr << "error: unknown output format '" << args[i+1] << "'" << std::endl;
+                return 2;
+            }
+            ++i;
+        }
+        else if (args[i] == "-j" || args[i] == "--jobs") {
+            if (!checkArg(args, i, argc) || !parseUInt32(args[i+1], &threads))
+                return 2;
+            ++i;
+        }
         else if (args[i] == "-d" || args[i] == "--disassemble") {
             disassemble = true;
         }
@@ -139,7 +162,7 @@ int main(int argc, char **argv)
         }
     }
 
-    Linker ld(input, entry, tdata, sdata);
+    Linker ld(input, entry, tdata, sdata, threads, format);
 
     if (disassemble) {
         int ret = 0;
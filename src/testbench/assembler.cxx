@@ -0,0 +1,148 @@
+/*
+ *  assembler.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "assembler.hxx"
+
+using namespace SoloMIPS;
+
+Assembler::Assembler(uint32_t base) : _base(base) {}
+
+void Assembler::emit(uint32_t word)
+{
+    this->_words.push_back(word);
+}
+
+void Assembler::emit(const OP &op)
+{
+    this->emit(op.encode());
+}
+
+void Assembler::emit(const OP &op, Label target)
+{
+    OP unresolved = op;
+    if (op.isBranch()) {
+        this->_references.push_back(Reference{this->_words.size(), target, Fixup::Branch});
+        unresolved.imm = 0;
+    }
+    else if (op.isJump()) {
+        this->_references.push_back(Reference{this->_words.size(), target, Fixup::Jump});
+        unresolved.addr = 0;
+    }
+    else {
+        throw std::logic_error("instruction takes no label");
+    }
+    this->emit(unresolved);
+}
+
+void Assembler::nop()
+{
+    this->emit(OP::NOP());
+}
+
+void Assembler::li(uint8_t rt, uint32_t value)
+{
+    if ((value >> 16) == 0) {
+        this->emit(OP::ORI(rt, 0, static_cast<uint16_t>(value)));
+        return;
+    }
+    this->emit(OP::LUI(rt, static_cast<uint16_t>(value >> 16)));
+    if ((value & 0xffff) != 0)
+        this->emit(OP::ORI(rt, rt, static_cast<uint16_t>(value)));
+}
+
+void Assembler::la(uint8_t rt, Label target)
+{
+    this->_references.push_back(Reference{this->_words.size(), target, Fixup::High});
+    this->emit(OP::LUI(rt, 0));
+    this->_references.push_back(Reference{this->_words.size(), target, Fixup::Low});
+    this->emit(OP::ORI(rt, rt, 0));
+}
+
+void Assembler::halt()
+{
+    this->emit(OP::JR(0));
+    this->nop();
+}
+
+Assembler::Label Assembler::label()
+{
+    this->_labels.push_back(SIZE_MAX);
+    return this->_labels.size() - 1;
+}
+
+void Assembler::bind(Label label)
+{
+    this->_labels[label] = this->_words.size();
+}
+
+Assembler::Label Assembler::here()
+{
+    Label label = this->label();
+    this->bind(label);
+    return label;
+}
+
+uint32_t Assembler::pc() const
+{
+    return this->_base + static_cast<uint32_t>(this->_words.size() * 4);
+}
+
+std::vector<uint8_t> Assembler::finish()
+{
+    for (const Reference &ref : this->_references) {
+        size_t index = this->_labels[ref.label];
+        if (index == SIZE_MAX)
+            throw std::logic_error("unbound label");
+        uint32_t target = this->_base + static_cast<uint32_t>(index * 4);
+        uint32_t &word = this->_words[ref.index];
+        switch (ref.fixup) {
+            case Fixup::Branch: {
+                // Relative to the delay slot
+                int64_t offset = (static_cast<int64_t>(index) - static_cast<int64_t>(ref.index) - 1);
+                if (offset < INT16_MIN || offset > INT16_MAX)
+                    throw std::logic_error("branch out of range");
+                word |= static_cast<uint16_t>(offset);
+                break;
+            }
+            case Fixup::Jump:
+                word |= (target >> 2) & 0x3ffffff;
+                break;
+            case Fixup::High:
+                word |= target >> 16;
+                break;
+            case Fixup::Low:
+                word |= target & 0xffff;
+                break;
+        }
+    }
+
+    std::vector<uint8_t> program;
+    program.reserve(this->_words.size() * 4);
+    for (uint32_t word : this->_words) {
+        program.push_back(word >> 24);
+        program.push_back((word >> 16) & 0xff);
+        program.push_back((word >> 8) & 0xff);
+        program.push_back(word & 0xff);
+    }
+    return program;
+}
@@ -0,0 +1,108 @@
+/*
+ *  assembler.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_ASSEMBLER_HXX
+#define HEADER_SOLOMIPS_ASSEMBLER_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "op.hxx"
+
+/*
+Builds flat guest programs in memory from `OP` encoders, as solomips-ld would
+place them at the default entry point. Branches, jumps and addresses may
+refer to labels bound later; they are resolved by `finish()`. Nothing is reordered and no delay
+slots are filled, so the caller emits exactly the instructions that run.
+*/
+
+namespace SoloMIPS {
+
+// Conventional register names
+enum : uint8_t
+{
+    ZERO = 0, AT = 1, V0 = 2, V1 = 3, A0 = 4, A1 = 5, A2 = 6, A3 = 7,
+    T0 = 8, T1 = 9, T2 = 10, T3 = 11, T4 = 12, T5 = 13, T6 = 14, T7 = 15,
+    S0 = 16, S1 = 17, S2 = 18, S3 = 19, S4 = 20, S5 = 21, S6 = 22, S7 = 23,
+    T8 = 24, T9 = 25, GP = 28, SP = 29, FP = 30, RA = 31
+};
+
+class Assembler
+{
+public:
+    typedef size_t Label;
+
+    explicit Assembler(uint32_t base);
+
+    void emit(uint32_t word);
+    void emit(const OP &op);
+    // Emit a branch or jump to a label, replacing the offset or target of op;
+    // the delay slot is up to the caller
+    void emit(const OP &op, Label target);
+    void nop();
+
+    // Load a constant or the address of a label with lui/ori
+    void li(uint8_t rt, uint32_t value);
+    void la(uint8_t rt, Label target);
+
+    // Return to address 0, which halts the machine
+    void halt();
+
+    Label label();
+    void bind(Label label);
+    // A label bound to the current position
+    Label here();
+
+    // Address of the next instruction emitted
+    uint32_t pc() const;
+
+    /**
+     * Resolve all references and return the program in big endian. Throws
+     * std::logic_error on unbound labels and branches out of range.
+     */
+    std::vector<uint8_t> finish();
+
+private:
+    enum class Fixup : uint8_t
+    {
+        Branch,
+        Jump,
+        High,
+        Low
+    };
+
+    struct Reference
+    {
+        size_t index;
+        Label label;
+        Fixup fixup;
+    };
+
+    uint32_t _base;
+    std::vector<uint32_t> _words;
+    std::vector<size_t> _labels;
+    std::vector<Reference> _references;
+};
+
+}
+
+#endif /* HEADER_SOLOMIPS_ASSEMBLER_HXX */
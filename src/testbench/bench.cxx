@@ -0,0 +1,356 @@
+/*
+ *  bench.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "defaults.hxx"
+#include "machine.hxx"
+#include "assembler.hxx"
+#include "bench.hxx"
+
+using namespace SoloMIPS;
+
+namespace {
+
+typedef Assembler::Label Label;
+
+// Buffers in work RAM for the memory streams
+const uint32_t SOURCE = SOLOMIPS_DEFAULT_DATA_ADDR;
+const uint32_t DESTINATION = SOLOMIPS_DEFAULT_DATA_ADDR + 0x10000;
+const uint32_t STREAM_SIZE = 0x4000;
+
+Benchmark finish(const char *name, Assembler &a)
+{
+    a.halt();
+    Benchmark b;
+    b.name = name;
+    b.program = a.finish();
+    b.expectedStatus = -1;
+    return b;
+}
+
+// Count s0 down to zero and loop; the caller emits the delay slot
+void loopEnd(Assembler &a, Label loop)
+{
+    a.emit(OP::ADDIU(S0, S0, -1));
+    a.emit(OP::BNE(S0, 0, 0), loop);
+}
+
+// Mixed register and immediate arithmetic, 15 instructions per iteration
+Benchmark alu(uint32_t iterations)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S0, iterations);
+    a.li(T0, 0x12345678);
+    a.li(T1, 0x9abcdef0);
+    Label loop = a.here();
+    a.emit(OP::ADDU(T2, T0, T1));
+    a.emit(OP::XOR(T0, T0, T2));
+    a.emit(OP::SLL(T3, T0, 3));
+    a.emit(OP::SRL(T4, T1, 5));
+    a.emit(OP::OR(T1, T3, T4));
+    a.emit(OP::SUBU(T2, T2, T1));
+    a.emit(OP::AND(T5, T2, T0));
+    a.emit(OP::NOR(T6, T5, T1));
+    a.emit(OP::SRA(T7, T6, 7));
+    a.emit(OP::SLT(T8, T7, T0));
+    a.emit(OP::SLTU(T9, T1, T0));
+    a.emit(OP::XORI(T1, T1, 0x5a5a));
+    loopEnd(a, loop);
+    a.emit(OP::ADDU(T0, T0, T8));
+    a.emit(OP::XOR(V0, T0, T9));
+    return finish("alu", a);
+}
+
+// Fill the source buffer, then copy it word by word, unrolled four times
+Benchmark wordStream(uint32_t passes)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(T0, SOURCE);
+    a.li(T2, SOURCE + STREAM_SIZE);
+    Label fill = a.here();
+    a.emit(OP::SW(T0, 0, T0));
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::BNE(T0, T2, 0), fill);
+    a.nop();
+
+    a.li(S0, passes);
+    Label pass = a.here();
+    a.li(T0, SOURCE);
+    a.li(T1, DESTINATION);
+    Label copy = a.here();
+    a.emit(OP::LW(T3, 0, T0));
+    a.emit(OP::LW(T4, 4, T0));
+    a.emit(OP::LW(T5, 8, T0));
+    a.emit(OP::LW(T6, 12, T0));
+    a.emit(OP::ADDIU(T0, T0, 16));
+    a.emit(OP::SW(T3, 0, T1));
+    a.emit(OP::SW(T4, 4, T1));
+    a.emit(OP::SW(T5, 8, T1));
+    a.emit(OP::SW(T6, 12, T1));
+    a.emit(OP::BNE(T0, T2, 0), copy);
+    a.emit(OP::ADDIU(T1, T1, 16));
+    loopEnd(a, pass);
+    a.nop();
+
+    // Sum of the last words copied
+    a.emit(OP::ADDU(V0, T3, T6));
+    return finish("word_stream", a);
+}
+
+// Copy the source buffer byte by byte, summing the signed bytes and halfwords
+Benchmark byteStream(uint32_t passes)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(T0, SOURCE);
+    a.li(T2, SOURCE + STREAM_SIZE);
+    a.li(T3, 0x01030507);
+    Label fill = a.here();
+    a.emit(OP::SW(T3, 0, T0));
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::BNE(T0, T2, 0), fill);
+    a.emit(OP::ADDU(T3, T3, T0));
+
+    a.li(S0, passes);
+    a.li(V0, 0);
+    Label pass = a.here();
+    a.li(T0, SOURCE);
+    a.li(T1, DESTINATION);
+    Label copy = a.here();
+    a.emit(OP::LBU(T3, 0, T0));
+    a.emit(OP::LB(T4, 1, T0));
+    a.emit(OP::SB(T3, 0, T1));
+    a.emit(OP::LH(T5, 2, T0));
+    a.emit(OP::SB(T4, 1, T1));
+    a.emit(OP::LHU(T6, 2, T0));
+    a.emit(OP::SH(T5, 2, T1));
+    a.emit(OP::ADDU(V0, V0, T4));
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::BNE(T0, T2, 0), copy);
+    a.emit(OP::ADDIU(T1, T1, 4));
+    loopEnd(a, pass);
+    a.emit(OP::ADDU(V0, V0, T6));
+    return finish("byte_stream", a);
+}
+
+// Branches on the bits of a xorshift sequence, which are hard to predict for
+// the host as well
+Benchmark branches(uint32_t iterations)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S0, iterations);
+    a.li(T0, 0x2545f491);
+    Label loop = a.here();
+    a.emit(OP::SLL(T1, T0, 13));
+    a.emit(OP::XOR(T0, T0, T1));
+    a.emit(OP::SRL(T1, T0, 17));
+    a.emit(OP::XOR(T0, T0, T1));
+    a.emit(OP::SLL(T1, T0, 5));
+    a.emit(OP::XOR(T0, T0, T1));
+
+    Label skip1 = a.label();
+    a.emit(OP::ANDI(T1, T0, 1));
+    a.emit(OP::BEQ(T1, 0, 0), skip1);
+    a.nop();
+    a.emit(OP::ADDIU(T2, T2, 1));
+    a.bind(skip1);
+
+    Label skip2 = a.label();
+    a.emit(OP::ANDI(T1, T0, 2));
+    a.emit(OP::BNE(T1, 0, 0), skip2);
+    a.nop();
+    a.emit(OP::ADDIU(T3, T3, 1));
+    a.bind(skip2);
+
+    Label skip3 = a.label();
+    a.emit(OP::BLTZ(T0, 0), skip3);
+    a.nop();
+    a.emit(OP::ADDIU(T4, T4, 1));
+    a.bind(skip3);
+
+    a.emit(OP::ADDIU(S0, S0, -1));
+    a.emit(OP::BGTZ(S0, 0), loop);
+    a.nop();
+    a.emit(OP::ADDU(V0, T2, T3));
+    a.emit(OP::ADDU(V0, V0, T4));
+    return finish("branches", a);
+}
+
+// Calls to leaf functions, directly and through a register
+Benchmark calls(uint32_t iterations)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Label direct = a.label();
+    Label indirect = a.label();
+    a.li(S0, iterations);
+    a.la(S1, indirect);
+    Label loop = a.here();
+    a.emit(OP::JAL(0), direct);
+    a.emit(OP::ADDU(A0, T0, 0));
+    a.emit(OP::JALR(RA, S1));
+    a.nop();
+    loopEnd(a, loop);
+    a.nop();
+    a.emit(OP::ADDU(V0, V1, 0));
+    a.halt();
+
+    a.bind(direct);
+    a.emit(OP::ADDU(V1, V1, A0));
+    a.emit(OP::JR(RA));
+    a.emit(OP::ADDIU(T0, T0, 1));
+
+    a.bind(indirect);
+    a.emit(OP::XOR(V1, V1, T0));
+    a.emit(OP::JR(RA));
+    a.nop();
+    return finish("calls", a);
+}
+
+// Signed and unsigned multiplication and division
+Benchmark muldiv(uint32_t iterations)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S0, iterations);
+    a.li(T0, 0x7654321);
+    a.li(T1, 0x89abcdef);
+    Label loop = a.here();
+    a.emit(OP::MULT(T0, T1));
+    a.emit(OP::MFLO(T2));
+    a.emit(OP::MFHI(T3));
+    a.emit(OP::MULTU(T2, T3));
+    a.emit(OP::MFLO(T1));
+    a.emit(OP::ORI(T4, S0, 1));
+    a.emit(OP::DIV(T2, T4));
+    a.emit(OP::MFLO(T5));
+    a.emit(OP::MFHI(T6));
+    a.emit(OP::DIVU(T3, T4));
+    a.emit(OP::MFLO(T7));
+    a.emit(OP::ADDU(T0, T0, T5));
+    a.emit(OP::XOR(T0, T0, T6));
+    loopEnd(a, loop);
+    a.emit(OP::ADDU(T0, T0, T7));
+    a.emit(OP::XOR(V0, T0, T1));
+    return finish("muldiv", a);
+}
+
+// Echo the input to the output through the console ports, one word access
+// per character
+Benchmark io(uint32_t characters)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S0, characters);
+    a.li(S1, SOLOMIPS_DEFAULT_I_ADDR);
+    a.li(S2, SOLOMIPS_DEFAULT_O_ADDR);
+    Label loop = a.here();
+    a.emit(OP::LW(T0, 0, S1));
+    a.nop();
+    a.emit(OP::ADDU(V0, V0, T0));
+    a.emit(OP::SW(T0, 0, S2));
+    loopEnd(a, loop);
+    a.nop();
+    Benchmark b = finish("io", a);
+    b.input.reserve(characters);
+    for (uint32_t i = 0; i < characters; ++i)
+        b.input.push_back(static_cast<char>('a' + i % 26));
+    b.expectedOutput = b.input;
+    return b;
+}
+
+}
+
+std::vector<Benchmark> SoloMIPS::microbenchmarks(unsigned int scale)
+{
+    // Iteration counts for about two million instructions each
+    std::vector<Benchmark> benchmarks;
+    benchmarks.push_back(alu(135000 * scale));
+    benchmarks.push_back(wordStream(180 * scale));
+    benchmarks.push_back(byteStream(45 * scale));
+    benchmarks.push_back(branches(100000 * scale));
+    benchmarks.push_back(calls(200000 * scale));
+    benchmarks.push_back(muldiv(130000 * scale));
+    benchmarks.push_back(io(300000 * scale));
+    return benchmarks;
+}
+
+BenchmarkResult SoloMIPS::runBenchmark(const Benchmark &benchmark, ExecutionEngine engine, unsigned int runs)
+{
+    BenchmarkResult result;
+    result.passed = true;
+    result.status = 0;
+    result.instructions = 0;
+
+    std::vector<double> seconds;
+    for (unsigned int i = 0; i <= runs; ++i) {
+        std::istringstream input(benchmark.input);
+        std::ostringstream output;
+        std::ostringstream err;
+        Machine machine(std::vector<uint8_t>(benchmark.program), &input, &output);
+        machine.cpu.engine = engine;
+
+        auto start = std::chrono::steady_clock::now();
+        int status = machine.run(err);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (status < 0) {
+            result.passed = false;
+            result.message = err.str();
+            if (!result.message.empty() && result.message.back() == '\n')
+                result.message.pop_back();
+            return result;
+        }
+        if (benchmark.expectedStatus >= 0 && status != benchmark.expectedStatus) {
+            result.passed = false;
+            result.message = "exit status " + std::to_string(status) + ", expected " + std::to_string(benchmark.expectedStatus);
+            return result;
+        }
+        if (!benchmark.expectedOutput.empty() && output.str() != benchmark.expectedOutput) {
+            result.passed = false;
+            result.message = "output differs from the expected output";
+            return result;
+        }
+        if (i == 0) {
+            // Warm-up
+            result.status = status;
+            result.instructions = machine.cpu.instructions;
+            continue;
+        }
+        if (status != result.status || machine.cpu.instructions != result.instructions) {
+            result.passed = false;
+            result.message = "runs differ in exit status or instruction count";
+            return result;
+        }
+        seconds.push_back(elapsed);
+    }
+
+    std::vector<double> mips;
+    for (double s : seconds)
+        mips.push_back(result.instructions / std::max(s, 1e-9) / 1e6);
+    std::sort(mips.begin(), mips.end());
+    std::sort(seconds.begin(), seconds.end());
+    size_t n = mips.size();
+    result.medianSeconds = (n % 2) ? seconds[n / 2] : (seconds[n / 2 - 1] + seconds[n / 2]) / 2;
+    result.minMIPS = mips.front();
+    result.medianMIPS = (n % 2) ? mips[n / 2] : (mips[n / 2 - 1] + mips[n / 2]) / 2;
+    result.p99MIPS = mips[(n * 99 + 99) / 100 - 1];
+    return result;
+}
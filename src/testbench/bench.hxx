@@ -0,0 +1,80 @@
+/*
+ *  bench.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_BENCH_HXX
+#define HEADER_SOLOMIPS_BENCH_HXX
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu.hxx"
+
+/*
+Microbenchmarks: guest programs that each stress one part of the emulator
+(ALU operations, word and byte streams through memory, data dependent
+branches, calls and returns, multiplication and division, and the console
+ports). Each one ends with a checksum of its work as exit status.
+
+A benchmark is run a number of times on a fresh Machine per run, after one
+untimed run to warm up the host. Only `Machine::run()` is timed. The rate of
+each run is given in MIPS (million guest instructions per second); reported
+are the minimum, the median and the 99th percentile (nearest rank) of these.
+All runs must agree on the exit status and the instruction count, and on the
+expected status and output where the benchmark has them.
+*/
+
+#define SOLOMIPS_BENCH_RUNS 10u
+
+namespace SoloMIPS {
+
+struct Benchmark
+{
+    std::string name;
+    std::vector<uint8_t> program;
+    std::string input;
+    int expectedStatus;                 // -1 to not check the exit status
+    std::string expectedOutput;         // empty to not check the output
+};
+
+struct BenchmarkResult
+{
+    bool passed;
+    std::string message;                // reason of failure
+    int status;
+    uint64_t instructions;              // per run
+    double medianSeconds;
+    double minMIPS;
+    double medianMIPS;
+    double p99MIPS;
+};
+
+/**
+ * Return all microbenchmarks; scale multiplies their amount of work (about
+ * two million instructions each at 1).
+ */
+std::vector<Benchmark> microbenchmarks(unsigned int scale);
+
+BenchmarkResult runBenchmark(const Benchmark &benchmark, ExecutionEngine engine, unsigned int runs);
+
+}
+
+#endif /* HEADER_SOLOMIPS_BENCH_HXX */
@@ -0,0 +1,992 @@
+/*
+ *  components.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "defaults.hxx"
+#include "elf.hxx"
+#include "executable.hxx"
+#include "image.hxx"
+#include "io.hxx"
+#include "linker.hxx"
+#include "machine.hxx"
+#include "batch.hxx"
+#include "lockstep.hxx"
+#include "snapshot.hxx"
+#include "assembler.hxx"
+#include "components.hxx"
+
+using namespace SoloMIPS;
+
+namespace {
+
+void require(bool condition, const std::string &what)
+{
+    if (!condition)
+        throw std::runtime_error(what);
+}
+
+std::string hex(uint32_t value)
+{
+    std::ostringstream str;
+    str << "0x" << std::hex << value;
+    return str.str();
+}
+
+uint32_t loadWord(R3000 &cpu, uint32_t addr)
+{
+    return cpu.ram.mapperAt(addr)->loadWord(addr);
+}
+
+// Scratch file with the given contents, removed again when it goes out of scope
+class TempFile
+{
+public:
+    explicit TempFile(const std::vector<uint8_t> &contents)
+    {
+        const char *dir = std::getenv("TMPDIR");
+        if (dir == NULL)
+            dir = std::getenv("TEMP");
+        std::random_device random;
+        this->path = std::string(dir != NULL ? dir : "/tmp") + "/solomips-test-" + hex(random()).substr(2);
+        std::ofstream out(this->path, std::ios::out | std::ios::binary);
+        out.write(reinterpret_cast<const char *>(contents.data()), static_cast<std::streamsize>(contents.size()));
+        require(!out.fail(), "could not write '" + this->path + "'");
+    }
+
+    ~TempFile()
+    {
+        std::remove(this->path.c_str());
+    }
+
+    std::string path;
+
+private:
+    TempFile(const TempFile &other);
+    TempFile &operator=(const TempFile &other);
+};
+
+void putHalf(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putWord(std::vector<uint8_t> &out, uint32_t value)
+{
+    putHalf(out, static_cast<uint16_t>(value >> 16));
+    putHalf(out, static_cast<uint16_t>(value));
+}
+
+uint32_t readWord(const std::vector<uint8_t> &in, size_t at)
+{
+    return (static_cast<uint32_t>(in[at]) << 24) | (in[at+1] << 16) | (in[at+2] << 8) | in[at+3];
+}
+
+// Copy of the data with one big-endian word replaced
+std::vector<uint8_t> patchWord(const std::vector<uint8_t> &in, size_t at, uint32_t value)
+{
+    std::vector<uint8_t> out(in);
+    out[at] = static_cast<uint8_t>(value >> 24);
+    out[at+1] = static_cast<uint8_t>(value >> 16);
+    out[at+2] = static_cast<uint8_t>(value >> 8);
+    out[at+3] = static_cast<uint8_t>(value);
+    return out;
+}
+
+// Big-endian MIPS ELF32 relocatable object with a .text and a .data section,
+// their relocations and global symbols, as a compiler would write it
+class ObjectBuilder
+{
+public:
+    enum SectionIndex : uint16_t
+    {
+        Undefined = 0,
+        Text = 1,
+        Data = 3
+    };
+
+    // Add a global symbol and return its index
+    uint32_t symbol(const std::string &name, uint16_t shndx = Undefined, uint32_t value = 0, bool func = false)
+    {
+        Symbol sym = {name, shndx, value, func};
+        this->_symbols.push_back(sym);
+        return static_cast<uint32_t>(this->_symbols.size());
+    }
+
+    void emit(const OP &op, ELFRelType type = ELFRelType::MIPS_NONE, uint32_t sym = 0)
+    {
+        if (type != ELFRelType::MIPS_NONE)
+            putRel(this->_textRel, static_cast<uint32_t>(this->_text.size()), type, sym);
+        putWord(this->_text, op.encode());
+    }
+
+    void nop()
+    {
+        putWord(this->_text, 0);
+    }
+
+    void word(uint32_t value, uint32_t sym = 0)
+    {
+        if (sym != 0)
+            putRel(this->_dataRel, static_cast<uint32_t>(this->_data.size()), ELFRelType::MIPS_32, sym);
+        putWord(this->_data, value);
+    }
+
+    std::vector<uint8_t> finish() const
+    {
+        std::vector<uint8_t> strtab(1, 0), symtab(16, 0);
+        for (const Symbol &sym : this->_symbols) {
+            putWord(symtab, static_cast<uint32_t>(strtab.size()));
+            putWord(symtab, sym.value);
+            putWord(symtab, sym.shndx == Undefined ? 0 : 4);
+            symtab.push_back(static_cast<uint8_t>((1 << 4) | (sym.func ? 2 : sym.shndx == Undefined ? 0 : 1)));
+            symtab.push_back(0);
+            putHalf(symtab, sym.shndx);
+            strtab.insert(strtab.end(), sym.name.begin(), sym.name.end());
+            strtab.push_back(0);
+        }
+        static const char names[] = "\0.text\0.rel.text\0.data\0.rel.data\0.symtab\0.strtab\0.shstrtab";
+        std::vector<uint8_t> shstrtab(names, names + sizeof(names));
+
+        // Contents follow the file header, the section headers come last
+        const std::vector<uint8_t> *contents[] = {&this->_text, &this->_textRel, &this->_data, &this->_dataRel, &symtab, &strtab, &shstrtab};
+        std::vector<uint8_t> file(52, 0);
+        std::vector<uint32_t> offsets;
+        for (const std::vector<uint8_t> *c : contents) {
+            offsets.push_back(static_cast<uint32_t>(file.size()));
+            file.insert(file.end(), c->begin(), c->end());
+            file.resize((file.size() + 3) & ~static_cast<size_t>(3));
+        }
+        uint32_t shoff = static_cast<uint32_t>(file.size());
+        file.resize(file.size() + 40, 0);
+        const uint32_t alloc = static_cast<uint32_t>(ELFSectionFlags::Alloc);
+        sectionHeader(file, 1, ELFSectionType::ProgBits, alloc | static_cast<uint32_t>(ELFSectionFlags::ExecInstr), offsets[0], contents[0]->size(), 0, 0, 0);
+        sectionHeader(file, 7, ELFSectionType::Rel, 0, offsets[1], contents[1]->size(), 5, Text, 8);
+        sectionHeader(file, 17, ELFSectionType::ProgBits, alloc | static_cast<uint32_t>(ELFSectionFlags::Write), offsets[2], contents[2]->size(), 0, 0, 0);
+        sectionHeader(file, 23, ELFSectionType::Rel, 0, offsets[3], contents[3]->size(), 5, Data, 8);
+        sectionHeader(file, 33, ELFSectionType::SymTab, 0, offsets[4], contents[4]->size(), 6, 1, 16);
+        sectionHeader(file, 41, ELFSectionType::StrTab, 0, offsets[5], contents[5]->size(), 0, 0, 0);
+        sectionHeader(file, 49, ELFSectionType::StrTab, 0, offsets[6], contents[6]->size(), 0, 0, 0);
+
+        std::vector<uint8_t> header;
+        const uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 1, 2, 1};
+        header.insert(header.end(), ident, ident + 16);
+        putHalf(header, static_cast<uint16_t>(ELFObjectType::Rel));
+        putHalf(header, static_cast<uint16_t>(ELFMachineType::MIPS));
+        putWord(header, 1);
+        putWord(header, 0);
+        putWord(header, 0);
+        putWord(header, shoff);
+        putWord(header, 0);
+        putHalf(header, 52);
+        putHalf(header, 0);
+        putHalf(header, 0);
+        putHalf(header, 40);
+        putHalf(header, 8);
+        putHalf(header, 7);
+        std::copy(header.begin(), header.end(), file.begin());
+        return file;
+    }
+
+private:
+    struct Symbol
+    {
+        std::string name;
+        uint16_t shndx;
+        uint32_t value;
+        bool func;
+    };
+
+    static void putRel(std::vector<uint8_t> &rel, uint32_t offset, ELFRelType type, uint32_t sym)
+    {
+        putWord(rel, offset);
+        putWord(rel, (sym << 8) | static_cast<uint8_t>(type));
+    }
+
+    static void sectionHeader(std::vector<uint8_t> &file, uint32_t name, ELFSectionType type, uint32_t flags, uint32_t offset,
+                              size_t size, uint32_t link, uint32_t info, uint32_t entsize)
+    {
+        putWord(file, name);
+        putWord(file, static_cast<uint32_t>(type));
+        putWord(file, flags);
+        putWord(file, 0);
+        putWord(file, offset);
+        putWord(file, static_cast<uint32_t>(size));
+        putWord(file, link);
+        putWord(file, info);
+        putWord(file, 4);
+        putWord(file, entsize);
+    }
+
+    std::vector<Symbol> _symbols;
+    std::vector<uint8_t> _text, _textRel, _data, _dataRel;
+};
+
+// Call a function in the first page and one in the second 100 times each,
+// rewriting the first halfway through; s0 sums up what they return
+void selfModifyingCode(ExecutionEngine engine)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label first = a.label(), second = a.label(), patched = a.label();
+    Assembler::Label loop = a.label(), skip = a.label();
+    a.li(S0, 0);
+    a.li(T5, 100);
+    a.bind(loop);
+    a.emit(OP::ADDIU(T6, 0, 50));
+    a.emit(OP::BNE(T5, T6, 0), skip);
+    a.nop();
+    a.la(T0, patched);
+    a.li(T1, OP::ADDIU(V0, 0, 2).encode());
+    a.emit(OP::SW(T1, 0, T0));
+    a.bind(skip);
+    a.emit(OP::JAL(0), first);
+    a.nop();
+    a.emit(OP::ADDU(S0, S0, V0));
+    a.emit(OP::JAL(0), second);
+    a.nop();
+    a.emit(OP::ADDU(S0, S0, V0));
+    a.emit(OP::ADDIU(T5, T5, -1));
+    a.emit(OP::BNE(T5, 0, 0), loop);
+    a.nop();
+    a.halt();
+
+    a.bind(first);
+    a.bind(patched);
+    a.emit(OP::ADDIU(V0, 0, 1));
+    a.emit(OP::JR(RA));
+    a.nop();
+
+    while (a.pc() < SOLOMIPS_DEFAULT_ENTRY + 0x1000)
+        a.nop();
+    a.bind(second);
+    a.emit(OP::ADDIU(V0, 0, 3));
+    a.emit(OP::JR(RA));
+    a.nop();
+
+    std::istringstream in;
+    std::ostringstream out, err;
+    Machine machine(a.finish(), &in, &out);
+    machine.rom.setFlags(RAMMapperFlag::Readable | RAMMapperFlag::Writable | RAMMapperFlag::Executable);
+    machine.cpu.engine = engine;
+    int status = machine.run(err, 100000);
+    require(status >= 0, "exit status " + std::to_string(status) + ": " + err.str());
+    require(machine.cpu.r[S0] == 50 * 1 + 50 * 2 + 100 * 3, "s0 = " + hex(machine.cpu.r[S0]) + ", expected " + hex(450));
+}
+
+// Count to 1000 in the first word of work RAM, stop halfway and snapshot; the
+// snapshot must neither see later writes of the parent nor pass on those of a
+// fork
+void snapshotAndFork(ExecutionEngine engine)
+{
+    const uint32_t counter = SOLOMIPS_DEFAULT_DATA_ADDR, other = SOLOMIPS_DEFAULT_DATA_ADDR + 0x100000;
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label loop = a.label();
+    a.li(T0, counter);
+    a.li(T1, 1000);
+    a.bind(loop);
+    a.emit(OP::LW(T2, 0, T0));
+    a.nop();
+    a.emit(OP::ADDIU(T2, T2, 1));
+    a.emit(OP::SW(T2, 0, T0));
+    a.emit(OP::ADDIU(T1, T1, -1));
+    a.emit(OP::BNE(T1, 0, 0), loop);
+    a.nop();
+    a.halt();
+
+    std::istringstream in;
+    std::ostringstream out;
+    Machine machine(a.finish(), &in, &out);
+    machine.cpu.engine = engine;
+    RunResult result = machine.cpu.runFor(3000);
+    require(result.reason == StopReason::InstructionLimit, "parent stopped early: " + result.message);
+    uint32_t pc = machine.cpu.pc, count = loadWord(machine.cpu, counter);
+    require(count > 0 && count < 1000, "count = " + std::to_string(count) + " after 3000 instructions");
+
+    Snapshot snapshot(machine.cpu);
+    machine.wram.storeWord(counter, 0xdeadbeef);
+    machine.wram.storeWord(other, 0xdeadbeef);
+
+    // Restoring gives back the state at the time of the snapshot
+    std::unique_ptr<R3000> child = snapshot.fork(&in, &out);
+    require(child->pc == pc, "fork resumes at " + hex(child->pc) + ", expected " + hex(pc));
+    require(loadWord(*child, counter) == count, "fork sees counter " + hex(loadWord(*child, counter)) + ", expected " + hex(count));
+    require(loadWord(*child, other) == 0, "fork sees a write of the parent after the snapshot");
+
+    // ...and runs on from there, while its writes stay its own
+    child->ram.mapperAt(other)->storeWord(other, 0x12345678);
+    result = child->runFor(UINT64_MAX);
+    require(result.reason == StopReason::Halted, "fork did not halt: " + result.message);
+    require(loadWord(*child, counter) == 1000, "fork counted to " + std::to_string(loadWord(*child, counter)));
+    require(loadWord(machine.cpu, counter) == 0xdeadbeef && loadWord(machine.cpu, other) == 0xdeadbeef,
+            "parent sees the writes of a fork");
+
+    std::unique_ptr<R3000> second = snapshot.fork(&in, &out);
+    require(loadWord(*second, counter) == count && loadWord(*second, other) == 0,
+            "second fork sees the writes of the first");
+}
+
+// Require the bytes of the mapper from addr on to be the expected ones
+void requireContents(const RAMMapper *mapper, uint32_t addr, const std::vector<uint8_t> &expected, size_t from, size_t size,
+                     const std::string &what)
+{
+    const ArrayRAMMapper *array = dynamic_cast<const ArrayRAMMapper *>(mapper);
+    require(array != NULL && array->respondsTo(addr) && array->respondsTo(static_cast<uint32_t>(addr + size - 1)),
+            what + " does not cover " + hex(addr));
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t byte = array->loadByte(static_cast<uint32_t>(addr + i));
+        require(byte == expected[from + i], what + " has " + hex(byte) + " at " + hex(static_cast<uint32_t>(addr + i)) +
+                ", expected " + hex(expected[from + i]));
+    }
+}
+
+// Snapshot a machine whose ROM and data are mapped from a file, and a fork of
+// that; pages the parent never touched still hold file data, which copies,
+// images and forks at any depth must see
+void snapshotOfFork(ExecutionEngine engine)
+{
+    const uint32_t counter = SOLOMIPS_DEFAULT_DATA_ADDR, dataAddr = SOLOMIPS_DEFAULT_DATA_ADDR + 0x10000;
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label loop = a.label();
+    a.li(T0, counter);
+    a.li(T1, 1000);
+    a.bind(loop);
+    a.emit(OP::LW(T2, 0, T0));
+    a.nop();
+    a.emit(OP::ADDIU(T2, T2, 1));
+    a.emit(OP::SW(T2, 0, T0));
+    a.emit(OP::ADDIU(T1, T1, -1));
+    a.emit(OP::BNE(T1, 0, 0), loop);
+    a.nop();
+    a.halt();
+
+    std::vector<uint8_t> program = a.finish(), data(0x3000);
+    for (size_t i = program.size(); i < 0x8000; ++i)
+        program.push_back(static_cast<uint8_t>(i ^ (i >> 8) ^ 0x5a));
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(i ^ (i >> 8) ^ 0xa5);
+    appendDataImage(program, data, dataAddr);
+    TempFile file(program);
+
+    std::istringstream in;
+    std::ostringstream out;
+    Machine machine(file.path, &in, &out);
+    machine.cpu.engine = engine;
+    RunResult result = machine.cpu.runFor(3000);
+    require(result.reason == StopReason::InstructionLimit, "parent stopped early: " + result.message);
+
+    // Copies and images of the mappers themselves
+    ArrayRAMMapper romCopy(machine.rom), wramCopy(machine.wram);
+    requireContents(&romCopy, SOLOMIPS_DEFAULT_ENTRY, program, 0, program.size(), "copy of the ROM");
+    requireContents(&wramCopy, dataAddr, data, 0, data.size(), "copy of work RAM");
+    RAMImage image(machine.rom);
+    ArrayRAMMapper fromImage(SOLOMIPS_DEFAULT_ENTRY, image);
+    requireContents(&fromImage, SOLOMIPS_DEFAULT_ENTRY, program, 0, program.size(), "image of the ROM");
+
+    Snapshot snapshot(machine.cpu);
+    std::unique_ptr<R3000> child = snapshot.fork(&in, &out);
+    requireContents(child->ram.mapperAt(SOLOMIPS_DEFAULT_ENTRY), SOLOMIPS_DEFAULT_ENTRY, program, 0, program.size(), "ROM of a fork");
+    requireContents(child->ram.mapperAt(dataAddr), dataAddr, data, 0, data.size(), "work RAM of a fork");
+
+    // The fork inherits its pages from the snapshot without touching them
+    result = child->runFor(1000);
+    require(result.reason == StopReason::InstructionLimit, "fork stopped early: " + result.message);
+    uint32_t pc = child->pc, count = loadWord(*child, counter);
+    ArrayRAMMapper childCopy(*dynamic_cast<ArrayRAMMapper *>(child->ram.mapperAt(dataAddr)));
+    requireContents(&childCopy, dataAddr, data, 0, data.size(), "copy of the work RAM of a fork");
+
+    Snapshot nested(*child);
+    std::unique_ptr<R3000> grandchild = nested.fork(&in, &out);
+    requireContents(grandchild->ram.mapperAt(SOLOMIPS_DEFAULT_ENTRY), SOLOMIPS_DEFAULT_ENTRY, program, 0, program.size(),
+                    "ROM of a fork of a fork");
+    requireContents(grandchild->ram.mapperAt(dataAddr), dataAddr, data, 0, data.size(), "work RAM of a fork of a fork");
+    require(grandchild->pc == pc && loadWord(*grandchild, counter) == count,
+            "fork of a fork resumes at " + hex(grandchild->pc) + " with counter " + hex(loadWord(*grandchild, counter)) +
+            ", expected " + hex(pc) + " and " + hex(count));
+    result = grandchild->runFor(UINT64_MAX);
+    require(result.reason == StopReason::Halted, "fork of a fork did not halt: " + result.message);
+    require(loadWord(*grandchild, counter) == 1000, "fork of a fork counted to " + std::to_string(loadWord(*grandchild, counter)));
+}
+
+// One job passes, one spins past the instruction limit, one faults with an
+// error code whose low byte is the exit status it expects and one cannot be
+// loaded
+void batchFailures(ExecutionEngine engine)
+{
+    Assembler exits(SOLOMIPS_DEFAULT_ENTRY);
+    exits.li(V0, 7);
+    exits.halt();
+
+    Assembler spins(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label loop = spins.here();
+    spins.emit(OP::BEQ(0, 0, 0), loop);
+    spins.nop();
+
+    Assembler faults(SOLOMIPS_DEFAULT_ENTRY);
+    faults.emit(OP::LW(T0, 0, 0));
+    faults.nop();
+    faults.halt();
+
+    TempFile exitsFile(exits.finish()), spinsFile(spins.finish()), faultsFile(faults.finish());
+    std::vector<BatchJob> jobs(4);
+    jobs[0].program = exitsFile.path;
+    jobs[0].expectedStatus = 7;
+    jobs[1].program = spinsFile.path;
+    jobs[1].expectedStatus = -1;
+    jobs[2].program = faultsFile.path;
+    jobs[2].expectedStatus = -11 & 0xff;
+    jobs[3].program = exitsFile.path + ".missing";
+    jobs[3].expectedStatus = -1;
+
+    std::vector<BatchResult> results = runBatch(jobs, 2, engine, 100000);
+    require(results.size() == 4, "got " + std::to_string(results.size()) + " results for 4 jobs");
+    require(results[0].passed && results[0].status == 7,
+            "exiting job: status " + std::to_string(results[0].status) + ", " + results[0].message);
+    require(!results[1].passed && results[1].status == -13,
+            "spinning job: status " + std::to_string(results[1].status) + ", " + (results[1].passed ? "passed" : "failed"));
+    require(!results[2].passed && results[2].status == -11,
+            "faulting job: status " + std::to_string(results[2].status) + ", " + (results[2].passed ? "passed" : "failed"));
+    require(!results[3].passed && results[3].status == -21,
+            "missing program: status " + std::to_string(results[3].status) + ", " + (results[3].passed ? "passed" : "failed"));
+}
+
+// Jumping to an address that is not word aligned stops with a reason and a
+// message of its own
+void misalignedPC(ExecutionEngine engine)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(T0, SOLOMIPS_DEFAULT_ENTRY + 2);
+    a.emit(OP::JR(T0));
+    a.nop();
+    a.halt();
+
+    std::istringstream in;
+    std::ostringstream out, err;
+    Machine machine(a.finish(), &in, &out);
+    machine.cpu.engine = engine;
+    RunResult result = machine.cpu.runFor(1000);
+    require(result.reason == StopReason::MisalignedPC, "stopped with reason " + std::to_string(static_cast<unsigned int>(result.reason)));
+    require(result.message == "misaligned program counter", "message '" + result.message + "'");
+
+    machine.cpu.reset();
+    int status = machine.run(err, 1000);
+    require(status == -20 && err.str().find("misaligned program counter") != std::string::npos,
+            "exit status " + std::to_string(status) + ": " + err.str());
+}
+
+// Stop a loop counting to 100 in t1 halfway and at its end, resuming each time
+void runUntilAddress(ExecutionEngine engine)
+{
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label loop = a.label();
+    a.li(T1, 0);
+    a.emit(OP::ADDIU(T2, 0, 100));
+    uint32_t loopAddr = a.pc();
+    a.bind(loop);
+    a.emit(OP::ADDIU(T1, T1, 1));
+    a.emit(OP::BNE(T1, T2, 0), loop);
+    a.nop();
+    uint32_t endAddr = a.pc();
+    a.emit(OP::ADDU(V0, T1, 0));
+    a.halt();
+
+    std::istringstream in;
+    std::ostringstream out;
+    Machine machine(a.finish(), &in, &out);
+    machine.cpu.engine = engine;
+
+    // The pc is one instruction ahead of the one about to run
+    RunResult result = machine.cpu.runUntil([loopAddr](const R3000 &cpu) {
+        return cpu.pc - 4 == loopAddr && cpu.r[T1] == 50;
+    });
+    require(result.reason == StopReason::Condition, "first stop: " + std::to_string(static_cast<unsigned int>(result.reason)) + " " + result.message);
+    require(result.address == loopAddr && machine.cpu.r[T1] == 50,
+            "first stop at " + hex(result.address) + " with t1 = " + std::to_string(machine.cpu.r[T1]));
+
+    result = machine.cpu.runUntil([endAddr](const R3000 &cpu) {
+        return cpu.pc - 4 == endAddr;
+    });
+    require(result.reason == StopReason::Condition, "second stop: " + std::to_string(static_cast<unsigned int>(result.reason)) + " " + result.message);
+    require(result.address == endAddr && machine.cpu.r[T1] == 100,
+            "second stop at " + hex(result.address) + " with t1 = " + std::to_string(machine.cpu.r[T1]));
+
+    result = machine.cpu.runFor(1000);
+    require(result.reason == StopReason::Halted && machine.cpu.r[V0] == 100,
+            "resumed run: " + std::to_string(static_cast<unsigned int>(result.reason)) + ", v0 = " + std::to_string(machine.cpu.r[V0]));
+}
+
+// Interrupt a loop waiting for a flag in work RAM from another thread, then
+// raise the flag and resume
+void interruptFromThread(ExecutionEngine engine)
+{
+    const uint32_t flag = SOLOMIPS_DEFAULT_DATA_ADDR;
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Assembler::Label loop = a.label();
+    a.li(S0, flag);
+    uint32_t loopAddr = a.pc();
+    a.bind(loop);
+    a.emit(OP::LW(T0, 0, S0));
+    a.emit(OP::ADDIU(T1, T1, 1));
+    a.emit(OP::BEQ(T0, 0, 0), loop);
+    a.nop();
+    uint32_t endAddr = a.pc();
+    a.emit(OP::ADDU(V0, T0, 0));
+    a.halt();
+
+    std::istringstream in;
+    std::ostringstream out;
+    Machine machine(a.finish(), &in, &out);
+    machine.cpu.engine = engine;
+
+    std::thread interrupter([&machine]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        machine.cpu.interrupt();
+    });
+    RunResult result = machine.cpu.runFor(UINT64_C(20000000000));
+    interrupter.join();
+    require(result.reason == StopReason::Interrupted, "stopped with reason " + std::to_string(static_cast<unsigned int>(result.reason)) + " " + result.message);
+    require(result.address >= loopAddr && result.address < endAddr && machine.cpu.r[T1] > 0,
+            "interrupted at " + hex(result.address) + " after " + std::to_string(machine.cpu.r[T1]) + " iterations");
+
+    machine.wram.storeWord(flag, 42);
+    result = machine.cpu.runFor(1000);
+    require(result.reason == StopReason::Halted && machine.cpu.r[V0] == 42,
+            "resumed run: " + std::to_string(static_cast<unsigned int>(result.reason)) + ", v0 = " + std::to_string(machine.cpu.r[V0]));
+}
+
+// Random programs for the lockstep harness should run about as long as asked
+// for; faults and loops must stay rare
+void randomProgramLength(ExecutionEngine engine)
+{
+    const size_t length = 1000, programs = 100;
+    std::mt19937 random(1);
+    uint64_t total = 0;
+    for (size_t i = 0; i < programs; ++i) {
+        std::istringstream in;
+        std::ostringstream out;
+        Machine machine(randomProgram(random, length), &in, &out);
+        machine.cpu.engine = engine;
+        machine.cpu.runFor(2 * length);
+        total += machine.cpu.instructions;
+    }
+    uint64_t average = total / programs;
+    require(average >= length * 8 / 10 && average <= length * 12 / 10,
+            "average run of " + std::to_string(average) + " instructions, expected about " + std::to_string(length));
+}
+
+// Object i of n defines f<i>, returning i, and d<i>, holding 10 * i and the
+// address of f<i>; main in object 0 returns f1() + d1
+std::vector<uint8_t> linkerTestObject(size_t i, size_t n)
+{
+    ObjectBuilder obj;
+    std::string id = std::to_string(i);
+    uint32_t f = obj.symbol("f" + id, ObjectBuilder::Text, 0, true);
+    obj.symbol("d" + id, ObjectBuilder::Data, 0);
+    obj.emit(OP::ADDIU(V0, 0, static_cast<int16_t>(i)));
+    obj.emit(OP::JR(RA));
+    obj.nop();
+    obj.word(static_cast<uint32_t>(10 * i));
+    obj.word(0, f);
+    if (i == 0) {
+        uint32_t f1 = obj.symbol("f" + std::to_string(1 % n));
+        uint32_t d1 = obj.symbol("d" + std::to_string(1 % n));
+        obj.symbol("main", ObjectBuilder::Text, 12, true);
+        obj.emit(OP::ADDIU(SP, SP, -8));
+        obj.emit(OP::SW(RA, 4, SP));
+        obj.emit(OP::JAL(0), ELFRelType::MIPS_26, f1);
+        obj.nop();
+        obj.emit(OP::LUI(T0, 0), ELFRelType::MIPS_HI16, d1);
+        obj.emit(OP::LW(T1, 0, T0), ELFRelType::MIPS_LO16, d1);
+        obj.nop();
+        obj.emit(OP::ADDU(V0, V0, T1));
+        obj.emit(OP::LW(RA, 4, SP));
+        obj.emit(OP::ADDIU(SP, SP, 8));
+        obj.emit(OP::JR(RA));
+        obj.nop();
+    }
+    return obj.finish();
+}
+
+std::vector<uint8_t> link(const std::vector<std::string> &paths, unsigned int threads, LinkerFormat format)
+{
+    Linker ld(paths, SOLOMIPS_DEFAULT_ENTRY, SOLOMIPS_DEFAULT_DATA_ADDR, SOLOMIPS_DEFAULT_DATA_SIZE, threads, format);
+    std::ostringstream out;
+    ld.run(out);
+    std::string s = out.str();
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+// Linking on one thread and on eight gives the same bytes, and the program
+// runs; a duplicate definition is blamed on the object defining it first
+void linkerThreads(ExecutionEngine engine)
+{
+    const size_t n = 16;
+    std::vector<std::unique_ptr<TempFile>> files;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < n; ++i) {
+        files.emplace_back(new TempFile(linkerTestObject(i, n)));
+        paths.push_back(files.back()->path);
+    }
+
+    const LinkerFormat formats[] = {LinkerFormat::Flat, LinkerFormat::Executable};
+    for (LinkerFormat format : formats) {
+        std::vector<uint8_t> serial = link(paths, 1, format);
+        std::vector<uint8_t> parallel = link(paths, 8, format);
+        require(!serial.empty() && serial == parallel, "output differs between 1 and 8 threads");
+
+        TempFile program(serial);
+        std::istringstream in;
+        std::ostringstream out, err;
+        Machine machine(program.path, &in, &out);
+        machine.cpu.engine = engine;
+        int status = machine.run(err, 100000);
+        require(status == 11, "linked program exited with " + std::to_string(status) + ": " + err.str());
+    }
+
+    // Objects 3 and 9 both define f3 (and d3)
+    TempFile duplicate(linkerTestObject(3, n));
+    paths.insert(paths.begin() + 9, duplicate.path);
+    const unsigned int threads[] = {1, 8};
+    for (unsigned int t : threads) {
+        std::string message;
+        try {
+            link(paths, t, LinkerFormat::Flat);
+        }
+        catch (LinkerError &e) {
+            message = e.what();
+        }
+        std::string expected = "multiple definition of 'f3' in object file '" + duplicate.path + "' (first defined by '" + paths[3] + "')";
+        require(message == expected, "with " + std::to_string(t) + " threads: '" + message + "', expected '" + expected + "'");
+    }
+}
+
+// Data images are found again behind the code they were appended to, and a
+// trailer pointing outside the file is ignored
+void dataImageTrailer(ExecutionEngine)
+{
+    std::vector<uint8_t> program(100, 0x11), data(5000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(i * 7);
+    DataImage image;
+    require(!findDataImage(program.data(), program.size(), image), "data image found in plain code");
+    appendDataImage(program, data, SOLOMIPS_DEFAULT_DATA_ADDR);
+    require(findDataImage(program.data(), program.size(), image), "appended data image not found");
+    require(image.offset == SOLOMIPS_DATA_IMAGE_ALIGN && image.size == data.size() && image.addr == SOLOMIPS_DEFAULT_DATA_ADDR,
+            "data image at " + hex(image.offset) + " of size " + hex(image.size) + " for " + hex(image.addr));
+    require(std::equal(data.begin(), data.end(), program.begin() + image.offset), "data image contents differ");
+
+    // Offset, size and alignment of the trailer are checked against the file
+    struct { uint32_t offset, size; } bad[] = {
+        {0x3000, 16}, {0x1000, 5000 + 1}, {0x1000, 0xffffffffu}, {0xfffff000u, 0x2000}, {0x1004, 16}
+    };
+    size_t trailer = program.size() - SOLOMIPS_DATA_IMAGE_TRAILER_SIZE;
+    for (const auto &b : bad) {
+        std::vector<uint8_t> corrupt(program.begin(), program.begin() + trailer);
+        putWord(corrupt, b.offset);
+        putWord(corrupt, b.size);
+        putWord(corrupt, SOLOMIPS_DEFAULT_DATA_ADDR);
+        putWord(corrupt, SOLOMIPS_DATA_IMAGE_MAGIC);
+        require(!findDataImage(corrupt.data(), corrupt.size(), image),
+                "accepted a trailer with offset " + hex(b.offset) + " and size " + hex(b.size));
+    }
+}
+
+// Map parts of a file into a mapper, page aligned and not, and check that
+// writes stay in memory and ranges beyond the file or the mapper are refused
+void mapFileAt(ExecutionEngine)
+{
+    const uint32_t base = SOLOMIPS_DEFAULT_DATA_ADDR, length = 0x10000;
+    std::vector<uint8_t> contents(0x3000 + 100);
+    for (size_t i = 0; i < contents.size(); ++i)
+        contents[i] = static_cast<uint8_t>(i ^ (i >> 8));
+    TempFile file(contents);
+
+    struct { uint32_t addr, offset, size; } ranges[] = {
+        {base + 0x1000, 0x1000, 0x2000 + 100}, {base + 0x8800, 0x800, 0x1000 + 7}
+    };
+    for (const auto &r : ranges) {
+        ArrayRAMMapper ram(base, length, RAMMapperFlag::Readable | RAMMapperFlag::Writable);
+        ram.mapFileAt(r.addr, file.path, r.offset, r.size);
+        for (uint32_t a = base; a < base + length; ++a) {
+            bool inside = (a >= r.addr && a - r.addr < r.size);
+            uint8_t expected = inside ? contents[r.offset + (a - r.addr)] : 0;
+            require(ram.loadByte(a) == expected, "byte at " + hex(a) + " is " + hex(ram.loadByte(a)) + ", expected " + hex(expected));
+        }
+        ram.storeWord(r.addr, 0xdeadbeef);
+        require(ram.loadWord(r.addr) == 0xdeadbeef, "store to mapped file lost");
+    }
+    std::ifstream check(file.path, std::ios::in | std::ios::binary);
+    std::vector<uint8_t> after((std::istreambuf_iterator<char>(check)), std::istreambuf_iterator<char>());
+    require(after == contents, "file changed by a store to its mapping");
+
+    ArrayRAMMapper ram(base, length, RAMMapperFlag::Readable | RAMMapperFlag::Writable);
+    struct { uint32_t addr, offset, size; } refused[] = {
+        {base + 0x1000, 0x1000, 0x2000 + 101}, {base + length - 0x1000, 0, 0x1001}, {base - 4, 0, 16}, {base, 0x4000, 1}
+    };
+    for (const auto &r : refused) {
+        bool threw = false;
+        try {
+            ram.mapFileAt(r.addr, file.path, r.offset, r.size);
+        }
+        catch (IOException &) {
+            threw = true;
+        }
+        require(threw, "mapped " + hex(r.size) + " bytes at file offset " + hex(r.offset) + " to " + hex(r.addr));
+    }
+    for (uint32_t a = base; a < base + length; a += 4)
+        require(ram.loadWord(a) == 0, "refused mapping changed memory at " + hex(a));
+}
+
+// Write an executable with a code, a data and a bss segment and symbols, and
+// read it back; then break it in every way the tables allow
+void executableFormat(ExecutionEngine)
+{
+    const uint32_t code[] = {OP::ADDIU(V0, 0, 1).encode(), 0xffffffffu, OP::JR(RA).encode(), 0};
+    std::vector<uint8_t> text;
+    for (uint32_t word : code)
+        putWord(text, word);
+    std::vector<uint8_t> data(8, 0x5a);
+
+    Executable exe;
+    exe.entry = SOLOMIPS_DEFAULT_ENTRY;
+    exe.segments.resize(3);
+    exe.segments[0].addr = SOLOMIPS_DEFAULT_ENTRY;
+    exe.segments[0].fileSize = static_cast<uint32_t>(text.size());
+    exe.segments[0].memSize = 0x1000;
+    exe.segments[0].flags = SegmentFlag::Readable | SegmentFlag::Executable;
+    exe.segments[1].addr = SOLOMIPS_DEFAULT_DATA_ADDR;
+    exe.segments[1].fileSize = static_cast<uint32_t>(data.size());
+    exe.segments[1].memSize = 0x2000;
+    exe.segments[1].flags = SegmentFlag::Readable | SegmentFlag::Writable;
+    exe.segments[2].addr = SOLOMIPS_DEFAULT_DATA_ADDR + 0x2000;
+    exe.segments[2].memSize = 0x100;
+    exe.segments[2].flags = SegmentFlag::Readable | SegmentFlag::Writable;
+    exe.symbols.push_back(ExecutableSymbol(SOLOMIPS_DEFAULT_ENTRY, 16, "main"));
+    exe.symbols.push_back(ExecutableSymbol(SOLOMIPS_DEFAULT_DATA_ADDR, 8, "table"));
+    std::vector<const uint8_t *> contents;
+    contents.push_back(text.data());
+    contents.push_back(data.data());
+    contents.push_back(NULL);
+    std::vector<uint8_t> file = exe.write(contents);
+
+    Executable back;
+    require(Executable::isExecutable(file.data(), file.size()) && back.parse(file.data(), file.size()), "written executable does not parse");
+    require(back.entry == exe.entry && back.segments.size() == 3 && back.symbols.size() == 2, "header differs");
+    for (size_t i = 0; i < 3; ++i) {
+        const ExecutableSegment &a = exe.segments[i], &b = back.segments[i];
+        require(a.addr == b.addr && a.fileSize == b.fileSize && a.memSize == b.memSize && a.flags == b.flags,
+                "segment " + std::to_string(i) + " differs");
+        require(b.fileSize == 0 || (b.offset % SOLOMIPS_EXECUTABLE_ALIGN == 0
+                                    && std::equal(file.begin() + b.offset, file.begin() + b.offset + b.fileSize, contents[i])),
+                "contents of segment " + std::to_string(i) + " differ");
+    }
+    require(back.segments[0].instructionMap == std::vector<uint8_t>(1, 0xb0), "instruction map of the code differs");
+    require(back.segments[1].instructionMap.empty() && back.segments[2].instructionMap.empty(), "data has an instruction map");
+    for (size_t i = 0; i < 2; ++i) {
+        const ExecutableSymbol &a = exe.symbols[i], &b = back.symbols[i];
+        require(a.addr == b.addr && a.size == b.size && a.name == b.name, "symbol '" + b.name + "' differs");
+    }
+
+    // Any truncation cuts into a table or the contents of the last segment
+    for (size_t n = 0; n < file.size(); ++n)
+        require(!back.parse(file.data(), n), "accepted the file truncated to " + std::to_string(n) + " bytes");
+
+    const size_t segmentTable = readWord(file, 20), symbolTable = readWord(file, 28);
+    const uint32_t stringSize = readWord(file, 36);
+    const uint32_t size = static_cast<uint32_t>(file.size());
+    struct { size_t at; uint32_t value; const char *what; } broken[] = {
+        {16, 0x10000000u, "segment count"},
+        {20, size - 8, "segment table offset"},
+        {24, 0x10000000u, "symbol count"},
+        {28, size - 8, "symbol table offset"},
+        {32, size - 4, "string table offset"},
+        {36, stringSize - 1, "unterminated string table"},
+        {symbolTable + 8, stringSize, "symbol name offset"},
+        {segmentTable + 4, size - 4, "segment offset"},
+        {segmentTable + 8, 0x2000, "segment file size"},
+        {segmentTable + 20, size, "instruction map offset"},
+        {segmentTable + 16, 7 | 8, "segment flags"},
+        {segmentTable + 24 + 16, 0x80000003u, "segment flags"},
+        {segmentTable + 24, SOLOMIPS_DEFAULT_ENTRY + 0x800, "overlapping segment"},
+        {segmentTable + 48, SOLOMIPS_DEFAULT_DATA_ADDR + 0x1ffc, "overlapping segment"},
+        {segmentTable + 48 + 12, 0xffffffffu, "segment beyond the address space"}
+    };
+    for (const auto &b : broken) {
+        std::vector<uint8_t> f = patchWord(file, b.at, b.value);
+        require(!back.parse(f.data(), f.size()), std::string("accepted a bad ") + b.what + " of " + hex(b.value));
+    }
+
+    // Segments may touch, and all flags may be set
+    std::vector<uint8_t> f = patchWord(patchWord(file, segmentTable + 24, SOLOMIPS_DEFAULT_ENTRY + 0x1000), segmentTable + 16, 7);
+    require(back.parse(f.data(), f.size()), "rejected adjacent segments with all flags");
+}
+
+struct ProgramHeader
+{
+    ELFSegmentType type;
+    uint32_t offset, vaddr, filesz, memsz;
+    ELFSegmentFlags flags;
+};
+
+// Big-endian MIPS ELF32 executable with the given program headers and no
+// sections; the contents are placed at the offsets of the headers
+std::vector<uint8_t> elfExecutable(uint32_t entry, const std::vector<ProgramHeader> &headers, size_t size)
+{
+    std::vector<uint8_t> file;
+    const uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 1, 2, 1};
+    file.insert(file.end(), ident, ident + 16);
+    putHalf(file, static_cast<uint16_t>(ELFObjectType::Exec));
+    putHalf(file, static_cast<uint16_t>(ELFMachineType::MIPS));
+    putWord(file, 1);
+    putWord(file, entry);
+    putWord(file, 52);
+    putWord(file, 0);
+    putWord(file, 0);
+    putHalf(file, 52);
+    putHalf(file, 32);
+    putHalf(file, static_cast<uint16_t>(headers.size()));
+    putHalf(file, 40);
+    putHalf(file, 0);
+    putHalf(file, 0);
+    for (const ProgramHeader &ph : headers) {
+        putWord(file, static_cast<uint32_t>(ph.type));
+        putWord(file, ph.offset);
+        putWord(file, ph.vaddr);
+        putWord(file, ph.vaddr);
+        putWord(file, ph.filesz);
+        putWord(file, ph.memsz);
+        putWord(file, static_cast<uint32_t>(ph.flags));
+        putWord(file, SOLOMIPS_EXECUTABLE_ALIGN);
+    }
+    file.resize(size, 0);
+    return file;
+}
+
+// Load segments from a hand-built ELF executable: those whose offset and
+// address agree within a page are widened to start on it unless that would
+// overlap the segment before, and segments past the end of the file are
+// refused
+void elfProgramHeaders(ExecutionEngine engine)
+{
+    const ELFSegmentFlags rx = ELFSegmentFlags::Read | ELFSegmentFlags::Exec, r = ELFSegmentFlags::Read;
+    std::vector<ProgramHeader> headers = {
+        {ELFSegmentType::Load, 0x100, SOLOMIPS_DEFAULT_ENTRY + 0x100, 0x28, 0x1000, rx},
+        {ELFSegmentType::Load, 0x1010, 0x40001010, 4, 0x10, r},
+        {ELFSegmentType::Load, 0x2040, 0x50000020, 4, 4, r},
+        {ELFSegmentType::Load, 0x3180, SOLOMIPS_DEFAULT_ENTRY + 0x1180, 4, 4, r},
+        {ELFSegmentType::Note, 0x100000, 0, 0x100, 0x100, r}
+    };
+    std::vector<uint8_t> file = elfExecutable(SOLOMIPS_DEFAULT_ENTRY + 0x100, headers, 0x3184);
+
+    // Return the sum of the words of the three data segments
+    const uint32_t code[] = {
+        OP::LUI(T0, 0x4000).encode(), OP::LW(V0, 0x1010, T0).encode(),
+        OP::LUI(T0, 0x5000).encode(), OP::LW(T1, 0x20, T0).encode(),
+        OP::LUI(T0, SOLOMIPS_DEFAULT_ENTRY >> 16).encode(), OP::LW(T2, 0x1180, T0).encode(),
+        OP::ADDU(V0, V0, T1).encode(), OP::ADDU(V0, V0, T2).encode(), OP::JR(0).encode(), 0
+    };
+    for (size_t i = 0; i < sizeof(code) / sizeof(code[0]); ++i)
+        file = patchWord(file, 0x100 + 4 * i, code[i]);
+    file = patchWord(file, 0x1010, 30);
+    file = patchWord(file, 0x2040, 10);
+    file = patchWord(file, 0x3180, 2);
+
+    ELF32Object obj;
+    require(obj.parse(file.data(), file.size()) && obj.segmentCount() == headers.size(), "hand-built executable does not parse");
+    for (size_t i = 0; i < headers.size(); ++i) {
+        ELF32ProgramHeader ph = obj.segment(i);
+        const ProgramHeader &h = headers[i];
+        require(ph.type == h.type && ph.offset == h.offset && ph.vaddr == h.vaddr && ph.filesz == h.filesz && ph.memsz == h.memsz
+                && ph.flags == h.flags, "program header " + std::to_string(i) + " differs");
+    }
+
+    // Past the end of the file, or with more in the file than in memory
+    std::vector<uint8_t> beyond = patchWord(file, 52 + 2 * 32 + 4, 0x3181);
+    std::vector<uint8_t> larger = patchWord(file, 52 + 2 * 32 + 16, 8);
+    require(!obj.parse(beyond.data(), beyond.size()), "accepted a PT_LOAD past the end of the file");
+    require(!obj.parse(larger.data(), larger.size()), "accepted a PT_LOAD larger in the file than in memory");
+    bool threw = false;
+    try {
+        Machine machine(std::move(beyond));
+    }
+    catch (IOException &) {
+        threw = true;
+    }
+    require(threw, "loaded a PT_LOAD past the end of the file");
+
+    std::istringstream in;
+    std::ostringstream out, err;
+    Machine machine(std::move(file), &in, &out);
+    require(machine.rom.offset() == SOLOMIPS_DEFAULT_ENTRY && machine.rom.size() == 0x1100,
+            "code at " + hex(machine.rom.offset()) + " of size " + hex(machine.rom.size()) + ", expected widening to the page");
+    require(machine.segments.size() == 3, std::to_string(machine.segments.size()) + " data segments");
+    require(machine.segments[0]->offset() == 0x40001000 && machine.segments[0]->size() == 0x20,
+            "data at " + hex(machine.segments[0]->offset()) + " of size " + hex(machine.segments[0]->size()) + ", expected widening to the page");
+    require(machine.segments[1]->offset() == 0x50000020, "data not congruent to its offset moved to " + hex(machine.segments[1]->offset()));
+    require(machine.segments[2]->offset() == SOLOMIPS_DEFAULT_ENTRY + 0x1180,
+            "data after the code page widened to " + hex(machine.segments[2]->offset()));
+    machine.cpu.engine = engine;
+    int status = machine.run(err, 1000);
+    require(status == 42, "exit status " + std::to_string(status) + ": " + err.str());
+}
+
+}
+
+std::vector<ComponentTest> SoloMIPS::componentTests()
+{
+    std::vector<ComponentTest> tests;
+    tests.push_back({"self_modifying_code", true, selfModifyingCode});
+    tests.push_back({"snapshot_and_fork", true, snapshotAndFork});
+    tests.push_back({"snapshot_of_fork", true, snapshotOfFork});
+    tests.push_back({"batch_failures", true, batchFailures});
+    tests.push_back({"misaligned_pc", true, misalignedPC});
+    tests.push_back({"run_until_address", true, runUntilAddress});
+    tests.push_back({"interrupt_from_thread", true, interruptFromThread});
+    tests.push_back({"random_program_length", false, randomProgramLength});
+    tests.push_back({"linker_threads", true, linkerThreads});
+    tests.push_back({"data_image_trailer", false, dataImageTrailer});
+    tests.push_back({"map_file_at", false, mapFileAt});
+    tests.push_back({"executable_format", false, executableFormat});
+    tests.push_back({"elf_program_headers", true, elfProgramHeaders});
+    return tests;
+}
+
+TestResult SoloMIPS::runComponentTest(const ComponentTest &test, ExecutionEngine engine)
+{
+    TestResult result;
+    try {
+        test.run(engine);
+        result.passed = true;
+    }
+    catch (std::exception &e) {
+        result.passed = false;
+        result.message = e.what();
+    }
+    return result;
+}
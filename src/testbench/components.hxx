@@ -0,0 +1,59 @@
+/*
+ *  components.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_COMPONENTS_HXX
+#define HEADER_SOLOMIPS_COMPONENTS_HXX
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cpu.hxx"
+#include "tests.hxx"
+
+/*
+Tests of the parts of the emulator and the linker that instruction tests
+cannot reach, such as self-modifying code. Each test builds what it needs in
+memory (and in temporary files where the part reads files) and checks the
+outcome through the API of the part. Tests which depend on the engine run on
+every engine, the others once.
+*/
+
+namespace SoloMIPS {
+
+struct ComponentTest
+{
+    std::string name;
+    bool perEngine;
+    // Throws std::exception with the reason of a failure
+    std::function<void(ExecutionEngine)> run;
+};
+
+std::vector<ComponentTest> componentTests();
+
+/**
+ * Run the test on the given engine, which is ignored unless it depends on it.
+ */
+TestResult runComponentTest(const ComponentTest &test, ExecutionEngine engine);
+
+}
+
+#endif /* HEADER_SOLOMIPS_COMPONENTS_HXX */
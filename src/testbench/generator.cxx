@@ -0,0 +1,692 @@
+/*
+ *  generator.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "defaults.hxx"
+#include "assembler.hxx"
+#include "generator.hxx"
+
+using namespace SoloMIPS;
+
+namespace {
+
+typedef Assembler::Label Label;
+
+const uint32_t DATA = SOLOMIPS_DEFAULT_DATA_ADDR;
+const uint32_t DATA_SIZE = SOLOMIPS_DEFAULT_DATA_SIZE;
+
+// Kept free for the call stack of the sort workload
+const uint32_t STACK_SIZE = 0x100000;
+
+// Limits of Adler-32: the modulus and the number of bytes that can be summed
+// before the sums may overflow
+const uint32_t ADLER_BASE = 65521;
+const uint32_t ADLER_NMAX = 5552;
+
+const uint32_t MEMCPY_PASSES = 8;
+const uint32_t LIST_ROUNDS = 8;
+
+const struct {
+    Workload workload;
+    const char *name;
+    uint32_t size;
+} workloadList[] = {
+    {Workload::Memcpy, "memcpy", 256 * 1024},
+    {Workload::Checksum, "checksum", 256 * 1024},
+    {Workload::Sort, "sort", 16384},
+    {Workload::MatMul, "matmul", 60},
+    {Workload::ListChase, "list_chase", 20000},
+    {Workload::TextIO, "text_io", 150000}
+};
+
+// The xorshift generator of the guest programs, for computing the expected
+// results
+struct Xorshift
+{
+    explicit Xorshift(uint32_t state) : state(state) {}
+
+    uint32_t next()
+    {
+        this->state ^= this->state << 13;
+        this->state ^= this->state >> 17;
+        this->state ^= this->state << 5;
+        return this->state;
+    }
+
+    uint32_t state;
+};
+
+uint32_t initialState(uint32_t seed)
+{
+    uint32_t state = seed * 0x9e3779b9u + 0x7f4a7c15u;
+    return state != 0 ? state : 1;
+}
+
+// h = h * 31 + word, as computed by hashWords()
+uint32_t hash(uint32_t h, uint32_t word)
+{
+    return h * 31 + word;
+}
+
+// The exit status for a result
+int fold(uint32_t h)
+{
+    h ^= h >> 16;
+    h ^= h >> 8;
+    return static_cast<int>(h & 0xff);
+}
+
+uint32_t roundUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void checkSize(bool valid, const char *name)
+{
+    if (!valid)
+        throw std::out_of_range(std::string("size out of range for ") + name);
+}
+
+// Advance the xorshift state in s7, clobbering t9
+void xorshift(Assembler &a)
+{
+    a.emit(OP::SLL(T9, S7, 13));
+    a.emit(OP::XOR(S7, S7, T9));
+    a.emit(OP::SRL(T9, S7, 17));
+    a.emit(OP::XOR(S7, S7, T9));
+    a.emit(OP::SLL(T9, S7, 5));
+    a.emit(OP::XOR(S7, S7, T9));
+}
+
+// Fill the words from begin to end with xorshift numbers, clobbering t0, t1
+// and t9
+void fillRandom(Assembler &a, uint32_t begin, uint32_t end)
+{
+    a.li(T0, begin);
+    a.li(T1, end);
+    Label fill = a.here();
+    xorshift(a);
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::BNE(T0, T1, 0), fill);
+    a.emit(OP::SW(S7, -4, T0));
+}
+
+// Host side of fillRandom()
+std::vector<uint32_t> randomWords(Xorshift &random, uint32_t count)
+{
+    std::vector<uint32_t> words(count);
+    for (uint32_t &word : words)
+        word = random.next();
+    return words;
+}
+
+// Hash the words from begin to end into v0, clobbering s0, s1, t0 and t1
+void hashWords(Assembler &a, uint32_t begin, uint32_t end)
+{
+    a.li(S0, begin);
+    a.li(S1, end);
+    a.li(V0, 0);
+    Label loop = a.here();
+    a.emit(OP::LW(T0, 0, S0));
+    a.emit(OP::ADDIU(S0, S0, 4));
+    a.emit(OP::SLL(T1, V0, 5));
+    a.emit(OP::SUBU(T1, T1, V0));
+    a.emit(OP::BNE(S0, S1, 0), loop);
+    a.emit(OP::ADDU(V0, T1, T0));
+}
+
+// Fold v0 into its low byte, which becomes the exit status, and halt
+void foldAndHalt(Assembler &a)
+{
+    a.emit(OP::SRL(T0, V0, 16));
+    a.emit(OP::XOR(V0, V0, T0));
+    a.emit(OP::SRL(T0, V0, 8));
+    a.emit(OP::XOR(V0, V0, T0));
+    a.halt();
+}
+
+Benchmark finish(Assembler &a, Workload workload, int expectedStatus)
+{
+    Benchmark b;
+    b.name = workloadName(workload);
+    b.program = a.finish();
+    b.expectedStatus = expectedStatus;
+    return b;
+}
+
+Benchmark generateMemcpy(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 0 && size <= DATA_SIZE / 2, "memcpy");
+    const uint32_t words = roundUp(size, 4) / 4;
+    const uint32_t source = DATA;
+    const uint32_t destination = DATA + roundUp(size, 16);
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Label function = a.label();
+    a.li(S7, initialState(seed));
+    fillRandom(a, source, source + words * 4);
+    a.li(S4, MEMCPY_PASSES);
+    Label pass = a.here();
+    a.li(A0, destination);
+    a.li(A1, source);
+    a.li(A2, size);
+    a.emit(OP::JAL(0), function);
+    a.emit(OP::ADDIU(S4, S4, -1));
+    a.emit(OP::BNE(S4, 0, 0), pass);
+    a.nop();
+    hashWords(a, destination, destination + words * 4);
+    foldAndHalt(a);
+
+    // memcpy(a0 = destination, a1 = source, a2 = bytes), both word aligned
+    Label tail = a.label();
+    Label done = a.label();
+    a.bind(function);
+    a.emit(OP::SRL(T0, A2, 4));
+    a.emit(OP::BEQ(T0, 0, 0), tail);
+    a.emit(OP::ANDI(A2, A2, 15));
+    Label block = a.here();
+    a.emit(OP::LW(T1, 0, A1));
+    a.emit(OP::LW(T2, 4, A1));
+    a.emit(OP::LW(T3, 8, A1));
+    a.emit(OP::LW(T4, 12, A1));
+    a.emit(OP::ADDIU(A1, A1, 16));
+    a.emit(OP::SW(T1, 0, A0));
+    a.emit(OP::SW(T2, 4, A0));
+    a.emit(OP::SW(T3, 8, A0));
+    a.emit(OP::SW(T4, 12, A0));
+    a.emit(OP::ADDIU(T0, T0, -1));
+    a.emit(OP::BNE(T0, 0, 0), block);
+    a.emit(OP::ADDIU(A0, A0, 16));
+    a.bind(tail);
+    a.emit(OP::BEQ(A2, 0, 0), done);
+    a.nop();
+    Label byte = a.here();
+    a.emit(OP::LBU(T1, 0, A1));
+    a.emit(OP::ADDIU(A1, A1, 1));
+    a.emit(OP::SB(T1, 0, A0));
+    a.emit(OP::ADDIU(A2, A2, -1));
+    a.emit(OP::BNE(A2, 0, 0), byte);
+    a.emit(OP::ADDIU(A0, A0, 1));
+    a.bind(done);
+    a.emit(OP::JR(RA));
+    a.nop();
+
+    // The destination holds the first size bytes of the source, then zeros
+    Xorshift random(initialState(seed));
+    std::vector<uint32_t> data = randomWords(random, words);
+    if (size % 4 != 0)
+        data.back() &= ~(0xffffffffu >> ((size % 4) * 8));
+    uint32_t h = 0;
+    for (uint32_t word : data)
+        h = hash(h, word);
+    return finish(a, Workload::Memcpy, fold(h));
+}
+
+Benchmark generateChecksum(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 0 && size <= DATA_SIZE, "checksum");
+    const uint32_t words = roundUp(size, 4) / 4;
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S7, initialState(seed));
+    fillRandom(a, DATA, DATA + words * 4);
+    a.li(S0, DATA);
+    a.li(S1, DATA + size);
+    a.li(S2, 1);
+    a.li(S3, 0);
+    a.li(S4, ADLER_BASE);
+    a.li(S5, ADLER_NMAX);
+
+    // Sum blocks of at most ADLER_NMAX bytes, reducing after each one
+    Label outer = a.here();
+    Label blockEnd = a.label();
+    a.emit(OP::SUBU(T0, S1, S0));
+    a.emit(OP::SLTU(T1, T0, S5));
+    a.emit(OP::BNE(T1, 0, 0), blockEnd);
+    a.nop();
+    a.emit(OP::OR(T0, S5, 0));
+    a.bind(blockEnd);
+    a.emit(OP::ADDU(T2, S0, T0));
+    Label inner = a.here();
+    a.emit(OP::LBU(T3, 0, S0));
+    a.emit(OP::ADDIU(S0, S0, 1));
+    a.emit(OP::ADDU(S2, S2, T3));
+    a.emit(OP::BNE(S0, T2, 0), inner);
+    a.emit(OP::ADDU(S3, S3, S2));
+    a.emit(OP::DIVU(S2, S4));
+    a.emit(OP::MFHI(S2));
+    a.emit(OP::DIVU(S3, S4));
+    a.emit(OP::MFHI(S3));
+    a.emit(OP::BNE(S0, S1, 0), outer);
+    a.nop();
+    a.emit(OP::SLL(V0, S3, 16));
+    a.emit(OP::OR(V0, V0, S2));
+    foldAndHalt(a);
+
+    Xorshift random(initialState(seed));
+    std::vector<uint32_t> data = randomWords(random, words);
+    uint32_t sumA = 1;
+    uint32_t sumB = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+        sumA = (sumA + ((data[i / 4] >> (24 - (i % 4) * 8)) & 0xff)) % ADLER_BASE;
+        sumB = (sumB + sumA) % ADLER_BASE;
+    }
+    return finish(a, Workload::Checksum, fold((sumB << 16) | sumA));
+}
+
+Benchmark generateSort(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 0 && size <= (DATA_SIZE - STACK_SIZE) / 4, "sort");
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    Label quicksort = a.label();
+    a.li(S7, initialState(seed));
+    fillRandom(a, DATA, DATA + size * 4);
+    a.li(SP, DATA + DATA_SIZE);
+    a.li(A0, DATA);
+    a.li(A1, DATA + (size - 1) * 4);
+    a.emit(OP::JAL(0), quicksort);
+    a.nop();
+    hashWords(a, DATA, DATA + size * 4);
+    foldAndHalt(a);
+
+    // quicksort(a0 = first, a1 = last element), Lomuto partition around the
+    // last element
+    Label done = a.label();
+    a.bind(quicksort);
+    a.emit(OP::SLTU(T0, A0, A1));
+    a.emit(OP::BEQ(T0, 0, 0), done);
+    a.nop();
+    a.emit(OP::ADDIU(SP, SP, -12));
+    a.emit(OP::SW(RA, 0, SP));
+    a.emit(OP::SW(A1, 8, SP));
+    a.emit(OP::LW(T1, 0, A1));
+    a.emit(OP::OR(T2, A0, 0));
+    a.emit(OP::OR(T3, A0, 0));
+    Label partition = a.here();
+    Label skip = a.label();
+    a.emit(OP::LW(T4, 0, T3));
+    a.nop();
+    a.emit(OP::SLT(T5, T4, T1));
+    a.emit(OP::BEQ(T5, 0, 0), skip);
+    a.emit(OP::ADDIU(T3, T3, 4));
+    // Swaps keep stores to the loaded address out of the load delay slot:
+    // the memory is read only after it
+    a.emit(OP::LW(T6, 0, T2));
+    a.emit(OP::ADDIU(T2, T2, 4));
+    a.emit(OP::SW(T4, -4, T2));
+    a.emit(OP::SW(T6, -4, T3));
+    a.bind(skip);
+    a.emit(OP::BNE(T3, A1, 0), partition);
+    a.nop();
+    a.emit(OP::LW(T6, 0, T2));
+    a.emit(OP::SW(T2, 4, SP));
+    a.emit(OP::SW(T1, 0, T2));
+    a.emit(OP::SW(T6, 0, A1));
+    a.emit(OP::JAL(0), quicksort);
+    a.emit(OP::ADDIU(A1, T2, -4));
+    a.emit(OP::LW(T2, 4, SP));
+    a.emit(OP::LW(A1, 8, SP));
+    a.emit(OP::JAL(0), quicksort);
+    a.emit(OP::ADDIU(A0, T2, 4));
+    a.emit(OP::LW(RA, 0, SP));
+    a.emit(OP::ADDIU(SP, SP, 12));
+    a.bind(done);
+    a.emit(OP::JR(RA));
+    a.nop();
+
+    Xorshift random(initialState(seed));
+    std::vector<uint32_t> data = randomWords(random, size);
+    std::sort(data.begin(), data.end(), [](uint32_t x, uint32_t y) {
+        return static_cast<int32_t>(x) < static_cast<int32_t>(y);
+    });
+    uint32_t h = 0;
+    for (uint32_t word : data)
+        h = hash(h, word);
+    return finish(a, Workload::Sort, fold(h));
+}
+
+Benchmark generateMatMul(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 0 && static_cast<uint64_t>(size) * size * 12 <= DATA_SIZE, "matmul");
+    const uint32_t n = size;
+    const uint32_t stride = n * 4;
+    const uint32_t matrixA = DATA;
+    const uint32_t matrixB = matrixA + n * stride;
+    const uint32_t matrixC = matrixB + n * stride;
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S7, initialState(seed));
+    fillRandom(a, matrixA, matrixC);
+    a.li(S0, matrixA);
+    a.li(S2, matrixB + stride);
+    a.li(S3, matrixC);
+    a.li(S5, stride);
+    a.li(S6, matrixB);
+
+    // For each row of A (s0) and column of B (s1), the dot product into C
+    Label row = a.here();
+    a.li(S1, matrixB);
+    Label column = a.here();
+    a.emit(OP::OR(T0, S0, 0));
+    a.emit(OP::OR(T1, S1, 0));
+    a.emit(OP::ADDU(T2, S0, S5));
+    a.emit(OP::OR(T3, 0, 0));
+    Label product = a.here();
+    a.emit(OP::LW(T4, 0, T0));
+    a.emit(OP::LW(T5, 0, T1));
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::MULT(T4, T5));
+    a.emit(OP::MFLO(T6));
+    a.emit(OP::ADDU(T1, T1, S5));
+    a.emit(OP::BNE(T0, T2, 0), product);
+    a.emit(OP::ADDU(T3, T3, T6));
+    a.emit(OP::SW(T3, 0, S3));
+    a.emit(OP::ADDIU(S1, S1, 4));
+    a.emit(OP::BNE(S1, S2, 0), column);
+    a.emit(OP::ADDIU(S3, S3, 4));
+    a.emit(OP::ADDU(S0, S0, S5));
+    a.emit(OP::BNE(S0, S6, 0), row);
+    a.nop();
+    hashWords(a, matrixC, matrixC + n * stride);
+    foldAndHalt(a);
+
+    Xorshift random(initialState(seed));
+    std::vector<uint32_t> data = randomWords(random, 2 * n * n);
+    const uint32_t *A = data.data();
+    const uint32_t *B = A + n * n;
+    uint32_t h = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t j = 0; j < n; ++j) {
+            uint32_t sum = 0;
+            for (uint32_t k = 0; k < n; ++k)
+                sum += A[i * n + k] * B[k * n + j];
+            h = hash(h, sum);
+        }
+    }
+    return finish(a, Workload::MatMul, fold(h));
+}
+
+Benchmark generateListChase(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 1 && static_cast<uint64_t>(size) * 12 + 4 <= DATA_SIZE, "list_chase");
+    const uint32_t order = DATA;
+    const uint32_t nodes = DATA + roundUp(size * 4, 8);
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S7, initialState(seed));
+    a.li(S2, order);
+    a.li(S3, nodes);
+
+    // order[i] = i, then shuffle (Fisher-Yates)
+    a.li(T0, order);
+    a.li(T1, order + size * 4);
+    a.li(T2, 0);
+    Label identity = a.here();
+    a.emit(OP::SW(T2, 0, T0));
+    a.emit(OP::ADDIU(T0, T0, 4));
+    a.emit(OP::BNE(T0, T1, 0), identity);
+    a.emit(OP::ADDIU(T2, T2, 1));
+    a.li(S0, size - 1);
+    Label shuffle = a.here();
+    xorshift(a);
+    a.emit(OP::ADDIU(T0, S0, 1));
+    a.emit(OP::DIVU(S7, T0));
+    a.emit(OP::MFHI(T1));
+    a.emit(OP::SLL(T1, T1, 2));
+    a.emit(OP::ADDU(T1, T1, S2));
+    a.emit(OP::SLL(T2, S0, 2));
+    a.emit(OP::ADDU(T2, T2, S2));
+    a.emit(OP::LW(T3, 0, T1));
+    a.emit(OP::LW(T4, 0, T2));
+    a.emit(OP::ADDIU(S0, S0, -1));
+    a.emit(OP::SW(T3, 0, T2));
+    a.emit(OP::BNE(S0, 0, 0), shuffle);
+    a.emit(OP::SW(T4, 0, T1));
+
+    // Link the nodes (next, value) in shuffled order into a cycle
+    a.li(S0, order);
+    a.li(S1, order + (size - 1) * 4);
+    Label link = a.here();
+    a.emit(OP::LW(T0, 0, S0));
+    a.emit(OP::LW(T1, 4, S0));
+    a.emit(OP::SLL(T0, T0, 3));
+    a.emit(OP::ADDU(T0, T0, S3));
+    a.emit(OP::SLL(T1, T1, 3));
+    a.emit(OP::ADDU(T1, T1, S3));
+    a.emit(OP::SW(T1, 0, T0));
+    xorshift(a);
+    a.emit(OP::ADDIU(S0, S0, 4));
+    a.emit(OP::BNE(S0, S1, 0), link);
+    a.emit(OP::SW(S7, 4, T0));
+    a.emit(OP::LW(T0, 0, S0));
+    a.emit(OP::LW(T1, 0, S2));
+    a.emit(OP::SLL(T0, T0, 3));
+    a.emit(OP::ADDU(T0, T0, S3));
+    a.emit(OP::SLL(T1, T1, 3));
+    a.emit(OP::ADDU(T1, T1, S3));
+    a.emit(OP::SW(T1, 0, T0));
+    xorshift(a);
+    a.emit(OP::SW(S7, 4, T0));
+
+    // Follow the list from its first node
+    a.emit(OP::OR(S0, T1, 0));
+    a.li(S1, size * LIST_ROUNDS);
+    a.li(V0, 0);
+    Label chase = a.here();
+    a.emit(OP::LW(T0, 4, S0));
+    a.emit(OP::LW(S0, 0, S0));
+    a.emit(OP::ADDIU(S1, S1, -1));
+    a.emit(OP::SLL(T1, V0, 5));
+    a.emit(OP::SUBU(T1, T1, V0));
+    a.emit(OP::BNE(S1, 0, 0), chase);
+    a.emit(OP::ADDU(V0, T1, T0));
+    foldAndHalt(a);
+
+    Xorshift random(initialState(seed));
+    std::vector<uint32_t> shuffled(size);
+    for (uint32_t i = 0; i < size; ++i)
+        shuffled[i] = i;
+    for (uint32_t i = size - 1; i > 0; --i)
+        std::swap(shuffled[i], shuffled[random.next() % (i + 1)]);
+    std::vector<uint32_t> next(size);
+    std::vector<uint32_t> value(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        next[shuffled[i]] = shuffled[(i + 1) % size];
+        value[shuffled[i]] = random.next();
+    }
+    uint32_t h = 0;
+    uint32_t node = shuffled[0];
+    for (uint64_t i = 0; i < static_cast<uint64_t>(size) * LIST_ROUNDS; ++i) {
+        h = hash(h, value[node]);
+        node = next[node];
+    }
+    return finish(a, Workload::ListChase, fold(h));
+}
+
+// Lines of words of lower case letters, with the odd capital, digit and
+// punctuation mark
+std::string generateText(uint32_t size, uint32_t seed)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzABCDEF0123,.;!";
+    Xorshift random(initialState(seed));
+    std::string text;
+    text.reserve(size + 16);
+    uint32_t column = 0;
+    while (text.size() < size) {
+        uint32_t length = 1 + random.next() % 8;
+        if (column + length > 64) {
+            text.push_back('\n');
+            column = 0;
+        }
+        for (uint32_t i = 0; i < length; ++i)
+            text.push_back(alphabet[random.next() % (sizeof(alphabet) - 1)]);
+        text.push_back(' ');
+        column += length + 1;
+    }
+    text.resize(size);
+    return text;
+}
+
+Benchmark generateTextIO(uint32_t size, uint32_t seed)
+{
+    checkSize(size > 0, "text_io");
+
+    Assembler a(SOLOMIPS_DEFAULT_ENTRY);
+    a.li(S1, SOLOMIPS_DEFAULT_I_ADDR);
+    a.li(S2, SOLOMIPS_DEFAULT_O_ADDR);
+    a.li(S3, 0);
+    a.li(S4, 0);
+    a.li(S5, 0xff);
+
+    // Copy characters up to the end of input, converting lower case letters
+    // and counting new lines; s4 hashes the output
+    Label loop = a.here();
+    Label end = a.label();
+    Label notLower = a.label();
+    Label notNewline = a.label();
+    a.emit(OP::LBU(T0, 0, S1));
+    a.nop();
+    a.emit(OP::BEQ(T0, S5, 0), end);
+    a.emit(OP::ADDIU(T1, T0, -'a'));
+    a.emit(OP::SLTIU(T1, T1, 26));
+    a.emit(OP::BEQ(T1, 0, 0), notLower);
+    a.emit(OP::XORI(T2, T0, '\n'));
+    a.emit(OP::ADDIU(T0, T0, 'A' - 'a'));
+    a.bind(notLower);
+    a.emit(OP::BNE(T2, 0, 0), notNewline);
+    a.emit(OP::SB(T0, 0, S2));
+    a.emit(OP::ADDIU(S3, S3, 1));
+    a.bind(notNewline);
+    a.emit(OP::SLL(T3, S4, 5));
+    a.emit(OP::SUBU(T3, T3, S4));
+    a.emit(OP::J(0), loop);
+    a.emit(OP::ADDU(S4, T3, T0));
+
+    // Print the line count in decimal, digits reversed through a buffer
+    a.bind(end);
+    a.li(T0, 10);
+    a.emit(OP::OR(T1, S3, 0));
+    a.li(S6, DATA);
+    a.emit(OP::OR(S0, S6, 0));
+    Label digits = a.here();
+    a.emit(OP::DIVU(T1, T0));
+    a.emit(OP::MFLO(T1));
+    a.emit(OP::MFHI(T2));
+    a.emit(OP::ADDIU(T2, T2, '0'));
+    a.emit(OP::SB(T2, 0, S0));
+    a.emit(OP::BNE(T1, 0, 0), digits);
+    a.emit(OP::ADDIU(S0, S0, 1));
+    Label print = a.here();
+    a.emit(OP::ADDIU(S0, S0, -1));
+    a.emit(OP::LBU(T2, 0, S0));
+    a.nop();
+    a.emit(OP::BNE(S0, S6, 0), print);
+    a.emit(OP::SB(T2, 0, S2));
+    a.li(T2, '\n');
+    a.emit(OP::SB(T2, 0, S2));
+    a.emit(OP::XOR(V0, S4, S3));
+    foldAndHalt(a);
+
+    std::string input = generateText(size, seed);
+    std::string output;
+    output.reserve(size + 16);
+    uint32_t lines = 0;
+    uint32_t h = 0;
+    for (char c : input) {
+        if (c >= 'a' && c <= 'z')
+            c = static_cast<char>(c - 'a' + 'A');
+        if (c == '\n')
+            ++lines;
+        output.push_back(c);
+        h = hash(h, static_cast<unsigned char>(c));
+    }
+    output += std::to_string(lines) + "\n";
+    Benchmark b = finish(a, Workload::TextIO, fold(h ^ lines));
+    b.input = input;
+    b.expectedOutput = output;
+    return b;
+}
+
+}
+
+const char *SoloMIPS::workloadName(Workload workload)
+{
+    for (const auto &entry : workloadList) {
+        if (entry.workload == workload)
+            return entry.name;
+    }
+    return "unknown";
+}
+
+bool SoloMIPS::parseWorkload(const std::string &name, Workload &workload)
+{
+    for (const auto &entry : workloadList) {
+        if (name == entry.name) {
+            workload = entry.workload;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t SoloMIPS::defaultWorkloadSize(Workload workload)
+{
+    for (const auto &entry : workloadList) {
+        if (entry.workload == workload)
+            return entry.size;
+    }
+    return 0;
+}
+
+Benchmark SoloMIPS::generateWorkload(Workload workload, uint32_t size, uint32_t seed)
+{
+    switch (workload) {
+        case Workload::Memcpy:
+            return generateMemcpy(size, seed);
+        case Workload::Checksum:
+            return generateChecksum(size, seed);
+        case Workload::Sort:
+            return generateSort(size, seed);
+        case Workload::MatMul:
+            return generateMatMul(size, seed);
+        case Workload::ListChase:
+            return generateListChase(size, seed);
+        case Workload::TextIO:
+            return generateTextIO(size, seed);
+    }
+    throw std::out_of_range("unknown workload");
+}
+
+std::vector<Benchmark> SoloMIPS::workloads(unsigned int scale)
+{
+    std::vector<Benchmark> benchmarks;
+    for (const auto &entry : workloadList) {
+        uint32_t size = entry.size * scale;
+        if (entry.workload == Workload::MatMul)
+            size = static_cast<uint32_t>(std::lround(entry.size * std::cbrt(static_cast<double>(scale))));
+        benchmarks.push_back(generateWorkload(entry.workload, size, SOLOMIPS_WORKLOAD_SEED));
+    }
+    return benchmarks;
+}
@@ -0,0 +1,93 @@
+/*
+ *  generator.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_GENERATOR_HXX
+#define HEADER_SOLOMIPS_GENERATOR_HXX
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bench.hxx"
+
+/*
+Workload generator: synthetic guest programs doing the kind of work real
+programs do, as opposed to the microbenchmarks which stress one feature each.
+
+    memcpy      copy a buffer of <size> bytes eight times with a memcpy
+                function (word loop unrolled four times, byte tail)
+    checksum    Adler-32 of <size> bytes
+    sort        recursive quicksort of <size> signed words
+    matmul      product of two <size> x <size> word matrices
+    list_chase  build a linked list of <size> nodes in random order, then
+                follow it eight times around
+    text_io     read <size> characters of text from the console, write them
+                back in upper case and print the number of lines
+
+The input data is generated by the guest itself with a xorshift generator
+seeded from the given seed, except for the text of text_io, which is
+generated on the host. The exit status is a hash of the result; the host
+computes the expected status (and output) for the same seed, so every run
+checks itself. The same workload, size and seed always give the same program.
+*/
+
+#define SOLOMIPS_WORKLOAD_SEED 1u
+
+namespace SoloMIPS {
+
+enum class Workload
+{
+    Memcpy,
+    Checksum,
+    Sort,
+    MatMul,
+    ListChase,
+    TextIO
+};
+
+const char *workloadName(Workload workload);
+
+/**
+ * Look up a workload by name; returns false if there is none.
+ */
+bool parseWorkload(const std::string &name, Workload &workload);
+
+/**
+ * The size giving about two million instructions.
+ */
+uint32_t defaultWorkloadSize(Workload workload);
+
+/**
+ * Generate the workload for the given size and seed. Throws
+ * std::out_of_range if the size is too small (zero, or one for list_chase)
+ * or the data does not fit into work RAM.
+ */
+Benchmark generateWorkload(Workload workload, uint32_t size, uint32_t seed);
+
+/**
+ * Return all workloads at their default sizes times scale (matmul grows by
+ * the cube root) and the default seed.
+ */
+std::vector<Benchmark> workloads(unsigned int scale);
+
+}
+
+#endif /* HEADER_SOLOMIPS_GENERATOR_HXX */
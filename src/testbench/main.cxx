@@ -19,7 +19,303 @@
  *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cpu.hxx"
+#include "jit.hxx"
+#include "lockstep.hxx"
+#include "tests.hxx"
+#include "components.hxx"
+#include "bench.hxx"
+#include "generator.hxx"
+
+/*
+The testbench runs the instruction and component tests, the microbenchmarks
+and the generated workloads on every engine and prints one JSON object per
+line to stdout: a "config" record, a "test" record per test and engine (with
+a null engine for component tests that run only once), a "bench" record per
+benchmark and engine and a final "summary". A short summary also goes to
+stderr. The exit status is 0 if all tests and benchmarks passed and 1
+otherwise.
+
+With --generate, a single workload is written to a file instead, along with
+its input and expected output next to it (<path>.in, <path>.out), and a line
+for the batch manifest of solomips-emu is printed.
+*/
+
+using namespace SoloMIPS;
+
+static void showUsage(const char *argv0)
+{
+    std::cerr << "Usage: " << argv0 << " [options]" << std::endl;
+    std::cerr << "       " << argv0 << " --generate NAME [--size N] [--seed N] -o <path>" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --tests                     Only run the instruction tests" << std::endl;
+    std::cerr << "  --bench                     Only run the microbenchmarks and workloads" << std::endl;
+    std::cerr << "  --engine NAME[,NAME...]     Engines to run on (default: switch,threaded,blocks,jit)" << std::endl;
+    std::cerr << "  --runs N                    Timed runs per benchmark (default: " << SOLOMIPS_BENCH_RUNS << ")" << std::endl;
+    std::cerr << "  --scale N                   Multiply the work of every benchmark (default: 1)" << std::endl;
+    std::cerr << "  --filter TEXT               Only run tests and benchmarks whose name contains TEXT" << std::endl;
+    std::cerr << "  --generate NAME             Write the workload NAME (memcpy, checksum, sort, matmul," << std::endl;
+    std::cerr << "                              list_chase, text_io) to the output file" << std::endl;
+    std::cerr << "  --size N                    Size of the generated workload (default: about two million" << std::endl;
+    std::cerr << "                              instructions)" << std::endl;
+    std::cerr << "  --seed N                    Seed of the generated workload (default: " << SOLOMIPS_WORKLOAD_SEED << ")" << std::endl;
+    std::cerr << "  -o <path>                   Output file of --generate" << std::endl;
+    std::cerr << "  -h, --help                  Print option help" << std::endl;
+}
+
+static bool parseEngines(const char *list, std::vector<ExecutionEngine> &engines)
+{
+    static const ExecutionEngine all[] = {ExecutionEngine::Switch, ExecutionEngine::Threaded, ExecutionEngine::Blocks, ExecutionEngine::JIT};
+    std::istringstream str(list);
+    std::string name;
+    while (std::getline(str, name, ',')) {
+        bool found = false;
+        for (ExecutionEngine engine : all) {
+            if (name == engineName(engine)) {
+                engines.push_back(engine);
+                found = true;
+            }
+        }
+        if (!found) {
+            std::cerr << "error: unknown engine '" << name << "'" << std::endl;
+            return false;
+        }
+    }
+    return !engines.empty();
+}
+
+static std::string json(const std::string &s)
+{
+    std::ostringstream str;
+    str << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            str << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            str << "\\u" << std::setfill('0') << std::setw(4) << std::hex << static_cast<int>(c) << std::dec;
+        else
+            str << c;
+    }
+    str << '"';
+    return str.str();
+}
+
+static bool writeFile(const std::string &path, const char *data, size_t size)
+{
+    std::ofstream out;
+    out.open(path, std::ios::out | std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "error: could not open '" << path << "' for writing" << std::endl;
+        return false;
+    }
+    out.write(data, static_cast<std::streamsize>(size));
+    if (out.fail()) {
+        std::cerr << "error: could not write '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int generate(Workload workload, uint32_t size, uint32_t seed, const std::string &output)
+{
+    Benchmark benchmark;
+    try {
+        benchmark = generateWorkload(workload, size, seed);
+    }
+    catch (std::out_of_range &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return -20;
+    }
+    if (!writeFile(output, reinterpret_cast<const char *>(benchmark.program.data()), benchmark.program.size()))
+        return -21;
+    std::string input = "-";
+    if (!benchmark.input.empty()) {
+        input = output + ".in";
+        if (!writeFile(input, benchmark.input.data(), benchmark.input.size()))
+            return -21;
+    }
+    std::string expectedOutput = "-";
+    if (!benchmark.expectedOutput.empty()) {
+        expectedOutput = output + ".out";
+        if (!writeFile(expectedOutput, benchmark.expectedOutput.data(), benchmark.expectedOutput.size()))
+            return -21;
+    }
+    std::cout << output << " " << input << " " << expectedOutput << " " << benchmark.expectedStatus << std::endl;
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    return -10;
+    bool runTests = true;
+    bool runBenchmarks = true;
+    std::vector<ExecutionEngine> engines;
+    unsigned int runs = SOLOMIPS_BENCH_RUNS;
+    unsigned int scale = 1;
+    std::string filter;
+    bool generating = false;
+    Workload workload = Workload::Memcpy;
+    uint32_t size = 0;
+    uint32_t seed = SOLOMIPS_WORKLOAD_SEED;
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--tests") == 0) {
+            runBenchmarks = false;
+        }
+        else if (std::strcmp(argv[i], "--bench") == 0) {
+            runTests = false;
+        }
+        else if (std::strcmp(argv[i], "--engine") == 0 && i+1 < argc) {
+            if (!parseEngines(argv[++i], engines))
+                return -20;
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 && i+1 < argc) {
+            runs = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 0));
+            if (runs == 0) {
+                std::cerr << "error: invalid number of runs" << std::endl;
+                return -20;
+            }
+        }
+        else if (std::strcmp(argv[i], "--scale") == 0 && i+1 < argc) {
+            scale = static_cast<unsigned int>(std::strtoul(argv[++i], NULL, 0));
+            if (scale == 0) {
+                std::cerr << "error: invalid scale" << std::endl;
+                return -20;
+            }
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && i+1 < argc) {
+            filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--generate") == 0 && i+1 < argc) {
+            if (!parseWorkload(argv[++i], workload)) {
+                std::cerr << "error: unknown workload '" << argv[i] << "'" << std::endl;
+                return -20;
+            }
+            generating = true;
+        }
+        else if (std::strcmp(argv[i], "--size") == 0 && i+1 < argc) {
+            size = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 0));
+            if (size == 0) {
+                std::cerr << "error: invalid size" << std::endl;
+                return -20;
+            }
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 0));
+        }
+        else if (std::strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+            output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+            showUsage(argv[0]);
+            return 0;
+        }
+        else {
+            showUsage(argv[0]);
+            return -20;
+        }
+    }
+    if (generating) {
+        if (output.empty()) {
+            std::cerr << "error: no output file given" << std::endl;
+            return -20;
+        }
+        return generate(workload, size != 0 ? size : defaultWorkloadSize(workload), seed, output);
+    }
+    if (engines.empty())
+        engines = {ExecutionEngine::Switch, ExecutionEngine::Threaded, ExecutionEngine::Blocks, ExecutionEngine::JIT};
+
+#ifdef NDEBUG
+    const char *build = "release";
+#else
+    const char *build = "debug";
+#endif
+    std::cout << "{\"type\":\"config\",\"build\":\"" << build << "\",\"jit\":" << (JITCompiler::isSupported() ? "true" : "false")
+              << ",\"runs\":" << runs << ",\"scale\":" << scale << "}" << std::endl;
+
+    size_t tests = 0;
+    size_t testsFailed = 0;
+    if (runTests) {
+        for (const InstructionTest &test : instructionTests()) {
+            if (test.name.find(filter) == std::string::npos)
+                continue;
+            for (ExecutionEngine engine : engines) {
+                TestResult result = runTest(test, engine);
+                ++tests;
+                if (!result.passed)
+                    ++testsFailed;
+                std::cout << "{\"type\":\"test\",\"engine\":\"" << engineName(engine) << "\",\"name\":" << json(test.name)
+                          << ",\"instruction\":" << json(test.instruction) << ",\"passed\":" << (result.passed ? "true" : "false");
+                if (!result.passed)
+                    std::cout << ",\"message\":" << json(result.message);
+                std::cout << "}" << std::endl;
+            }
+        }
+        for (const ComponentTest &test : componentTests()) {
+            if (test.name.find(filter) == std::string::npos)
+                continue;
+            for (ExecutionEngine engine : engines) {
+                TestResult result = runComponentTest(test, engine);
+                ++tests;
+                if (!result.passed)
+                    ++testsFailed;
+                std::cout << "{\"type\":\"test\",\"engine\":" << (test.perEngine ? json(engineName(engine)) : "null")
+                          << ",\"name\":" << json(test.name) << ",\"passed\":" << (result.passed ? "true" : "false");
+                if (!result.passed)
+                    std::cout << ",\"message\":" << json(result.message);
+                std::cout << "}" << std::endl;
+                if (!test.perEngine)
+                    break;
+            }
+        }
+    }
+
+    size_t benchmarks = 0;
+    size_t benchmarksFailed = 0;
+    if (runBenchmarks) {
+        std::vector<Benchmark> all = microbenchmarks(scale);
+        try {
+            for (Benchmark &benchmark : workloads(scale))
+                all.push_back(std::move(benchmark));
+        }
+        catch (std::out_of_range &e) {
+            std::cerr << "error: " << e.what() << std::endl;
+            return -20;
+        }
+        for (const Benchmark &benchmark : all) {
+            if (benchmark.name.find(filter) == std::string::npos)
+                continue;
+            for (ExecutionEngine engine : engines) {
+                BenchmarkResult result = runBenchmark(benchmark, engine, runs);
+                ++benchmarks;
+                std::cout << "{\"type\":\"bench\",\"engine\":\"" << engineName(engine) << "\",\"name\":" << json(benchmark.name)
+                          << ",\"passed\":" << (result.passed ? "true" : "false");
+                if (result.passed) {
+                    std::cout << ",\"status\":" << result.status << ",\"instructions\":" << result.instructions
+                              << std::fixed << std::setprecision(6) << ",\"seconds_median\":" << result.medianSeconds
+                              << std::setprecision(2) << ",\"mips_min\":" << result.minMIPS << ",\"mips_median\":" << result.medianMIPS
+                              << ",\"mips_p99\":" << result.p99MIPS;
+                }
+                else {
+                    ++benchmarksFailed;
+                    std::cout << ",\"message\":" << json(result.message);
+                }
+                std::cout << "}" << std::endl;
+            }
+        }
+    }
+
+    std::cout << "{\"type\":\"summary\",\"tests\":" << tests << ",\"tests_failed\":" << testsFailed
+              << ",\"benchmarks\":" << benchmarks << ",\"benchmarks_failed\":" << benchmarksFailed << "}" << std::endl;
+    std::cerr << tests << " tests, " << testsFailed << " failed; " << benchmarks << " benchmarks, " << benchmarksFailed << " failed" << std::endl;
+    return (testsFailed == 0 && benchmarksFailed == 0) ? 0 : 1;
 }
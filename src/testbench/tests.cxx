@@ -0,0 +1,505 @@
+/*
+ *  tests.cxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include "defaults.hxx"
+#include "machine.hxx"
+#include "assembler.hxx"
+#include "tests.hxx"
+
+using namespace SoloMIPS;
+
+InstructionTest &InstructionTest::expect(unsigned int reg, uint32_t value)
+{
+    this->registers.push_back(std::make_pair(reg, value));
+    return *this;
+}
+
+InstructionTest &InstructionTest::expectStatus(int status)
+{
+    this->status = status;
+    return *this;
+}
+
+InstructionTest &InstructionTest::expectOutput(const std::string &output)
+{
+    this->output = output;
+    return *this;
+}
+
+InstructionTest &InstructionTest::withInput(const std::string &input)
+{
+    this->input = input;
+    return *this;
+}
+
+namespace {
+
+typedef Assembler::Label Label;
+
+const uint32_t DATA = SOLOMIPS_DEFAULT_DATA_ADDR;
+
+Assembler program()
+{
+    return Assembler(SOLOMIPS_DEFAULT_ENTRY);
+}
+
+InstructionTest test(const char *name, const char *instruction, Assembler &a)
+{
+    a.halt();
+    InstructionTest t;
+    t.name = name;
+    t.instruction = instruction;
+    t.program = a.finish();
+    t.status = 0;
+    return t;
+}
+
+// t2 = t0 <op> t1, in assembler operand order
+InstructionTest rtype(const char *name, const char *instruction, OP (*encode)(uint8_t, uint8_t, uint8_t), uint32_t first, uint32_t second)
+{
+    Assembler a = program();
+    a.li(T0, first);
+    a.li(T1, second);
+    a.li(T2, 0xdeadbeef);
+    a.emit(encode(T2, T0, T1));
+    return test(name, instruction, a);
+}
+
+// t2 = t1 <op> shamt
+InstructionTest shift(const char *name, const char *instruction, OP (*encode)(uint8_t, uint8_t, uint8_t), uint32_t rt, uint8_t shamt)
+{
+    Assembler a = program();
+    a.li(T1, rt);
+    a.emit(encode(T2, T1, shamt));
+    return test(name, instruction, a);
+}
+
+// Run op, which is to write t1 from t0
+InstructionTest itype(const char *name, const char *instruction, const OP &op, uint32_t rs)
+{
+    Assembler a = program();
+    a.li(T0, rs);
+    a.li(T1, 0xdeadbeef);
+    a.emit(op);
+    return test(name, instruction, a);
+}
+
+// hi, lo = t0 <op> t1
+InstructionTest muldiv(const char *name, const char *instruction, OP (*encode)(uint8_t, uint8_t), uint32_t rs, uint32_t rt)
+{
+    Assembler a = program();
+    a.li(T0, rs);
+    a.li(T1, rt);
+    a.emit(encode(T0, T1));
+    return test(name, instruction, a);
+}
+
+// Branch on t0 and t1 over an instruction setting t3; the delay slot sets t2
+// and links, if at all, into ra
+InstructionTest branch(const char *name, const char *instruction, const std::function<void(Assembler &, Label)> &emit,
+                       uint32_t rs, uint32_t rt, bool taken, bool links = false)
+{
+    Assembler a = program();
+    a.li(T0, rs);
+    a.li(T1, rt);
+    Label target = a.label();
+    uint32_t link = a.pc() + 8;
+    emit(a, target);
+    a.emit(OP::ADDIU(T2, 0, 1));
+    a.emit(OP::ADDIU(T3, 0, 1));
+    a.bind(target);
+    InstructionTest t = test(name, instruction, a);
+    t.expect(T2, 1).expect(T3, taken ? 0 : 1);
+    if (links)
+        t.expect(RA, link);
+    return t;
+}
+
+// Emit op with its target set to the label
+std::function<void(Assembler &, Label)> to(const OP &op)
+{
+    return [op](Assembler &a, Label target) { a.emit(op, target); };
+}
+
+// Store t1 with the given instruction to DATA+4, then load it back as a word
+// into t2
+InstructionTest store(const char *name, const char *instruction, OP (*encode)(uint8_t, int16_t, uint8_t), int16_t offset, uint32_t value)
+{
+    Assembler a = program();
+    a.li(T0, DATA);
+    a.li(T1, 0x11223344);
+    a.emit(OP::SW(T1, 4, T0));
+    a.li(T1, value);
+    a.emit(encode(T1, 4 + offset, T0));
+    a.emit(OP::LW(T2, 4, T0));
+    a.nop();
+    return test(name, instruction, a);
+}
+
+// Store 0x80ff7f01 to DATA+4, then load from DATA+4+offset into t2, using a
+// negative displacement
+InstructionTest load(const char *name, const char *instruction, OP (*encode)(uint8_t, int16_t, uint8_t), int16_t offset)
+{
+    Assembler a = program();
+    a.li(T0, DATA + 4);
+    a.li(T1, 0x80ff7f01);
+    a.emit(OP::SW(T1, 0, T0));
+    a.li(T0, DATA + 8);
+    a.emit(encode(T2, offset - 4, T0));
+    a.nop();
+    return test(name, instruction, a);
+}
+
+void addALUTests(std::vector<InstructionTest> &tests)
+{
+    tests.push_back(shift("sll", "sll", OP::SLL, 0x80000001, 4).expect(T2, 0x00000010));
+    tests.push_back(shift("sll_zero", "sll", OP::SLL, 0x80000001, 0).expect(T2, 0x80000001));
+    tests.push_back(shift("srl", "srl", OP::SRL, 0x80000010, 4).expect(T2, 0x08000001));
+    tests.push_back(shift("sra", "sra", OP::SRA, 0x80000010, 4).expect(T2, 0xf8000001));
+    tests.push_back(shift("sra_positive", "sra", OP::SRA, 0x70000000, 31).expect(T2, 0));
+    // Variable shifts use the low five bits of rs only
+    tests.push_back(rtype("sllv", "sllv", OP::SLLV, 1, 31).expect(T2, 0x80000000));
+    tests.push_back(rtype("sllv_mask", "sllv", OP::SLLV, 1, 33).expect(T2, 2));
+    tests.push_back(rtype("srlv", "srlv", OP::SRLV, 0x80000000, 3).expect(T2, 0x10000000));
+    tests.push_back(rtype("srlv_mask", "srlv", OP::SRLV, 0x80000000, 0xffffffe4).expect(T2, 0x08000000));
+    tests.push_back(rtype("srav", "srav", OP::SRAV, 0x80000000, 4).expect(T2, 0xf8000000));
+    tests.push_back(rtype("srav_mask", "srav", OP::SRAV, 0x80000000, 36).expect(T2, 0xf8000000));
+
+    tests.push_back(rtype("add", "add", OP::ADD, 1, 2).expect(T2, 3));
+    tests.push_back(rtype("add_negative", "add", OP::ADD, 0xffffffff, 0xffffffff).expect(T2, 0xfffffffe));
+    tests.push_back(rtype("add_overflow", "add", OP::ADD, 0x7fffffff, 1).expectStatus(-10).expect(T2, 0xdeadbeef));
+    tests.push_back(rtype("add_underflow", "add", OP::ADD, 0x80000000, 0xffffffff).expectStatus(-10).expect(T2, 0xdeadbeef));
+    tests.push_back(rtype("addu", "addu", OP::ADDU, 0x7fffffff, 1).expect(T2, 0x80000000));
+    tests.push_back(rtype("sub", "sub", OP::SUB, 5, 7).expect(T2, 0xfffffffe));
+    tests.push_back(rtype("sub_overflow", "sub", OP::SUB, 0x80000000, 1).expectStatus(-10).expect(T2, 0xdeadbeef));
+    tests.push_back(rtype("sub_overflow_negate", "sub", OP::SUB, 0, 0x80000000).expectStatus(-10).expect(T2, 0xdeadbeef));
+    tests.push_back(rtype("subu", "subu", OP::SUBU, 0x80000000, 1).expect(T2, 0x7fffffff));
+    tests.push_back(rtype("and", "and", OP::AND, 0xff00ff00, 0x0ff00ff0).expect(T2, 0x0f000f00));
+    tests.push_back(rtype("or", "or", OP::OR, 0xff00ff00, 0x0ff00ff0).expect(T2, 0xfff0fff0));
+    tests.push_back(rtype("xor", "xor", OP::XOR, 0xff00ff00, 0x0ff00ff0).expect(T2, 0xf0f0f0f0));
+    tests.push_back(rtype("nor", "nor", OP::NOR, 0xff00ff00, 0x0ff00ff0).expect(T2, 0x000f000f));
+    tests.push_back(rtype("slt", "slt", OP::SLT, 0xffffffff, 1).expect(T2, 1));
+    tests.push_back(rtype("slt_false", "slt", OP::SLT, 1, 0xffffffff).expect(T2, 0));
+    tests.push_back(rtype("slt_equal", "slt", OP::SLT, 7, 7).expect(T2, 0));
+    tests.push_back(rtype("sltu", "sltu", OP::SLTU, 1, 0xffffffff).expect(T2, 1));
+    tests.push_back(rtype("sltu_false", "sltu", OP::SLTU, 0xffffffff, 1).expect(T2, 0));
+
+    tests.push_back(itype("addi", "addi", OP::ADDI(T1, T0, -3), 5).expect(T1, 2));
+    tests.push_back(itype("addi_overflow", "addi", OP::ADDI(T1, T0, 1), 0x7fffffff).expectStatus(-10).expect(T1, 0xdeadbeef));
+    tests.push_back(itype("addi_underflow", "addi", OP::ADDI(T1, T0, 0xffff), 0x80000000).expectStatus(-10).expect(T1, 0xdeadbeef));
+    tests.push_back(itype("addiu", "addiu", OP::ADDIU(T1, T0, 1), 0x7fffffff).expect(T1, 0x80000000));
+    tests.push_back(itype("addiu_negative", "addiu", OP::ADDIU(T1, T0, 0x8000), 0).expect(T1, 0xffff8000));
+    tests.push_back(itype("slti", "slti", OP::SLTI(T1, T0, -4), 0xfffffffb).expect(T1, 1));
+    tests.push_back(itype("slti_false", "slti", OP::SLTI(T1, T0, 0xffff), 5).expect(T1, 0));
+    // The immediate is sign-extended, then compared unsigned
+    tests.push_back(itype("sltiu", "sltiu", OP::SLTIU(T1, T0, 0xffff), 5).expect(T1, 1));
+    tests.push_back(itype("sltiu_high", "sltiu", OP::SLTIU(T1, T0, 0xffff), 0xfffffffe).expect(T1, 1));
+    tests.push_back(itype("sltiu_false", "sltiu", OP::SLTIU(T1, T0, 0x7fff), 0xffff0000).expect(T1, 0));
+    tests.push_back(itype("andi", "andi", OP::ANDI(T1, T0, 0x8001), 0xffffffff).expect(T1, 0x00008001));
+    tests.push_back(itype("ori", "ori", OP::ORI(T1, T0, 0x8001), 0x12340000).expect(T1, 0x12348001));
+    tests.push_back(itype("xori", "xori", OP::XORI(T1, T0, 0xffff), 0xffffffff).expect(T1, 0xffff0000));
+    {
+        Assembler a = program();
+        a.emit(OP::LUI(T1, 0x8001));
+        tests.push_back(test("lui", "lui", a).expect(T1, 0x80010000));
+    }
+    {
+        // Writes to the zero register are discarded
+        Assembler a = program();
+        a.emit(OP::ADDIU(0, 0, 5));
+        a.emit(OP::OR(T0, 0, 0));
+        tests.push_back(test("zero_register", "addiu", a).expect(0, 0).expect(T0, 0));
+    }
+}
+
+void addMultiplyTests(std::vector<InstructionTest> &tests)
+{
+    {
+        Assembler a = program();
+        a.li(T0, 0x12345678);
+        a.emit(OP::MTHI(T0));
+        a.emit(OP::MFHI(T1));
+        tests.push_back(test("mthi_mfhi", "mfhi", a).expect(T1, 0x12345678).expect(SOLOMIPS_TEST_HI, 0x12345678));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, 0x87654321);
+        a.emit(OP::MTLO(T0));
+        a.emit(OP::MFLO(T1));
+        tests.push_back(test("mtlo_mflo", "mflo", a).expect(T1, 0x87654321).expect(SOLOMIPS_TEST_LO, 0x87654321));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, 0xcafe);
+        a.emit(OP::MTHI(T0));
+        tests.push_back(test("mthi", "mthi", a).expect(SOLOMIPS_TEST_HI, 0xcafe));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, 0xbabe);
+        a.emit(OP::MTLO(T0));
+        tests.push_back(test("mtlo", "mtlo", a).expect(SOLOMIPS_TEST_LO, 0xbabe));
+    }
+
+    tests.push_back(muldiv("mult", "mult", OP::MULT, 0xfffffffd, 5).expect(SOLOMIPS_TEST_HI, 0xffffffff).expect(SOLOMIPS_TEST_LO, 0xfffffff1));
+    tests.push_back(muldiv("mult_wide", "mult", OP::MULT, 0x7fffffff, 0x7fffffff).expect(SOLOMIPS_TEST_HI, 0x3fffffff).expect(SOLOMIPS_TEST_LO, 1));
+    tests.push_back(muldiv("mult_min", "mult", OP::MULT, 0x80000000, 0x80000000).expect(SOLOMIPS_TEST_HI, 0x40000000).expect(SOLOMIPS_TEST_LO, 0));
+    tests.push_back(muldiv("multu", "multu", OP::MULTU, 0xffffffff, 0xffffffff).expect(SOLOMIPS_TEST_HI, 0xfffffffe).expect(SOLOMIPS_TEST_LO, 1));
+    tests.push_back(muldiv("multu_small", "multu", OP::MULTU, 6, 7).expect(SOLOMIPS_TEST_HI, 0).expect(SOLOMIPS_TEST_LO, 42));
+    // Quotients round towards zero, remainders take the sign of the dividend
+    tests.push_back(muldiv("div", "div", OP::DIV, 0xfffffff9, 2).expect(SOLOMIPS_TEST_HI, 0xffffffff).expect(SOLOMIPS_TEST_LO, 0xfffffffd));
+    tests.push_back(muldiv("div_negative_divisor", "div", OP::DIV, 7, 0xfffffffe).expect(SOLOMIPS_TEST_HI, 1).expect(SOLOMIPS_TEST_LO, 0xfffffffd));
+    tests.push_back(muldiv("div_min", "div", OP::DIV, 0x80000000, 0xffffffff).expect(SOLOMIPS_TEST_HI, 0).expect(SOLOMIPS_TEST_LO, 0x80000000));
+    tests.push_back(muldiv("div_zero", "div", OP::DIV, 1, 0).expectStatus(-10));
+    tests.push_back(muldiv("divu", "divu", OP::DIVU, 0xffffffff, 2).expect(SOLOMIPS_TEST_HI, 1).expect(SOLOMIPS_TEST_LO, 0x7fffffff));
+    tests.push_back(muldiv("divu_zero", "divu", OP::DIVU, 1, 0).expectStatus(-10));
+}
+
+void addBranchTests(std::vector<InstructionTest> &tests)
+{
+    tests.push_back(branch("beq", "beq", to(OP::BEQ(T0, T1, 0)), 5, 5, true));
+    tests.push_back(branch("beq_not_taken", "beq", to(OP::BEQ(T0, T1, 0)), 5, 6, false));
+    tests.push_back(branch("bne", "bne", to(OP::BNE(T0, T1, 0)), 5, 6, true));
+    tests.push_back(branch("bne_not_taken", "bne", to(OP::BNE(T0, T1, 0)), 5, 5, false));
+    tests.push_back(branch("blez_zero", "blez", to(OP::BLEZ(T0, 0)), 0, 0, true));
+    tests.push_back(branch("blez_negative", "blez", to(OP::BLEZ(T0, 0)), 0x80000000, 0, true));
+    tests.push_back(branch("blez_positive", "blez", to(OP::BLEZ(T0, 0)), 1, 0, false));
+    tests.push_back(branch("bgtz", "bgtz", to(OP::BGTZ(T0, 0)), 1, 0, true));
+    tests.push_back(branch("bgtz_zero", "bgtz", to(OP::BGTZ(T0, 0)), 0, 0, false));
+    tests.push_back(branch("bgtz_negative", "bgtz", to(OP::BGTZ(T0, 0)), 0xffffffff, 0, false));
+    tests.push_back(branch("bltz", "bltz", to(OP::BLTZ(T0, 0)), 0xffffffff, 0, true));
+    tests.push_back(branch("bltz_zero", "bltz", to(OP::BLTZ(T0, 0)), 0, 0, false));
+    tests.push_back(branch("bgez_zero", "bgez", to(OP::BGEZ(T0, 0)), 0, 0, true));
+    tests.push_back(branch("bgez_negative", "bgez", to(OP::BGEZ(T0, 0)), 0x80000000, 0, false));
+    // Linking branches link whether taken or not
+    tests.push_back(branch("bltzal", "bltzal", to(OP::BLTZAL(T0, 0)), 0xffffffff, 0, true, true));
+    tests.push_back(branch("bltzal_not_taken", "bltzal", to(OP::BLTZAL(T0, 0)), 1, 0, false, true));
+    tests.push_back(branch("bgezal", "bgezal", to(OP::BGEZAL(T0, 0)), 1, 0, true, true));
+    tests.push_back(branch("bgezal_not_taken", "bgezal", to(OP::BGEZAL(T0, 0)), 0xffffffff, 0, false, true));
+    tests.push_back(branch("j", "j", to(OP::J(0)), 0, 0, true));
+    tests.push_back(branch("jal", "jal", to(OP::JAL(0)), 0, 0, true, true));
+    tests.push_back(branch("jr", "jr", [](Assembler &a, Label target) {
+        a.la(T4, target);
+        a.emit(OP::JR(T4));
+    }, 0, 0, true));
+    {
+        // rd receives the address after the delay slot
+        Assembler a = program();
+        Label target = a.label();
+        a.la(T4, target);
+        uint32_t link = a.pc() + 8;
+        a.emit(OP::JALR(T5, T4));
+        a.emit(OP::ADDIU(T2, 0, 1));
+        a.emit(OP::ADDIU(T3, 0, 1));
+        a.bind(target);
+        tests.push_back(test("jalr", "jalr", a).expect(T2, 1).expect(T3, 0).expect(T5, link));
+    }
+    {
+        // Backward branch: sum 1..10
+        Assembler a = program();
+        a.li(T0, 10);
+        a.li(T1, 0);
+        Label loop = a.here();
+        a.emit(OP::ADDU(T1, T1, T0));
+        a.emit(OP::ADDIU(T0, T0, -1));
+        a.emit(OP::BNE(T0, 0, 0), loop);
+        a.nop();
+        tests.push_back(test("bne_backward", "bne", a).expect(T0, 0).expect(T1, 55));
+    }
+    {
+        // Call and return through ra
+        Assembler a = program();
+        Label function = a.label();
+        Label done = a.label();
+        a.emit(OP::JAL(0), function);
+        a.li(T0, 1);
+        a.emit(OP::J(0), done);
+        a.nop();
+        a.bind(function);
+        a.emit(OP::JR(RA));
+        a.emit(OP::ADDIU(T1, T0, 1));
+        a.bind(done);
+        tests.push_back(test("jal_jr_return", "jal", a).expect(T0, 1).expect(T1, 2));
+    }
+}
+
+void addMemoryTests(std::vector<InstructionTest> &tests)
+{
+    tests.push_back(store("sw", "sw", OP::SW, 0, 0xcafebabe).expect(T2, 0xcafebabe));
+    // Big endian
+    tests.push_back(store("sb", "sb", OP::SB, 0, 0xaabbccdd).expect(T2, 0xdd223344));
+    tests.push_back(store("sb_offset", "sb", OP::SB, 3, 0xaabbccdd).expect(T2, 0x112233dd));
+    tests.push_back(store("sh", "sh", OP::SH, 0, 0xaabbccdd).expect(T2, 0xccdd3344));
+    tests.push_back(store("sh_offset", "sh", OP::SH, 2, 0xaabbccdd).expect(T2, 0x1122ccdd));
+
+    tests.push_back(load("lw", "lw", OP::LW, 0).expect(T2, 0x80ff7f01));
+    tests.push_back(load("lb", "lb", OP::LB, 0).expect(T2, 0xffffff80));
+    tests.push_back(load("lb_positive", "lb", OP::LB, 2).expect(T2, 0x0000007f));
+    tests.push_back(load("lbu", "lbu", OP::LBU, 0).expect(T2, 0x00000080));
+    tests.push_back(load("lbu_offset", "lbu", OP::LBU, 3).expect(T2, 0x00000001));
+    tests.push_back(load("lh", "lh", OP::LH, 0).expect(T2, 0xffff80ff));
+    tests.push_back(load("lh_positive", "lh", OP::LH, 2).expect(T2, 0x00007f01));
+    tests.push_back(load("lhu", "lhu", OP::LHU, 0).expect(T2, 0x000080ff));
+    {
+        // The loaded value is not visible in the load delay slot
+        Assembler a = program();
+        a.li(T0, DATA);
+        a.li(T1, 42);
+        a.emit(OP::SW(T1, 0, T0));
+        a.li(T1, 7);
+        a.emit(OP::LW(T1, 0, T0));
+        a.emit(OP::ADDU(T2, T1, 0));
+        a.emit(OP::ADDU(T3, T1, 0));
+        tests.push_back(test("lw_delay_slot", "lw", a).expect(T2, 7).expect(T3, 42));
+    }
+    {
+        Assembler a = program();
+        a.emit(OP::LW(T0, 0, 0));
+        a.nop();
+        tests.push_back(test("lw_unmapped", "lw", a).expectStatus(-11));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, SOLOMIPS_DEFAULT_ENTRY);
+        a.emit(OP::SW(0, 0, T0));
+        tests.push_back(test("sw_read_only", "sw", a).expectStatus(-11));
+    }
+}
+
+void addSystemTests(std::vector<InstructionTest> &tests)
+{
+    {
+        // The low byte of v0 is the exit status
+        Assembler a = program();
+        a.li(V0, 0x1234);
+        tests.push_back(test("exit_status", "jr", a).expectStatus(0x34));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, SOLOMIPS_DEFAULT_I_ADDR);
+        a.li(T1, SOLOMIPS_DEFAULT_O_ADDR);
+        a.emit(OP::LW(T2, 0, T0));
+        a.nop();
+        a.emit(OP::ADDIU(T2, T2, 1));
+        a.emit(OP::SW(T2, 0, T1));
+        a.emit(OP::LBU(T3, 0, T0));
+        a.nop();
+        a.emit(OP::SB(T3, 0, T1));
+        tests.push_back(test("io_echo", "lw", a).withInput("AZ").expectOutput("BZ").expect(T2, 'B'));
+    }
+    {
+        // System calls are not supported
+        Assembler a = program();
+        a.emit(OP::SYSCALL());
+        tests.push_back(test("syscall", "syscall", a).expectStatus(-12));
+    }
+    {
+        Assembler a = program();
+        a.emit(0xfc000000);
+        tests.push_back(test("invalid_opcode", "invalid", a).expectStatus(-12));
+    }
+    {
+        Assembler a = program();
+        a.li(T0, 1);
+        OP op = OP::BLTZ(T0, -1);
+        op.rt = 0x1f;
+        a.emit(op);
+        a.nop();
+        tests.push_back(test("invalid_regimm", "invalid", a).expectStatus(-12));
+    }
+}
+
+std::string hex(uint32_t value)
+{
+    std::ostringstream str;
+    str << "0x" << std::setfill('0') << std::setw(8) << std::hex << value;
+    return str.str();
+}
+
+std::string registerName(unsigned int reg)
+{
+    if (reg == SOLOMIPS_TEST_HI)
+        return "hi";
+    if (reg == SOLOMIPS_TEST_LO)
+        return "lo";
+    return "r" + std::to_string(reg);
+}
+
+}
+
+std::vector<InstructionTest> SoloMIPS::instructionTests()
+{
+    std::vector<InstructionTest> tests;
+    addALUTests(tests);
+    addMultiplyTests(tests);
+    addBranchTests(tests);
+    addMemoryTests(tests);
+    addSystemTests(tests);
+    return tests;
+}
+
+TestResult SoloMIPS::runTest(const InstructionTest &test, ExecutionEngine engine)
+{
+    std::istringstream input(test.input);
+    std::ostringstream output;
+    std::ostringstream err;
+    Machine machine(std::vector<uint8_t>(test.program), &input, &output);
+    machine.cpu.engine = engine;
+
+    // The tests are short; anything longer is stuck
+    TestResult result;
+    int status = machine.run(err, 100000);
+    std::string fault = err.str();
+    if (!fault.empty() && fault.back() == '\n')
+        fault.pop_back();
+    if (status != test.status) {
+        result.passed = false;
+        result.message = "exit status " + std::to_string(status) + ", expected " + std::to_string(test.status);
+        if (!fault.empty())
+            result.message += " (" + fault + ")";
+        return result;
+    }
+    if (output.str() != test.output) {
+        result.passed = false;
+        result.message = "output '" + output.str() + "', expected '" + test.output + "'";
+        return result;
+    }
+    for (const auto &expected : test.registers) {
+        uint32_t value;
+        if (expected.first == SOLOMIPS_TEST_HI)
+            value = machine.cpu.hi;
+        else if (expected.first == SOLOMIPS_TEST_LO)
+            value = machine.cpu.lo;
+        else
+            value = machine.cpu.r[expected.first];
+        if (value != expected.second) {
+            result.passed = false;
+            result.message = registerName(expected.first) + " = " + hex(value) + ", expected " + hex(expected.second);
+            return result;
+        }
+    }
+    result.passed = true;
+    return result;
+}
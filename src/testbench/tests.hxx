@@ -0,0 +1,77 @@
+/*
+ *  tests.hxx
+ *
+ *  Copyright (C) 2019  Patrick "p2k" Schneider
+ *
+ *  This file is part of SoloMIPS.
+ *
+ *  SoloMIPS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  SoloMIPS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with SoloMIPS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_SOLOMIPS_TESTS_HXX
+#define HEADER_SOLOMIPS_TESTS_HXX
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cpu.hxx"
+
+/*
+Correctness tests for the instruction set. Each test is a small program run
+on a standard Machine until it halts; afterwards the exit status (as returned
+by `Machine::run()`), the output and selected registers are compared with the
+expected values. Every opcode and function code of `Opcode`/`Funct` is
+covered by at least one test, including the faults it may raise.
+*/
+
+// Pseudo register numbers of hi and lo in expectations
+#define SOLOMIPS_TEST_HI 32u
+#define SOLOMIPS_TEST_LO 33u
+
+namespace SoloMIPS {
+
+struct InstructionTest
+{
+    InstructionTest &expect(unsigned int reg, uint32_t value);
+    InstructionTest &expectStatus(int status);
+    InstructionTest &expectOutput(const std::string &output);
+    InstructionTest &withInput(const std::string &input);
+
+    std::string name;
+    std::string instruction;            // mnemonic of the instruction tested
+    std::vector<uint8_t> program;
+    std::string input;
+    int status;                         // 0 unless set
+    std::string output;
+    std::vector<std::pair<unsigned int, uint32_t>> registers;
+};
+
+struct TestResult
+{
+    bool passed;
+    std::string message;                // reason of failure
+};
+
+std::vector<InstructionTest> instructionTests();
+
+/**
+ * Run the test on the given engine.
+ */
+TestResult runTest(const InstructionTest &test, ExecutionEngine engine);
+
+}
+
+#endif /* HEADER_SOLOMIPS_TESTS_HXX */